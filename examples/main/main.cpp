@@ -1,27 +1,71 @@
+#include "cJSON.h"
+#include "earbrain/gateway/async.hpp"
 #include "earbrain/gateway/gateway.hpp"
 #include "earbrain/gateway/middlewares/logging.hpp"
+#include "earbrain/gateway/watch.hpp"
 #include "esp_err.h"
 #include "earbrain/logging.hpp"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
-// Simple custom middleware that adds a custom header
-static esp_err_t add_custom_header(httpd_req_t *req, earbrain::NextHandler next) {
-  httpd_resp_set_hdr(req, "X-Custom", "HelloWorld");
+// Simple custom middleware that adds a custom header. Written as a type so
+// it is composed with the handler at compile time (see pipeline.hpp).
+struct AddCustomHeader {
+  template <typename Next>
+  static esp_err_t handle(httpd_req_t *req, Next &&next) {
+    httpd_resp_set_hdr(req, "X-Custom", "HelloWorld");
 
-  // Call the next handler
-  esp_err_t result = next(req);
+    // Call the next handler
+    esp_err_t result = next(req);
 
-  // Can add post-processing here if needed
-  return result;
-}
+    // Can add post-processing here if needed
+    return result;
+  }
+};
+
+// The greeting never changes, so its version never moves; clients polling
+// with If-None-Match get a 304 without the handler running (see watch.hpp).
+static uint64_t custom_hello_version() { return 1; }
 
 static esp_err_t custom_hello_handler(httpd_req_t *req) {
   static constexpr char payload[] = R"({"message":"hello"})";
   httpd_resp_set_type(req, "application/json");
+  if (const char *tag = earbrain::watch::current_entity_tag()) {
+    httpd_resp_set_hdr(req, "ETag", tag);
+  }
   return httpd_resp_send(req, payload, HTTPD_RESP_USE_STRLEN);
 }
 
+// Coroutine handler: the scan runs on the gateway's helper task while the
+// httpd task goes on serving other requests.
+static earbrain::async::Task strongest_network_handler(httpd_req_t *req) {
+  const earbrain::WifiScanResult result = co_await earbrain::async::scan();
+
+  const earbrain::WifiNetworkSummary *strongest = nullptr;
+  for (const auto &network : result.networks) {
+    if (!strongest || network.rssi > strongest->rssi) {
+      strongest = &network;
+    }
+  }
+
+  // SSIDs are arbitrary bytes; cJSON escapes quotes and control characters.
+  cJSON *body = cJSON_CreateObject();
+  if (body) {
+    cJSON_AddStringToObject(body, "ssid", strongest ? strongest->ssid.c_str() : "");
+    cJSON_AddNumberToObject(body, "rssi", strongest ? strongest->rssi : 0);
+  }
+  char *payload = body ? cJSON_PrintUnformatted(body) : nullptr;
+  cJSON_Delete(body);
+  if (!payload) {
+    co_return httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Out of memory");
+  }
+
+  httpd_resp_set_type(req, "application/json");
+  const esp_err_t err = httpd_resp_send(req, payload, HTTPD_RESP_USE_STRLEN);
+  cJSON_free(payload);
+  co_return err;
+}
+
 extern "C" void app_main(void) {
   static const char *TAG = "gateway_example";
 
@@ -38,14 +82,20 @@ extern "C" void app_main(void) {
   // Apply logging middleware globally to all routes
   earbrain::gateway().server().use(earbrain::middleware::log_request);
 
-  // Add custom route with route-specific middleware
-  earbrain::RouteOptions hello_opts;
-  hello_opts.middlewares = {add_custom_header};
-  if (earbrain::gateway().add_route("/api/ext/hello", HTTP_GET, &custom_hello_handler, hello_opts) != ESP_OK) {
+  // Add custom route with route-specific middleware, inlined into one handler
+  earbrain::RouteOptions hello_options;
+  hello_options.version = &custom_hello_version;
+  if (earbrain::gateway().add_route<&custom_hello_handler, AddCustomHeader>("/api/ext/hello", HTTP_GET, hello_options) != ESP_OK) {
     earbrain::logging::error("Failed to register /api/ext/hello", TAG);
     return;
   }
 
+  if (earbrain::gateway().add_route("/api/ext/strongest", HTTP_GET,
+                                    &earbrain::async::serve<&strongest_network_handler>) != ESP_OK) {
+    earbrain::logging::error("Failed to register /api/ext/strongest", TAG);
+    return;
+  }
+
   earbrain::logging::infof(TAG, "Gateway version: %s", earbrain::Gateway::version());
 
   // Start portal (AP + HTTP server + mDNS)
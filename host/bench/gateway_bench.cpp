@@ -0,0 +1,525 @@
+// Microbenchmarks for the gateway's JSON, response and routing layers.
+//
+//   gateway_bench [--filter SUBSTR] [--min-time-ms N]
+//
+// Prints one JSON object per line on stdout:
+//   {"name":"json.scan_result/50","iterations":..,"ns_per_op":..,
+//    "allocs_per_op":..,"bytes_per_op":..}
+// Each serialiser also gets a {"size":"scan_result/50","json_bytes":..,
+// "cbor_bytes":..} line comparing its two encodings. These are followed by a
+// {"route_heap":...} line per route with the figures
+// middleware::heap_accounting collected while the routes were dispatched.
+// Allocation counts come from the host heap hooks and include cJSON.
+
+#include "earbrain/gateway/captive_dns.hpp"
+#include "earbrain/gateway/gateway.hpp"
+#include "earbrain/gateway/http_server.hpp"
+#include "earbrain/gateway/middlewares/heap_accounting.hpp"
+#include "earbrain/gateway/response_cache.hpp"
+#include "earbrain/gateway/tracing.hpp"
+#include "earbrain/host/allocations.hpp"
+#include "earbrain/host/fakes.hpp"
+#include "earbrain/host/server.hpp"
+#include "earbrain/logging.hpp"
+#include "earbrain/wifi_service.hpp"
+
+#include "captive_dns_context.hpp"
+#include "cbor.hpp"
+#include "json/device_detail.hpp"
+#include "json/heap_stats.hpp"
+#include "json/http_response.hpp"
+#include "json/log_entries.hpp"
+#include "json/metrics.hpp"
+#include "json/portal_detail.hpp"
+#include "json/trace_events.hpp"
+#include "json/wifi_scan.hpp"
+#include "json/wifi_status.hpp"
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace {
+
+using namespace earbrain;
+
+struct Options {
+  std::string_view filter;
+  int64_t min_time_ns = 200'000'000;
+};
+
+Options options;
+
+template <typename T>
+inline void keep(const T &value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+// Runs `body` in growing batches until a batch takes at least min_time_ns,
+// then reports the figures of that last batch.
+template <typename Body>
+void run(const std::string &name, Body &&body) {
+  if (!options.filter.empty() &&
+      name.find(options.filter) == std::string::npos) {
+    return;
+  }
+
+  body(); // warm-up: first-use allocations are not part of the steady state
+
+  uint64_t iterations = 1;
+  for (;;) {
+    const host::AllocationCounters before = host::allocation_counters();
+    const auto start = std::chrono::steady_clock::now();
+    for (uint64_t i = 0; i < iterations; ++i) {
+      body();
+    }
+    const auto elapsed = std::chrono::steady_clock::now() - start;
+    const host::AllocationCounters after = host::allocation_counters();
+
+    const int64_t ns =
+        std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+    if (ns >= options.min_time_ns || iterations >= (1ull << 32)) {
+      const double n = static_cast<double>(iterations);
+      std::printf("{\"name\":\"%s\",\"iterations\":%llu,\"ns_per_op\":%.1f,"
+                  "\"allocs_per_op\":%.2f,\"bytes_per_op\":%.1f}\n",
+                  name.c_str(), static_cast<unsigned long long>(iterations),
+                  static_cast<double>(ns) / n,
+                  static_cast<double>(after.allocations - before.allocations) /
+                      n,
+                  static_cast<double>(after.bytes - before.bytes) / n);
+      std::fflush(stdout);
+      return;
+    }
+    iterations *= ns > 0 && ns < options.min_time_ns / 100 ? 10 : 2;
+  }
+}
+
+// --- fixtures ---------------------------------------------------------------
+
+WifiScanResult make_scan_result(std::size_t count) {
+  static constexpr wifi_auth_mode_t modes[] = {
+      WIFI_AUTH_WPA2_PSK, WIFI_AUTH_WPA_WPA2_PSK, WIFI_AUTH_WPA3_PSK,
+      WIFI_AUTH_OPEN, WIFI_AUTH_WPA2_WPA3_PSK};
+
+  WifiScanResult result;
+  result.error = ESP_OK;
+  for (std::size_t i = 0; i < count; ++i) {
+    WifiNetworkSummary network;
+    char buffer[32];
+    std::snprintf(buffer, sizeof(buffer), "network-%02zu-ssid", i);
+    network.ssid = buffer;
+    std::snprintf(buffer, sizeof(buffer), "a4:cf:12:%02zx:%02zx:%02zx", i,
+                  i * 7 % 256, i * 13 % 256);
+    network.bssid = buffer;
+    network.rssi = -40 - static_cast<int>(i % 50);
+    network.signal = 100 - static_cast<int>(i % 50) * 2;
+    network.channel = 1 + static_cast<int>(i % 13);
+    network.auth_mode = modes[i % (sizeof(modes) / sizeof(modes[0]))];
+    network.connected = i == 0;
+    network.hidden = i % 11 == 10;
+    result.networks.push_back(std::move(network));
+  }
+  return result;
+}
+
+logging::LogBatch make_log_batch(std::size_t count) {
+  static constexpr esp_log_level_t levels[] = {ESP_LOG_INFO, ESP_LOG_WARN,
+                                               ESP_LOG_DEBUG, ESP_LOG_ERROR};
+  logging::LogBatch batch;
+  for (std::size_t i = 0; i < count; ++i) {
+    logging::LogEntry entry;
+    entry.id = 1000 + i;
+    entry.timestamp_ms = 123'456 + i * 37;
+    entry.level = levels[i % 4];
+    entry.tag = i % 2 ? "wifi" : "gateway";
+    entry.message = "Request handled: GET /api/v1/wifi/status -> 200 (" +
+                    std::to_string(i) + ")";
+    batch.entries.push_back(std::move(entry));
+  }
+  batch.next_cursor = 1000 + count;
+  batch.has_more = false;
+  return batch;
+}
+
+std::vector<middleware::RouteHeapStats> make_heap_stats(std::size_t count) {
+  std::vector<middleware::RouteHeapStats> routes(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    routes[i].uri = "/api/v1/route/" + std::to_string(i);
+    routes[i].method = HTTP_GET;
+    routes[i].requests = 100 + i;
+    routes[i].allocations = 40 * i;
+    routes[i].allocated_bytes = 2048 * i;
+    routes[i].peak_bytes = 1024 * i;
+    routes[i].last_peak_bytes = 512 * i;
+  }
+  return routes;
+}
+
+std::vector<tracing::SpanRecord> make_spans(std::size_t count) {
+  static constexpr const char *names[] = {"request", "handler", "json.print",
+                                          "socket.send"};
+  std::vector<tracing::SpanRecord> spans(count);
+  for (std::size_t i = 0; i < count; ++i) {
+    spans[i].trace_id = static_cast<uint32_t>(i / 4 + 1);
+    spans[i].name = names[i % 4];
+    spans[i].start_us = static_cast<int64_t>(i) * 150;
+    spans[i].duration_us = 40 + static_cast<uint32_t>(i % 7) * 10;
+    if (i % 4 == 0) {
+      std::strcpy(spans[i].detail, "/api/v1/wifi/scan");
+    }
+  }
+  return spans;
+}
+
+void report_size(const std::string &name, const cJSON *node) {
+  if (!options.filter.empty() &&
+      ("json." + name).find(options.filter) == std::string::npos) {
+    return;
+  }
+  char *text = cJSON_PrintUnformatted(node);
+  cbor::Buffer buffer;
+  if (text && cbor::encode(node, buffer) == ESP_OK) {
+    std::printf("{\"size\":\"%s\",\"json_bytes\":%zu,\"cbor_bytes\":%zu}\n",
+                name.c_str(), std::strlen(text), buffer.size);
+  }
+  cJSON_free(text);
+}
+
+template <typename Model>
+void bench_to_json(const std::string &name, const Model &model) {
+  run("json." + name, [&] {
+    json::Ptr node = json_model::to_json(model);
+    keep(node);
+  });
+  run("json." + name + "+print", [&] {
+    json::Ptr node = json_model::to_json(model);
+    char *text = cJSON_PrintUnformatted(node.get());
+    keep(text);
+    cJSON_free(text);
+  });
+  run("json." + name + "+cbor", [&] {
+    json::Ptr node = json_model::to_json(model);
+    cbor::Buffer buffer;
+    cbor::encode(node.get(), buffer);
+    keep(buffer);
+  });
+  report_size(name, json_model::to_json(model).get());
+}
+
+// --- serialisers ------------------------------------------------------------
+
+void bench_serialisers() {
+  bench_to_json("scan_result/50", make_scan_result(50));
+  bench_to_json("log_batch/" + std::to_string(logging::LogStore::max_entries),
+                make_log_batch(logging::LogStore::max_entries));
+
+  Metrics metrics;
+  metrics.heap_total = 327'680;
+  metrics.heap_free = 182'344;
+  metrics.heap_used = metrics.heap_total - metrics.heap_free;
+  metrics.heap_min_free = 160'112;
+  metrics.heap_largest_free_block = 110'592;
+  metrics.timestamp_ms = 987'654;
+  bench_to_json("metrics", metrics);
+
+  json_model::WifiStatus status;
+  status.ap_active = true;
+  status.sta_active = true;
+  status.sta_connected = true;
+  status.ip = "192.168.1.50";
+  bench_to_json("wifi_status", status);
+
+  DeviceDetail device{"ESP32-S3", "1.2.3", "Oct 18 2026 07:00:00",
+                      "v5.3.1"};
+  bench_to_json("device_detail", device);
+
+  json_model::PortalDetail portal{"ESP Gateway"};
+  bench_to_json("portal_detail", portal);
+
+  const auto heap_routes = make_heap_stats(16);
+  run("json.heap_stats/16", [&] {
+    json::Ptr node = json_model::to_json(heap_routes, true);
+    keep(node);
+  });
+
+  const auto spans = make_spans(tracing::ring_capacity);
+  run("json.trace_events/" + std::to_string(tracing::ring_capacity), [&] {
+    json::Ptr node = json_model::to_json(spans.data(), spans.size());
+    keep(node);
+  });
+}
+
+// --- response envelope ------------------------------------------------------
+
+esp_err_t envelope_handler(httpd_req_t *req) {
+  auto data = json::object();
+  if (!data || json::add(data.get(), "title", "ESP Gateway") != ESP_OK) {
+    return ESP_ERR_NO_MEM;
+  }
+  return http::send_success(req, std::move(data));
+}
+
+esp_err_t raw_handler(httpd_req_t *req) {
+  return httpd_resp_send(req, "{\"title\":\"ESP Gateway\"}",
+                         HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t pass_through(httpd_req_t *req, NextHandler next) {
+  return next(req);
+}
+
+struct PassThrough {
+  template <typename Next>
+  static esp_err_t handle(httpd_req_t *req, Next &&next) {
+    return next(req);
+  }
+};
+
+void dispatch_get(httpd_handle_t handle, const char *uri) {
+  host::Request request;
+  request.uri = uri;
+  host::Response response;
+  host::dispatch(handle, request, response);
+  keep(response);
+}
+
+void bench_envelope(httpd_handle_t handle) {
+  run("envelope.make", [] {
+    auto data = json::object();
+    json::add(data.get(), "title", "ESP Gateway");
+    json::Ptr root = http::make_envelope("success", std::move(data), nullptr);
+    keep(root);
+  });
+  run("envelope.make+print", [] {
+    auto data = json::object();
+    json::add(data.get(), "title", "ESP Gateway");
+    json::Ptr root = http::make_envelope("success", std::move(data), nullptr);
+    char *text = cJSON_PrintUnformatted(root.get());
+    keep(text);
+    cJSON_free(text);
+  });
+
+  // Full send path through the host httpd, against a handler that writes the
+  // same payload without the envelope.
+  run("envelope.send_response", [&] { dispatch_get(handle, "/bench/envelope"); });
+  run("envelope.raw_send", [&] { dispatch_get(handle, "/bench/raw"); });
+}
+
+// --- middleware chain -------------------------------------------------------
+
+// Chain depths to measure. Kept sparse: every depth is a route in the table
+// every request is looked up in.
+constexpr int chain_depths[] = {0, 1, 2, 4, 8};
+
+void bench_middleware(httpd_handle_t handle) {
+  // HttpServer::dispatch walks the middlewares through a NextHandler per
+  // step, so the per-request cost of N middlewares is the delta against /0.
+  // Route /0 has no middlewares and calls the handler directly.
+  for (const int n : chain_depths) {
+    const std::string uri = "/bench/chain/" + std::to_string(n);
+    run("middleware.chain/" + std::to_string(n),
+        [&] { dispatch_get(handle, uri.c_str()); });
+  }
+  // The same 8 middlewares composed at compile time, at the deepest depth
+  // only.
+  run("middleware.static/8", [&] { dispatch_get(handle, "/bench/static/8"); });
+  // The runtime pass_through adapted with as_stage, 8 deep.
+  run("middleware.stage/8", [&] { dispatch_get(handle, "/bench/stage/8"); });
+}
+
+// --- response cache ---------------------------------------------------------
+
+void bench_response_cache(httpd_handle_t handle) {
+  // /api/v1/device is a cached builtin; dropping the cache before every
+  // request measures the handler path it saves.
+  run("response_cache.device/hit", [&] { dispatch_get(handle, "/api/v1/device"); });
+  run("response_cache.device/miss", [&] {
+    response_cache::invalidate();
+    dispatch_get(handle, "/api/v1/device");
+  });
+}
+
+// --- captive DNS -------------------------------------------------------------
+
+// A query as phones send it: one question, no EDNS.
+std::vector<uint8_t> dns_query(std::string_view name, uint16_t qtype) {
+  std::vector<uint8_t> query = {0x12, 0x34, 0x01, 0x00, 0, 1, 0, 0, 0, 0, 0, 0};
+  while (!name.empty()) {
+    const std::size_t dot = name.find('.');
+    const std::string_view label = name.substr(0, dot);
+    query.push_back(static_cast<uint8_t>(label.size()));
+    query.insert(query.end(), label.begin(), label.end());
+    name = dot == std::string_view::npos ? std::string_view{}
+                                         : name.substr(dot + 1);
+  }
+  query.insert(query.end(), {0, static_cast<uint8_t>(qtype >> 8),
+                             static_cast<uint8_t>(qtype), 0, 1});
+  return query;
+}
+
+void bench_captive_dns() {
+  CaptiveDnsConfig config;
+  config.passthrough = {"example.com", "ntp.org"};
+  const captive_dns::detail::Rules rules(config,
+                                         ESP_IP4TOADDR(192, 168, 4, 1));
+  const std::vector<uint8_t> a =
+      dns_query("connectivitycheck.gstatic.com", 1);
+  const std::vector<uint8_t> aaaa =
+      dns_query("connectivitycheck.gstatic.com", 28);
+  const std::vector<uint8_t> passthrough = dns_query("api.example.com", 1);
+  uint8_t out[captive_dns::detail::max_packet_size];
+  std::size_t out_len = 0;
+
+  run("captive_dns.answer", [&] {
+    keep(rules.handle(a.data(), a.size(), out, out_len));
+  });
+  run("captive_dns.no_data", [&] {
+    keep(rules.handle(aaaa.data(), aaaa.size(), out, out_len));
+  });
+  run("captive_dns.refuse", [&] {
+    keep(rules.handle(passthrough.data(), passthrough.size(), out, out_len));
+  });
+}
+
+void bench_captive_probe(httpd_handle_t handle) {
+  // Answered from the 404 handler, before any route or middleware.
+  run("captive_probe.generate_204", [&] { dispatch_get(handle, "/generate_204"); });
+  run("captive_probe.not_found", [&] { dispatch_get(handle, "/missing"); });
+}
+
+esp_err_t register_bench_routes(HttpServer &server) {
+  esp_err_t err = server.add_route("/bench/envelope", HTTP_GET, &envelope_handler);
+  if (err == ESP_OK) {
+    err = server.add_route("/bench/raw", HTTP_GET, &raw_handler);
+  }
+  for (const int n : chain_depths) {
+    if (err != ESP_OK) {
+      break;
+    }
+    RouteOptions route_options;
+    route_options.middlewares.assign(n, &pass_through);
+    err = server.add_route("/bench/chain/" + std::to_string(n), HTTP_GET,
+                           &raw_handler, route_options);
+  }
+  if (err == ESP_OK) {
+    using Stage = as_stage<&pass_through>;
+    err = server.add_route<&raw_handler, Stage, Stage, Stage, Stage, Stage,
+                           Stage, Stage, Stage>("/bench/stage/8", HTTP_GET);
+  }
+  if (err == ESP_OK) {
+    err = server.add_route<&raw_handler, PassThrough, PassThrough, PassThrough,
+                           PassThrough, PassThrough, PassThrough, PassThrough,
+                           PassThrough>("/bench/static/8", HTTP_GET);
+  }
+  return err;
+}
+
+// --- routing ----------------------------------------------------------------
+
+void bench_routing(const HttpServer &server) {
+  // Builtin routes plus the bench routes above; has_route is a linear scan,
+  // so the first, last and missing entries bound its cost.
+  run("routing.has_route/first", [&] {
+    bool found = server.has_route("/", HTTP_GET);
+    keep(found);
+  });
+  run("routing.has_route/last", [&] {
+    bool found = server.has_route("/bench/static/8", HTTP_GET);
+    keep(found);
+  });
+  run("routing.has_route/miss", [&] {
+    bool found = server.has_route("/api/v1/missing", HTTP_GET);
+    keep(found);
+  });
+  run("routing.has_route/method_miss", [&] {
+    bool found = server.has_route("/api/v1/wifi/scan", HTTP_POST);
+    keep(found);
+  });
+}
+
+// --- per-route heap report --------------------------------------------------
+
+void report_route_heap(httpd_handle_t handle) {
+  if (!options.filter.empty() &&
+      std::string_view("route_heap").find(options.filter) ==
+          std::string_view::npos) {
+    return;
+  }
+
+  static constexpr const char *uris[] = {
+      "/health",         "/api/v1/portal",      "/api/v1/device",
+      "/api/v1/metrics", "/api/v1/wifi/status", "/api/v1/wifi/scan",
+      "/api/v1/mdns",    "/api/v1/logs",        "/api/v1/trace",
+      "/app.js"};
+
+  middleware::reset_heap_stats();
+  for (int round = 0; round < 20; ++round) {
+    for (const char *uri : uris) {
+      dispatch_get(handle, uri);
+    }
+  }
+
+  for (const auto &stats : middleware::heap_stats()) {
+    if (stats.uri.rfind("/bench/", 0) == 0) {
+      continue;
+    }
+    json::Ptr node = json_model::to_json(stats);
+    char *text = cJSON_PrintUnformatted(node.get());
+    if (text) {
+      std::printf("{\"route_heap\":%s}\n", text);
+      cJSON_free(text);
+    }
+  }
+}
+
+void usage(const char *argv0) {
+  std::fprintf(stderr, "usage: %s [--filter SUBSTR] [--min-time-ms N]\n",
+               argv0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    if (arg == "--filter" && i + 1 < argc) {
+      options.filter = argv[++i];
+    } else if (arg == "--min-time-ms" && i + 1 < argc) {
+      options.min_time_ns = std::atoll(argv[++i]) * 1'000'000;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  setenv("EARBRAIN_HOST_HTTP_PORT", "0", 1);
+  host::set_scan_profile(host::ScanProfile{20, 0, ESP_OK});
+
+  GatewayOptions gateway_options;
+  gateway().initialize(gateway_options);
+  HttpServer &server = gateway().server();
+  if (register_bench_routes(server) != ESP_OK || server.start() != ESP_OK) {
+    std::fprintf(stderr, "failed to start the HTTP server\n");
+    return 1;
+  }
+  httpd_handle_t handle = host::last_started_server();
+
+  bench_serialisers();
+  bench_envelope(handle);
+  bench_middleware(handle);
+  bench_response_cache(handle);
+  bench_captive_dns();
+  bench_captive_probe(handle);
+  bench_routing(server);
+
+  // Last, since it installs a global middleware on every route.
+  server.use(middleware::heap_accounting);
+  report_route_heap(handle);
+
+  server.stop();
+  return 0;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+// Allocation counters and observers fed by the host heap hooks
+// (src/heap_hooks.cpp). Counters are per thread so benchmarks are not
+// disturbed by the server thread or background services.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace earbrain::host {
+
+struct AllocationCounters {
+  uint64_t allocations = 0;
+  uint64_t bytes = 0;
+};
+
+// Totals for the calling thread since it started. Always zero when the
+// build has no heap hooks.
+AllocationCounters allocation_counters() noexcept;
+
+// Receives every tracked allocation and every free, from any thread.
+// Allocations the observer itself makes are not reported back to it.
+class AllocationObserver {
+public:
+  virtual ~AllocationObserver() = default;
+  virtual void on_alloc(void *ptr, std::size_t size) = 0;
+  virtual void on_free(void *ptr) = 0;
+};
+
+// Installs the observer (nullptr removes it). Not synchronised with
+// in-flight hooks; install before starting the gateway.
+void set_allocation_observer(AllocationObserver *observer) noexcept;
+
+// Enables or disables reporting of allocations to the observer on the
+// calling thread for the lifetime of the scope; frees are always reported.
+// The host httpd disables tracking for its own bookkeeping, which has no
+// heap counterpart on the device, and re-enables it around handlers.
+class TrackingScope {
+public:
+  explicit TrackingScope(bool enabled) noexcept;
+  ~TrackingScope();
+
+  TrackingScope(const TrackingScope &) = delete;
+  TrackingScope &operator=(const TrackingScope &) = delete;
+
+private:
+  bool previous;
+};
+
+} // namespace earbrain::host
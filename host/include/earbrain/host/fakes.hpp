@@ -0,0 +1,48 @@
+#pragma once
+
+// Knobs for the host stand-ins of earbrain_core services. Lets host tools
+// shape scan results, connection outcomes, heap figures and time without
+// touching gateway code.
+
+#include "esp_err.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace earbrain::host {
+
+struct ScanProfile {
+  std::size_t networks = 12;
+  uint32_t latency_ms = 0;
+  esp_err_t error = ESP_OK;
+};
+
+struct ConnectProfile {
+  esp_err_t outcome = ESP_OK;
+  uint32_t latency_ms = 1500;
+};
+
+struct HeapFigures {
+  std::size_t total = 0;
+  std::size_t free = 0;
+  std::size_t min_free = 0;
+  std::size_t largest_free_block = 0;
+};
+
+using HeapProbe = HeapFigures (*)();
+// Microseconds since boot, as returned by esp_timer_get_time().
+using ClockSource = int64_t (*)();
+
+void set_scan_profile(const ScanProfile &profile);
+void set_connect_profile(const ConnectProfile &profile);
+
+// Replaces the source of heap_caps_* and collect_metrics() figures.
+void set_heap_probe(HeapProbe probe);
+HeapFigures heap_figures();
+
+// Replaces the monotonic clock behind esp_timer_get_time() (and everything
+// derived from it: log timestamps, uptime, tick counts), e.g. with a virtual
+// clock for simulated long runs. nullptr restores the real clock.
+void set_clock_source(ClockSource source);
+
+} // namespace earbrain::host
@@ -0,0 +1,46 @@
+#pragma once
+
+// Host-only extensions of the esp_http_server stand-in: in-process dispatch
+// (no sockets) and introspection of running server instances.
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <utility>
+#include <vector>
+
+namespace earbrain::host {
+
+using HeaderList = std::vector<std::pair<std::string, std::string>>;
+
+struct Request {
+  httpd_method_t method = HTTP_GET;
+  std::string uri;
+  HeaderList headers;
+  std::string body;
+};
+
+struct Response {
+  esp_err_t result = ESP_OK;
+  int status = 0;
+  HeaderList headers;
+  std::string body;
+
+  const std::string *header(std::string_view name) const;
+};
+
+// Runs a request through the same routing and handler path as a socket
+// request, on the calling thread. Blocks until async handlers complete.
+esp_err_t dispatch(httpd_handle_t handle, const Request &request,
+                   Response &response);
+
+// Most recently started server, or nullptr.
+httpd_handle_t last_started_server();
+
+// Actual listening port (useful with server_port = 0).
+uint16_t bound_port(httpd_handle_t handle);
+
+} // namespace earbrain::host
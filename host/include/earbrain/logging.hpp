@@ -0,0 +1,62 @@
+#pragma once
+
+// Host stand-in for earbrain_core's logging module. Keeps the same public
+// surface; entries go to an in-memory ring and stderr.
+
+#include "esp_log.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace earbrain::logging {
+
+struct LogEntry {
+  uint64_t id = 0;
+  uint64_t timestamp_ms = 0;
+  esp_log_level_t level = ESP_LOG_INFO;
+  std::string tag;
+  std::string message;
+};
+
+struct LogBatch {
+  std::vector<LogEntry> entries;
+  uint64_t next_cursor = 0;
+  bool has_more = false;
+};
+
+class LogStore {
+public:
+  static constexpr std::size_t max_entries = 100;
+};
+
+void log(esp_log_level_t level, std::string_view message,
+         std::string_view tag);
+
+inline void error(std::string_view message, std::string_view tag = "app") {
+  log(ESP_LOG_ERROR, message, tag);
+}
+inline void warn(std::string_view message, std::string_view tag = "app") {
+  log(ESP_LOG_WARN, message, tag);
+}
+inline void info(std::string_view message, std::string_view tag = "app") {
+  log(ESP_LOG_INFO, message, tag);
+}
+inline void debug(std::string_view message, std::string_view tag = "app") {
+  log(ESP_LOG_DEBUG, message, tag);
+}
+
+void errorf(const char *tag, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+void warnf(const char *tag, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+void infof(const char *tag, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+void debugf(const char *tag, const char *format, ...)
+    __attribute__((format(printf, 2, 3)));
+
+LogBatch collect(uint64_t cursor, std::size_t limit);
+
+} // namespace earbrain::logging
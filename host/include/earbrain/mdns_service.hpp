@@ -0,0 +1,37 @@
+#pragma once
+
+// Host stand-in for earbrain_core's mDNS service; records configuration only.
+
+#include "esp_err.h"
+
+#include <cstdint>
+#include <string>
+
+namespace earbrain {
+
+struct MdnsConfig {
+  std::string hostname;
+  std::string instance_name;
+  std::string service_type;
+  std::string protocol;
+  uint16_t port = 80;
+};
+
+class MdnsService {
+public:
+  esp_err_t initialize();
+  esp_err_t start(const MdnsConfig &config);
+  esp_err_t stop();
+
+  const MdnsConfig &config() const noexcept { return current; }
+  bool is_running() const noexcept { return running; }
+
+private:
+  MdnsConfig current{};
+  bool initialized = false;
+  bool running = false;
+};
+
+MdnsService &mdns();
+
+} // namespace earbrain
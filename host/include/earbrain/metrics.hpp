@@ -0,0 +1,21 @@
+#pragma once
+
+// Host stand-in for earbrain_core's metrics module.
+
+#include <cstddef>
+#include <cstdint>
+
+namespace earbrain {
+
+struct Metrics {
+  std::size_t heap_total = 0;
+  std::size_t heap_free = 0;
+  std::size_t heap_used = 0;
+  std::size_t heap_min_free = 0;
+  std::size_t heap_largest_free_block = 0;
+  uint64_t timestamp_ms = 0;
+};
+
+Metrics collect_metrics();
+
+} // namespace earbrain
@@ -0,0 +1,12 @@
+#pragma once
+
+// Host stand-in for earbrain_core's validation helpers.
+
+#include <string_view>
+
+namespace earbrain::validation {
+
+bool is_valid_ssid(std::string_view ssid);
+bool is_valid_passphrase(std::string_view passphrase);
+
+} // namespace earbrain::validation
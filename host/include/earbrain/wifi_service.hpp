@@ -0,0 +1,85 @@
+#pragma once
+
+// Host stand-in for earbrain_core's Wi-Fi service. State lives in memory and
+// can be driven through earbrain/host/fakes.hpp.
+
+#include "esp_err.h"
+#include "esp_netif.h"
+#include "esp_wifi.h"
+
+#include <cstdint>
+#include <mutex>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <vector>
+
+namespace earbrain {
+
+enum class WifiMode { Off, STA, AP, APSTA };
+
+struct AccessPointConfig {
+  std::string ssid;
+  std::string passphrase;
+  uint8_t channel = 1;
+  uint8_t max_connections = 4;
+};
+
+struct WifiConfig {
+  AccessPointConfig ap_config{"gateway-ap"};
+};
+
+struct WifiCredentials {
+  std::string ssid;
+  std::string passphrase;
+};
+
+struct WifiStatus {
+  WifiMode mode = WifiMode::Off;
+  bool sta_connected = false;
+  bool sta_connecting = false;
+  esp_ip4_addr_t sta_ip{};
+  esp_err_t sta_last_error = ESP_OK;
+  wifi_err_reason_t sta_last_disconnect_reason = WIFI_REASON_UNSPECIFIED;
+};
+
+struct WifiNetworkSummary {
+  std::string ssid;
+  std::string bssid;
+  int rssi = 0;
+  int signal = 0;
+  int channel = 0;
+  wifi_auth_mode_t auth_mode = WIFI_AUTH_OPEN;
+  bool connected = false;
+  bool hidden = false;
+};
+
+struct WifiScanResult {
+  std::vector<WifiNetworkSummary> networks;
+  esp_err_t error = ESP_OK;
+};
+
+class WifiService {
+public:
+  esp_err_t initialize();
+  esp_err_t config(const WifiConfig &config);
+  esp_err_t mode(WifiMode mode);
+  WifiMode mode() const;
+  WifiStatus status() const;
+
+  esp_err_t save_credentials(std::string_view ssid,
+                             std::string_view passphrase);
+  std::optional<WifiCredentials> load_credentials() const;
+  esp_err_t connect();
+  WifiScanResult perform_scan();
+
+private:
+  mutable std::mutex mutex;
+  WifiConfig current_config{};
+  WifiStatus current_status{};
+  std::optional<WifiCredentials> saved;
+};
+
+WifiService &wifi();
+
+} // namespace earbrain
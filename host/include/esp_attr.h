@@ -0,0 +1,6 @@
+#pragma once
+
+// Placement attributes are meaningless on the host.
+#define IRAM_ATTR
+#define DRAM_ATTR
+#define RTC_DATA_ATTR
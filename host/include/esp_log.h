@@ -0,0 +1,35 @@
+#pragma once
+
+#include "sdkconfig.h"
+
+#include <stdio.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef enum {
+  ESP_LOG_NONE,
+  ESP_LOG_ERROR,
+  ESP_LOG_WARN,
+  ESP_LOG_INFO,
+  ESP_LOG_DEBUG,
+  ESP_LOG_VERBOSE
+} esp_log_level_t;
+
+#define ESP_LOG_HOST(letter, level, tag, format, ...)                    \
+  do {                                                                   \
+    if (CONFIG_LOG_DEFAULT_LEVEL >= (level)) {                           \
+      fprintf(stderr, letter " (%s) " format "\n", tag, ##__VA_ARGS__); \
+    }                                                                    \
+  } while (0)
+
+#define ESP_LOGE(tag, format, ...) ESP_LOG_HOST("E", ESP_LOG_ERROR, tag, format, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) ESP_LOG_HOST("W", ESP_LOG_WARN, tag, format, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) ESP_LOG_HOST("I", ESP_LOG_INFO, tag, format, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ESP_LOG_HOST("D", ESP_LOG_DEBUG, tag, format, ##__VA_ARGS__)
+#define ESP_LOGV(tag, format, ...) ESP_LOG_HOST("V", ESP_LOG_VERBOSE, tag, format, ##__VA_ARGS__)
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,43 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_event.h"
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct esp_ip4_addr {
+  uint32_t addr;
+} esp_ip4_addr_t;
+
+typedef struct {
+  esp_ip4_addr_t ip;
+  esp_ip4_addr_t netmask;
+  esp_ip4_addr_t gw;
+} esp_netif_ip_info_t;
+
+// Only the soft-AP interface ("WIFI_AP_DEF") exists, at IDF's default
+// 192.168.4.1.
+typedef struct esp_netif_obj esp_netif_t;
+
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key);
+esp_err_t esp_netif_get_ip_info(esp_netif_t *esp_netif,
+                                esp_netif_ip_info_t *ip_info);
+
+ESP_EVENT_DECLARE_BASE(IP_EVENT);
+
+typedef enum {
+  IP_EVENT_STA_GOT_IP,
+  IP_EVENT_STA_LOST_IP,
+} ip_event_t;
+
+#define ESP_IP4TOADDR(a, b, c, d)                                        \
+  ((uint32_t)(d) << 24 | (uint32_t)(c) << 16 | (uint32_t)(b) << 8 |     \
+   (uint32_t)(a))
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "esp_err.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+typedef struct {
+  size_t stack_size;
+  size_t prio;
+  bool inherit_cfg;
+  const char *thread_name;
+  int pin_to_core;
+} esp_pthread_cfg_t;
+
+// Kept per calling thread like on the device, but host threads always get
+// the OS default stack.
+esp_pthread_cfg_t esp_pthread_get_default_config(void);
+esp_err_t esp_pthread_set_cfg(const esp_pthread_cfg_t *cfg);
+esp_err_t esp_pthread_get_cfg(esp_pthread_cfg_t *cfg);
+
+#ifdef __cplusplus
+}
+#endif
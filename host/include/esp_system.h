@@ -0,0 +1,14 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_idf_version.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+const char *esp_get_idf_version(void);
+
+#ifdef __cplusplus
+}
+#endif
@@ -0,0 +1,9 @@
+#pragma once
+
+// Host stand-in for lwIP's BSD socket API: the POSIX one.
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <unistd.h>
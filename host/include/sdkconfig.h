@@ -0,0 +1,14 @@
+#pragma once
+
+// Host build configuration. Mirrors the handful of sdkconfig symbols the
+// gateway sources consult.
+
+#define CONFIG_IDF_TARGET_LINUX 1
+#define CONFIG_LOG_DEFAULT_LEVEL 3
+
+// The host allocator feeds esp_heap_trace_*_hook (see src/heap_hooks.cpp).
+#define CONFIG_HEAP_USE_HOOKS 1
+
+// Diagnostics routes (see Kconfig); the host tools read them.
+#define CONFIG_EARBRAIN_GATEWAY_TRACE_ROUTE 1
+#define CONFIG_EARBRAIN_GATEWAY_CAPTURE_ROUTE 1
@@ -0,0 +1,80 @@
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_wifi_types.h"
+
+#include <cstring>
+#include <mutex>
+#include <vector>
+
+ESP_EVENT_DEFINE_BASE(WIFI_EVENT);
+ESP_EVENT_DEFINE_BASE(IP_EVENT);
+
+namespace {
+
+struct Registration {
+  esp_event_base_t base;
+  int32_t id;
+  esp_event_handler_t handler;
+  void *arg;
+};
+
+std::mutex registrations_mutex;
+std::vector<Registration> registrations;
+
+} // namespace
+
+esp_err_t esp_event_loop_create_default(void) { return ESP_OK; }
+
+esp_err_t esp_event_handler_register(esp_event_base_t event_base,
+                                     int32_t event_id,
+                                     esp_event_handler_t event_handler,
+                                     void *event_handler_arg) {
+  if (!event_base || !event_handler) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  std::lock_guard lock(registrations_mutex);
+  registrations.push_back(
+      Registration{event_base, event_id, event_handler, event_handler_arg});
+  return ESP_OK;
+}
+
+esp_err_t esp_event_handler_unregister(esp_event_base_t event_base,
+                                       int32_t event_id,
+                                       esp_event_handler_t event_handler) {
+  std::lock_guard lock(registrations_mutex);
+  for (auto it = registrations.begin(); it != registrations.end(); ++it) {
+    if (it->base == event_base && it->id == event_id &&
+        it->handler == event_handler) {
+      registrations.erase(it);
+      return ESP_OK;
+    }
+  }
+  return ESP_ERR_NOT_FOUND;
+}
+
+esp_err_t esp_event_post(esp_event_base_t event_base, int32_t event_id,
+                         const void *event_data, size_t event_data_size,
+                         TickType_t) {
+  std::vector<Registration> matching;
+  {
+    std::lock_guard lock(registrations_mutex);
+    for (const Registration &registration : registrations) {
+      if (registration.base == event_base &&
+          (registration.id == ESP_EVENT_ANY_ID ||
+           registration.id == event_id)) {
+        matching.push_back(registration);
+      }
+    }
+  }
+
+  // The real loop hands handlers a copy of the data.
+  std::vector<unsigned char> data(event_data_size);
+  if (event_data_size > 0) {
+    std::memcpy(data.data(), event_data, event_data_size);
+  }
+  for (const Registration &registration : matching) {
+    registration.handler(registration.arg, event_base, event_id,
+                         data.empty() ? nullptr : data.data());
+  }
+  return ESP_OK;
+}
@@ -0,0 +1,1134 @@
+#include "esp_http_server.h"
+
+#include "earbrain/host/allocations.hpp"
+#include "earbrain/host/server.hpp"
+
+#include <algorithm>
+#include <arpa/inet.h>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <condition_variable>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <fcntl.h>
+#include <functional>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <string>
+#include <string_view>
+#include <sys/select.h>
+#include <sys/socket.h>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace {
+
+struct Server;
+
+struct Session {
+  int fd = -1;
+  std::string inbuf;
+  std::atomic<bool> busy{false};
+  std::atomic<bool> close_requested{false};
+  std::chrono::steady_clock::time_point last_used{};
+};
+
+struct Header {
+  std::string name;
+  std::string value;
+};
+
+struct RequestAux {
+  Server *server = nullptr;
+  std::shared_ptr<Session> session;
+  std::string *capture = nullptr;
+  std::shared_ptr<std::atomic<bool>> async_done;
+
+  std::string path;
+  std::string query;
+  bool has_query = false;
+  std::vector<Header> headers;
+
+  std::string pending_body;
+  std::size_t body_remaining = 0;
+
+  const char *status = HTTPD_200;
+  const char *content_type = HTTPD_TYPE_TEXT;
+  std::vector<std::pair<const char *, const char *>> resp_headers;
+  bool headers_sent = false;
+  bool completed = false;
+  bool failed = false;
+  bool detached = false;
+};
+
+struct Route {
+  std::string uri;
+  httpd_method_t method;
+  esp_err_t (*handler)(httpd_req_t *);
+  void *user_ctx;
+};
+
+struct Server {
+  httpd_config_t config{};
+  int listen_fd = -1;
+  int wake_pipe[2] = {-1, -1};
+  uint16_t port = 0;
+  std::thread thread;
+  std::atomic<bool> stopping{false};
+
+  std::mutex routes_mutex;
+  std::vector<Route> routes;
+  httpd_err_handler_func_t err_handlers[HTTPD_ERR_CODE_MAX] = {};
+
+  // Serialises handler execution the way the single httpd task does.
+  std::recursive_mutex dispatch_mutex;
+
+  std::mutex sessions_mutex;
+  std::list<std::shared_ptr<Session>> sessions;
+
+  std::mutex work_mutex;
+  std::deque<std::pair<httpd_work_fn_t, void *>> work;
+
+  std::mutex async_mutex;
+  std::condition_variable async_cv;
+  int async_in_flight = 0;
+
+  void wake() {
+    const char byte = 0;
+    if (wake_pipe[1] >= 0) {
+      (void)::write(wake_pipe[1], &byte, 1);
+    }
+  }
+};
+
+std::atomic<Server *> last_server{nullptr};
+
+RequestAux *aux_of(httpd_req_t *r) {
+  return r ? static_cast<RequestAux *>(r->aux) : nullptr;
+}
+
+bool iequals(std::string_view a, std::string_view b) {
+  return a.size() == b.size() &&
+         std::equal(a.begin(), a.end(), b.begin(), [](char x, char y) {
+           return std::tolower(static_cast<unsigned char>(x)) ==
+                  std::tolower(static_cast<unsigned char>(y));
+         });
+}
+
+const Header *find_header(const RequestAux &aux, const char *field) {
+  for (const auto &header : aux.headers) {
+    if (iequals(header.name, field)) {
+      return &header;
+    }
+  }
+  return nullptr;
+}
+
+bool write_all(RequestAux &aux, const char *data, std::size_t len) {
+  if (aux.capture) {
+    aux.capture->append(data, len);
+    return true;
+  }
+  if (!aux.session) {
+    return false;
+  }
+  while (len > 0) {
+    const ssize_t sent = ::send(aux.session->fd, data, len, MSG_NOSIGNAL);
+    if (sent < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      aux.failed = true;
+      return false;
+    }
+    data += sent;
+    len -= static_cast<std::size_t>(sent);
+  }
+  return true;
+}
+
+std::string status_head(const RequestAux &aux) {
+  std::string head = "HTTP/1.1 ";
+  head += aux.status;
+  head += "\r\nContent-Type: ";
+  head += aux.content_type;
+  head += "\r\n";
+  for (const auto &[field, value] : aux.resp_headers) {
+    head += field;
+    head += ": ";
+    head += value;
+    head += "\r\n";
+  }
+  return head;
+}
+
+const char *method_name(int method) {
+  switch (method) {
+  case HTTP_DELETE:
+    return "DELETE";
+  case HTTP_GET:
+    return "GET";
+  case HTTP_HEAD:
+    return "HEAD";
+  case HTTP_POST:
+    return "POST";
+  case HTTP_PUT:
+    return "PUT";
+  case HTTP_OPTIONS:
+    return "OPTIONS";
+  case HTTP_PATCH:
+    return "PATCH";
+  default:
+    return nullptr;
+  }
+}
+
+int method_from(std::string_view name) {
+  for (int m : {HTTP_DELETE, HTTP_GET, HTTP_HEAD, HTTP_POST, HTTP_PUT,
+                HTTP_OPTIONS, HTTP_PATCH}) {
+    if (name == method_name(m)) {
+      return m;
+    }
+  }
+  return -1;
+}
+
+bool default_match(const char *reference, const char *uri, std::size_t len) {
+  return std::strlen(reference) == len && std::strncmp(reference, uri, len) == 0;
+}
+
+httpd_req_t *new_request(Server *server, std::unique_ptr<RequestAux> aux,
+                         int method, std::string_view raw_uri) {
+  // httpd_req_t has a const uri array, so it is created as raw storage.
+  auto *req = static_cast<httpd_req_t *>(std::calloc(1, sizeof(httpd_req_t)));
+  req->handle = server;
+  req->method = method;
+  const std::size_t n = std::min<std::size_t>(raw_uri.size(), HTTPD_MAX_URI_LEN);
+  std::memcpy(const_cast<char *>(req->uri), raw_uri.data(), n);
+  const_cast<char *>(req->uri)[n] = '\0';
+
+  const std::string_view uri{req->uri, n};
+  const std::size_t q = uri.find('?');
+  aux->path = std::string(uri.substr(0, q));
+  if (q != std::string_view::npos) {
+    aux->has_query = true;
+    aux->query = std::string(uri.substr(q + 1));
+  }
+  aux->server = server;
+  req->aux = aux.release();
+  return req;
+}
+
+void delete_request(httpd_req_t *req) {
+  if (!req) {
+    return;
+  }
+  delete aux_of(req);
+  std::free(req);
+}
+
+void drain_body(RequestAux &aux) {
+  aux.pending_body.clear();
+  if (!aux.session || aux.body_remaining == 0) {
+    aux.body_remaining = 0;
+    return;
+  }
+  // Leftover body bytes beyond what is buffered are consumed from inbuf by
+  // the session loop; here we only discard what was already buffered.
+  std::string &in = aux.session->inbuf;
+  const std::size_t take = std::min(in.size(), aux.body_remaining);
+  in.erase(0, take);
+  aux.body_remaining -= take;
+  char scratch[512];
+  while (aux.body_remaining > 0) {
+    const ssize_t got = ::recv(aux.session->fd, scratch,
+                               std::min(sizeof(scratch), aux.body_remaining), 0);
+    if (got <= 0) {
+      aux.session->close_requested = true;
+      break;
+    }
+    aux.body_remaining -= static_cast<std::size_t>(got);
+  }
+}
+
+esp_err_t handle_error(httpd_req_t *req, httpd_err_code_t code) {
+  Server *server = static_cast<Server *>(req->handle);
+  httpd_err_handler_func_t fn = nullptr;
+  {
+    std::lock_guard lock(server->routes_mutex);
+    fn = server->err_handlers[code];
+  }
+  if (fn) {
+    const earbrain::host::TrackingScope tracked(true);
+    return fn(req, code);
+  }
+  return httpd_resp_send_err(req, code, nullptr);
+}
+
+// Finds and runs the handler. Returns false when the session must close.
+bool run_request(Server *server, httpd_req_t *req) {
+  const earbrain::host::TrackingScope untracked(false);
+  RequestAux &aux = *aux_of(req);
+
+  Route route{};
+  bool found = false;
+  bool uri_known = false;
+  {
+    std::lock_guard lock(server->routes_mutex);
+    httpd_uri_match_func_t match =
+        server->config.uri_match_fn ? server->config.uri_match_fn : &default_match;
+    for (const auto &candidate : server->routes) {
+      if (!match(candidate.uri.c_str(), aux.path.c_str(), aux.path.size())) {
+        continue;
+      }
+      uri_known = true;
+      if (candidate.method == req->method) {
+        route = candidate;
+        found = true;
+        break;
+      }
+    }
+  }
+
+  std::lock_guard dispatch(server->dispatch_mutex);
+  esp_err_t result = ESP_OK;
+  if (!found) {
+    result = handle_error(req, uri_known ? HTTPD_405_METHOD_NOT_ALLOWED
+                                         : HTTPD_404_NOT_FOUND);
+  } else {
+    req->user_ctx = route.user_ctx;
+    const earbrain::host::TrackingScope tracked(true);
+    result = route.handler(req);
+  }
+  return result == ESP_OK && !aux.failed;
+}
+
+void finish_session_request(httpd_req_t *req) {
+  RequestAux &aux = *aux_of(req);
+  drain_body(aux);
+  delete_request(req);
+}
+
+// Parses one request head from the session buffer, if complete.
+httpd_req_t *parse_head(Server *server, const std::shared_ptr<Session> &session,
+                        bool &malformed) {
+  malformed = false;
+  std::string &in = session->inbuf;
+  const std::size_t end = in.find("\r\n\r\n");
+  if (end == std::string::npos) {
+    if (in.size() > 8192) {
+      malformed = true;
+    }
+    return nullptr;
+  }
+
+  std::string_view head{in.data(), end};
+  const std::size_t line_end = head.find("\r\n");
+  std::string_view request_line = head.substr(0, line_end);
+  const std::size_t sp1 = request_line.find(' ');
+  const std::size_t sp2 = request_line.rfind(' ');
+  if (sp1 == std::string_view::npos || sp2 == sp1) {
+    malformed = true;
+    return nullptr;
+  }
+
+  const int method = method_from(request_line.substr(0, sp1));
+  const std::string_view raw_uri = request_line.substr(sp1 + 1, sp2 - sp1 - 1);
+
+  auto aux = std::make_unique<RequestAux>();
+  aux->session = session;
+  std::size_t content_len = 0;
+  std::size_t pos = line_end == std::string_view::npos ? head.size() : line_end + 2;
+  while (pos < head.size()) {
+    std::size_t next = head.find("\r\n", pos);
+    if (next == std::string_view::npos) {
+      next = head.size();
+    }
+    std::string_view line = head.substr(pos, next - pos);
+    const std::size_t colon = line.find(':');
+    if (colon != std::string_view::npos) {
+      std::string_view value = line.substr(colon + 1);
+      while (!value.empty() && value.front() == ' ') {
+        value.remove_prefix(1);
+      }
+      aux->headers.push_back({std::string(line.substr(0, colon)), std::string(value)});
+      if (iequals(line.substr(0, colon), "Content-Length")) {
+        content_len = std::strtoul(std::string(value).c_str(), nullptr, 10);
+      }
+    }
+    pos = next + 2;
+  }
+
+  aux->body_remaining = content_len;
+
+  if (method < 0 || raw_uri.size() > HTTPD_MAX_URI_LEN) {
+    malformed = true;
+    return nullptr;
+  }
+
+  // raw_uri points into the session buffer, so consume the head afterwards.
+  httpd_req_t *req = new_request(server, std::move(aux), method, raw_uri);
+  req->content_len = content_len;
+  in.erase(0, end + 4);
+  return req;
+}
+
+void close_session(Server *server, const std::shared_ptr<Session> &session) {
+  ::close(session->fd);
+  std::lock_guard lock(server->sessions_mutex);
+  server->sessions.remove(session);
+}
+
+// Handles every complete request buffered on an idle session.
+void serve_session(Server *server, const std::shared_ptr<Session> &session) {
+  while (!session->busy) {
+    bool malformed = false;
+    httpd_req_t *req = parse_head(server, session, malformed);
+    if (malformed) {
+      session->close_requested = true;
+      break;
+    }
+    if (!req) {
+      break;
+    }
+
+    const bool ok = run_request(server, req);
+    if (aux_of(req)->detached) {
+      // An async copy owns the session and the body until it completes.
+      delete_request(req);
+      break;
+    }
+    if (!ok) {
+      session->close_requested = true;
+    }
+    finish_session_request(req);
+    if (session->close_requested) {
+      break;
+    }
+  }
+
+  if (session->close_requested && !session->busy) {
+    close_session(server, session);
+  }
+}
+
+void accept_client(Server *server) {
+  const int fd = ::accept(server->listen_fd, nullptr, nullptr);
+  if (fd < 0) {
+    return;
+  }
+  const int one = 1;
+  ::setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  timeval tv{};
+  tv.tv_sec = server->config.recv_wait_timeout;
+  ::setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  tv.tv_sec = server->config.send_wait_timeout;
+  ::setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  std::lock_guard lock(server->sessions_mutex);
+  if (server->sessions.size() >= server->config.max_open_sockets) {
+    std::shared_ptr<Session> victim;
+    if (server->config.lru_purge_enable) {
+      for (const auto &candidate : server->sessions) {
+        if (!candidate->busy &&
+            (!victim || candidate->last_used < victim->last_used)) {
+          victim = candidate;
+        }
+      }
+    }
+    if (!victim) {
+      ::close(fd);
+      return;
+    }
+    ::close(victim->fd);
+    server->sessions.remove(victim);
+  }
+
+  auto session = std::make_shared<Session>();
+  session->fd = fd;
+  session->last_used = std::chrono::steady_clock::now();
+  server->sessions.push_back(std::move(session));
+}
+
+void run_work(Server *server) {
+  for (;;) {
+    std::pair<httpd_work_fn_t, void *> item;
+    {
+      std::lock_guard lock(server->work_mutex);
+      if (server->work.empty()) {
+        return;
+      }
+      item = server->work.front();
+      server->work.pop_front();
+    }
+    std::lock_guard dispatch(server->dispatch_mutex);
+    const earbrain::host::TrackingScope tracked(true);
+    item.first(item.second);
+  }
+}
+
+// Picks up sessions handed back by async handlers: closes the ones that
+// failed and serves requests that were pipelined behind the async one.
+void release_sessions(Server *server) {
+  std::vector<std::shared_ptr<Session>> released;
+  {
+    std::lock_guard lock(server->sessions_mutex);
+    for (const auto &session : server->sessions) {
+      if (!session->busy && (session->close_requested || !session->inbuf.empty())) {
+        released.push_back(session);
+      }
+    }
+  }
+  for (const auto &session : released) {
+    if (session->close_requested) {
+      close_session(server, session);
+    } else {
+      serve_session(server, session);
+    }
+  }
+}
+
+void server_loop(Server *server) {
+  // Session buffers and request bookkeeping are host-only; see
+  // earbrain::host::TrackingScope.
+  const earbrain::host::TrackingScope untracked(false);
+  while (!server->stopping.load()) {
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(server->listen_fd, &readable);
+    FD_SET(server->wake_pipe[0], &readable);
+    int max_fd = std::max(server->listen_fd, server->wake_pipe[0]);
+
+    std::vector<std::shared_ptr<Session>> idle;
+    {
+      std::lock_guard lock(server->sessions_mutex);
+      for (const auto &session : server->sessions) {
+        if (!session->busy) {
+          idle.push_back(session);
+        }
+      }
+    }
+    for (const auto &session : idle) {
+      FD_SET(session->fd, &readable);
+      max_fd = std::max(max_fd, session->fd);
+    }
+
+    if (::select(max_fd + 1, &readable, nullptr, nullptr, nullptr) < 0) {
+      continue;
+    }
+
+    if (FD_ISSET(server->wake_pipe[0], &readable)) {
+      char drain[64];
+      (void)::read(server->wake_pipe[0], drain, sizeof(drain));
+      run_work(server);
+      release_sessions(server);
+    }
+
+    if (FD_ISSET(server->listen_fd, &readable)) {
+      accept_client(server);
+    }
+
+    for (const auto &session : idle) {
+      if (!FD_ISSET(session->fd, &readable)) {
+        continue;
+      }
+      char buffer[2048];
+      const ssize_t got = ::recv(session->fd, buffer, sizeof(buffer), 0);
+      if (got <= 0) {
+        close_session(server, session);
+        continue;
+      }
+      session->last_used = std::chrono::steady_clock::now();
+      session->inbuf.append(buffer, static_cast<std::size_t>(got));
+      serve_session(server, session);
+    }
+  }
+}
+
+std::size_t resolve_len(const char *buf, ssize_t len) {
+  if (!buf) {
+    return 0;
+  }
+  return len == HTTPD_RESP_USE_STRLEN ? std::strlen(buf)
+                                      : static_cast<std::size_t>(len);
+}
+
+} // namespace
+
+extern "C" {
+
+esp_err_t httpd_start(httpd_handle_t *handle, const httpd_config_t *config) {
+  if (!handle || !config) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  auto server = std::make_unique<Server>();
+  server->config = *config;
+  // Workstations rarely allow binding port 80; let host tools redirect it.
+  if (const char *port = std::getenv("EARBRAIN_HOST_HTTP_PORT")) {
+    server->config.server_port = static_cast<uint16_t>(std::strtoul(port, nullptr, 10));
+  }
+
+  server->listen_fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (server->listen_fd < 0) {
+    return ESP_ERR_HTTPD_TASK;
+  }
+  const int one = 1;
+  ::setsockopt(server->listen_fd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(server->config.server_port);
+  if (::bind(server->listen_fd, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 ||
+      ::listen(server->listen_fd, std::max<int>(server->config.backlog_conn, 16)) != 0 ||
+      ::pipe(server->wake_pipe) != 0) {
+    ::close(server->listen_fd);
+    return ESP_ERR_HTTPD_TASK;
+  }
+
+  socklen_t addr_len = sizeof(addr);
+  ::getsockname(server->listen_fd, reinterpret_cast<sockaddr *>(&addr), &addr_len);
+  server->port = ntohs(addr.sin_port);
+
+  Server *raw = server.release();
+  raw->thread = std::thread(server_loop, raw);
+  last_server.store(raw);
+  *handle = raw;
+  return ESP_OK;
+}
+
+esp_err_t httpd_stop(httpd_handle_t handle) {
+  auto *server = static_cast<Server *>(handle);
+  if (!server) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  server->stopping.store(true);
+  server->wake();
+  if (server->thread.joinable()) {
+    server->thread.join();
+  }
+  {
+    std::unique_lock lock(server->async_mutex);
+    server->async_cv.wait(lock, [server] { return server->async_in_flight == 0; });
+  }
+  for (const auto &session : server->sessions) {
+    ::close(session->fd);
+  }
+  ::close(server->listen_fd);
+  ::close(server->wake_pipe[0]);
+  ::close(server->wake_pipe[1]);
+
+  Server *expected = server;
+  last_server.compare_exchange_strong(expected, nullptr);
+  delete server;
+  return ESP_OK;
+}
+
+esp_err_t httpd_register_uri_handler(httpd_handle_t handle,
+                                     const httpd_uri_t *uri_handler) {
+  auto *server = static_cast<Server *>(handle);
+  if (!server || !uri_handler || !uri_handler->uri || !uri_handler->handler) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  std::lock_guard lock(server->routes_mutex);
+  for (const auto &route : server->routes) {
+    if (route.method == uri_handler->method && route.uri == uri_handler->uri) {
+      return ESP_ERR_HTTPD_HANDLER_EXISTS;
+    }
+  }
+  if (server->routes.size() >= server->config.max_uri_handlers) {
+    return ESP_ERR_HTTPD_HANDLERS_FULL;
+  }
+  server->routes.push_back({uri_handler->uri, uri_handler->method,
+                            uri_handler->handler, uri_handler->user_ctx});
+  return ESP_OK;
+}
+
+esp_err_t httpd_unregister_uri_handler(httpd_handle_t handle, const char *uri,
+                                       httpd_method_t method) {
+  auto *server = static_cast<Server *>(handle);
+  if (!server || !uri) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  std::lock_guard lock(server->routes_mutex);
+  auto it = std::find_if(server->routes.begin(), server->routes.end(),
+                         [&](const Route &route) {
+                           return route.method == method && route.uri == uri;
+                         });
+  if (it == server->routes.end()) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  server->routes.erase(it);
+  return ESP_OK;
+}
+
+esp_err_t httpd_unregister_uri(httpd_handle_t handle, const char *uri) {
+  auto *server = static_cast<Server *>(handle);
+  if (!server || !uri) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  std::lock_guard lock(server->routes_mutex);
+  const auto before = server->routes.size();
+  server->routes.erase(std::remove_if(server->routes.begin(), server->routes.end(),
+                                      [&](const Route &route) { return route.uri == uri; }),
+                       server->routes.end());
+  return before == server->routes.size() ? ESP_ERR_NOT_FOUND : ESP_OK;
+}
+
+esp_err_t httpd_register_err_handler(httpd_handle_t handle,
+                                     httpd_err_code_t error,
+                                     httpd_err_handler_func_t handler_fn) {
+  auto *server = static_cast<Server *>(handle);
+  if (!server || error >= HTTPD_ERR_CODE_MAX) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  std::lock_guard lock(server->routes_mutex);
+  server->err_handlers[error] = handler_fn;
+  return ESP_OK;
+}
+
+bool httpd_uri_match_wildcard(const char *uri_template, const char *uri_to_match,
+                              size_t match_upto) {
+  const std::string_view tpl{uri_template};
+  const std::string_view uri{uri_to_match, match_upto};
+  if (!tpl.empty() && tpl.back() == '*') {
+    return uri.substr(0, tpl.size() - 1) == tpl.substr(0, tpl.size() - 1);
+  }
+  if (!tpl.empty() && tpl.back() == '?') {
+    const std::string_view base = tpl.substr(0, tpl.size() - 1);
+    return uri == base || (uri.size() == tpl.size() && uri.substr(0, base.size()) == base);
+  }
+  return tpl == uri;
+}
+
+int httpd_req_recv(httpd_req_t *r, char *buf, size_t buf_len) {
+  const earbrain::host::TrackingScope untracked(false);
+  RequestAux *aux = aux_of(r);
+  if (!aux || !buf) {
+    return HTTPD_SOCK_ERR_INVALID;
+  }
+  if (buf_len == 0 || aux->body_remaining == 0) {
+    return 0;
+  }
+
+  const std::size_t want = std::min(buf_len, aux->body_remaining);
+  if (!aux->pending_body.empty()) {
+    const std::size_t take = std::min(want, aux->pending_body.size());
+    std::memcpy(buf, aux->pending_body.data(), take);
+    aux->pending_body.erase(0, take);
+    aux->body_remaining -= take;
+    return static_cast<int>(take);
+  }
+  if (!aux->session) {
+    return HTTPD_SOCK_ERR_FAIL;
+  }
+
+  std::string &in = aux->session->inbuf;
+  if (!in.empty()) {
+    const std::size_t take = std::min(want, in.size());
+    std::memcpy(buf, in.data(), take);
+    in.erase(0, take);
+    aux->body_remaining -= take;
+    return static_cast<int>(take);
+  }
+
+  const ssize_t got = ::recv(aux->session->fd, buf, want, 0);
+  if (got < 0) {
+    return (errno == EAGAIN || errno == EWOULDBLOCK) ? HTTPD_SOCK_ERR_TIMEOUT
+                                                    : HTTPD_SOCK_ERR_FAIL;
+  }
+  if (got == 0) {
+    return HTTPD_SOCK_ERR_FAIL;
+  }
+  aux->body_remaining -= static_cast<std::size_t>(got);
+  return static_cast<int>(got);
+}
+
+size_t httpd_req_get_hdr_value_len(httpd_req_t *r, const char *field) {
+  const earbrain::host::TrackingScope untracked(false);
+  RequestAux *aux = aux_of(r);
+  if (!aux || !field) {
+    return 0;
+  }
+  const Header *header = find_header(*aux, field);
+  return header ? header->value.size() : 0;
+}
+
+esp_err_t httpd_req_get_hdr_value_str(httpd_req_t *r, const char *field,
+                                      char *val, size_t val_size) {
+  const earbrain::host::TrackingScope untracked(false);
+  RequestAux *aux = aux_of(r);
+  if (!aux || !field || !val || val_size == 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  const Header *header = find_header(*aux, field);
+  if (!header) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  const std::size_t n = std::min(header->value.size(), val_size - 1);
+  std::memcpy(val, header->value.data(), n);
+  val[n] = '\0';
+  return n < header->value.size() ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+size_t httpd_req_get_url_query_len(httpd_req_t *r) {
+  const earbrain::host::TrackingScope untracked(false);
+  RequestAux *aux = aux_of(r);
+  return aux && aux->has_query ? aux->query.size() : 0;
+}
+
+esp_err_t httpd_req_get_url_query_str(httpd_req_t *r, char *buf, size_t buf_len) {
+  const earbrain::host::TrackingScope untracked(false);
+  RequestAux *aux = aux_of(r);
+  if (!aux || !buf || buf_len == 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!aux->has_query) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  const std::size_t n = std::min(aux->query.size(), buf_len - 1);
+  std::memcpy(buf, aux->query.data(), n);
+  buf[n] = '\0';
+  return n < aux->query.size() ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+}
+
+esp_err_t httpd_query_key_value(const char *qry, const char *key, char *val,
+                                size_t val_size) {
+  if (!qry || !key || !val || val_size == 0) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  const std::string_view query{qry};
+  const std::string_view wanted{key};
+  std::size_t pos = 0;
+  while (pos <= query.size()) {
+    std::size_t end = query.find('&', pos);
+    if (end == std::string_view::npos) {
+      end = query.size();
+    }
+    const std::string_view pair = query.substr(pos, end - pos);
+    const std::size_t eq = pair.find('=');
+    if (pair.substr(0, eq) == wanted) {
+      const std::string_view value =
+          eq == std::string_view::npos ? std::string_view{} : pair.substr(eq + 1);
+      const std::size_t n = std::min(value.size(), val_size - 1);
+      std::memcpy(val, value.data(), n);
+      val[n] = '\0';
+      return n < value.size() ? ESP_ERR_HTTPD_RESULT_TRUNC : ESP_OK;
+    }
+    pos = end + 1;
+  }
+  return ESP_ERR_NOT_FOUND;
+}
+
+int httpd_req_to_sockfd(httpd_req_t *r) {
+  RequestAux *aux = aux_of(r);
+  return aux && aux->session ? aux->session->fd : -1;
+}
+
+esp_err_t httpd_resp_set_status(httpd_req_t *r, const char *status) {
+  const earbrain::host::TrackingScope untracked(false);
+  RequestAux *aux = aux_of(r);
+  if (!aux || !status) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  aux->status = status;
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_type(httpd_req_t *r, const char *type) {
+  const earbrain::host::TrackingScope untracked(false);
+  RequestAux *aux = aux_of(r);
+  if (!aux || !type) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  aux->content_type = type;
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_set_hdr(httpd_req_t *r, const char *field,
+                             const char *value) {
+  const earbrain::host::TrackingScope untracked(false);
+  RequestAux *aux = aux_of(r);
+  if (!aux || !field || !value) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (aux->resp_headers.size() >= aux->server->config.max_resp_headers) {
+    return ESP_ERR_HTTPD_RESP_HDR;
+  }
+  aux->resp_headers.emplace_back(field, value);
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_send(httpd_req_t *r, const char *buf, ssize_t buf_len) {
+  const earbrain::host::TrackingScope untracked(false);
+  RequestAux *aux = aux_of(r);
+  if (!aux) {
+    return ESP_ERR_HTTPD_INVALID_REQ;
+  }
+  const std::size_t len = resolve_len(buf, buf_len);
+  std::string head = status_head(*aux);
+  head += "Content-Length: ";
+  head += std::to_string(len);
+  head += "\r\n\r\n";
+  aux->headers_sent = true;
+  aux->completed = true;
+  if (!write_all(*aux, head.data(), head.size()) ||
+      (len > 0 && !write_all(*aux, buf, len))) {
+    return ESP_ERR_HTTPD_RESP_SEND;
+  }
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_chunk(httpd_req_t *r, const char *buf,
+                                ssize_t buf_len) {
+  const earbrain::host::TrackingScope untracked(false);
+  RequestAux *aux = aux_of(r);
+  if (!aux) {
+    return ESP_ERR_HTTPD_INVALID_REQ;
+  }
+  if (!aux->headers_sent) {
+    std::string head = status_head(*aux);
+    head += "Transfer-Encoding: chunked\r\n\r\n";
+    aux->headers_sent = true;
+    if (!write_all(*aux, head.data(), head.size())) {
+      return ESP_ERR_HTTPD_RESP_SEND;
+    }
+  }
+
+  const std::size_t len = resolve_len(buf, buf_len);
+  char size_line[24];
+  const int n = std::snprintf(size_line, sizeof(size_line), "%zx\r\n", len);
+  if (!write_all(*aux, size_line, static_cast<std::size_t>(n)) ||
+      (len > 0 && !write_all(*aux, buf, len)) || !write_all(*aux, "\r\n", 2)) {
+    return ESP_ERR_HTTPD_RESP_SEND;
+  }
+  if (len == 0) {
+    aux->completed = true;
+  }
+  return ESP_OK;
+}
+
+esp_err_t httpd_resp_send_err(httpd_req_t *req, httpd_err_code_t error,
+                              const char *msg) {
+  const char *status = HTTPD_500;
+  const char *fallback = "Server has encountered an unexpected error";
+  switch (error) {
+  case HTTPD_400_BAD_REQUEST:
+    status = HTTPD_400;
+    fallback = "Bad request syntax";
+    break;
+  case HTTPD_404_NOT_FOUND:
+    status = HTTPD_404;
+    fallback = "Nothing matches the given URI";
+    break;
+  case HTTPD_405_METHOD_NOT_ALLOWED:
+    status = "405 Method Not Allowed";
+    fallback = "Request method for this URI is not handled by server";
+    break;
+  case HTTPD_408_REQ_TIMEOUT:
+    status = HTTPD_408;
+    fallback = "Server closed this connection";
+    break;
+  default:
+    break;
+  }
+  httpd_resp_set_status(req, status);
+  httpd_resp_set_type(req, HTTPD_TYPE_TEXT);
+  return httpd_resp_send(req, msg ? msg : fallback, HTTPD_RESP_USE_STRLEN);
+}
+
+esp_err_t httpd_req_async_handler_begin(httpd_req_t *r, httpd_req_t **out) {
+  const earbrain::host::TrackingScope untracked(false);
+  RequestAux *aux = aux_of(r);
+  if (!aux || !out) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  auto copy_aux = std::make_unique<RequestAux>(*aux);
+  auto *copy = static_cast<httpd_req_t *>(std::malloc(sizeof(httpd_req_t)));
+  std::memcpy(static_cast<void *>(copy), r, sizeof(httpd_req_t));
+  copy->aux = copy_aux.release();
+
+  aux->detached = true;
+    if (aux->session) {
+    aux->session->busy = true;
+  }
+  {
+    std::lock_guard lock(aux->server->async_mutex);
+    ++aux->server->async_in_flight;
+  }
+  *out = copy;
+  return ESP_OK;
+}
+
+esp_err_t httpd_req_async_handler_complete(httpd_req_t *r) {
+  const earbrain::host::TrackingScope untracked(false);
+  RequestAux *aux = aux_of(r);
+  if (!aux) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  Server *server = aux->server;
+  std::shared_ptr<Session> session = aux->session;
+  std::shared_ptr<std::atomic<bool>> done = aux->async_done;
+  if (session) {
+    drain_body(*aux);
+    if (aux->failed) {
+      session->close_requested = true;
+    }
+  }
+  delete_request(r);
+
+  if (session) {
+    // The server task closes or resumes the session once woken.
+    session->busy = false;
+  }
+  {
+    std::lock_guard lock(server->async_mutex);
+    --server->async_in_flight;
+    if (done) {
+      done->store(true);
+    }
+  }
+  server->async_cv.notify_all();
+  server->wake();
+  return ESP_OK;
+}
+
+esp_err_t httpd_queue_work(httpd_handle_t handle, httpd_work_fn_t work, void *arg) {
+  const earbrain::host::TrackingScope untracked(false);
+  auto *server = static_cast<Server *>(handle);
+  if (!server || !work) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  {
+    std::lock_guard lock(server->work_mutex);
+    server->work.emplace_back(work, arg);
+  }
+  server->wake();
+  return ESP_OK;
+}
+
+} // extern "C"
+
+namespace earbrain::host {
+
+namespace {
+
+void parse_response(const std::string &raw, Response &response) {
+  const std::size_t head_end = raw.find("\r\n\r\n");
+  if (head_end == std::string::npos) {
+    return;
+  }
+  std::string_view head{raw.data(), head_end};
+  if (head.size() > 12) {
+    response.status = std::atoi(std::string(head.substr(9, 3)).c_str());
+  }
+
+  bool chunked = false;
+  std::size_t pos = head.find("\r\n");
+  while (pos != std::string_view::npos && pos < head.size()) {
+    pos += 2;
+    std::size_t next = head.find("\r\n", pos);
+    if (next == std::string_view::npos) {
+      next = head.size();
+    }
+    std::string_view line = head.substr(pos, next - pos);
+    const std::size_t colon = line.find(':');
+    if (colon != std::string_view::npos) {
+      std::string name{line.substr(0, colon)};
+      std::string value{line.substr(colon + 2 <= line.size() ? colon + 2 : colon + 1)};
+      if (iequals(name, "Transfer-Encoding") && value == "chunked") {
+        chunked = true;
+      }
+      response.headers.emplace_back(std::move(name), std::move(value));
+    }
+    pos = next;
+  }
+
+  std::string_view body{raw.data() + head_end + 4, raw.size() - head_end - 4};
+  if (!chunked) {
+    response.body.assign(body);
+    return;
+  }
+  while (!body.empty()) {
+    const std::size_t line_end = body.find("\r\n");
+    if (line_end == std::string_view::npos) {
+      break;
+    }
+    const std::size_t len = std::strtoul(std::string(body.substr(0, line_end)).c_str(), nullptr, 16);
+    if (len == 0) {
+      break;
+    }
+    response.body.append(body.substr(line_end + 2, len));
+    body.remove_prefix(std::min(body.size(), line_end + 2 + len + 2));
+  }
+}
+
+} // namespace
+
+const std::string *Response::header(std::string_view name) const {
+  for (const auto &[field, value] : headers) {
+    if (iequals(field, name)) {
+      return &value;
+    }
+  }
+  return nullptr;
+}
+
+esp_err_t dispatch(httpd_handle_t handle, const Request &request,
+                   Response &response) {
+  auto *server = static_cast<Server *>(handle);
+  if (!server || request.uri.empty() || request.uri.size() > HTTPD_MAX_URI_LEN) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  const TrackingScope untracked(false);
+
+  std::string raw;
+  auto done = std::make_shared<std::atomic<bool>>(false);
+  auto aux = std::make_unique<RequestAux>();
+  aux->capture = &raw;
+  aux->async_done = done;
+  aux->pending_body = request.body;
+  aux->body_remaining = request.body.size();
+  for (const auto &[name, value] : request.headers) {
+    aux->headers.push_back({name, value});
+  }
+
+  httpd_req_t *req = new_request(server, std::move(aux), request.method, request.uri);
+  req->content_len = request.body.size();
+
+  const bool ok = run_request(server, req);
+  const bool detached = aux_of(req)->detached;
+  delete_request(req);
+  if (detached) {
+    std::unique_lock lock(server->async_mutex);
+    server->async_cv.wait(lock, [&] { return done->load(); });
+  }
+
+  response = Response{};
+  response.result = ok ? ESP_OK : ESP_FAIL;
+  parse_response(raw, response);
+  return ESP_OK;
+}
+
+httpd_handle_t last_started_server() { return last_server.load(); }
+
+uint16_t bound_port(httpd_handle_t handle) {
+  auto *server = static_cast<Server *>(handle);
+  return server ? server->port : 0;
+}
+
+} // namespace earbrain::host
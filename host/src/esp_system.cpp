@@ -0,0 +1,195 @@
+#include "esp_chip_info.h"
+#include "esp_err.h"
+#include "esp_heap_caps.h"
+#include "esp_http_server.h"
+#include "esp_netif.h"
+#include "esp_pthread.h"
+#include "esp_random.h"
+#include "esp_system.h"
+#include "esp_timer.h"
+#include "esp_wifi.h"
+#include "freertos/task.h"
+#include "lwip/ip4_addr.h"
+
+#include "earbrain/host/fakes.hpp"
+
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+#include <random>
+#include <thread>
+
+namespace {
+
+const auto process_start = std::chrono::steady_clock::now();
+std::atomic<earbrain::host::ClockSource> clock_source{nullptr};
+
+thread_local bool pthread_cfg_set = false;
+thread_local esp_pthread_cfg_t pthread_cfg;
+
+} // namespace
+
+namespace earbrain::host {
+
+void set_clock_source(ClockSource source) { clock_source.store(source); }
+
+} // namespace earbrain::host
+
+extern "C" {
+
+const char *esp_err_to_name(esp_err_t code) {
+  switch (code) {
+  case ESP_OK:
+    return "ESP_OK";
+  case ESP_FAIL:
+    return "ESP_FAIL";
+  case ESP_ERR_NO_MEM:
+    return "ESP_ERR_NO_MEM";
+  case ESP_ERR_INVALID_ARG:
+    return "ESP_ERR_INVALID_ARG";
+  case ESP_ERR_INVALID_STATE:
+    return "ESP_ERR_INVALID_STATE";
+  case ESP_ERR_INVALID_SIZE:
+    return "ESP_ERR_INVALID_SIZE";
+  case ESP_ERR_NOT_FOUND:
+    return "ESP_ERR_NOT_FOUND";
+  case ESP_ERR_NOT_SUPPORTED:
+    return "ESP_ERR_NOT_SUPPORTED";
+  case ESP_ERR_TIMEOUT:
+    return "ESP_ERR_TIMEOUT";
+  case ESP_ERR_WIFI_SSID:
+    return "ESP_ERR_WIFI_SSID";
+  case ESP_ERR_WIFI_PASSWORD:
+    return "ESP_ERR_WIFI_PASSWORD";
+  case ESP_ERR_WIFI_NOT_STARTED:
+    return "ESP_ERR_WIFI_NOT_STARTED";
+  case ESP_ERR_WIFI_STATE:
+    return "ESP_ERR_WIFI_STATE";
+  case ESP_ERR_HTTPD_HANDLERS_FULL:
+    return "ESP_ERR_HTTPD_HANDLERS_FULL";
+  case ESP_ERR_HTTPD_HANDLER_EXISTS:
+    return "ESP_ERR_HTTPD_HANDLER_EXISTS";
+  case ESP_ERR_HTTPD_INVALID_REQ:
+    return "ESP_ERR_HTTPD_INVALID_REQ";
+  case ESP_ERR_HTTPD_RESULT_TRUNC:
+    return "ESP_ERR_HTTPD_RESULT_TRUNC";
+  case ESP_ERR_HTTPD_RESP_HDR:
+    return "ESP_ERR_HTTPD_RESP_HDR";
+  case ESP_ERR_HTTPD_RESP_SEND:
+    return "ESP_ERR_HTTPD_RESP_SEND";
+  case ESP_ERR_HTTPD_TASK:
+    return "ESP_ERR_HTTPD_TASK";
+  default:
+    return "UNKNOWN ERROR";
+  }
+}
+
+int64_t esp_timer_get_time(void) {
+  if (const earbrain::host::ClockSource source = clock_source.load()) {
+    return source();
+  }
+  return std::chrono::duration_cast<std::chrono::microseconds>(
+             std::chrono::steady_clock::now() - process_start)
+      .count();
+}
+
+void esp_chip_info(esp_chip_info_t *out_info) {
+  if (!out_info) {
+    return;
+  }
+  *out_info = esp_chip_info_t{};
+  out_info->model = CHIP_POSIX_LINUX;
+  out_info->cores = 1;
+}
+
+const char *esp_get_idf_version(void) { return "v5.2-host"; }
+
+uint32_t esp_random(void) {
+  static std::mutex mutex;
+  static std::random_device device;
+  std::lock_guard<std::mutex> lock(mutex);
+  return device();
+}
+
+void vTaskDelay(TickType_t ticks) {
+  std::this_thread::sleep_for(std::chrono::milliseconds(ticks * portTICK_PERIOD_MS));
+}
+
+TickType_t xTaskGetTickCount(void) {
+  return static_cast<TickType_t>(esp_timer_get_time() / 1000 / portTICK_PERIOD_MS);
+}
+
+esp_pthread_cfg_t esp_pthread_get_default_config(void) {
+  return esp_pthread_cfg_t{3072, 5, false, nullptr, -1};
+}
+
+esp_err_t esp_pthread_set_cfg(const esp_pthread_cfg_t *cfg) {
+  if (!cfg) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  pthread_cfg = *cfg;
+  pthread_cfg_set = true;
+  return ESP_OK;
+}
+
+esp_err_t esp_pthread_get_cfg(esp_pthread_cfg_t *cfg) {
+  if (!cfg) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  if (!pthread_cfg_set) {
+    return ESP_ERR_NOT_FOUND;
+  }
+  *cfg = pthread_cfg;
+  return ESP_OK;
+}
+
+char *ip4addr_ntoa_r(const ip4_addr_t *addr, char *buf, int buflen) {
+  if (!addr || !buf || buflen <= 0) {
+    return nullptr;
+  }
+  const uint32_t a = addr->addr;
+  const int n = std::snprintf(buf, static_cast<size_t>(buflen), "%u.%u.%u.%u",
+                              a & 0xff, (a >> 8) & 0xff, (a >> 16) & 0xff,
+                              (a >> 24) & 0xff);
+  return n < buflen ? buf : nullptr;
+}
+
+struct esp_netif_obj {
+  esp_netif_ip_info_t ip_info;
+};
+
+esp_netif_t *esp_netif_get_handle_from_ifkey(const char *if_key) {
+  static esp_netif_t ap{{{ESP_IP4TOADDR(192, 168, 4, 1)},
+                         {ESP_IP4TOADDR(255, 255, 255, 0)},
+                         {ESP_IP4TOADDR(192, 168, 4, 1)}}};
+  return if_key && std::strcmp(if_key, "WIFI_AP_DEF") == 0 ? &ap : nullptr;
+}
+
+esp_err_t esp_netif_get_ip_info(esp_netif_t *esp_netif,
+                                esp_netif_ip_info_t *ip_info) {
+  if (!esp_netif || !ip_info) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  *ip_info = esp_netif->ip_info;
+  return ESP_OK;
+}
+
+size_t heap_caps_get_total_size(uint32_t) {
+  return earbrain::host::heap_figures().total;
+}
+
+size_t heap_caps_get_free_size(uint32_t) {
+  return earbrain::host::heap_figures().free;
+}
+
+size_t heap_caps_get_minimum_free_size(uint32_t) {
+  return earbrain::host::heap_figures().min_free;
+}
+
+size_t heap_caps_get_largest_free_block(uint32_t) {
+  return earbrain::host::heap_figures().largest_free_block;
+}
+
+} // extern "C"
@@ -0,0 +1,115 @@
+// Routes host allocations through the ESP-IDF heap hooks so heap-aware
+// gateway code (e.g. middleware::heap_accounting) sees them as on a device.
+// Covers C++ operator new/delete and cJSON's allocator, and keeps the
+// per-thread counters behind earbrain/host/allocations.hpp.
+
+#include "earbrain/host/allocations.hpp"
+#include "esp_heap_caps.h"
+
+#include <cJSON.h>
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#if CONFIG_HEAP_USE_HOOKS
+
+namespace {
+
+using earbrain::host::AllocationObserver;
+
+thread_local earbrain::host::AllocationCounters counters;
+thread_local bool tracking = true;
+thread_local bool in_observer = false;
+std::atomic<AllocationObserver *> observer{nullptr};
+
+void *hooked_malloc(std::size_t size) {
+  void *ptr = std::malloc(size ? size : 1);
+  if (ptr) {
+    ++counters.allocations;
+    counters.bytes += size;
+    esp_heap_trace_alloc_hook(ptr, size, MALLOC_CAP_DEFAULT);
+    AllocationObserver *current = observer.load(std::memory_order_acquire);
+    if (current && tracking && !in_observer) {
+      in_observer = true;
+      current->on_alloc(ptr, size);
+      in_observer = false;
+    }
+  }
+  return ptr;
+}
+
+void hooked_free(void *ptr) {
+  if (ptr) {
+    esp_heap_trace_free_hook(ptr);
+    // Reported before the block is released so the address cannot be
+    // handed out (and reported) again in between.
+    AllocationObserver *current = observer.load(std::memory_order_acquire);
+    if (current && !in_observer) {
+      in_observer = true;
+      current->on_free(ptr);
+      in_observer = false;
+    }
+    std::free(ptr);
+  }
+}
+
+struct InstallCjsonHooks {
+  InstallCjsonHooks() {
+    cJSON_Hooks hooks{&hooked_malloc, &hooked_free};
+    cJSON_InitHooks(&hooks);
+  }
+} install_cjson_hooks;
+
+} // namespace
+
+earbrain::host::AllocationCounters earbrain::host::allocation_counters() noexcept {
+  return counters;
+}
+
+void earbrain::host::set_allocation_observer(AllocationObserver *next) noexcept {
+  observer.store(next, std::memory_order_release);
+}
+
+earbrain::host::TrackingScope::TrackingScope(bool enabled) noexcept
+    : previous(tracking) {
+  tracking = enabled;
+}
+
+earbrain::host::TrackingScope::~TrackingScope() { tracking = previous; }
+
+void *operator new(std::size_t size) {
+  if (void *ptr = hooked_malloc(size)) {
+    return ptr;
+  }
+  throw std::bad_alloc();
+}
+
+void *operator new[](std::size_t size) { return operator new(size); }
+
+void *operator new(std::size_t size, const std::nothrow_t &) noexcept {
+  return hooked_malloc(size);
+}
+
+void *operator new[](std::size_t size, const std::nothrow_t &) noexcept {
+  return hooked_malloc(size);
+}
+
+void operator delete(void *ptr) noexcept { hooked_free(ptr); }
+void operator delete[](void *ptr) noexcept { hooked_free(ptr); }
+void operator delete(void *ptr, std::size_t) noexcept { hooked_free(ptr); }
+void operator delete[](void *ptr, std::size_t) noexcept { hooked_free(ptr); }
+
+#else
+
+earbrain::host::AllocationCounters earbrain::host::allocation_counters() noexcept {
+  return {};
+}
+
+void earbrain::host::set_allocation_observer(AllocationObserver *) noexcept {}
+
+earbrain::host::TrackingScope::TrackingScope(bool) noexcept : previous(true) {}
+
+earbrain::host::TrackingScope::~TrackingScope() = default;
+
+#endif
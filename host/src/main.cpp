@@ -0,0 +1,139 @@
+// Serves the portal and REST API from a workstation.
+//
+//   gateway_host [--port N] [--scan-networks N] [--scan-latency-ms N]
+//                [--rate-limit] [--memory-governor] [--trace]
+//                [--heap-accounting] [--capture] [--compress] [--quiet]
+//                [--dns-port N]
+
+#include "earbrain/gateway/gateway.hpp"
+#include "earbrain/gateway/middlewares/capture.hpp"
+#include "earbrain/gateway/middlewares/compression.hpp"
+#include "earbrain/gateway/middlewares/heap_accounting.hpp"
+#include "earbrain/gateway/middlewares/logging.hpp"
+#include "earbrain/gateway/middlewares/memory_governor.hpp"
+#include "earbrain/gateway/middlewares/rate_limit.hpp"
+#include "earbrain/gateway/middlewares/tracing.hpp"
+#include "earbrain/host/fakes.hpp"
+#include "earbrain/host/server.hpp"
+#include "earbrain/logging.hpp"
+
+#include <csignal>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <string_view>
+#include <unistd.h>
+
+namespace {
+
+volatile std::sig_atomic_t stop_requested = 0;
+
+void on_signal(int) { stop_requested = 1; }
+
+void usage(const char *argv0) {
+  std::fprintf(stderr,
+               "usage: %s [--port N] [--scan-networks N] [--scan-latency-ms N]\n"
+               "          [--rate-limit] [--memory-governor] [--trace]\n"
+               "          [--heap-accounting] [--capture] [--compress] [--quiet]\n"
+               "          [--dns-port N]\n",
+               argv0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  const char *port = "8080";
+  bool quiet = false;
+  bool rate_limit = false;
+  bool memory_governor = false;
+  bool trace = false;
+  bool heap_accounting = false;
+  bool capture = false;
+  bool compress = false;
+  // The captive DNS responder stays off unless asked for: port 53 is
+  // privileged, and the workstation's own resolver may hold it.
+  uint16_t dns_port = 0;
+  earbrain::host::ScanProfile scan;
+
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg{argv[i]};
+    const bool has_value = i + 1 < argc;
+    if (arg == "--port" && has_value) {
+      port = argv[++i];
+    } else if (arg == "--scan-networks" && has_value) {
+      scan.networks = std::strtoul(argv[++i], nullptr, 10);
+    } else if (arg == "--scan-latency-ms" && has_value) {
+      scan.latency_ms = static_cast<uint32_t>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--rate-limit") {
+      rate_limit = true;
+    } else if (arg == "--memory-governor") {
+      memory_governor = true;
+    } else if (arg == "--trace") {
+      trace = true;
+    } else if (arg == "--heap-accounting") {
+      heap_accounting = true;
+    } else if (arg == "--capture") {
+      capture = true;
+    } else if (arg == "--compress") {
+      compress = true;
+    } else if (arg == "--dns-port" && has_value) {
+      dns_port = static_cast<uint16_t>(std::strtoul(argv[++i], nullptr, 10));
+    } else if (arg == "--quiet") {
+      quiet = true;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  // The host httpd honours this instead of the compiled-in port 80.
+  setenv("EARBRAIN_HOST_HTTP_PORT", port, 1);
+  earbrain::host::set_scan_profile(scan);
+
+  earbrain::GatewayOptions options;
+  options.portal_config.title = "ESP Gateway (host)";
+  options.captive_dns.enabled = dns_port != 0;
+  options.captive_dns.port = dns_port;
+  earbrain::gateway().initialize(options);
+  // Admission control first, so rejected requests cost nothing further down
+  // the chain.
+  if (rate_limit) {
+    earbrain::gateway().server().use(earbrain::middleware::rate_limit);
+  }
+  if (memory_governor) {
+    earbrain::gateway().server().use(earbrain::middleware::memory_governor);
+  }
+  if (trace) {
+    earbrain::gateway().server().use(earbrain::middleware::trace_request);
+  }
+  if (heap_accounting) {
+    earbrain::gateway().server().use(earbrain::middleware::heap_accounting);
+  }
+  if (capture) {
+    earbrain::gateway().server().use(earbrain::middleware::capture_request);
+  }
+  if (compress) {
+    earbrain::gateway().server().use(earbrain::middleware::compress_response);
+  }
+  if (!quiet) {
+    earbrain::gateway().server().use(earbrain::middleware::log_request);
+  }
+
+  if (earbrain::gateway().start_portal() != ESP_OK) {
+    std::fprintf(stderr, "failed to start portal\n");
+    return 1;
+  }
+
+  const uint16_t bound =
+      earbrain::host::bound_port(earbrain::host::last_started_server());
+  std::fprintf(stderr, "gateway_host listening on http://127.0.0.1:%u/\n", bound);
+
+  std::signal(SIGINT, on_signal);
+  std::signal(SIGTERM, on_signal);
+  while (!stop_requested) {
+    pause();
+  }
+
+  earbrain::gateway().stop_portal();
+  return 0;
+}
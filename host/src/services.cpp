@@ -0,0 +1,341 @@
+// Host stand-ins for the earbrain_core services the gateway talks to.
+
+#include "earbrain/host/fakes.hpp"
+#include "earbrain/logging.hpp"
+#include "earbrain/mdns_service.hpp"
+#include "earbrain/metrics.hpp"
+#include "earbrain/validation.hpp"
+#include "earbrain/wifi_service.hpp"
+
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_timer.h"
+#include "esp_wifi_types.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdarg>
+#include <cstdio>
+#include <deque>
+#include <mutex>
+#include <thread>
+
+namespace earbrain {
+
+namespace {
+
+std::mutex profile_mutex;
+host::ScanProfile scan_profile{};
+host::ConnectProfile connect_profile{};
+
+host::HeapFigures default_heap() {
+  // Roughly what an ESP32 has left after Wi-Fi and httpd are up.
+  return host::HeapFigures{300 * 1024, 180 * 1024, 150 * 1024, 110 * 1024};
+}
+
+std::atomic<host::HeapProbe> heap_probe{&default_heap};
+
+} // namespace
+
+namespace host {
+
+void set_scan_profile(const ScanProfile &profile) {
+  std::lock_guard lock(profile_mutex);
+  scan_profile = profile;
+}
+
+void set_connect_profile(const ConnectProfile &profile) {
+  std::lock_guard lock(profile_mutex);
+  connect_profile = profile;
+}
+
+void set_heap_probe(HeapProbe probe) {
+  heap_probe.store(probe ? probe : &default_heap);
+}
+
+HeapFigures heap_figures() { return heap_probe.load()(); }
+
+} // namespace host
+
+// ---------------------------------------------------------------------------
+// Logging
+
+namespace logging {
+
+namespace {
+
+std::mutex log_mutex;
+std::deque<LogEntry> log_ring;
+uint64_t next_log_id = 1;
+
+void vlogf(esp_log_level_t level, const char *tag, const char *format,
+           va_list args) {
+  char buffer[256];
+  std::vsnprintf(buffer, sizeof(buffer), format, args);
+  log(level, buffer, tag ? tag : "app");
+}
+
+} // namespace
+
+void log(esp_log_level_t level, std::string_view message, std::string_view tag) {
+  std::lock_guard lock(log_mutex);
+  LogEntry entry;
+  entry.id = next_log_id++;
+  entry.timestamp_ms = static_cast<uint64_t>(esp_timer_get_time() / 1000);
+  entry.level = level;
+  entry.tag = std::string(tag);
+  entry.message = std::string(message);
+  if (CONFIG_LOG_DEFAULT_LEVEL >= level) {
+    std::fprintf(stderr, "[%s] %.*s\n", entry.tag.c_str(),
+                 static_cast<int>(message.size()), message.data());
+  }
+  log_ring.push_back(std::move(entry));
+  if (log_ring.size() > LogStore::max_entries) {
+    log_ring.pop_front();
+  }
+}
+
+#define EARBRAIN_HOST_LOGF(name, level)                    \
+  void name(const char *tag, const char *format, ...) {    \
+    va_list args;                                          \
+    va_start(args, format);                                \
+    vlogf(level, tag, format, args);                       \
+    va_end(args);                                          \
+  }
+
+EARBRAIN_HOST_LOGF(errorf, ESP_LOG_ERROR)
+EARBRAIN_HOST_LOGF(warnf, ESP_LOG_WARN)
+EARBRAIN_HOST_LOGF(infof, ESP_LOG_INFO)
+EARBRAIN_HOST_LOGF(debugf, ESP_LOG_DEBUG)
+
+#undef EARBRAIN_HOST_LOGF
+
+LogBatch collect(uint64_t cursor, std::size_t limit) {
+  std::lock_guard lock(log_mutex);
+  LogBatch batch;
+  batch.next_cursor = cursor;
+  for (const auto &entry : log_ring) {
+    if (entry.id <= cursor) {
+      continue;
+    }
+    if (batch.entries.size() >= limit) {
+      batch.has_more = true;
+      break;
+    }
+    batch.entries.push_back(entry);
+    batch.next_cursor = entry.id;
+  }
+  return batch;
+}
+
+} // namespace logging
+
+// ---------------------------------------------------------------------------
+// Metrics
+
+Metrics collect_metrics() {
+  const host::HeapFigures heap = host::heap_figures();
+  Metrics metrics;
+  metrics.heap_total = heap.total;
+  metrics.heap_free = heap.free;
+  metrics.heap_used = heap.total - heap.free;
+  metrics.heap_min_free = heap.min_free;
+  metrics.heap_largest_free_block = heap.largest_free_block;
+  metrics.timestamp_ms = static_cast<uint64_t>(esp_timer_get_time() / 1000);
+  return metrics;
+}
+
+// ---------------------------------------------------------------------------
+// Validation
+
+namespace validation {
+
+bool is_valid_ssid(std::string_view ssid) {
+  return !ssid.empty() && ssid.size() <= 32;
+}
+
+bool is_valid_passphrase(std::string_view passphrase) {
+  if (passphrase.size() >= 8 && passphrase.size() <= 63) {
+    return true;
+  }
+  return passphrase.size() == 64 &&
+         std::all_of(passphrase.begin(), passphrase.end(), [](char c) {
+           return std::isxdigit(static_cast<unsigned char>(c)) != 0;
+         });
+}
+
+} // namespace validation
+
+// ---------------------------------------------------------------------------
+// Wi-Fi
+
+esp_err_t WifiService::initialize() { return ESP_OK; }
+
+esp_err_t WifiService::config(const WifiConfig &config) {
+  std::lock_guard lock(mutex);
+  current_config = config;
+  return ESP_OK;
+}
+
+esp_err_t WifiService::mode(WifiMode mode) {
+  bool sta_was_on = false;
+  {
+    std::lock_guard lock(mutex);
+    sta_was_on = current_status.mode == WifiMode::STA ||
+                 current_status.mode == WifiMode::APSTA;
+    current_status.mode = mode;
+    if (mode == WifiMode::Off || mode == WifiMode::AP) {
+      current_status.sta_connected = false;
+      current_status.sta_connecting = false;
+      current_status.sta_ip = {};
+    }
+  }
+  // Like the driver, announce the change once the state is in place.
+  const bool sta_on = mode == WifiMode::STA || mode == WifiMode::APSTA;
+  esp_event_post(WIFI_EVENT, sta_on ? WIFI_EVENT_STA_START : WIFI_EVENT_STA_STOP,
+                 nullptr, 0, 0);
+  if (sta_was_on && !sta_on) {
+    esp_event_post(IP_EVENT, IP_EVENT_STA_LOST_IP, nullptr, 0, 0);
+  }
+  return ESP_OK;
+}
+
+WifiMode WifiService::mode() const {
+  std::lock_guard lock(mutex);
+  return current_status.mode;
+}
+
+WifiStatus WifiService::status() const {
+  std::lock_guard lock(mutex);
+  return current_status;
+}
+
+esp_err_t WifiService::save_credentials(std::string_view ssid,
+                                        std::string_view passphrase) {
+  std::lock_guard lock(mutex);
+  saved = WifiCredentials{std::string(ssid), std::string(passphrase)};
+  return ESP_OK;
+}
+
+std::optional<WifiCredentials> WifiService::load_credentials() const {
+  std::lock_guard lock(mutex);
+  return saved;
+}
+
+esp_err_t WifiService::connect() {
+  host::ConnectProfile profile;
+  {
+    std::lock_guard lock(profile_mutex);
+    profile = connect_profile;
+  }
+
+  {
+    std::lock_guard lock(mutex);
+    if (current_status.mode != WifiMode::STA &&
+        current_status.mode != WifiMode::APSTA) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    if (!saved) {
+      return ESP_ERR_NOT_FOUND;
+    }
+    current_status.sta_connecting = true;
+    current_status.sta_connected = false;
+    current_status.sta_last_error = ESP_OK;
+  }
+
+  std::thread([this, profile] {
+    std::this_thread::sleep_for(std::chrono::milliseconds(profile.latency_ms));
+    {
+      std::lock_guard lock(mutex);
+      current_status.sta_connecting = false;
+      current_status.sta_last_error = profile.outcome;
+      if (profile.outcome == ESP_OK) {
+        current_status.sta_connected = true;
+        current_status.sta_ip.addr = ESP_IP4TOADDR(192, 168, 1, 50);
+      } else {
+        current_status.sta_last_disconnect_reason = WIFI_REASON_AUTH_FAIL;
+      }
+    }
+    if (profile.outcome == ESP_OK) {
+      esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_CONNECTED, nullptr, 0, 0);
+      esp_event_post(IP_EVENT, IP_EVENT_STA_GOT_IP, nullptr, 0, 0);
+    } else {
+      esp_event_post(WIFI_EVENT, WIFI_EVENT_STA_DISCONNECTED, nullptr, 0, 0);
+    }
+  }).detach();
+  return ESP_OK;
+}
+
+WifiScanResult WifiService::perform_scan() {
+  host::ScanProfile profile;
+  {
+    std::lock_guard lock(profile_mutex);
+    profile = scan_profile;
+  }
+  if (profile.latency_ms > 0) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(profile.latency_ms));
+  }
+
+  WifiScanResult result;
+  result.error = profile.error;
+  if (profile.error != ESP_OK) {
+    return result;
+  }
+
+  static constexpr wifi_auth_mode_t modes[] = {
+      WIFI_AUTH_WPA2_PSK, WIFI_AUTH_WPA_WPA2_PSK, WIFI_AUTH_WPA3_PSK,
+      WIFI_AUTH_OPEN, WIFI_AUTH_WPA2_WPA3_PSK};
+  result.networks.reserve(profile.networks);
+  for (std::size_t i = 0; i < profile.networks; ++i) {
+    WifiNetworkSummary network;
+    char ssid[33];
+    char bssid[18];
+    std::snprintf(ssid, sizeof(ssid), "host-network-%02zu", i);
+    std::snprintf(bssid, sizeof(bssid), "02:00:00:00:%02zx:%02zx", i / 256, i % 256);
+    network.ssid = ssid;
+    network.bssid = bssid;
+    network.rssi = -40 - static_cast<int>((i * 7) % 50);
+    network.signal = std::clamp(2 * (network.rssi + 100), 0, 100);
+    network.channel = 1 + static_cast<int>(i % 11);
+    network.auth_mode = modes[i % std::size(modes)];
+    network.hidden = (i % 17) == 16;
+    result.networks.push_back(std::move(network));
+  }
+  return result;
+}
+
+WifiService &wifi() {
+  static WifiService instance;
+  return instance;
+}
+
+// ---------------------------------------------------------------------------
+// mDNS
+
+esp_err_t MdnsService::initialize() {
+  initialized = true;
+  return ESP_OK;
+}
+
+esp_err_t MdnsService::start(const MdnsConfig &config) {
+  if (!initialized) {
+    return ESP_ERR_INVALID_STATE;
+  }
+  current = config;
+  running = true;
+  return ESP_OK;
+}
+
+esp_err_t MdnsService::stop() {
+  running = false;
+  return ESP_OK;
+}
+
+MdnsService &mdns() {
+  static MdnsService instance;
+  return instance;
+}
+
+} // namespace earbrain
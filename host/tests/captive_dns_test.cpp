@@ -0,0 +1,338 @@
+// Captive DNS responder test.
+//
+//   captive_dns_test
+//
+// Starts captive_dns on a loopback port with a fake upstream resolver and
+// sends it real UDP queries: redirected A queries, other types, malformed
+// packets, EDNS queries and passthrough names that are forwarded. Prints
+// each failed check and exits 1 when there was one.
+
+#include "earbrain/gateway/captive_dns.hpp"
+
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace earbrain;
+
+using Packet = std::vector<uint8_t>;
+
+constexpr uint16_t type_a = 1;
+constexpr uint16_t type_mx = 15;
+constexpr uint16_t type_aaaa = 28;
+constexpr uint16_t type_opt = 41;
+constexpr int reply_timeout_ms = 500;
+
+int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,   \
+                   #cond);                                                     \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (false)
+
+uint16_t read_u16(const Packet &p, std::size_t at) {
+  return static_cast<uint16_t>(p[at] << 8 | p[at + 1]);
+}
+
+void put_u16(Packet &p, uint16_t value) {
+  p.push_back(static_cast<uint8_t>(value >> 8));
+  p.push_back(static_cast<uint8_t>(value & 0xff));
+}
+
+// A standard query with RD set and, when edns_size is given, an OPT record
+// advertising that payload size.
+Packet query(uint16_t id, const std::string &name, uint16_t type,
+             uint16_t edns_size = 0) {
+  Packet p;
+  put_u16(p, id);
+  put_u16(p, 0x0100);
+  put_u16(p, 1);
+  put_u16(p, 0);
+  put_u16(p, 0);
+  put_u16(p, edns_size ? 1 : 0);
+  std::size_t start = 0;
+  while (start <= name.size()) {
+    std::size_t dot = name.find('.', start);
+    if (dot == std::string::npos) {
+      dot = name.size();
+    }
+    p.push_back(static_cast<uint8_t>(dot - start));
+    p.insert(p.end(), name.begin() + start, name.begin() + dot);
+    start = dot + 1;
+  }
+  p.push_back(0);
+  put_u16(p, type);
+  put_u16(p, 1);
+  if (edns_size) {
+    p.push_back(0);
+    put_u16(p, type_opt);
+    put_u16(p, edns_size);
+    put_u16(p, 0);
+    put_u16(p, 0);
+    put_u16(p, 0);
+  }
+  return p;
+}
+
+int open_socket() {
+  const int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  bind(sock, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr));
+  const timeval timeout{0, reply_timeout_ms * 1000};
+  setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+  return sock;
+}
+
+uint16_t port_of(int sock) {
+  sockaddr_in addr{};
+  socklen_t len = sizeof(addr);
+  getsockname(sock, reinterpret_cast<sockaddr *>(&addr), &len);
+  return ntohs(addr.sin_port);
+}
+
+// A UDP port nothing listens on right now.
+uint16_t free_port() {
+  const int sock = open_socket();
+  const uint16_t port = port_of(sock);
+  close(sock);
+  return port;
+}
+
+void send_to(int sock, uint16_t port, const Packet &p) {
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  addr.sin_port = htons(port);
+  sendto(sock, p.data(), p.size(), 0, reinterpret_cast<const sockaddr *>(&addr),
+         sizeof(addr));
+}
+
+// The next datagram, or an empty packet after reply_timeout_ms.
+Packet receive(int sock, sockaddr_in *from = nullptr) {
+  Packet p(2048);
+  sockaddr_in addr{};
+  socklen_t len = sizeof(addr);
+  const ssize_t n = recvfrom(sock, p.data(), p.size(), 0,
+                             reinterpret_cast<sockaddr *>(&addr), &len);
+  p.resize(n > 0 ? static_cast<std::size_t>(n) : 0);
+  if (from) {
+    *from = addr;
+  }
+  return p;
+}
+
+bool same_question(const Packet &a, const Packet &b, std::size_t len) {
+  return a.size() >= len && b.size() >= len &&
+         std::memcmp(a.data() + 12, b.data() + 12, len - 12) == 0;
+}
+
+void test_redirected_a(int client, uint16_t port) {
+  const Packet q = query(0x1234, "Connectivitycheck.gstatic.com", type_a);
+  send_to(client, port, q);
+  const Packet r = receive(client);
+  CHECK(r.size() == q.size() + 16);
+  if (r.size() != q.size() + 16) {
+    return;
+  }
+  CHECK(read_u16(r, 0) == 0x1234);
+  CHECK((r[2] & 0x80) != 0); // QR
+  CHECK((r[2] & 0x01) != 0); // RD echoed
+  CHECK((r[3] & 0x0f) == 0);
+  CHECK(read_u16(r, 6) == 1);
+  CHECK(same_question(q, r, q.size()));
+  const std::size_t rdata = r.size() - 4;
+  CHECK(read_u16(r, q.size() + 2) == type_a);
+  CHECK(read_u16(r, rdata - 2) == 4);
+  uint32_t address = 0;
+  std::memcpy(&address, r.data() + rdata, sizeof(address));
+  CHECK(address == captive_dns::portal_address());
+}
+
+void test_other_types(int client, uint16_t port) {
+  for (const uint16_t type : {type_aaaa, type_mx}) {
+    const Packet q = query(0x2000 + type, "example.com", type);
+    send_to(client, port, q);
+    const Packet r = receive(client);
+    CHECK(r.size() == q.size());
+    if (r.size() != q.size()) {
+      continue;
+    }
+    CHECK(read_u16(r, 0) == 0x2000 + type);
+    CHECK((r[2] & 0x80) != 0);
+    CHECK((r[3] & 0x0f) == 0); // NOERROR, no data
+    CHECK(read_u16(r, 6) == 0);
+  }
+}
+
+void test_malformed(int client, uint16_t port) {
+  const captive_dns::Stats before = captive_dns::stats();
+
+  // Shorter than a header.
+  send_to(client, port, Packet{0x12, 0x34, 0x01, 0x00, 0x00});
+  // A label running past the end.
+  Packet cut = query(0x3001, "example.com", type_a);
+  cut.resize(16);
+  send_to(client, port, cut);
+  // A response rather than a query.
+  Packet response = query(0x3002, "example.com", type_a);
+  response[2] |= 0x80;
+  send_to(client, port, response);
+  // A compression pointer in the question.
+  Packet pointer = query(0x3003, "example.com", type_a);
+  pointer[12] = 0xc0;
+  send_to(client, port, pointer);
+  // Longer than max_packet_size.
+  Packet long_query = query(0x3004, "example.com", type_a);
+  long_query.resize(600, 0);
+  send_to(client, port, long_query);
+
+  CHECK(receive(client).empty());
+  CHECK(captive_dns::stats().dropped - before.dropped == 5);
+
+  // Still answering.
+  send_to(client, port, query(0x3005, "example.com", type_a));
+  const Packet r = receive(client);
+  CHECK(r.size() >= 2 && read_u16(r, 0) == 0x3005);
+}
+
+void test_edns(int client, uint16_t port) {
+  const Packet plain = query(0x4000, "example.com", type_a);
+  const Packet q = query(0x4000, "example.com", type_a, 4096);
+  send_to(client, port, q);
+  const Packet r = receive(client);
+  // Answered without an OPT record of its own.
+  CHECK(r.size() == plain.size() + 16);
+  if (r.size() != plain.size() + 16) {
+    return;
+  }
+  CHECK(read_u16(r, 6) == 1);
+  CHECK(read_u16(r, 10) == 0);
+  CHECK(same_question(plain, r, plain.size()));
+}
+
+// Waits for the forwarded query on upstream; checks it went out without
+// its OPT record.
+Packet upstream_query(int upstream, const Packet &plain, sockaddr_in &from) {
+  const Packet f = receive(upstream, &from);
+  CHECK(f.size() == plain.size());
+  if (f.size() == plain.size()) {
+    CHECK(read_u16(f, 10) == 0);
+    CHECK(same_question(plain, f, plain.size()));
+  }
+  return f;
+}
+
+Packet answer_to(const Packet &f, std::size_t pad) {
+  Packet a = f;
+  a[2] |= 0x80;
+  a[7] = 1;
+  const uint8_t record[] = {0xc0, 12, 0, 1, 0, 1, 0, 0, 0, 60, 0, 4,
+                            93,   184, 216, 34};
+  a.insert(a.end(), record, record + sizeof(record));
+  a.resize(a.size() + pad, 0);
+  return a;
+}
+
+void reply_from(int upstream, const sockaddr_in &to, const Packet &p) {
+  sendto(upstream, p.data(), p.size(), 0,
+         reinterpret_cast<const sockaddr *>(&to), sizeof(to));
+}
+
+void test_forwarded(int client, uint16_t port, int upstream) {
+  const Packet plain = query(0x5000, "www.Example.org", type_a);
+  send_to(client, port, query(0x5000, "www.Example.org", type_a, 4096));
+  sockaddr_in from{};
+  const Packet f = upstream_query(upstream, plain, from);
+  if (f.size() != plain.size()) {
+    return;
+  }
+
+  // A reply from another port, and one with another ID, are not relayed.
+  const int spoofer = open_socket();
+  const Packet a = answer_to(f, 0);
+  reply_from(spoofer, from, a);
+  close(spoofer);
+  Packet wrong_id = a;
+  wrong_id[1] ^= 0xff;
+  reply_from(upstream, from, wrong_id);
+  CHECK(receive(client).empty());
+
+  reply_from(upstream, from, a);
+  const Packet r = receive(client);
+  CHECK(r.size() == a.size());
+  if (r.size() == a.size()) {
+    CHECK(read_u16(r, 0) == 0x5000);
+    CHECK(std::memcmp(r.data() + 2, a.data() + 2, a.size() - 2) == 0);
+  }
+  // Relayed once.
+  reply_from(upstream, from, a);
+  CHECK(receive(client).empty());
+}
+
+void test_forwarded_too_long(int client, uint16_t port, int upstream) {
+  const Packet plain = query(0x6000, "example.org", type_a);
+  send_to(client, port, plain);
+  sockaddr_in from{};
+  const Packet f = upstream_query(upstream, plain, from);
+  if (f.size() != plain.size()) {
+    return;
+  }
+  reply_from(upstream, from, answer_to(f, 600));
+  const Packet r = receive(client);
+  // Header and question, TC set.
+  CHECK(r.size() == plain.size());
+  if (r.size() == plain.size()) {
+    CHECK(read_u16(r, 0) == 0x6000);
+    CHECK((r[2] & 0x02) != 0);
+    CHECK(read_u16(r, 6) == 0);
+    CHECK(same_question(plain, r, plain.size()));
+  }
+}
+
+} // namespace
+
+int main() {
+  const int upstream = open_socket();
+  CaptiveDnsConfig config;
+  config.port = free_port();
+  config.passthrough = {"example.org."};
+  config.upstream = htonl(INADDR_LOOPBACK);
+  config.upstream_port = port_of(upstream);
+  if (captive_dns::start(config) != ESP_OK) {
+    std::fprintf(stderr, "captive_dns::start failed\n");
+    return 1;
+  }
+
+  const int client = open_socket();
+  test_redirected_a(client, config.port);
+  test_other_types(client, config.port);
+  test_malformed(client, config.port);
+  test_edns(client, config.port);
+  test_forwarded(client, config.port, upstream);
+  test_forwarded_too_long(client, config.port, upstream);
+
+  captive_dns::stop();
+  close(client);
+  close(upstream);
+  if (failures) {
+    std::fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  std::printf("captive_dns_test: ok\n");
+  return 0;
+}
@@ -0,0 +1,218 @@
+// Response compression test.
+//
+//   compression_test
+//
+// Feeds bodies through deflate::gzip and inflates the stream with zlib:
+// empty, longer than the match window, runs crossing output chunks, and
+// incompressible. Then serves requests through an in-process gateway with
+// compress_response installed and checks Content-Encoding and Vary on
+// gzipped and uncompressed responses. Prints each failed check and exits 1
+// when there was one.
+
+#include "deflate.hpp"
+#include "earbrain/gateway/gateway.hpp"
+#include "earbrain/gateway/middlewares/compression.hpp"
+#include "earbrain/host/server.hpp"
+
+#include <zlib.h>
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+namespace {
+
+using namespace earbrain;
+
+int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,   \
+                   #cond);                                                     \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (false)
+
+struct Collected {
+  std::string stream;
+  std::size_t pieces = 0;
+  std::size_t largest_piece = 0;
+};
+
+esp_err_t collect(void *ctx, const uint8_t *data, std::size_t len) {
+  auto *out = static_cast<Collected *>(ctx);
+  out->stream.append(reinterpret_cast<const char *>(data), len);
+  ++out->pieces;
+  out->largest_piece = len > out->largest_piece ? len : out->largest_piece;
+  return ESP_OK;
+}
+
+// The whole gzip member inflated, or false if zlib rejects it (including a
+// CRC or length mismatch in the trailer).
+bool inflate_gzip(const std::string &stream, std::string &out) {
+  z_stream z{};
+  if (inflateInit2(&z, 16 + MAX_WBITS) != Z_OK) {
+    return false;
+  }
+  z.next_in = reinterpret_cast<Bytef *>(const_cast<char *>(stream.data()));
+  z.avail_in = static_cast<uInt>(stream.size());
+  out.clear();
+  int status = Z_OK;
+  while (status == Z_OK) {
+    char buffer[1024];
+    z.next_out = reinterpret_cast<Bytef *>(buffer);
+    z.avail_out = sizeof(buffer);
+    status = inflate(&z, Z_NO_FLUSH);
+    out.append(buffer, sizeof(buffer) - z.avail_out);
+  }
+  const bool consumed = z.avail_in == 0;
+  inflateEnd(&z);
+  return status == Z_STREAM_END && consumed;
+}
+
+// Compresses body with each chain length and checks that zlib gets it back.
+void round_trip(const char *name, const std::string &body,
+                std::size_t *compressed_size = nullptr) {
+  for (const uint32_t max_chain : {1u, 8u, 64u}) {
+    Collected collected;
+    deflate::Result result;
+    const esp_err_t err =
+        deflate::gzip(reinterpret_cast<const uint8_t *>(body.data()),
+                      body.size(), max_chain, &collect, &collected, &result);
+    std::string inflated;
+    const bool ok = err == ESP_OK && inflate_gzip(collected.stream, inflated) &&
+                    inflated == body;
+    if (!ok) {
+      std::fprintf(stderr, "%s (max_chain %u): round trip failed\n", name,
+                   max_chain);
+    }
+    CHECK(ok);
+    CHECK(result.bytes_out == collected.stream.size());
+    CHECK(collected.largest_piece <= deflate::chunk_size);
+    if (compressed_size) {
+      *compressed_size = collected.stream.size();
+    }
+  }
+}
+
+void test_empty() { round_trip("empty", std::string{}); }
+
+// Log-like lines: repeats within and beyond the window, plus varying ids.
+void test_longer_than_window() {
+  std::string body;
+  for (int i = 0; body.size() < 5 * deflate::window_size; ++i) {
+    char line[96];
+    std::snprintf(line, sizeof(line),
+                  "{\"id\":%d,\"level\":\"info\",\"message\":\"entry %d\"},",
+                  i, i * 7919 % 1000);
+    body += line;
+  }
+  std::size_t compressed = 0;
+  round_trip("longer than window", body, &compressed);
+  CHECK(compressed < body.size() / 2);
+}
+
+// Long runs, so single matches cover many output bytes and cross chunk
+// boundaries, around literals and at the very end of the input.
+void test_runs_across_chunks() {
+  std::string body(3 * deflate::chunk_size + 17, 'a');
+  body += "boundary";
+  body += std::string(deflate::window_size + 300, 'b');
+  body += std::string(deflate::chunk_size - 1, 'a');
+  round_trip("runs", body);
+
+  std::string pattern;
+  for (int i = 0; pattern.size() < 4 * deflate::window_size; ++i) {
+    pattern += "abcdefghij"[i % 10];
+  }
+  round_trip("repeated pattern", pattern);
+}
+
+// Nothing to match: output larger than input must still decode.
+void test_incompressible() {
+  std::string body;
+  uint32_t state = 0x12345678;
+  for (std::size_t i = 0; i < 3 * deflate::window_size + 123; ++i) {
+    state = state * 1664525u + 1013904223u;
+    body += static_cast<char>(state >> 24);
+  }
+  round_trip("incompressible", body);
+}
+
+host::Response get(httpd_handle_t handle, const std::string &uri,
+                   bool accept_gzip) {
+  host::Request request;
+  request.uri = uri;
+  if (accept_gzip) {
+    request.headers.emplace_back("Accept-Encoding", "gzip, deflate");
+  }
+  host::Response response;
+  host::dispatch(handle, request, response);
+  return response;
+}
+
+bool varies(const host::Response &response) {
+  const std::string *vary = response.header("Vary");
+  return vary && *vary == "Accept-Encoding";
+}
+
+bool gzipped(const host::Response &response) {
+  const std::string *encoding = response.header("Content-Encoding");
+  return encoding && *encoding == "gzip";
+}
+
+// Inline (/api/v1/device) and coalesced (/api/v1/logs) responses.
+void test_vary(httpd_handle_t handle) {
+  for (const char *uri : {"/api/v1/device", "/api/v1/logs"}) {
+    middleware::configure_compression(middleware::CompressionConfig{});
+
+    // Not accepted, and accepted but below min_size: sent as is.
+    for (const bool accept_gzip : {false, true}) {
+      const host::Response plain = get(handle, uri, accept_gzip);
+      CHECK(plain.status == 200);
+      CHECK(!gzipped(plain));
+      CHECK(varies(plain));
+    }
+
+    middleware::CompressionConfig always;
+    always.min_size = 0;
+    middleware::configure_compression(always);
+    const host::Response compressed = get(handle, uri, true);
+    std::string body;
+    CHECK(compressed.status == 200);
+    CHECK(gzipped(compressed));
+    CHECK(varies(compressed));
+    CHECK(inflate_gzip(compressed.body, body) && body.front() == '{');
+  }
+  middleware::configure_compression(middleware::CompressionConfig{});
+}
+
+} // namespace
+
+int main() {
+  test_empty();
+  test_longer_than_window();
+  test_runs_across_chunks();
+  test_incompressible();
+
+  setenv("EARBRAIN_HOST_HTTP_PORT", "0", 1);
+  gateway().initialize(GatewayOptions{});
+  gateway().server().use(middleware::compress_response);
+  if (gateway().server().start() != ESP_OK) {
+    std::fprintf(stderr, "failed to start the in-process gateway\n");
+    return 1;
+  }
+  test_vary(host::last_started_server());
+  gateway().server().stop();
+
+  if (failures) {
+    std::fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  std::printf("compression_test: ok\n");
+  return 0;
+}
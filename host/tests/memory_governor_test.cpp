@@ -0,0 +1,159 @@
+// Memory governor test.
+//
+//   memory_governor_test
+//
+// Serves repeated requests through an in-process gateway with
+// memory_governor and heap_accounting installed, and checks that each
+// route's estimate is learned from its observed peaks and settles just
+// above them, for a light route (metrics) and a heavy one (a 24-network
+// scan), and that a request refused for want of memory allocates nothing.
+// Prints each failed check and exits 1 when there was one.
+
+#include "earbrain/gateway/gateway.hpp"
+#include "earbrain/gateway/middlewares/heap_accounting.hpp"
+#include "earbrain/gateway/middlewares/memory_governor.hpp"
+#include "earbrain/host/allocations.hpp"
+#include "earbrain/host/fakes.hpp"
+#include "earbrain/host/server.hpp"
+
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+using namespace earbrain;
+using namespace earbrain::middleware;
+
+constexpr int requests_per_route = 12;
+
+int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,   \
+                   #cond);                                                     \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (false)
+
+int get(httpd_handle_t handle, const std::string &uri) {
+  host::Request request;
+  request.uri = uri;
+  host::Response response;
+  host::dispatch(handle, request, response);
+  return response.status;
+}
+
+template <typename Stats>
+const Stats *find(const std::vector<Stats> &routes, const char *uri) {
+  for (const Stats &route : routes) {
+    if (route.uri == uri) {
+      return &route;
+    }
+  }
+  return nullptr;
+}
+
+std::size_t estimate_of(const char *uri) {
+  const MemoryGovernorStats stats = middleware::memory_governor_stats();
+  const RouteMemoryStats *route = find(stats.routes, uri);
+  return route && route->learned ? route->estimate : 0;
+}
+
+void test_converges(httpd_handle_t handle, const char *uri) {
+  std::size_t estimates[requests_per_route] = {};
+  for (int i = 0; i < requests_per_route; ++i) {
+    CHECK(get(handle, uri) == 200);
+    estimates[i] = estimate_of(uri);
+  }
+
+  const std::vector<RouteHeapStats> heap = middleware::heap_stats();
+  const RouteHeapStats *measured = find(heap, uri);
+  CHECK(measured != nullptr);
+  if (!measured) {
+    return;
+  }
+  std::printf("%s: peak %zu, estimates", uri, measured->peak_bytes);
+  for (const std::size_t estimate : estimates) {
+    std::printf(" %zu", estimate);
+  }
+  std::printf("\n");
+
+  // Every peak was exact, so the estimate comes from them rather than from
+  // default_estimate...
+  CHECK(measured->saturated == 0);
+  CHECK(estimates[0] != 0);
+  const std::size_t last = estimates[requests_per_route - 1];
+  CHECK(last != MemoryGovernorConfig{}.default_estimate);
+  // ...covers the largest one with the 1/8 margin to spare, at most...
+  CHECK(last >= measured->peak_bytes);
+  CHECK(last <= measured->peak_bytes + measured->peak_bytes / 8);
+  // ...and has stopped moving by more than the margin.
+  const std::size_t before = estimates[requests_per_route - 2];
+  CHECK(last + last / 8 >= before && before + before / 8 >= last);
+}
+
+host::HeapFigures exhausted_heap() { return {320 * 1024, 1024, 1024, 512}; }
+
+// Counts what the gateway allocates, leaving out the host httpd's own
+// bookkeeping, which has no heap counterpart on the device.
+class Counter final : public host::AllocationObserver {
+public:
+  void on_alloc(void *, std::size_t) override { ++allocations; }
+  void on_free(void *) override {}
+
+  std::atomic<uint64_t> allocations{0};
+};
+
+Counter counter;
+
+// Refused on a route the governor has not seen yet, and on one it has.
+void test_rejection_allocates_nothing(httpd_handle_t handle) {
+  host::set_heap_probe(&exhausted_heap);
+  for (const char *uri : {"/api/v1/device", "/api/v1/metrics"}) {
+    const uint64_t before = counter.allocations.load();
+    CHECK(get(handle, uri) == 503);
+    CHECK(counter.allocations.load() == before);
+  }
+  host::set_heap_probe(nullptr);
+
+  const MemoryGovernorStats stats = middleware::memory_governor_stats();
+  CHECK(find(stats.routes, "/api/v1/device") == nullptr);
+  const RouteMemoryStats *metrics = find(stats.routes, "/api/v1/metrics");
+  CHECK(metrics && metrics->rejected == 1);
+}
+
+} // namespace
+
+int main() {
+  setenv("EARBRAIN_HOST_HTTP_PORT", "0", 1);
+  host::ScanProfile scan;
+  scan.networks = 24;
+  host::set_scan_profile(scan);
+  host::set_allocation_observer(&counter);
+  gateway().initialize(GatewayOptions{});
+  gateway().server().use(middleware::memory_governor);
+  gateway().server().use(middleware::heap_accounting);
+  if (gateway().server().start() != ESP_OK) {
+    std::fprintf(stderr, "failed to start the in-process gateway\n");
+    return 1;
+  }
+  httpd_handle_t handle = host::last_started_server();
+
+  test_converges(handle, "/api/v1/metrics");
+  test_converges(handle, "/api/v1/wifi/scan");
+  test_rejection_allocates_nothing(handle);
+
+  gateway().server().stop();
+  // Background tasks outlive main; keep them off the destroyed counter.
+  host::set_allocation_observer(nullptr);
+  if (failures) {
+    std::fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  std::printf("memory_governor_test: ok\n");
+  return 0;
+}
@@ -0,0 +1,127 @@
+// Request tracing test.
+//
+//   tracing_test
+//
+// Serves requests through an in-process gateway with trace_request
+// installed and checks that every response carries the X-Trace-Id of the
+// trace recorded for it, including requests whose handler is detached and
+// answered after the middleware has returned. Prints each failed check and
+// exits 1 when there was one.
+
+#include "earbrain/gateway/gateway.hpp"
+#include "earbrain/gateway/middlewares/tracing.hpp"
+#include "earbrain/gateway/tracing.hpp"
+#include "earbrain/host/fakes.hpp"
+#include "earbrain/host/server.hpp"
+
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+
+namespace {
+
+using namespace earbrain;
+
+int failures = 0;
+
+#define CHECK(cond)                                                            \
+  do {                                                                         \
+    if (!(cond)) {                                                             \
+      std::fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__,   \
+                   #cond);                                                     \
+      ++failures;                                                              \
+    }                                                                          \
+  } while (false)
+
+host::Response get(httpd_handle_t handle, const std::string &uri) {
+  host::Request request;
+  request.uri = uri;
+  host::Response response;
+  host::dispatch(handle, request, response);
+  return response;
+}
+
+// Whether the response's X-Trace-Id names the trace recorded for path.
+bool traced(const host::Response &response, const char *path) {
+  const std::string *header = response.header("X-Trace-Id");
+  if (!header || header->size() != 8 ||
+      header->find_first_not_of("0123456789abcdef") != std::string::npos) {
+    return false;
+  }
+  const uint32_t id =
+      static_cast<uint32_t>(std::strtoul(header->c_str(), nullptr, 16));
+  tracing::SpanRecord spans[tracing::ring_capacity];
+  const std::size_t count = tracing::snapshot(spans, tracing::ring_capacity);
+  for (std::size_t i = 0; i < count; ++i) {
+    if (spans[i].trace_id == id && std::string{spans[i].name} == "request") {
+      return std::string{spans[i].detail}.rfind(path, 0) == 0;
+    }
+  }
+  return false;
+}
+
+void test_inline(httpd_handle_t handle) {
+  const host::Response response = get(handle, "/api/v1/device");
+  CHECK(response.status == 200);
+  CHECK(traced(response, "/api/v1/device"));
+}
+
+// Coalesced: answered from a singleflight worker.
+void test_coalesced(httpd_handle_t handle) {
+  for (int i = 0; i < 3; ++i) {
+    const host::Response response = get(handle, "/api/v1/logs");
+    CHECK(response.status == 200);
+    CHECK(traced(response, "/api/v1/logs"));
+  }
+}
+
+// On the async executor: the scan, with the handler resumed once it is done.
+void test_async_scan(httpd_handle_t handle) {
+  const host::Response response = get(handle, "/api/v1/wifi/scan");
+  CHECK(response.status == 200);
+  CHECK(traced(response, "/api/v1/wifi/scan"));
+}
+
+// Parked on the async executor until timeout_ms passes.
+void test_long_poll(httpd_handle_t handle) {
+  const host::Response first = get(handle, "/api/v1/wifi/status");
+  const std::string *version = first.header("X-Resource-Version");
+  CHECK(version != nullptr);
+  if (!version) {
+    return;
+  }
+  const host::Response response =
+      get(handle, "/api/v1/wifi/status?wait_for_change_since=" + *version +
+                      "&timeout_ms=150");
+  CHECK(response.status == 200);
+  CHECK(traced(response, "/api/v1/wifi/status"));
+}
+
+} // namespace
+
+int main() {
+  setenv("EARBRAIN_HOST_HTTP_PORT", "0", 1);
+  host::ScanProfile scan;
+  scan.latency_ms = 100;
+  host::set_scan_profile(scan);
+  gateway().initialize(GatewayOptions{});
+  gateway().server().use(middleware::trace_request);
+  if (gateway().server().start() != ESP_OK) {
+    std::fprintf(stderr, "failed to start the in-process gateway\n");
+    return 1;
+  }
+  httpd_handle_t handle = host::last_started_server();
+
+  test_inline(handle);
+  test_coalesced(handle);
+  test_async_scan(handle);
+  test_long_poll(handle);
+
+  gateway().server().stop();
+  if (failures) {
+    std::fprintf(stderr, "%d check(s) failed\n", failures);
+    return 1;
+  }
+  std::printf("tracing_test: ok\n");
+  return 0;
+}
@@ -0,0 +1,609 @@
+// Load generator for the gateway HTTP API.
+//
+//   gateway_loadgen [--url http://HOST:PORT] [--concurrency N] [--rate R]
+//                   [--duration S] [--mix NAME=W,...] [--timeout-ms N]
+//                   [--no-keepalive] [--scan-latency-ms N] [--json]
+//
+// Without --url an in-process host gateway is started on a free port, so the
+// tool measures the gateway code rather than the network. With --url it
+// drives any instance, including a device on the bench.
+//
+// Closed loop (default): N workers issue requests back to back.
+// Open loop (--rate): requests are scheduled at R per second across up to N
+// connections and latency is measured from the scheduled start, so a
+// stalled server shows up as latency instead of as a lower request rate.
+//
+// The mix is a weighted list of scenarios (see kScenarios); a page load is
+// the SPA document plus its two assets. Requests taking longer than
+// --timeout-ms (default 3000, the portal's fetch timeout) count as errors.
+
+#include "earbrain/gateway/gateway.hpp"
+#include "earbrain/host/fakes.hpp"
+#include "earbrain/host/server.hpp"
+
+#include <arpa/inet.h>
+#include <netdb.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+struct Step {
+  const char *method;
+  const char *path;
+  const char *body;
+};
+
+struct Scenario {
+  const char *name;
+  std::vector<Step> steps;
+};
+
+const std::vector<Scenario> kScenarios = {
+    {"page",
+     {{"GET", "/", nullptr},
+      {"GET", "/app.js", nullptr},
+      {"GET", "/assets/index.css", nullptr}}},
+    {"health", {{"GET", "/health", nullptr}}},
+    {"metrics", {{"GET", "/api/v1/metrics", nullptr}}},
+    {"status", {{"GET", "/api/v1/wifi/status", nullptr}}},
+    {"logs", {{"GET", "/api/v1/logs?limit=50", nullptr}}},
+    {"scan", {{"GET", "/api/v1/wifi/scan", nullptr}}},
+    {"credentials",
+     {{"POST", "/api/v1/wifi/credentials",
+       R"({"ssid":"loadgen-network","passphrase":"loadgen-passphrase"})"}}},
+};
+
+constexpr const char *kDefaultMix =
+    "page=1,health=4,metrics=4,status=4,logs=2,scan=1,credentials=1";
+
+struct Options {
+  std::string host = "127.0.0.1";
+  uint16_t port = 0;
+  bool in_process = true;
+  int concurrency = 4;
+  double rate = 0;
+  double duration_s = 10;
+  int timeout_ms = 3000;
+  bool keepalive = true;
+  uint32_t scan_latency_ms = 0;
+  bool json = false;
+  std::vector<std::pair<const Scenario *, double>> mix;
+};
+
+Options options;
+
+// --- HTTP client -------------------------------------------------------------
+
+enum class Outcome { ok, http_error, timeout, io_error };
+
+struct Connection {
+  int fd = -1;
+  std::string buffer;
+
+  ~Connection() { close(); }
+
+  void close() {
+    if (fd >= 0) {
+      ::close(fd);
+      fd = -1;
+    }
+    buffer.clear();
+  }
+};
+
+bool connect_to_server(Connection &conn) {
+  addrinfo hints{};
+  hints.ai_family = AF_INET;
+  hints.ai_socktype = SOCK_STREAM;
+  addrinfo *found = nullptr;
+  const std::string port = std::to_string(options.port);
+  if (::getaddrinfo(options.host.c_str(), port.c_str(), &hints, &found) != 0) {
+    return false;
+  }
+
+  conn.fd = ::socket(AF_INET, SOCK_STREAM, 0);
+  if (conn.fd < 0) {
+    ::freeaddrinfo(found);
+    return false;
+  }
+  const int one = 1;
+  ::setsockopt(conn.fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+  timeval tv{};
+  tv.tv_sec = options.timeout_ms / 1000;
+  tv.tv_usec = (options.timeout_ms % 1000) * 1000;
+  ::setsockopt(conn.fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+  ::setsockopt(conn.fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+  const bool ok = ::connect(conn.fd, found->ai_addr, found->ai_addrlen) == 0;
+  ::freeaddrinfo(found);
+  if (!ok) {
+    conn.close();
+  }
+  return ok;
+}
+
+// Reads until `conn.buffer` holds at least `size` bytes. 0 on success,
+// otherwise the failing errno (ECONNRESET on EOF).
+int fill(Connection &conn, std::size_t size) {
+  char chunk[4096];
+  while (conn.buffer.size() < size) {
+    const ssize_t n = ::recv(conn.fd, chunk, sizeof(chunk), 0);
+    if (n > 0) {
+      conn.buffer.append(chunk, static_cast<std::size_t>(n));
+    } else if (n == 0) {
+      return ECONNRESET;
+    } else if (errno != EINTR) {
+      return errno;
+    }
+  }
+  return 0;
+}
+
+int read_line(Connection &conn, std::string &line) {
+  std::size_t end;
+  while ((end = conn.buffer.find("\r\n")) == std::string::npos) {
+    if (const int err = fill(conn, conn.buffer.size() + 1)) {
+      return err;
+    }
+  }
+  line.assign(conn.buffer, 0, end);
+  conn.buffer.erase(0, end + 2);
+  return 0;
+}
+
+struct Reply {
+  int status = 0;
+  bool keepalive = true;
+};
+
+// Reads one response, discarding the body. 0 on success or an errno.
+int read_response(Connection &conn, Reply &reply) {
+  std::string line;
+  if (const int err = read_line(conn, line)) {
+    return err;
+  }
+  if (line.size() < 12 || line.compare(0, 5, "HTTP/") != 0) {
+    return EPROTO;
+  }
+  reply.status = std::atoi(line.c_str() + 9);
+  reply.keepalive = line.compare(0, 8, "HTTP/1.0") != 0;
+
+  std::size_t content_length = 0;
+  bool chunked = false;
+  for (;;) {
+    if (const int err = read_line(conn, line)) {
+      return err;
+    }
+    if (line.empty()) {
+      break;
+    }
+    const std::size_t colon = line.find(':');
+    if (colon == std::string::npos) {
+      continue;
+    }
+    std::string name = line.substr(0, colon);
+    std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+    std::string_view value(line);
+    value.remove_prefix(colon + 1);
+    while (!value.empty() && value.front() == ' ') {
+      value.remove_prefix(1);
+    }
+    if (name == "content-length") {
+      content_length = std::strtoul(std::string(value).c_str(), nullptr, 10);
+    } else if (name == "transfer-encoding") {
+      chunked = value.find("chunked") != std::string_view::npos;
+    } else if (name == "connection") {
+      reply.keepalive = value.find("close") == std::string_view::npos;
+    }
+  }
+
+  if (!chunked) {
+    if (const int err = fill(conn, content_length)) {
+      return err;
+    }
+    conn.buffer.erase(0, content_length);
+    return 0;
+  }
+
+  for (;;) {
+    if (const int err = read_line(conn, line)) {
+      return err;
+    }
+    const std::size_t size = std::strtoul(line.c_str(), nullptr, 16);
+    if (const int err = fill(conn, size + 2)) {
+      return err;
+    }
+    conn.buffer.erase(0, size + 2);
+    if (size == 0) {
+      return 0;
+    }
+  }
+}
+
+Outcome perform(Connection &conn, const Step &step) {
+  std::string request;
+  request.reserve(256);
+  request += step.method;
+  request += ' ';
+  request += step.path;
+  request += " HTTP/1.1\r\nHost: ";
+  request += options.host;
+  request += options.keepalive ? "\r\nConnection: keep-alive\r\n"
+                               : "\r\nConnection: close\r\n";
+  if (step.body) {
+    request += "Content-Type: application/json\r\nContent-Length: ";
+    request += std::to_string(std::strlen(step.body));
+    request += "\r\n\r\n";
+    request += step.body;
+  } else {
+    request += "\r\n";
+  }
+
+  // A reused connection may have been purged by the server (the httpd drops
+  // the least recently used socket when max_open_sockets is reached); retry
+  // once on a fresh one, as a browser would.
+  for (int attempt = 0; attempt < 2; ++attempt) {
+    const bool reused = conn.fd >= 0;
+    if (!reused && !connect_to_server(conn)) {
+      return Outcome::io_error;
+    }
+
+    Reply reply;
+    int err = 0;
+    if (::send(conn.fd, request.data(), request.size(), MSG_NOSIGNAL) !=
+        static_cast<ssize_t>(request.size())) {
+      err = errno ? errno : EIO;
+    } else {
+      err = read_response(conn, reply);
+    }
+
+    if (err == 0) {
+      if (!options.keepalive || !reply.keepalive) {
+        conn.close();
+      }
+      return reply.status >= 200 && reply.status < 400 ? Outcome::ok
+                                                       : Outcome::http_error;
+    }
+
+    conn.close();
+    if (err == EAGAIN || err == EWOULDBLOCK) {
+      return Outcome::timeout;
+    }
+    if (!reused) {
+      return Outcome::io_error;
+    }
+  }
+  return Outcome::io_error;
+}
+
+// --- statistics ---------------------------------------------------------------
+
+struct RouteStats {
+  std::vector<uint32_t> latencies_us;
+  uint64_t http_errors = 0;
+  uint64_t timeouts = 0;
+  uint64_t io_errors = 0;
+
+  void merge(const RouteStats &other) {
+    latencies_us.insert(latencies_us.end(), other.latencies_us.begin(),
+                        other.latencies_us.end());
+    http_errors += other.http_errors;
+    timeouts += other.timeouts;
+    io_errors += other.io_errors;
+  }
+
+  uint64_t total() const {
+    return latencies_us.size() + timeouts + io_errors;
+  }
+};
+
+using StatsTable = std::map<std::string, RouteStats>;
+
+std::string route_key(const Step &step) {
+  std::string key = step.method;
+  key += ' ';
+  const char *query = std::strchr(step.path, '?');
+  key.append(step.path, query ? query - step.path : std::strlen(step.path));
+  return key;
+}
+
+double percentile_ms(const std::vector<uint32_t> &sorted, double p) {
+  if (sorted.empty()) {
+    return 0;
+  }
+  const std::size_t index = std::min(
+      sorted.size() - 1,
+      static_cast<std::size_t>(p * static_cast<double>(sorted.size())));
+  return sorted[index] / 1000.0;
+}
+
+// --- workers ------------------------------------------------------------------
+
+const Scenario &pick(std::mt19937 &rng) {
+  double total = 0;
+  for (const auto &[scenario, weight] : options.mix) {
+    total += weight;
+  }
+  double roll = std::uniform_real_distribution<double>(0, total)(rng);
+  for (const auto &[scenario, weight] : options.mix) {
+    if (roll < weight) {
+      return *scenario;
+    }
+    roll -= weight;
+  }
+  return *options.mix.back().first;
+}
+
+struct Shared {
+  Clock::time_point start;
+  Clock::time_point deadline;
+  std::atomic<uint64_t> next_ticket{0};
+  std::mutex mutex;
+  StatsTable stats;
+};
+
+void run_worker(Shared &shared, unsigned seed) {
+  std::mt19937 rng(seed);
+  Connection conn;
+  StatsTable local;
+
+  for (;;) {
+    Clock::time_point scheduled = Clock::now();
+    if (options.rate > 0) {
+      const uint64_t ticket = shared.next_ticket.fetch_add(1);
+      scheduled = shared.start +
+                  std::chrono::duration_cast<Clock::duration>(
+                      std::chrono::duration<double>(ticket / options.rate));
+      if (scheduled >= shared.deadline) {
+        break;
+      }
+      std::this_thread::sleep_until(scheduled);
+    } else if (scheduled >= shared.deadline) {
+      break;
+    }
+
+    // Steps of a scenario run back to back on one connection; in open loop
+    // only the first carries the queueing delay.
+    for (const Step &step : pick(rng).steps) {
+      const Outcome outcome = perform(conn, step);
+      const auto done = Clock::now();
+      RouteStats &stats = local[route_key(step)];
+      switch (outcome) {
+      case Outcome::http_error:
+        ++stats.http_errors;
+        [[fallthrough]];
+      case Outcome::ok:
+        stats.latencies_us.push_back(static_cast<uint32_t>(
+            std::chrono::duration_cast<std::chrono::microseconds>(done -
+                                                                  scheduled)
+                .count()));
+        break;
+      case Outcome::timeout:
+        ++stats.timeouts;
+        break;
+      case Outcome::io_error:
+        ++stats.io_errors;
+        break;
+      }
+      scheduled = done;
+    }
+  }
+
+  std::lock_guard lock(shared.mutex);
+  for (const auto &[key, stats] : local) {
+    shared.stats[key].merge(stats);
+  }
+}
+
+// --- reporting ----------------------------------------------------------------
+
+void report(StatsTable &table, double elapsed_s) {
+  RouteStats all;
+  for (auto &[key, stats] : table) {
+    std::sort(stats.latencies_us.begin(), stats.latencies_us.end());
+    all.merge(stats);
+  }
+  std::sort(all.latencies_us.begin(), all.latencies_us.end());
+
+  const auto line = [&](const std::string &name, const RouteStats &stats) {
+    const uint64_t total = stats.total();
+    const uint64_t errors = stats.http_errors + stats.timeouts + stats.io_errors;
+    const double error_rate =
+        total ? static_cast<double>(errors) / static_cast<double>(total) : 0;
+    const double rps = static_cast<double>(total) / elapsed_s;
+    const auto &lat = stats.latencies_us;
+    if (options.json) {
+      std::printf("{\"route\":\"%s\",\"requests\":%llu,\"rps\":%.1f,"
+                  "\"p50_ms\":%.2f,\"p99_ms\":%.2f,\"p999_ms\":%.2f,"
+                  "\"max_ms\":%.2f,\"http_errors\":%llu,\"timeouts\":%llu,"
+                  "\"io_errors\":%llu,\"error_rate\":%.4f}\n",
+                  name.c_str(), static_cast<unsigned long long>(total), rps,
+                  percentile_ms(lat, 0.50), percentile_ms(lat, 0.99),
+                  percentile_ms(lat, 0.999), lat.empty() ? 0 : lat.back() / 1000.0,
+                  static_cast<unsigned long long>(stats.http_errors),
+                  static_cast<unsigned long long>(stats.timeouts),
+                  static_cast<unsigned long long>(stats.io_errors), error_rate);
+    } else {
+      std::printf("%-30s %8llu %8.1f %9.2f %9.2f %9.2f %9.2f %7.2f%%\n",
+                  name.c_str(), static_cast<unsigned long long>(total), rps,
+                  percentile_ms(lat, 0.50), percentile_ms(lat, 0.99),
+                  percentile_ms(lat, 0.999), lat.empty() ? 0 : lat.back() / 1000.0,
+                  error_rate * 100);
+    }
+  };
+
+  if (!options.json) {
+    std::printf("%-30s %8s %8s %9s %9s %9s %9s %8s\n", "route", "requests",
+                "rps", "p50 ms", "p99 ms", "p99.9 ms", "max ms", "errors");
+  }
+  for (const auto &[key, stats] : table) {
+    line(key, stats);
+  }
+  line("all", all);
+}
+
+// --- command line ---------------------------------------------------------------
+
+bool parse_mix(std::string_view text) {
+  options.mix.clear();
+  while (!text.empty()) {
+    const std::size_t comma = text.find(',');
+    const std::string_view item = text.substr(0, comma);
+    text = comma == std::string_view::npos ? std::string_view{}
+                                           : text.substr(comma + 1);
+
+    const std::size_t eq = item.find('=');
+    const std::string_view name = item.substr(0, eq);
+    const double weight =
+        eq == std::string_view::npos
+            ? 1.0
+            : std::strtod(std::string(item.substr(eq + 1)).c_str(), nullptr);
+    const auto found =
+        std::find_if(kScenarios.begin(), kScenarios.end(),
+                     [&](const Scenario &s) { return name == s.name; });
+    if (found == kScenarios.end() || weight < 0) {
+      std::fprintf(stderr, "unknown scenario in mix: %.*s\n",
+                   static_cast<int>(name.size()), name.data());
+      return false;
+    }
+    if (weight > 0) {
+      options.mix.emplace_back(&*found, weight);
+    }
+  }
+  return !options.mix.empty();
+}
+
+bool parse_url(std::string_view url) {
+  constexpr std::string_view scheme = "http://";
+  if (url.substr(0, scheme.size()) != scheme) {
+    std::fprintf(stderr, "only http:// URLs are supported\n");
+    return false;
+  }
+  url.remove_prefix(scheme.size());
+  url = url.substr(0, url.find('/'));
+  const std::size_t colon = url.find(':');
+  options.host = std::string(url.substr(0, colon));
+  options.port =
+      colon == std::string_view::npos
+          ? 80
+          : static_cast<uint16_t>(
+                std::atoi(std::string(url.substr(colon + 1)).c_str()));
+  options.in_process = false;
+  return !options.host.empty() && options.port != 0;
+}
+
+void usage(const char *argv0) {
+  std::fprintf(stderr,
+               "usage: %s [--url http://HOST:PORT] [--concurrency N] "
+               "[--rate R]\n"
+               "          [--duration S] [--mix NAME=W,...] [--timeout-ms N]\n"
+               "          [--no-keepalive] [--scan-latency-ms N] [--json]\n"
+               "scenarios:",
+               argv0);
+  for (const Scenario &scenario : kScenarios) {
+    std::fprintf(stderr, " %s", scenario.name);
+  }
+  std::fprintf(stderr, "\ndefault mix: %s\n", kDefaultMix);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  parse_mix(kDefaultMix);
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--url" && has_value) {
+      if (!parse_url(argv[++i])) {
+        return 2;
+      }
+    } else if (arg == "--concurrency" && has_value) {
+      options.concurrency = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--rate" && has_value) {
+      options.rate = std::atof(argv[++i]);
+    } else if (arg == "--duration" && has_value) {
+      options.duration_s = std::atof(argv[++i]);
+    } else if (arg == "--mix" && has_value) {
+      if (!parse_mix(argv[++i])) {
+        usage(argv[0]);
+        return 2;
+      }
+    } else if (arg == "--timeout-ms" && has_value) {
+      options.timeout_ms = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--no-keepalive") {
+      options.keepalive = false;
+    } else if (arg == "--scan-latency-ms" && has_value) {
+      options.scan_latency_ms = static_cast<uint32_t>(std::atoi(argv[++i]));
+    } else if (arg == "--json") {
+      options.json = true;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  if (options.in_process) {
+    setenv("EARBRAIN_HOST_HTTP_PORT", "0", 1);
+    earbrain::host::ScanProfile scan;
+    scan.latency_ms = options.scan_latency_ms;
+    earbrain::host::set_scan_profile(scan);
+    earbrain::gateway().initialize(earbrain::GatewayOptions{});
+    if (earbrain::gateway().server().start() != ESP_OK) {
+      std::fprintf(stderr, "failed to start the in-process gateway\n");
+      return 1;
+    }
+    options.port =
+        earbrain::host::bound_port(earbrain::host::last_started_server());
+  }
+
+  std::fprintf(stderr, "target %s:%u, %s, %d connections, %.0f s\n",
+               options.host.c_str(), options.port,
+               options.rate > 0
+                   ? ("open loop at " + std::to_string(options.rate) + " req/s")
+                         .c_str()
+                   : "closed loop",
+               options.concurrency, options.duration_s);
+
+  Shared shared;
+  shared.start = Clock::now();
+  shared.deadline = shared.start + std::chrono::duration_cast<Clock::duration>(
+                                       std::chrono::duration<double>(
+                                           options.duration_s));
+
+  std::vector<std::thread> workers;
+  for (int i = 0; i < options.concurrency; ++i) {
+    workers.emplace_back(run_worker, std::ref(shared), 0x9e3779b9u + i);
+  }
+  for (auto &worker : workers) {
+    worker.join();
+  }
+  const double elapsed_s =
+      std::chrono::duration<double>(Clock::now() - shared.start).count();
+
+  report(shared.stats, elapsed_s);
+
+  if (options.in_process) {
+    earbrain::gateway().server().stop();
+  }
+  return 0;
+}
@@ -0,0 +1,360 @@
+// Replays a traffic capture against the host gateway.
+//
+//   gateway_replay CAPTURE.bin [--speed X] [--workers N] [--loop N]
+//                  [--scan-latency-ms N] [--json]
+//
+// CAPTURE.bin is the download of GET /api/v1/capture (see
+// earbrain/gateway/capture.hpp), e.g. from a device in the field:
+//   curl -o capture.bin http://192.168.4.1/api/v1/capture
+//
+// Requests are issued at their recorded offsets divided by --speed
+// (1 = original timing, 0 = back to back) through in-process dispatch, from
+// up to --workers threads so overlapping requests overlap again. Bodies are
+// not captured; a body of the recorded size is synthesised (credential-shaped
+// for the credentials route). The report gives per-route latency and how
+// many replayed statuses differ from the captured ones.
+
+#include "earbrain/gateway/capture.hpp"
+#include "earbrain/gateway/gateway.hpp"
+#include "earbrain/host/fakes.hpp"
+#include "earbrain/host/server.hpp"
+#include "http_method.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <iterator>
+#include <map>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace {
+
+using namespace earbrain;
+using Clock = std::chrono::steady_clock;
+
+struct Record {
+  httpd_method_t method = HTTP_GET;
+  uint8_t flags = 0;
+  uint32_t start_ms = 0;
+  uint32_t duration_us = 0;
+  uint16_t status = 0;
+  uint32_t body_size = 0;
+  std::string uri;
+  host::HeaderList headers;
+};
+
+struct Capture {
+  uint32_t dropped = 0;
+  std::vector<Record> records;
+};
+
+class Reader {
+public:
+  Reader(const uint8_t *data, std::size_t size) : data(data), size(size) {}
+
+  bool ok() const { return !failed; }
+  std::size_t offset() const { return at; }
+  void seek(std::size_t to) {
+    at = to;
+    failed = failed || to > size;
+  }
+
+  uint8_t u8() {
+    if (at + 1 > size) {
+      failed = true;
+      return 0;
+    }
+    return data[at++];
+  }
+  uint16_t u16() {
+    const uint16_t lo = u8();
+    return static_cast<uint16_t>(lo | (u8() << 8));
+  }
+  uint32_t u32() {
+    const uint32_t lo = u16();
+    return lo | (static_cast<uint32_t>(u16()) << 16);
+  }
+  std::string bytes(std::size_t len) {
+    if (at + len > size) {
+      failed = true;
+      return {};
+    }
+    std::string out(reinterpret_cast<const char *>(data + at), len);
+    at += len;
+    return out;
+  }
+
+private:
+  const uint8_t *data;
+  std::size_t size;
+  std::size_t at = 0;
+  bool failed = false;
+};
+
+bool load_capture(const char *path, Capture &capture) {
+  std::ifstream in(path, std::ios::binary);
+  const std::vector<uint8_t> data{std::istreambuf_iterator<char>(in),
+                                  std::istreambuf_iterator<char>()};
+  Reader reader(data.data(), data.size());
+
+  if (reader.bytes(4) != "EBCP" || reader.u8() != capture::format_version) {
+    std::fprintf(stderr, "%s: not a version %u capture\n", path,
+                 capture::format_version);
+    return false;
+  }
+  reader.u8();
+  const uint16_t header_size = reader.u16();
+  capture.dropped = reader.u32();
+  reader.u32(); // export time
+  reader.seek(header_size);
+
+  while (reader.ok() && reader.offset() < data.size()) {
+    const std::size_t start = reader.offset();
+    const uint16_t size = reader.u16();
+    Record record;
+    record.method = static_cast<httpd_method_t>(reader.u8());
+    record.flags = reader.u8();
+    record.start_ms = reader.u32();
+    record.duration_us = reader.u32();
+    record.status = reader.u16();
+    record.body_size = reader.u32();
+    record.uri = reader.bytes(reader.u8());
+    const uint8_t header_count = reader.u8();
+    for (uint8_t i = 0; i < header_count && reader.ok(); ++i) {
+      const uint8_t id = reader.u8();
+      std::string value = reader.bytes(reader.u8());
+      if (id < capture::captured_header_count) {
+        record.headers.emplace_back(capture::captured_headers[id],
+                                    std::move(value));
+      }
+    }
+    if (!reader.ok() || size < 2) {
+      break;
+    }
+    reader.seek(start + size); // skips fields added by later versions
+    if (!record.uri.empty()) {
+      capture.records.push_back(std::move(record));
+    }
+  }
+
+  if (!reader.ok()) {
+    std::fprintf(stderr, "%s: truncated record, replaying %zu records\n", path,
+                 capture.records.size());
+  }
+  return true;
+}
+
+// Bodies are not captured. The credentials route gets a payload stretched to
+// the recorded size that is valid or not as the original was (judged by the
+// captured status), so it takes the same path; everything else gets a JSON
+// string of the right size.
+std::string synthesise_body(const Record &record) {
+  if (record.body_size == 0) {
+    return {};
+  }
+  const std::string_view path =
+      std::string_view(record.uri).substr(0, record.uri.find('?'));
+  if (path == "/api/v1/wifi/credentials" && record.status >= 400 &&
+      record.status < 500) {
+    return R"({"ssid":"replay"})";
+  }
+  if (path == "/api/v1/wifi/credentials") {
+    const std::string prefix = R"({"ssid":"replay","passphrase":")";
+    const std::string suffix = R"("})";
+    const std::size_t fixed = prefix.size() + suffix.size();
+    const std::size_t passphrase =
+        std::clamp<std::size_t>(record.body_size > fixed ? record.body_size - fixed : 0,
+                                8, 63);
+    return prefix + std::string(passphrase, 'p') + suffix;
+  }
+  if (record.body_size < 2) {
+    return std::string(record.body_size, ' ');
+  }
+  return "\"" + std::string(record.body_size - 2, 'x') + "\"";
+}
+
+struct Options {
+  const char *path = nullptr;
+  double speed = 1;
+  int workers = 4;
+  int loops = 1;
+  uint32_t scan_latency_ms = 0;
+  bool json = false;
+};
+
+Options options;
+
+struct RouteStats {
+  std::vector<uint32_t> latencies_us;
+  std::vector<uint32_t> captured_us;
+  uint64_t status_mismatches = 0;
+};
+
+double percentile_ms(std::vector<uint32_t> &values, double p) {
+  if (values.empty()) {
+    return 0;
+  }
+  std::sort(values.begin(), values.end());
+  const std::size_t index = std::min(
+      values.size() - 1,
+      static_cast<std::size_t>(p * static_cast<double>(values.size())));
+  return values[index] / 1000.0;
+}
+
+void usage(const char *argv0) {
+  std::fprintf(stderr,
+               "usage: %s CAPTURE.bin [--speed X] [--workers N] [--loop N]\n"
+               "          [--scan-latency-ms N] [--json]\n",
+               argv0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--speed" && has_value) {
+      options.speed = std::max(0.0, std::atof(argv[++i]));
+    } else if (arg == "--workers" && has_value) {
+      options.workers = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--loop" && has_value) {
+      options.loops = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--scan-latency-ms" && has_value) {
+      options.scan_latency_ms = static_cast<uint32_t>(std::atoi(argv[++i]));
+    } else if (arg == "--json") {
+      options.json = true;
+    } else if (!options.path && arg.substr(0, 2) != "--") {
+      options.path = argv[i];
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (!options.path) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  Capture capture;
+  if (!load_capture(options.path, capture)) {
+    return 1;
+  }
+  if (capture.records.empty()) {
+    std::fprintf(stderr, "%s: no records\n", options.path);
+    return 1;
+  }
+  std::fprintf(stderr, "%zu records (%u dropped on the device), span %.1f s\n",
+               capture.records.size(), capture.dropped,
+               (capture.records.back().start_ms - capture.records.front().start_ms) /
+                   1000.0);
+
+  setenv("EARBRAIN_HOST_HTTP_PORT", "0", 1);
+  host::ScanProfile scan;
+  scan.latency_ms = options.scan_latency_ms;
+  host::set_scan_profile(scan);
+  gateway().initialize(GatewayOptions{});
+  if (gateway().server().start() != ESP_OK) {
+    std::fprintf(stderr, "failed to start the in-process gateway\n");
+    return 1;
+  }
+  httpd_handle_t handle = host::last_started_server();
+
+  // Schedule: every record at its offset from the first one, per loop.
+  const uint32_t first_ms = capture.records.front().start_ms;
+  const uint32_t span_ms = capture.records.back().start_ms - first_ms + 1;
+  const std::size_t total = capture.records.size() * options.loops;
+
+  std::atomic<std::size_t> next{0};
+  std::mutex stats_mutex;
+  std::map<std::string, RouteStats> stats;
+  const Clock::time_point start = Clock::now();
+
+  const auto worker = [&] {
+    for (;;) {
+      const std::size_t n = next.fetch_add(1);
+      if (n >= total) {
+        return;
+      }
+      const Record &record = capture.records[n % capture.records.size()];
+      const std::size_t loop = n / capture.records.size();
+
+      Clock::time_point scheduled = Clock::now();
+      if (options.speed > 0) {
+        const double offset_ms =
+            (static_cast<double>(loop) * span_ms + (record.start_ms - first_ms)) /
+            options.speed;
+        scheduled = start + std::chrono::duration_cast<Clock::duration>(
+                                std::chrono::duration<double, std::milli>(offset_ms));
+        std::this_thread::sleep_until(scheduled);
+      }
+
+      host::Request request;
+      request.method = record.method;
+      request.uri = record.uri;
+      request.headers = record.headers;
+      request.body = synthesise_body(record);
+      host::Response response;
+      host::dispatch(handle, request, response);
+      const auto latency = std::chrono::duration_cast<std::chrono::microseconds>(
+          Clock::now() - scheduled);
+
+      std::string key = http::method_str(record.method);
+      key += ' ';
+      key += record.uri.substr(0, record.uri.find('?'));
+      std::lock_guard lock(stats_mutex);
+      RouteStats &route = stats[key];
+      route.latencies_us.push_back(static_cast<uint32_t>(latency.count()));
+      route.captured_us.push_back(record.duration_us);
+      if (record.status != 0 && response.status != record.status) {
+        ++route.status_mismatches;
+      }
+    }
+  };
+
+  std::vector<std::thread> threads;
+  for (int i = 0; i < options.workers; ++i) {
+    threads.emplace_back(worker);
+  }
+  for (auto &thread : threads) {
+    thread.join();
+  }
+  const double elapsed_s =
+      std::chrono::duration<double>(Clock::now() - start).count();
+  gateway().server().stop();
+
+  if (!options.json) {
+    std::printf("%-30s %8s %10s %10s %12s %12s %10s\n", "route", "requests",
+                "p50 ms", "p99 ms", "capt p50 ms", "capt p99 ms", "mismatch");
+  }
+  uint64_t mismatches = 0;
+  for (auto &[key, route] : stats) {
+    mismatches += route.status_mismatches;
+    const std::size_t count = route.latencies_us.size();
+    const double p50 = percentile_ms(route.latencies_us, 0.50);
+    const double p99 = percentile_ms(route.latencies_us, 0.99);
+    const double cap50 = percentile_ms(route.captured_us, 0.50);
+    const double cap99 = percentile_ms(route.captured_us, 0.99);
+    if (options.json) {
+      std::printf("{\"route\":\"%s\",\"requests\":%zu,\"p50_ms\":%.3f,"
+                  "\"p99_ms\":%.3f,\"captured_p50_ms\":%.3f,"
+                  "\"captured_p99_ms\":%.3f,\"status_mismatches\":%llu}\n",
+                  key.c_str(), count, p50, p99, cap50, cap99,
+                  static_cast<unsigned long long>(route.status_mismatches));
+    } else {
+      std::printf("%-30s %8zu %10.3f %10.3f %12.3f %12.3f %10llu\n",
+                  key.c_str(), count, p50, p99, cap50, cap99,
+                  static_cast<unsigned long long>(route.status_mismatches));
+    }
+  }
+  std::fprintf(stderr, "replayed %zu requests in %.2f s, %llu status mismatches\n",
+               total, elapsed_s, static_cast<unsigned long long>(mismatches));
+  return 0;
+}
@@ -0,0 +1,621 @@
+// Heap fragmentation soak test.
+//
+//   gateway_soak [--hours H] [--regions KIB,KIB,...] [--session-interval-min M]
+//                [--sample-interval-s S] [--warmup-min M]
+//                [--max-fragmentation F] [--max-fragmentation-slope F]
+//                [--max-free-drop B] [--samples FILE] [--seed N]
+//
+// Replays hours of simulated portal traffic against an in-process host
+// gateway on a virtual clock, so a day of traffic takes seconds. Every
+// allocation the gateway makes is mirrored into a model of the ESP-IDF heap
+// (a few fixed DRAM regions, best-fit with coalescing and per-block
+// overhead), and the model backs heap_caps_* / collect_metrics(), so the
+// samples use the same heap_free and heap_largest_free_block fields as
+// /api/v1/metrics.
+//
+// Each live block is attributed to the route whose request allocated it, so
+// memory retained across requests shows up as growth of that route. The
+// warm-up (default 30 min) covers start-up and the log ring filling up.
+// The run fails (exit 1) when, after the warm-up:
+//   - fragmentation (1 - largest_free_block / heap_free) ends above
+//     --max-fragmentation or trends up faster than --max-fragmentation-slope
+//     per hour,
+//   - heap_free trends down faster than --max-free-drop bytes per hour,
+//   - or the model runs out of memory.
+//
+// Sizes are host sizes: pointer-heavy structures are larger on a 64-bit host
+// than on the device, so trends matter more than absolute figures.
+
+#include "earbrain/gateway/gateway.hpp"
+#include "earbrain/gateway/http_server.hpp"
+#include "earbrain/host/allocations.hpp"
+#include "earbrain/host/fakes.hpp"
+#include "earbrain/host/server.hpp"
+#include "earbrain/logging.hpp"
+#include "earbrain/metrics.hpp"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <mutex>
+#include <random>
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+namespace {
+
+using namespace earbrain;
+
+// --- heap model ----------------------------------------------------------------
+
+// Names of allocation owners (routes). Kept apart from the model so that
+// registering a name, which allocates, never runs under the model's lock.
+class OwnerRegistry {
+public:
+  static constexpr std::size_t capacity = 64;
+
+  // Index for `name`, registering it on first use. Overflow shares the last
+  // slot.
+  std::size_t index(std::string_view name) {
+    const host::TrackingScope untracked(false);
+    std::lock_guard lock(mutex);
+    for (std::size_t i = 0; i < names.size(); ++i) {
+      if (names[i] == name) {
+        return i;
+      }
+    }
+    if (names.size() == capacity - 1) {
+      names.emplace_back("(other)");
+    }
+    if (names.size() == capacity) {
+      return capacity - 1;
+    }
+    names.emplace_back(name);
+    return names.size() - 1;
+  }
+
+  std::vector<std::string> snapshot() {
+    const host::TrackingScope untracked(false);
+    std::lock_guard lock(mutex);
+    return names;
+  }
+
+private:
+  std::mutex mutex;
+  std::vector<std::string> names;
+};
+
+OwnerRegistry owners;
+
+// Approximates multi_heap/TLSF: blocks carry a header and are 4-byte
+// aligned with a minimum size; free blocks coalesce with their neighbours.
+// Best fit stands in for TLSF's good fit.
+class HeapModel final : public host::AllocationObserver {
+public:
+  static constexpr std::size_t block_overhead = 8;
+  static constexpr std::size_t min_block = 16;
+
+  explicit HeapModel(const std::vector<std::size_t> &region_sizes) {
+    for (std::size_t size : region_sizes) {
+      Region region;
+      region.size = size;
+      region.free_blocks.emplace(0, size);
+      regions.push_back(std::move(region));
+      total += size;
+    }
+    free_bytes = total;
+    min_free = total;
+  }
+
+  // Attributes allocations on the calling thread to owner `index` (see
+  // OwnerRegistry) until changed.
+  static void set_owner(std::size_t index) { current_owner = index; }
+
+  void on_alloc(void *ptr, std::size_t size) override {
+    const std::size_t need =
+        std::max(min_block, ((size + 3) & ~std::size_t{3}) + block_overhead);
+
+    std::lock_guard lock(mutex);
+    Region *best_region = nullptr;
+    std::map<std::size_t, std::size_t>::iterator best;
+    for (Region &region : regions) {
+      for (auto it = region.free_blocks.begin(); it != region.free_blocks.end();
+           ++it) {
+        if (it->second >= need &&
+            (!best_region || it->second < best->second)) {
+          best_region = &region;
+          best = it;
+        }
+      }
+    }
+    if (!best_region) {
+      ++failed_allocations;
+      return;
+    }
+
+    const std::size_t offset = best->first;
+    const std::size_t remaining = best->second - need;
+    best_region->free_blocks.erase(best);
+    // Splinters too small to hold a block stay with the allocation.
+    const std::size_t taken = remaining < min_block ? need + remaining : need;
+    if (remaining >= min_block) {
+      best_region->free_blocks.emplace(offset + need, remaining);
+    }
+
+    const std::size_t owner = current_owner;
+    blocks[ptr] = Block{static_cast<std::size_t>(best_region - regions.data()),
+                        offset, taken, owner};
+    free_bytes -= taken;
+    min_free = std::min(min_free, free_bytes);
+    owner_stats[owner].live_bytes += taken;
+    ++owner_stats[owner].live_blocks;
+  }
+
+  void on_free(void *ptr) override {
+    std::lock_guard lock(mutex);
+    const auto found = blocks.find(ptr);
+    if (found == blocks.end()) {
+      return;
+    }
+    const Block block = found->second;
+    blocks.erase(found);
+
+    free_bytes += block.size;
+    owner_stats[block.owner].live_bytes -= block.size;
+    --owner_stats[block.owner].live_blocks;
+
+    auto &free_blocks = regions[block.region].free_blocks;
+    std::size_t offset = block.offset;
+    std::size_t size = block.size;
+    auto next = free_blocks.lower_bound(offset);
+    if (next != free_blocks.end() && offset + size == next->first) {
+      size += next->second;
+      next = free_blocks.erase(next);
+    }
+    if (next != free_blocks.begin()) {
+      auto prev = std::prev(next);
+      if (prev->first + prev->second == offset) {
+        offset = prev->first;
+        size += prev->second;
+        free_blocks.erase(prev);
+      }
+    }
+    free_blocks.emplace(offset, size);
+  }
+
+  host::HeapFigures figures() {
+    std::lock_guard lock(mutex);
+    std::size_t largest = 0;
+    for (const Region &region : regions) {
+      for (const auto &[offset, size] : region.free_blocks) {
+        largest = std::max(largest, size);
+      }
+    }
+    // heap_caps_get_largest_free_block reports usable bytes.
+    largest = largest > block_overhead ? largest - block_overhead : 0;
+    return host::HeapFigures{total, free_bytes, min_free, largest};
+  }
+
+  struct OwnerFigures {
+    std::string name;
+    std::size_t live_bytes = 0;
+    std::size_t live_blocks = 0;
+  };
+
+  std::vector<OwnerFigures> owner_figures() {
+    // Copied out first: allocating under the lock would re-enter on_alloc.
+    OwnerStats copy[OwnerRegistry::capacity];
+    {
+      std::lock_guard lock(mutex);
+      std::copy(std::begin(owner_stats), std::end(owner_stats), copy);
+    }
+    const std::vector<std::string> names = owners.snapshot();
+    std::vector<OwnerFigures> out;
+    for (std::size_t i = 0; i < names.size(); ++i) {
+      out.push_back({names[i], copy[i].live_bytes, copy[i].live_blocks});
+    }
+    return out;
+  }
+
+  uint64_t failures() {
+    std::lock_guard lock(mutex);
+    return failed_allocations;
+  }
+
+private:
+  struct Region {
+    std::size_t size = 0;
+    std::map<std::size_t, std::size_t> free_blocks; // offset -> size
+  };
+
+  struct Block {
+    std::size_t region;
+    std::size_t offset;
+    std::size_t size;
+    std::size_t owner;
+  };
+
+  struct OwnerStats {
+    std::size_t live_bytes = 0;
+    std::size_t live_blocks = 0;
+  };
+
+  static thread_local std::size_t current_owner;
+
+  std::mutex mutex;
+  std::vector<Region> regions;
+  std::unordered_map<void *, Block> blocks;
+  OwnerStats owner_stats[OwnerRegistry::capacity];
+  std::size_t total = 0;
+  std::size_t free_bytes = 0;
+  std::size_t min_free = 0;
+  uint64_t failed_allocations = 0;
+};
+
+thread_local std::size_t HeapModel::current_owner = 0;
+
+HeapModel *model = nullptr;
+std::atomic<int64_t> virtual_us{0};
+
+host::HeapFigures model_figures() { return model->figures(); }
+int64_t virtual_clock() { return virtual_us.load(); }
+
+// Tags the allocations of each request with its route.
+std::size_t background_owner = 0;
+
+esp_err_t attribute_route(httpd_req_t *req, NextHandler next) {
+  const RequestContext *context = RequestContext::current();
+  const UriHandler *route = context ? context->route() : nullptr;
+  std::size_t owner = 0;
+  {
+    const host::TrackingScope untracked(false);
+    std::string name = req->method == HTTP_POST ? "POST " : "GET ";
+    name += route ? route->uri : req->uri;
+    owner = owners.index(name);
+  }
+  HeapModel::set_owner(owner);
+  const esp_err_t err = next(req);
+  HeapModel::set_owner(background_owner);
+  return err;
+}
+
+// --- traffic ---------------------------------------------------------------------
+
+struct Options {
+  double hours = 8;
+  std::vector<std::size_t> regions = {96 * 1024, 64 * 1024, 24 * 1024};
+  double session_interval_min = 20;
+  int64_t sample_interval_s = 60;
+  double warmup_min = 30;
+  double max_fragmentation = 0.5;
+  double max_fragmentation_slope = 0.02;
+  double max_free_drop = 512;
+  const char *samples_path = nullptr;
+  unsigned seed = 1;
+};
+
+Options options;
+
+struct Session {
+  int64_t ends_s;
+  int64_t started_s;
+  bool posts_credentials;
+};
+
+httpd_handle_t handle = nullptr;
+uint64_t requests_sent = 0;
+uint64_t requests_failed = 0;
+
+void request(httpd_method_t method, const char *uri, const char *body = nullptr) {
+  host::Request req;
+  req.method = method;
+  req.uri = uri;
+  if (body) {
+    req.body = body;
+    req.headers.emplace_back("Content-Type", "application/json");
+  }
+  host::Response resp;
+  host::dispatch(handle, req, resp);
+  ++requests_sent;
+  if (resp.status < 200 || resp.status >= 400) {
+    ++requests_failed;
+  }
+}
+
+void page_load() {
+  request(HTTP_GET, "/");
+  request(HTTP_GET, "/app.js");
+  request(HTTP_GET, "/assets/index.css");
+  request(HTTP_GET, "/api/v1/portal");
+  request(HTTP_GET, "/api/v1/device");
+  request(HTTP_GET, "/api/v1/mdns");
+}
+
+// One virtual second of traffic. Mirrors the portal's polling intervals.
+void tick(int64_t now_s, std::vector<Session> &sessions, std::mt19937 &rng) {
+  std::uniform_real_distribution<double> unit(0, 1);
+
+  if (now_s % 30 == 0) {
+    request(HTTP_GET, "/health"); // external monitor
+  }
+  if (now_s % 10 == 0) {
+    // Application logging shares the heap with the gateway.
+    const host::TrackingScope tracked(true);
+    logging::infof("app", "sensor sample %lld", static_cast<long long>(now_s));
+  }
+
+  if (unit(rng) < 1.0 / (options.session_interval_min * 60)) {
+    const int64_t length = 60 + static_cast<int64_t>(unit(rng) * 540);
+    sessions.push_back(Session{now_s + length, now_s, unit(rng) < 0.5});
+    page_load();
+    request(HTTP_GET, "/api/v1/wifi/scan");
+  }
+
+  for (const Session &session : sessions) {
+    const int64_t age = now_s - session.started_s;
+    if (age % 2 == 0) {
+      request(HTTP_GET, "/api/v1/wifi/status");
+    }
+    if (age % 5 == 0) {
+      request(HTTP_GET, "/api/v1/metrics");
+      request(HTTP_GET, "/api/v1/logs?limit=50");
+    }
+    if (unit(rng) < 1.0 / 90) {
+      request(HTTP_GET, "/api/v1/wifi/scan");
+    }
+    if (session.posts_credentials && now_s == session.ends_s - 5) {
+      request(HTTP_POST, "/api/v1/wifi/credentials",
+              R"({"ssid":"soak-network","passphrase":"soak-passphrase"})");
+    }
+  }
+
+  sessions.erase(std::remove_if(sessions.begin(), sessions.end(),
+                                [&](const Session &s) { return s.ends_s <= now_s; }),
+                 sessions.end());
+}
+
+// --- analysis --------------------------------------------------------------------
+
+struct Sample {
+  double hours;
+  std::size_t heap_free;
+  std::size_t largest_free_block;
+  double fragmentation;
+};
+
+// Least-squares slope of y over x.
+double slope(const std::vector<Sample> &samples, double Sample::*x,
+             double (*y)(const Sample &)) {
+  const double n = static_cast<double>(samples.size());
+  if (n < 2) {
+    return 0;
+  }
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (const Sample &s : samples) {
+    const double xv = s.*x;
+    const double yv = y(s);
+    sx += xv;
+    sy += yv;
+    sxx += xv * xv;
+    sxy += xv * yv;
+  }
+  const double denom = n * sxx - sx * sx;
+  return denom == 0 ? 0 : (n * sxy - sx * sy) / denom;
+}
+
+double fragmentation_of(const Sample &s) { return s.fragmentation; }
+double free_of(const Sample &s) { return static_cast<double>(s.heap_free); }
+
+bool parse_regions(std::string_view text) {
+  options.regions.clear();
+  while (!text.empty()) {
+    const std::size_t comma = text.find(',');
+    const long kib = std::atol(std::string(text.substr(0, comma)).c_str());
+    if (kib <= 0) {
+      return false;
+    }
+    options.regions.push_back(static_cast<std::size_t>(kib) * 1024);
+    text = comma == std::string_view::npos ? std::string_view{}
+                                           : text.substr(comma + 1);
+  }
+  return !options.regions.empty();
+}
+
+void usage(const char *argv0) {
+  std::fprintf(stderr,
+               "usage: %s [--hours H] [--regions KIB,KIB,...] "
+               "[--session-interval-min M]\n"
+               "          [--sample-interval-s S] [--warmup-min M]\n"
+               "          [--max-fragmentation F] [--max-fragmentation-slope F]\n"
+               "          [--max-free-drop B] [--samples FILE] [--seed N]\n",
+               argv0);
+}
+
+} // namespace
+
+int main(int argc, char **argv) {
+  for (int i = 1; i < argc; ++i) {
+    const std::string_view arg = argv[i];
+    const bool has_value = i + 1 < argc;
+    if (arg == "--hours" && has_value) {
+      options.hours = std::atof(argv[++i]);
+    } else if (arg == "--regions" && has_value) {
+      if (!parse_regions(argv[++i])) {
+        usage(argv[0]);
+        return 2;
+      }
+    } else if (arg == "--session-interval-min" && has_value) {
+      options.session_interval_min = std::max(0.1, std::atof(argv[++i]));
+    } else if (arg == "--sample-interval-s" && has_value) {
+      options.sample_interval_s = std::max(1, std::atoi(argv[++i]));
+    } else if (arg == "--warmup-min" && has_value) {
+      options.warmup_min = std::atof(argv[++i]);
+    } else if (arg == "--max-fragmentation" && has_value) {
+      options.max_fragmentation = std::atof(argv[++i]);
+    } else if (arg == "--max-fragmentation-slope" && has_value) {
+      options.max_fragmentation_slope = std::atof(argv[++i]);
+    } else if (arg == "--max-free-drop" && has_value) {
+      options.max_free_drop = std::atof(argv[++i]);
+    } else if (arg == "--samples" && has_value) {
+      options.samples_path = argv[++i];
+    } else if (arg == "--seed" && has_value) {
+      options.seed = static_cast<unsigned>(std::atol(argv[++i]));
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  FILE *samples_out = nullptr;
+  if (options.samples_path) {
+    samples_out = std::fopen(options.samples_path, "w");
+    if (!samples_out) {
+      std::perror(options.samples_path);
+      return 2;
+    }
+  }
+
+  // The model sees every allocation from here on, including the gateway's
+  // own start-up, as the device heap would.
+  owners.index("(boot)");
+  static HeapModel heap(options.regions);
+  model = &heap;
+  host::set_allocation_observer(&heap);
+  host::set_heap_probe(&model_figures);
+  host::set_clock_source(&virtual_clock);
+  host::set_scan_profile(host::ScanProfile{12, 0, ESP_OK});
+  setenv("EARBRAIN_HOST_HTTP_PORT", "0", 1);
+
+  gateway().initialize(GatewayOptions{});
+  HttpServer &server = gateway().server();
+  server.use(&attribute_route);
+  if (server.start() != ESP_OK) {
+    std::fprintf(stderr, "failed to start the in-process gateway\n");
+    return 1;
+  }
+  handle = host::last_started_server();
+  background_owner = owners.index("(background)");
+  HeapModel::set_owner(background_owner);
+  // The driver's own bookkeeping (samples, sessions) is not device memory;
+  // requests re-enable tracking around their handlers.
+  const host::TrackingScope untracked(false);
+
+  std::mt19937 rng(options.seed);
+  std::vector<Session> sessions;
+  std::vector<Sample> samples;
+  std::vector<HeapModel::OwnerFigures> baseline;
+
+  const int64_t end_s = static_cast<int64_t>(options.hours * 3600);
+  const int64_t warmup_s = static_cast<int64_t>(options.warmup_min * 60);
+  for (int64_t now_s = 0; now_s <= end_s; ++now_s) {
+    virtual_us.store(now_s * 1'000'000);
+    tick(now_s, sessions, rng);
+
+    if (now_s == warmup_s) {
+      baseline = heap.owner_figures();
+    }
+    if (now_s % options.sample_interval_s != 0) {
+      continue;
+    }
+
+    const Metrics metrics = collect_metrics();
+    Sample sample{static_cast<double>(now_s) / 3600, metrics.heap_free,
+                  metrics.heap_largest_free_block, 0};
+    sample.fragmentation =
+        metrics.heap_free
+            ? 1.0 - static_cast<double>(metrics.heap_largest_free_block) /
+                        static_cast<double>(metrics.heap_free)
+            : 1.0;
+    if (now_s >= warmup_s) {
+      samples.push_back(sample);
+    }
+    if (samples_out) {
+      std::fprintf(samples_out,
+                   "{\"t_s\":%lld,\"heap_free\":%zu,\"heap_min_free\":%zu,"
+                   "\"heap_largest_free_block\":%zu,\"fragmentation\":%.4f,"
+                   "\"sessions\":%zu}\n",
+                   static_cast<long long>(now_s), metrics.heap_free,
+                   metrics.heap_min_free, metrics.heap_largest_free_block,
+                   sample.fragmentation, sessions.size());
+    }
+    if (now_s > 0 && now_s % 3600 == 0) {
+      std::fprintf(stderr, "[%5.1f h] heap_free=%zu largest=%zu frag=%.3f\n",
+                   sample.hours, sample.heap_free, sample.largest_free_block,
+                   sample.fragmentation);
+    }
+  }
+
+  server.stop();
+  host::set_allocation_observer(nullptr);
+  if (samples_out) {
+    std::fclose(samples_out);
+  }
+
+  // --- verdict ---
+  if (samples.empty()) {
+    std::fprintf(stderr, "run shorter than the warm-up; nothing to judge\n");
+    return 2;
+  }
+  const std::size_t tail = std::max<std::size_t>(1, samples.size() / 10);
+  double final_fragmentation = 0;
+  for (std::size_t i = samples.size() - tail; i < samples.size(); ++i) {
+    final_fragmentation += samples[i].fragmentation;
+  }
+  final_fragmentation /= static_cast<double>(tail);
+  const double fragmentation_slope = slope(samples, &Sample::hours, &fragmentation_of);
+  const double free_slope = slope(samples, &Sample::hours, &free_of);
+  const host::HeapFigures end = heap.figures();
+  const uint64_t failures = heap.failures();
+
+  std::printf("requests            %llu (%llu failed)\n",
+              static_cast<unsigned long long>(requests_sent),
+              static_cast<unsigned long long>(requests_failed));
+  std::printf("heap_free           %zu (min %zu of %zu)\n", end.free,
+              end.min_free, end.total);
+  std::printf("largest_free_block  %zu\n", end.largest_free_block);
+  std::printf("fragmentation       %.3f (limit %.3f), %+.4f/h (limit %+.4f/h)\n",
+              final_fragmentation, options.max_fragmentation,
+              fragmentation_slope, options.max_fragmentation_slope);
+  std::printf("heap_free trend     %+.1f B/h (limit -%.1f B/h)\n", free_slope,
+              options.max_free_drop);
+  std::printf("model OOM           %llu\n",
+              static_cast<unsigned long long>(failures));
+
+  // Growth per owner since the end of the warm-up, largest first.
+  struct Growth {
+    std::string name;
+    long long delta;
+    std::size_t live_bytes;
+    std::size_t live_blocks;
+  };
+  std::vector<Growth> growth;
+  for (const auto &owner : heap.owner_figures()) {
+    std::size_t before = 0;
+    for (const auto &base : baseline) {
+      if (base.name == owner.name) {
+        before = base.live_bytes;
+      }
+    }
+    growth.push_back({owner.name,
+                      static_cast<long long>(owner.live_bytes) -
+                          static_cast<long long>(before),
+                      owner.live_bytes, owner.live_blocks});
+  }
+  std::sort(growth.begin(), growth.end(),
+            [](const Growth &a, const Growth &b) { return a.delta > b.delta; });
+  std::printf("\n%-32s %10s %10s %8s\n", "owner", "growth", "live", "blocks");
+  for (const Growth &g : growth) {
+    std::printf("%-32s %+10lld %10zu %8zu\n", g.name.c_str(), g.delta,
+                g.live_bytes, g.live_blocks);
+  }
+
+  const bool failed = final_fragmentation > options.max_fragmentation ||
+                      fragmentation_slope > options.max_fragmentation_slope ||
+                      free_slope < -options.max_free_drop || failures > 0;
+  std::printf("\n%s\n", failed ? "FAIL" : "PASS");
+  return failed ? 1 : 0;
+}
@@ -0,0 +1,252 @@
+#pragma once
+
+#include "earbrain/gateway/watch.hpp"
+#include "earbrain/wifi_service.hpp"
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#include <coroutine>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <utility>
+
+namespace earbrain::async {
+
+// Coroutine request handlers, for requests that wait on something slow: a
+// scan, the station link, a timer, a client sending its body. The request
+// is detached with the httpd async request API and the handler runs on the
+// executor task; whenever it co_awaits, the executor moves on to the next
+// handler that is ready. Blocking calls (scans, socket reads) go to one
+// helper task. Any number of slow requests in flight therefore costs those
+// two tasks, not a task each.
+//
+//   async::Task wait_for_link(httpd_req_t *req) {
+//     WifiStatus status = wifi().status();
+//     while (status.sta_connecting) {
+//       status = co_await async::wifi_change(status, 1000);
+//     }
+//     co_return http::send_success(req);
+//   }
+//
+//   server.add_route("/api/ext/link", HTTP_GET, &async::serve<&wait_for_link>);
+//
+// The handler is given the detached request, and RequestContext::current()
+// is that request's context on every resume, as is whatever the measuring
+// middlewares (memory_governor, heap_accounting, trace_request,
+// capture_request) had open for it; they close once the handler finishes. Thread-local response state
+// such as http::ResponseShape must not be held across a co_await, as other
+// handlers run on the executor in between: make it after the last one. The
+// awaitables below only work inside such a handler; elsewhere they finish
+// at once (see each).
+
+class Task {
+public:
+  struct promise_type {
+    // Frames come from the heap; failing that, the handler is not started.
+    static void *operator new(std::size_t size) noexcept {
+      return ::operator new(size, std::nothrow);
+    }
+    static void operator delete(void *ptr) noexcept { ::operator delete(ptr); }
+    static Task get_return_object_on_allocation_failure() { return Task{}; }
+
+    Task get_return_object() {
+      return Task{std::coroutine_handle<promise_type>::from_promise(*this)};
+    }
+    // Started by the executor, never by the caller.
+    std::suspend_always initial_suspend() noexcept { return {}; }
+    std::suspend_always final_suspend() noexcept { return {}; }
+    void return_value(esp_err_t value) noexcept { result = value; }
+    void unhandled_exception() noexcept {}
+
+    esp_err_t result = ESP_OK;
+  };
+
+  using Handle = std::coroutine_handle<promise_type>;
+
+  Task() = default;
+  Task(Task &&other) noexcept : handle(std::exchange(other.handle, nullptr)) {}
+  ~Task() {
+    if (handle) {
+      handle.destroy();
+    }
+  }
+
+  Task(const Task &) = delete;
+  Task &operator=(const Task &) = delete;
+  Task &operator=(Task &&) = delete;
+
+  // Hands the frame to the caller.
+  Handle release() { return std::exchange(handle, nullptr); }
+
+private:
+  explicit Task(Handle handle) : handle(handle) {}
+
+  Handle handle = nullptr;
+};
+
+using Handler = Task (*)(httpd_req_t *req);
+
+// Detaches req and runs handler on the executor. When the request cannot be
+// detached, the handler still runs there while the calling task waits. A
+// handler that co_returns an error without answering gets a 500.
+esp_err_t run(httpd_req_t *req, Handler handler);
+
+// handler as a plain RequestHandler, for add_route.
+template <Handler handler> esp_err_t serve(httpd_req_t *req) {
+  return run(req, handler);
+}
+
+namespace detail {
+
+struct Session;
+
+// Executor hooks for the awaitables. Each returns false when there is no
+// handler to suspend, in which case the awaitable finishes at once.
+bool sleep(uint32_t ms);
+bool scan(WifiScanResult *out);
+// changed is polled on the executor, every 100 ms and once more at the
+// timeout, until it returns true or the timeout has passed.
+bool watch(bool (*changed)(void *arg), void *arg, uint32_t timeout_ms);
+bool receive(httpd_req_t *req, char *buf, std::size_t len, int *out);
+
+bool wifi_changed(const WifiStatus &a, const WifiStatus &b);
+
+} // namespace detail
+
+// Resumes after ms milliseconds. Outside a handler: does not wait.
+class Sleep {
+public:
+  explicit Sleep(uint32_t ms) : ms(ms) {}
+
+  bool await_ready() const noexcept { return ms == 0; }
+  bool await_suspend(std::coroutine_handle<>) noexcept {
+    return detail::sleep(ms);
+  }
+  void await_resume() const noexcept {}
+
+private:
+  uint32_t ms;
+};
+
+inline Sleep sleep_for(uint32_t ms) { return Sleep{ms}; }
+
+// Scans on the helper task. Handlers asking while a scan runs share its
+// result instead of starting another. Outside a handler: error
+// ESP_ERR_INVALID_STATE.
+class Scan {
+public:
+  bool await_ready() const noexcept { return false; }
+  bool await_suspend(std::coroutine_handle<>) {
+    if (detail::scan(&result)) {
+      return true;
+    }
+    result.error = ESP_ERR_INVALID_STATE;
+    return false;
+  }
+  WifiScanResult await_resume() { return std::move(result); }
+
+private:
+  WifiScanResult result;
+};
+
+inline Scan scan() { return Scan{}; }
+
+// Resumes with the Wi-Fi status once it differs from since (mode, link
+// state, address or last error), or with the unchanged status after
+// timeout_ms. Outside a handler: the current status, at once.
+class WifiChange {
+public:
+  WifiChange(const WifiStatus &since, uint32_t timeout_ms)
+    : since(since), timeout_ms(timeout_ms) {}
+
+  bool await_ready() {
+    status = wifi().status();
+    return timeout_ms == 0 || detail::wifi_changed(since, status);
+  }
+  bool await_suspend(std::coroutine_handle<>) {
+    return detail::watch(&poll, this, timeout_ms);
+  }
+  WifiStatus await_resume() const { return status; }
+
+private:
+  static bool poll(void *self) {
+    auto *change = static_cast<WifiChange *>(self);
+    change->status = wifi().status();
+    return detail::wifi_changed(change->since, change->status);
+  }
+
+  WifiStatus since;
+  uint32_t timeout_ms;
+  WifiStatus status;
+};
+
+inline WifiChange wifi_change(const WifiStatus &since, uint32_t timeout_ms) {
+  return WifiChange{since, timeout_ms};
+}
+
+// Resumes with the resource's version once it differs from since, or with
+// the unchanged version after timeout_ms. Outside a handler: the current
+// version, at once.
+class VersionChange {
+public:
+  VersionChange(ResourceVersion version, uint64_t since, uint32_t timeout_ms)
+    : version(version), since(since), timeout_ms(timeout_ms) {}
+
+  bool await_ready() {
+    current = version();
+    return timeout_ms == 0 || current != since;
+  }
+  bool await_suspend(std::coroutine_handle<>) {
+    return detail::watch(&poll, this, timeout_ms);
+  }
+  uint64_t await_resume() const { return current; }
+
+private:
+  static bool poll(void *self) {
+    auto *change = static_cast<VersionChange *>(self);
+    change->current = change->version();
+    return change->current != change->since;
+  }
+
+  ResourceVersion version;
+  uint64_t since;
+  uint32_t timeout_ms;
+  uint64_t current = 0;
+};
+
+inline VersionChange version_change(ResourceVersion version, uint64_t since,
+                                    uint32_t timeout_ms) {
+  return VersionChange{version, since, timeout_ms};
+}
+
+// httpd_req_recv on the helper task, retried on socket timeouts; resumes
+// with its result. Outside a handler: HTTPD_SOCK_ERR_FAIL.
+class Receive {
+public:
+  Receive(httpd_req_t *req, char *buf, std::size_t len)
+    : req(req), buf(buf), len(len) {}
+
+  bool await_ready() const noexcept { return len == 0; }
+  bool await_suspend(std::coroutine_handle<>) noexcept {
+    if (detail::receive(req, buf, len, &result)) {
+      return true;
+    }
+    result = HTTPD_SOCK_ERR_FAIL;
+    return false;
+  }
+  int await_resume() const noexcept { return result; }
+
+private:
+  httpd_req_t *req;
+  char *buf;
+  std::size_t len;
+  int result = 0;
+};
+
+inline Receive receive(httpd_req_t *req, char *buf, std::size_t len) {
+  return Receive{req, buf, len};
+}
+
+} // namespace earbrain::async
@@ -0,0 +1,92 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+
+namespace earbrain::http {
+
+// A top-level member of a JSON request body that a handler wants. Fields
+// are written straight into the handler's own variables; members that are
+// not declared are skipped without being stored.
+struct BodyField {
+  enum class Type { string, boolean, integer };
+
+  const char *name = nullptr;
+  Type type = Type::string;
+  std::string *string_out = nullptr;
+  bool *bool_out = nullptr;
+  int64_t *int_out = nullptr;
+  // Longest accepted string, in bytes once escapes are decoded.
+  std::size_t max_length = 0;
+  bool required = true;
+  bool seen = false;
+};
+
+inline BodyField string_field(const char *name, std::string &out,
+                              std::size_t max_length, bool required = true) {
+  BodyField field;
+  field.name = name;
+  field.type = BodyField::Type::string;
+  field.string_out = &out;
+  field.max_length = max_length;
+  field.required = required;
+  return field;
+}
+
+inline BodyField bool_field(const char *name, bool &out,
+                            bool required = true) {
+  BodyField field;
+  field.name = name;
+  field.type = BodyField::Type::boolean;
+  field.bool_out = &out;
+  field.required = required;
+  return field;
+}
+
+inline BodyField int_field(const char *name, int64_t &out,
+                           bool required = true) {
+  BodyField field;
+  field.name = name;
+  field.type = BodyField::Type::integer;
+  field.int_out = &out;
+  field.required = required;
+  return field;
+}
+
+enum class BodyError {
+  none,
+  too_large,     // Content-Length missing, zero or above the limit
+  read_failed,   // the socket failed mid-body
+  malformed,     // not a JSON object, or nested too deep
+  missing_field, // a required field is absent
+  wrong_type,    // a declared field holds another JSON type
+  too_long,      // a string field is longer than its max_length
+};
+
+struct BodyResult {
+  BodyError error = BodyError::none;
+  // The declared field the error is about, if any.
+  const char *field = nullptr;
+
+  bool ok() const { return error == BodyError::none; }
+};
+
+// Parses a JSON object body as it arrives from httpd_req_recv, through a
+// small fixed buffer: the body is never held in full and no cJSON tree is
+// built. Parsing stops at the first error, so an oversized body is refused
+// from its Content-Length and an overlong field as soon as it passes its
+// limit.
+BodyResult read_json_body(httpd_req_t *req, BodyField *fields,
+                          std::size_t count, std::size_t max_body_size);
+
+template <std::size_t N>
+BodyResult read_json_body(httpd_req_t *req, BodyField (&fields)[N],
+                          std::size_t max_body_size) {
+  return read_json_body(req, fields, N, max_body_size);
+}
+
+} // namespace earbrain::http
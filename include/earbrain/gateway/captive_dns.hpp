@@ -0,0 +1,61 @@
+#pragma once
+
+#include "esp_err.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace earbrain {
+
+struct CaptiveDnsConfig {
+  bool enabled = true;
+  uint16_t port = 53;
+  // Names answered by the upstream resolver instead of with the portal's
+  // address. Each also covers its subdomains; case does not matter.
+  std::vector<std::string> passthrough;
+  // IPv4 address (network order) passthrough queries are forwarded to.
+  // With none, they are answered REFUSED.
+  uint32_t upstream = 0;
+  // UDP port of the upstream resolver.
+  uint16_t upstream_port = 53;
+};
+
+namespace captive_dns {
+
+// The DNS half of the captive portal: a UDP responder on its own task that
+// answers every A query with the access point's address, so that whatever a
+// phone looks up first lands on the portal and its captive check pops at
+// once. Other query types get an empty answer, which sends clients back to
+// A. Replies are built in place from the query and a preformatted answer
+// record, without allocating.
+//
+// Gateway::start_portal starts it with GatewayOptions::captive_dns and
+// stop_portal stops it.
+
+// TTL of the answers; short, so clients look again once the portal is gone.
+constexpr uint32_t answer_ttl_s = 10;
+
+struct Stats {
+  uint32_t queries = 0;
+  uint32_t answered = 0;  // A queries given the portal's address
+  uint32_t no_data = 0;   // other types, answered with nothing
+  uint32_t forwarded = 0; // passthrough queries sent upstream
+  uint32_t refused = 0;   // passthrough queries with nowhere to go
+  uint32_t dropped = 0;   // malformed, not a query, or upstream timed out
+};
+
+// The soft-AP's IPv4 address (network order), which A queries are
+// answered with.
+uint32_t portal_address();
+
+esp_err_t start(const CaptiveDnsConfig &config);
+void stop();
+bool running();
+
+Stats stats();
+void reset_stats();
+
+} // namespace captive_dns
+
+} // namespace earbrain
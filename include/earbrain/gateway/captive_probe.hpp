@@ -0,0 +1,38 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#include <cstdint>
+#include <span>
+#include <string_view>
+
+namespace earbrain::captive_probe {
+
+// The HTTP half of the captive portal. With every name resolving to the
+// portal (see captive_dns.hpp), the operating systems' connectivity probes
+// (Android's /generate_204, Apple's /hotspot-detect.html, Windows'
+// /connecttest.txt, ...) arrive here. They are answered from the 404
+// handler, so before any route, middleware or JSON work, with a 302 to the
+// portal's root that makes the OS show its sign-in page at once.
+//
+// A GET for any other missing path is redirected the same way when its Host
+// names some other site, as with a hijacked lookup; requests for the
+// gateway itself (an IP literal, *.local, localhost) still get a 404.
+// Responses are built from strings prepared once, without allocating.
+
+struct Stats {
+  uint32_t probes = 0;    // known probe paths
+  uint32_t redirects = 0; // other paths on foreign hosts
+  uint32_t not_found = 0; // answered 404
+};
+
+// The probe paths, which must outlive the server. Gateway sets its own.
+void configure(std::span<const std::string_view> probe_paths);
+
+// The 404 handler; see HttpServer::set_not_found_handler.
+esp_err_t handle_not_found(httpd_req_t *req, httpd_err_code_t error);
+
+Stats stats();
+
+} // namespace earbrain::captive_probe
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace earbrain::capture {
+
+// Requests recorded by middleware::capture_request are kept in a fixed byte
+// ring; the oldest records are dropped to make room. The ring is allocated
+// on the first captured request.
+//
+// Export layout (GET /api/v1/capture), little-endian:
+//   header   "EBCP" | u8 version | u8 reserved | u16 header_size
+//            | u32 dropped_records | u32 export_ms
+//   records  oldest first:
+//     u16 size          whole record, including this field
+//     u8  method        httpd_method_t
+//     u8  flags         record_flag_*
+//     u32 start_ms      esp_timer time at request start
+//     u32 duration_us
+//     u16 status        HTTP status code, 0 when unknown
+//     u32 body_size     Content-Length; bodies are never recorded
+//     u8  uri_len, uri bytes (truncated to max_uri_length)
+//     u8  header_count, then per header:
+//         u8 id (index into captured_headers), u8 len, value bytes
+constexpr uint8_t format_version = 1;
+constexpr std::size_t header_size = 16;
+constexpr std::size_t ring_bytes = 4096;
+constexpr std::size_t max_uri_length = 128;
+constexpr std::size_t max_header_length = 48;
+
+constexpr uint8_t record_flag_handler_failed = 0x01;
+constexpr uint8_t record_flag_uri_truncated = 0x02;
+
+inline constexpr const char *captured_headers[] = {
+    "Content-Type", "Accept", "Accept-Encoding", "User-Agent", "Origin",
+};
+constexpr std::size_t captured_header_count =
+    sizeof(captured_headers) / sizeof(captured_headers[0]);
+
+// Copies the ring in export layout. Empty (header only) when nothing was
+// captured.
+std::vector<uint8_t> export_ring();
+void reset();
+
+// Records the status line set by the response helpers ("404 Not Found")
+// for the request being captured on this task. No-op otherwise.
+void note_status(const char *http_status) noexcept;
+
+} // namespace earbrain::capture
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "earbrain/gateway/captive_dns.hpp"
 #include "earbrain/gateway/http_server.hpp"
 #include "earbrain/mdns_service.hpp"
 #include "earbrain/wifi_service.hpp"
@@ -18,6 +19,7 @@ struct GatewayOptions {
   AccessPointConfig ap_config{"gateway-ap"};
   MdnsConfig mdns_config{"esp-gateway", "ESP Gateway", "_http", "_tcp", 80};
   PortalConfig portal_config{};
+  CaptiveDnsConfig captive_dns{};
 };
 
 class Gateway {
@@ -39,9 +41,17 @@ public:
   }
 
   esp_err_t add_route(std::string_view uri, httpd_method_t method,
-                      RequestHandler handler, void *user_ctx = nullptr);
+                      RequestHandler handler, RouteData user_data = {});
   esp_err_t add_route(std::string_view uri, httpd_method_t method,
                       RequestHandler handler, const RouteOptions &options);
+  // Middlewares are compile-time stages (pipeline.hpp); a runtime
+  // middleware goes in as as_stage<&fn>. Per-route runtime middlewares can
+  // also come in options.middlewares, and run outside the stages.
+  template <RequestHandler Handler, typename... Middlewares>
+  esp_err_t add_route(std::string_view uri, httpd_method_t method,
+                      const RouteOptions &options = {}) {
+    return add_route(uri, method, &compose<Handler, Middlewares...>, options);
+  }
 
   esp_err_t start_portal();
   esp_err_t stop_portal();
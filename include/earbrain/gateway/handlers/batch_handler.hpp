@@ -0,0 +1,14 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+namespace earbrain::handlers::batch {
+
+// GET /api/v1/batch?r=device,metrics,wifi/status
+// Serves routes with a RouteOptions::batch producer and no route-level
+// middlewares. Global middlewares wrap the batch request as a whole. The
+// response is streamed and never compressed.
+esp_err_t handle_get(httpd_req_t *req);
+
+} // namespace earbrain::handlers::batch
@@ -0,0 +1,13 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+namespace earbrain::handlers::capture {
+
+// Captured requests in the binary export layout of
+// earbrain/gateway/capture.hpp, for the host replay tool.
+// Registered only with CONFIG_EARBRAIN_GATEWAY_CAPTURE_ROUTE.
+esp_err_t handle_get(httpd_req_t *req);
+
+} // namespace earbrain::handlers::capture
@@ -2,6 +2,7 @@
 
 #include "esp_http_server.h"
 #include "earbrain/gateway/gateway.hpp"
+#include "earbrain/gateway/wifi_snapshot.hpp"
 #include "earbrain/wifi_service.hpp"
 #include "json/http_response.hpp"
 #include <string>
@@ -13,7 +14,7 @@ inline std::string get_connection_type(httpd_req_t *req, Gateway *gateway) {
     return "unknown";
   }
 
-  WifiStatus status = earbrain::wifi().status();
+  const WifiStatus status = wifi_snapshot::read().status;
 
   // Check WiFi mode and determine connection type
   if (status.mode == WifiMode::STA || status.mode == WifiMode::APSTA) {
@@ -0,0 +1,11 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+namespace earbrain::handlers::heap_stats {
+
+// Per-route allocation figures collected by middleware::heap_accounting.
+esp_err_t handle_get(httpd_req_t *req);
+
+} // namespace earbrain::handlers::heap_stats
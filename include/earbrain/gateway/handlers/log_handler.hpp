@@ -3,9 +3,12 @@
 #include "esp_err.h"
 #include "esp_http_server.h"
 
+#include <cstdint>
+
 namespace earbrain::handlers::logs {
 
 esp_err_t handle_get(httpd_req_t *req);
+uint64_t version_get();
 
 } // namespace earbrain::handlers::logs
 
@@ -3,9 +3,15 @@
 #include "esp_err.h"
 #include "esp_http_server.h"
 
+#include <cstdint>
+
+struct cJSON;
+
 namespace earbrain::handlers::metrics {
 
 esp_err_t handle_get(httpd_req_t *req);
+esp_err_t produce_get(cJSON **out);
+uint64_t version_get();
 
 } // namespace earbrain::handlers::metrics
 
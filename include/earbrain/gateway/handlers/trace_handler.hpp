@@ -0,0 +1,12 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+namespace earbrain::handlers::trace {
+
+// Recorded spans as Chrome trace-event JSON (chrome://tracing, Perfetto).
+// Registered only with CONFIG_EARBRAIN_GATEWAY_TRACE_ROUTE.
+esp_err_t handle_get(httpd_req_t *req);
+
+} // namespace earbrain::handlers::trace
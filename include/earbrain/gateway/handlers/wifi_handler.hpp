@@ -3,11 +3,17 @@
 #include "esp_err.h"
 #include "esp_http_server.h"
 
+#include <cstdint>
+
+struct cJSON;
+
 namespace earbrain::handlers::wifi {
 
 esp_err_t handle_credentials_post(httpd_req_t *req);
 esp_err_t handle_connect_post(httpd_req_t *req);
 esp_err_t handle_status_get(httpd_req_t *req);
+esp_err_t produce_status_get(cJSON **out);
+uint64_t version_status_get();
 esp_err_t handle_scan_get(httpd_req_t *req);
 
 } // namespace earbrain::handlers::wifi
@@ -2,12 +2,20 @@
 
 #include "esp_err.h"
 #include "esp_http_server.h"
+#include "earbrain/gateway/pipeline.hpp"
+#include "earbrain/gateway/request_context.hpp"
+#include "earbrain/gateway/watch.hpp"
+#include <atomic>
 #include <functional>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <string_view>
+#include <utility>
 #include <vector>
 
+struct cJSON;
+
 namespace earbrain {
 
 class Gateway;
@@ -16,32 +24,76 @@ using RequestHandler = esp_err_t (*)(httpd_req_t *);
 using NextHandler = std::function<esp_err_t(httpd_req_t *)>;
 using Middleware = std::function<esp_err_t(httpd_req_t *, NextHandler)>;
 
+// A compile-time middleware (see pipeline.hpp) as a runtime one, for use()
+// and RouteOptions::middlewares.
+template <typename M> Middleware as_middleware() {
+  return [](httpd_req_t *req, NextHandler next) { return M::handle(req, next); };
+}
+// The reverse: a runtime middleware function (middleware::log_request,
+// rate_limit, ...) as a compile-time stage, for add_route<Handler, ...>.
+// The rest of the chain is handed to it as a NextHandler, so the stage
+// is a call the compiler cannot inline through.
+template <esp_err_t (*M)(httpd_req_t *, NextHandler)> struct as_stage {
+  template <typename Next>
+  static esp_err_t handle(httpd_req_t *req, Next &&next) {
+    return M(req, NextHandler(std::forward<Next>(next)));
+  }
+};
+// Builds the `data` object a GET route sends, without sending it. On
+// ESP_OK, *out is a new cJSON item owned by the caller.
+using DataProducer = esp_err_t (*)(cJSON **out);
+
 struct RouteOptions {
   std::vector<Middleware> middlewares;
-  void *user_ctx = nullptr;
+  // Read back in the handler with RequestContext::user_data<T>().
+  RouteData user_data;
+  // Concurrent identical GETs share one handler run (see singleflight.hpp).
+  bool coalesce = false;
+  // Makes the route available to GET /api/v1/batch under its URI without
+  // the /api/v1/ prefix. Ignored while `middlewares` is non-empty, as the
+  // producer would run outside them.
+  DataProducer batch = nullptr;
+  // Sends the route's version and lets GETs wait for it to change (see
+  // watch.hpp).
+  ResourceVersion version = nullptr;
+  // Keeps the route's 200s for up to this long and serves them again while
+  // its version holds (see response_cache.hpp). 0: not kept.
+  uint32_t cache_ttl_ms = 0;
 };
 
 class HttpServer;
 
-struct UriHandler {
+// Shared between the route tables that list it and whatever still serves
+// one of its requests (see HttpServer), so removing it never pulls it from
+// under a handler. Code that keeps a route past its request, like a
+// detached handler, holds on to weak_from_this().lock().
+struct UriHandler : std::enable_shared_from_this<UriHandler> {
   UriHandler(std::string_view path, httpd_method_t m, RequestHandler h,
-             void *ctx, HttpServer *srv);
+             RouteData data, HttpServer *srv);
   UriHandler(std::string_view path, httpd_method_t m, RequestHandler h,
              const RouteOptions &opts, HttpServer *srv);
-  void refresh_descriptor();
 
   std::string uri;
   httpd_method_t method;
   RequestHandler handler;
-  void *user_ctx;
-  httpd_uri_t descriptor;
+  RouteData user_data;
   std::vector<Middleware> middlewares;
+  bool coalesce;
+  DataProducer batch;
+  ResourceVersion version;
+  uint32_t cache_ttl_ms;
   HttpServer *server;
 };
 
+// Routes, global middlewares and the not-found handler live in an
+// immutable table that every change replaces whole, so they can be changed
+// while requests are being served. httpd itself only knows one wildcard
+// handler per method, which looks the request up in the current table and
+// keeps that table alive until the request is done; a replaced table, and
+// any route only it listed, goes once its last request finishes.
 class HttpServer {
 public:
-  HttpServer() = default;
+  HttpServer();
   ~HttpServer();
 
   esp_err_t start();
@@ -50,24 +102,47 @@ public:
   bool is_running() const noexcept { return running; }
 
   esp_err_t add_route(std::string_view uri, httpd_method_t method,
-                      RequestHandler handler, void *user_ctx = nullptr);
+                      RequestHandler handler, RouteData user_data = {});
   esp_err_t add_route(std::string_view uri, httpd_method_t method,
                       RequestHandler handler, const RouteOptions &options);
+  // Handler and Middlewares composed into one function at compile time;
+  // see pipeline.hpp.
+  template <RequestHandler Handler, typename... Middlewares>
+  esp_err_t add_route(std::string_view uri, httpd_method_t method,
+                      const RouteOptions &options = {}) {
+    return add_route(uri, method, &compose<Handler, Middlewares...>, options);
+  }
+  // Requests already being served finish with the route; later ones get a
+  // 404. ESP_ERR_NOT_FOUND when there is no such route.
+  esp_err_t remove_route(std::string_view uri, httpd_method_t method);
   bool has_route(std::string_view uri, httpd_method_t method) const;
+  std::shared_ptr<const UriHandler> find_route(std::string_view uri,
+                                               httpd_method_t method) const;
+
+  // Answers requests no route matches, bypassing the middlewares.
+  void set_not_found_handler(httpd_err_handler_func_t handler);
 
   // Global middleware management
   void use(Middleware middleware);
-  const std::vector<Middleware> &get_global_middlewares() const noexcept {
-    return global_middlewares;
-  }
+  std::vector<Middleware> get_global_middlewares() const;
 
 private:
-  esp_err_t register_route_with_server(UriHandler &route) const;
+  struct RouteTable;
+  using TablePtr = std::shared_ptr<const RouteTable>;
+
+  static esp_err_t dispatch(httpd_req_t *req);
+  // Applies edit to a copy of the current table and publishes it, unless
+  // edit fails.
+  template <typename Edit> esp_err_t update(Edit &&edit);
 
   httpd_handle_t handle = nullptr;
   bool running = false;
-  std::vector<std::unique_ptr<UriHandler>> routes;
-  std::vector<Middleware> global_middlewares;
+  // std::atomic<std::shared_ptr> is C++20 and needs GCC 12 or later
+  // (ESP-IDF 5.1 and up). libstdc++ implements it with an internal spinlock
+  // rather than lock-free, which dispatch() pays once per request.
+  std::atomic<TablePtr> table;
+  // Serializes updates; readers never take it.
+  std::mutex update_mutex;
 };
 
 } // namespace earbrain
@@ -0,0 +1,16 @@
+#pragma once
+
+#include "earbrain/gateway/http_server.hpp"
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+namespace earbrain::middleware {
+
+// Records method, URI, selected headers, body size, timing and response
+// status of every request it wraps into the capture ring
+// (earbrain/gateway/capture.hpp). Request bodies are not recorded.
+// The ring is served at /api/v1/capture when
+// CONFIG_EARBRAIN_GATEWAY_CAPTURE_ROUTE is enabled.
+esp_err_t capture_request(httpd_req_t *req, NextHandler next);
+
+} // namespace earbrain::middleware
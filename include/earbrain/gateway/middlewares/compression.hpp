@@ -0,0 +1,43 @@
+#pragma once
+
+#include "earbrain/gateway/http_server.hpp"
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace earbrain::middleware {
+
+struct CompressionConfig {
+  // Smaller bodies go out as they are: below this, gzip's framing and the
+  // encoder setup cost more than the bytes they save.
+  std::size_t min_size = 1024;
+  // Match candidates tried per input position. Higher compresses better
+  // and costs more CPU.
+  uint32_t max_chain = 8;
+};
+
+struct CompressionStats {
+  uint32_t compressed = 0;
+  // Bodies the client would have taken gzipped, sent as is for being below
+  // min_size or because the encoder could not be allocated.
+  uint32_t skipped = 0;
+  uint64_t bytes_in = 0;
+  uint64_t bytes_out = 0;
+  uint64_t compress_us = 0;
+};
+
+// gzip for JSON and text responses when Accept-Encoding allows it. The
+// body is deflated with a small window and streamed out in chunks, so the
+// compressed copy is never held in full. Once it is in use, JSON and text
+// responses carry Vary: Accept-Encoding whether gzipped or not. Only bodies
+// sent whole through http::send_response are compressed; chunked responses
+// such as /api/v1/batch go out as they are.
+esp_err_t compress_response(httpd_req_t *req, NextHandler next);
+
+void configure_compression(const CompressionConfig &config);
+CompressionStats compression_stats();
+void reset_compression();
+
+} // namespace earbrain::middleware
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "earbrain/gateway/http_server.hpp"
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace earbrain::middleware {
+
+struct RouteHeapStats {
+  std::string uri;
+  httpd_method_t method = HTTP_GET;
+  uint32_t requests = 0;
+  uint64_t allocations = 0;
+  uint64_t allocated_bytes = 0;
+  // Largest live-byte high-water mark seen in a single request.
+  std::size_t peak_bytes = 0;
+  std::size_t last_peak_bytes = 0;
+  // Requests with more live blocks than could be tracked at once; their
+  // peaks are lower bounds.
+  uint32_t saturated = 0;
+};
+
+// Debug middleware: counts allocations, allocated bytes and peak live bytes
+// of every request it wraps and aggregates them per route. Allocation data
+// needs CONFIG_HEAP_USE_HOOKS; without it only request counts are kept.
+esp_err_t heap_accounting(httpd_req_t *req, NextHandler next);
+
+bool heap_accounting_available();
+std::vector<RouteHeapStats> heap_stats();
+void reset_heap_stats();
+
+} // namespace earbrain::middleware
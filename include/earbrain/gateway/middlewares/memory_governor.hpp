@@ -0,0 +1,61 @@
+#pragma once
+
+#include "earbrain/gateway/http_server.hpp"
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace earbrain::middleware {
+
+struct MemoryGovernorConfig {
+  // Free heap that must remain once the in-flight reservations and the new
+  // request's estimate are taken out.
+  std::size_t min_free_bytes = 16 * 1024;
+  // Requests are refused while the largest free block is smaller than this:
+  // on a fragmented heap the response buffers fail long before free heap
+  // runs out.
+  std::size_t min_largest_free_block = 4 * 1024;
+  // Reservation for routes whose peak has not been observed yet, and for
+  // every route when built without CONFIG_HEAP_USE_HOOKS.
+  std::size_t default_estimate = 4 * 1024;
+};
+
+// Listed from a route's first admitted request; rejections before that only
+// count in MemoryGovernorStats::rejected.
+struct RouteMemoryStats {
+  std::string uri;
+  httpd_method_t method = HTTP_GET;
+  std::size_t estimate = 0;
+  bool learned = false;
+  uint32_t admitted = 0;
+  uint32_t rejected = 0;
+};
+
+struct MemoryGovernorStats {
+  bool learning = false;
+  std::size_t reserved_bytes = 0;
+  uint32_t in_flight = 0;
+  uint32_t admitted = 0;
+  uint32_t rejected = 0;
+  std::vector<RouteMemoryStats> routes;
+};
+
+// Admission control against heap exhaustion. Each request reserves its
+// route's estimated peak; a request that would leave less than the
+// configured floor gets a static 503 with Retry-After, sent without
+// allocating, instead of failing halfway through serialisation. Estimates are learned from the live-byte
+// peaks the heap hooks observe while the request runs. A request holding
+// more blocks at once than can be tracked (1024, shared by the requests
+// being measured) only ever raises its route's estimate, since its peak is
+// then a lower bound; for such routes default_estimate is the floor.
+esp_err_t memory_governor(httpd_req_t *req, NextHandler next);
+
+void configure_memory_governor(const MemoryGovernorConfig &config);
+MemoryGovernorStats memory_governor_stats();
+void reset_memory_governor();
+
+} // namespace earbrain::middleware
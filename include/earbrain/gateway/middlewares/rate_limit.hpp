@@ -0,0 +1,74 @@
+#pragma once
+
+#include "earbrain/gateway/http_server.hpp"
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <vector>
+
+namespace earbrain::middleware {
+
+// Cost classes for admission control; each has its own bucket per client.
+enum class RouteClass : uint8_t {
+  page,  // portal document and assets
+  api,   // GET /api/...
+  write, // POST/PUT/DELETE
+  scan,  // GET /api/v1/wifi/scan, which blocks the radio
+};
+constexpr std::size_t route_class_count = 4;
+
+struct TokenBucketPolicy {
+  uint16_t burst;
+  uint16_t refill_per_minute;
+};
+
+struct RateLimitConfig {
+  // Indexed by RouteClass. Defaults leave room for the portal's polling
+  // (status every 2 s, metrics and logs every 5 s) and a few page loads.
+  TokenBucketPolicy policies[route_class_count] = {
+      {40, 1200}, // page: 20/s
+      {30, 600},  // api: 10/s
+      {5, 30},    // write: 1 per 2 s
+      {2, 6},     // scan: 1 per 10 s
+  };
+};
+
+// Buckets live in a fixed table; the least recently used one is evicted
+// when a new client/class pair arrives.
+constexpr std::size_t rate_limit_table_size = 16;
+
+struct RateLimitBucketStats {
+  // IPv4 address in network order; IPv6 clients are folded into 32 bits.
+  uint32_t client = 0;
+  bool client_ipv6 = false;
+  RouteClass route_class = RouteClass::page;
+  uint32_t allowed = 0;
+  uint32_t rejected = 0;
+  uint16_t tokens = 0;
+};
+
+struct RateLimitStats {
+  uint32_t allowed = 0;
+  uint32_t rejected = 0;
+  uint32_t evictions = 0;
+  uint32_t rejected_by_class[route_class_count] = {};
+  std::vector<RateLimitBucketStats> buckets;
+};
+
+// Admission control: one token bucket per client IP and route class.
+// Over-limit requests get a static 429 with Retry-After before the rest of
+// the chain (and any JSON work) runs, so install it as the first global
+// middleware.
+esp_err_t rate_limit(httpd_req_t *req, NextHandler next);
+
+void configure_rate_limit(const RateLimitConfig &config);
+RouteClass classify_route(httpd_method_t method, std::string_view uri);
+const char *route_class_name(RouteClass route_class);
+
+RateLimitStats rate_limit_stats();
+void reset_rate_limit();
+
+} // namespace earbrain::middleware
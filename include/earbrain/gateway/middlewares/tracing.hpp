@@ -0,0 +1,18 @@
+#pragma once
+
+#include "earbrain/gateway/http_server.hpp"
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+namespace earbrain::middleware {
+
+// Starts a trace for the request: assigns a trace ID (echoed in X-Trace-Id,
+// unless 16 traces are already open),
+// records a root span and lets tracing::Span instances inside the chain,
+// handler and http::send_response attach to it. Register it first with
+// HttpServer::use() so the root span covers the whole middleware chain.
+// Spans are served at /api/v1/trace when CONFIG_EARBRAIN_GATEWAY_TRACE_ROUTE
+// is enabled.
+esp_err_t trace_request(httpd_req_t *req, NextHandler next);
+
+} // namespace earbrain::middleware
@@ -0,0 +1,53 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#include <utility>
+
+namespace earbrain {
+
+// Middleware chains fixed at compile time. A compile-time middleware is a
+// type with a static handle that takes the request and the rest of the
+// chain as a callable:
+//
+//   struct AddCustomHeader {
+//     template <typename Next>
+//     static esp_err_t handle(httpd_req_t *req, Next &&next) {
+//       httpd_resp_set_hdr(req, "X-Custom", "HelloWorld");
+//       return next(req);
+//     }
+//   };
+//
+// compose<handler, A, B> is a plain request handler that runs A, then B,
+// then handler. Every call in it is direct, so the compiler can inline the
+// whole chain into that one function: no std::function, no captured copies.
+// HttpServer::add_route<handler, A, B>(uri, method) registers it, and the
+// route still runs the global and RouteOptions middlewares around it.
+// Runtime middlewares (std::function) are not stages: wrap one as
+// as_stage<&middleware::log_request> (http_server.hpp), or pass it in
+// RouteOptions::middlewares.
+template <typename... Middlewares> struct Pipeline;
+
+template <> struct Pipeline<> {
+  template <esp_err_t (*Handler)(httpd_req_t *)>
+  static esp_err_t run(httpd_req_t *req) {
+    return Handler(req);
+  }
+};
+
+template <typename First, typename... Rest> struct Pipeline<First, Rest...> {
+  template <esp_err_t (*Handler)(httpd_req_t *)>
+  static esp_err_t run(httpd_req_t *req) {
+    return First::handle(req, [](httpd_req_t *r) {
+      return Pipeline<Rest...>::template run<Handler>(r);
+    });
+  }
+};
+
+template <esp_err_t (*Handler)(httpd_req_t *), typename... Middlewares>
+esp_err_t compose(httpd_req_t *req) {
+  return Pipeline<Middlewares...>::template run<Handler>(req);
+}
+
+} // namespace earbrain
@@ -0,0 +1,147 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <string_view>
+#include <type_traits>
+
+namespace earbrain {
+
+struct UriHandler;
+
+// A route's user data, remembered with the type it was registered as so a
+// handler reading it back as anything else gets nullptr rather than a bad
+// cast. Works without RTTI.
+class RouteData {
+public:
+  RouteData() = default;
+
+  template <typename T>
+  RouteData(T *value)
+    : value(const_cast<std::remove_cv_t<T> *>(value)),
+      tag(type_tag<std::remove_cv_t<T>>()) {}
+
+  template <typename T> T *get() const {
+    return tag == type_tag<std::remove_cv_t<T>>() ? static_cast<T *>(value)
+                                                  : nullptr;
+  }
+
+  explicit operator bool() const { return value != nullptr; }
+
+private:
+  template <typename T> static const void *type_tag() {
+    static constexpr char tag = 0;
+    return &tag;
+  }
+
+  void *value = nullptr;
+  const void *tag = nullptr;
+};
+
+// What a request carries besides httpd_req_t, parsed at most once. Every
+// route's requests are served inside one: HttpServer::dispatch keeps it on
+// its stack for the whole middleware chain and handler, and publishes it to
+// the task with a Scope, so middlewares and the handler share the parsed
+// query and the header lookups.
+//
+// Query parameters are percent-decoded in place into the context's own
+// buffer and handed out as views into it, valid until the request ends. A
+// query longer than query_capacity is ignored as a whole.
+class RequestContext {
+public:
+  static constexpr std::size_t query_capacity = 192;
+  static constexpr std::size_t max_params = 12;
+  static constexpr std::size_t max_cached_headers = 8;
+  // Names and values of the headers looked up.
+  static constexpr std::size_t header_capacity = 256;
+
+  // Publishes a context to the calling task until the Scope ends. A context
+  // can be published again from another task later, as async handlers do
+  // on every resume.
+  class Scope {
+  public:
+    explicit Scope(RequestContext &context);
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    RequestContext *outer;
+  };
+
+  RequestContext(httpd_req_t *req, const UriHandler *route);
+
+  RequestContext(const RequestContext &) = delete;
+  RequestContext &operator=(const RequestContext &) = delete;
+
+  // The context of the request being served on this task, or nullptr
+  // outside a route.
+  static RequestContext *current();
+
+  httpd_req_t *request() const { return req; }
+  const UriHandler *route() const { return handler; }
+
+  // The route's RouteOptions::user_data as a T, or nullptr when there is
+  // none or it was registered as another type.
+  template <typename T> T *user_data() const { return data.get<T>(); }
+
+  // The value of a query parameter; empty for "?key" and "?key=", and a
+  // view with a null data() when the parameter is absent.
+  std::string_view query(std::string_view key);
+  bool has_query(std::string_view key);
+
+  // Integer parameters clamped to [min, max]. fallback when the parameter
+  // is absent or is not entirely a number.
+  int64_t query_int(std::string_view key, int64_t fallback, int64_t min,
+                    int64_t max);
+  uint64_t query_uint(std::string_view key, uint64_t fallback,
+                      uint64_t min = 0, uint64_t max = UINT64_MAX);
+  // 1/true/yes and 0/false/no; fallback otherwise.
+  bool query_bool(std::string_view key, bool fallback);
+
+  // A request header, fetched from httpd once per name and kept, name and
+  // value, for the rest of the request. Names match case-insensitively. A
+  // view with a null data() when the header is absent; values that do not
+  // fit what is left of header_capacity are cut short. Names past
+  // max_cached_headers, or that do not fit themselves, read as absent.
+  std::string_view header(const char *name);
+
+private:
+  struct Param {
+    uint8_t key_at;
+    uint8_t key_len;
+    uint8_t value_at;
+    uint8_t value_len;
+  };
+
+  // The name at header_text + at, its value right after.
+  struct CachedHeader {
+    uint16_t at;
+    uint8_t name_len;
+    uint16_t len;
+    bool present;
+  };
+
+  void parse_query();
+  const Param *find_param(std::string_view key);
+
+  httpd_req_t *req;
+  const UriHandler *handler;
+  RouteData data;
+
+  bool query_parsed = false;
+  std::size_t param_count = 0;
+  Param params[max_params];
+  char query_text[query_capacity];
+
+  std::size_t header_count = 0;
+  std::size_t header_used = 0;
+  CachedHeader headers[max_cached_headers];
+  char header_text[header_capacity];
+};
+
+} // namespace earbrain
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <cstddef>
+
+namespace earbrain::response_cache {
+
+// Finished bodies of routes added with RouteOptions::cache_ttl_ms, kept per
+// representation (the route's ETag, see watch.hpp) so that a hit skips the
+// handler altogether: no producer, no cJSON, no printing, and one
+// httpd_resp_send of the stored bytes. Such routes need a version too.
+//
+// An entry is served only while the route's version still gives the same
+// ETag, and for at most the route's TTL. invalidate() drops everything at
+// once; Gateway calls it when its options or the mDNS service change.
+// Bodies over max_body_size are not kept, and the least recently used
+// entries make room once max_total_bytes would be passed.
+
+constexpr std::size_t max_body_size = 1024;
+constexpr std::size_t max_total_bytes = 4096;
+
+void invalidate();
+
+// Called by http::send_response on a task whose response is being kept;
+// no-ops elsewhere. content_type must be a string with static storage.
+void note_status(const char *http_status) noexcept;
+void note_body(const char *content_type, const char *body,
+               std::size_t len) noexcept;
+
+} // namespace earbrain::response_cache
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace earbrain::singleflight {
+
+// Request coalescing for routes added with RouteOptions::coalesce. Their
+// GETs are detached with the httpd async request API and the handler runs
+// on one of two worker tasks (started on demand), so the httpd task stays
+// free while, say, the logs are serialised. Identical GETs arriving
+// meanwhile (same path, same query parameters in any order) are parked as
+// detached requests and answered with the bytes the running one sent,
+// without running the handler again.
+// The route's middlewares still run for every request, on the httpd task,
+// before the handler is detached. What the measuring ones keep open (the
+// memory_governor reservation, heap_accounting, trace_request and
+// capture_request) goes along with the detached request and is closed once
+// it has been answered.
+//
+// Only responses sent through http::send_response are shared; when the
+// running request answered some other way, or failed, each parked request
+// runs the handler itself. Requests arriving after the response went out
+// start a new run.
+
+struct Stats {
+  uint32_t leaders = 0;   // handler runs others could join
+  uint32_t followers = 0; // requests answered with a leader's bytes
+  uint32_t fallbacks = 0; // waiters that had to run the handler themselves
+};
+
+// Called by http::send_response on the leader's task; no-ops elsewhere.
+// content_type must be a string with static storage.
+void note_status(const char *http_status) noexcept;
+void note_body(const char *content_type, const char *body,
+               std::size_t len) noexcept;
+
+Stats stats();
+
+} // namespace earbrain::singleflight
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace earbrain::tracing {
+
+struct SpanRecord {
+  uint32_t trace_id = 0;
+  // Static string; spans are named by string literals.
+  const char *name = nullptr;
+  int64_t start_us = 0;
+  uint32_t duration_us = 0;
+  // Request URI for the root span of a trace, empty otherwise.
+  char detail[24] = {};
+};
+
+// Finished spans are kept in a fixed ring; the oldest are overwritten.
+constexpr std::size_t ring_capacity = 48;
+
+// Scoped span. Recorded only while a trace is active on the calling task,
+// so instrumented code costs a thread-local read when tracing is off.
+class Span {
+public:
+  explicit Span(const char *name) noexcept;
+  ~Span();
+
+  Span(const Span &) = delete;
+  Span &operator=(const Span &) = delete;
+
+private:
+  const char *name;
+  uint32_t trace_id;
+  int64_t start_us;
+};
+
+// Trace of the request running on this task, or 0 when none is active.
+uint32_t current_trace_id() noexcept;
+
+// Server-Timing value for the active trace ("handler;dur=1.20, ..."), built
+// from the spans finished so far. nullptr when no trace is active.
+const char *server_timing() noexcept;
+
+// Copies finished spans, oldest first. Returns the number copied.
+std::size_t snapshot(SpanRecord *out, std::size_t capacity);
+
+} // namespace earbrain::tracing
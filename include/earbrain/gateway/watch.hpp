@@ -0,0 +1,81 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <string_view>
+#include <type_traits>
+
+namespace earbrain {
+
+// The version of what a GET route returns: it grows whenever the body would
+// change, and never goes back. Versions start at 1, so 0 always differs.
+using ResourceVersion = uint64_t (*)();
+
+namespace watch {
+
+// Routes added with RouteOptions::version send their version in the
+// X-Resource-Version header. A GET with ?wait_for_change_since=<version>
+// naming the current version is parked on the async executor until the
+// version moves or timeout_ms (default 20 s, at most 30 s) passes, and is
+// then answered as usual, with whatever version it has by then. Any other
+// version is answered at once, so a client can loop on the header it was
+// last sent without missing a change.
+//
+// Versions are polled, every 100 ms while anything is parked.
+//
+// Their GETs also carry a strong ETag made of the version, a number drawn
+// at boot and a hash of what selects the representation (path, query,
+// Accept, gzip), so it is known before any JSON is built. A GET whose
+// If-None-Match names it is answered with a bodiless 304 without running
+// the handler. The route's responses say Cache-Control: no-cache rather
+// than no-store, so browsers keep them to revalidate.
+
+constexpr const char *version_header = "X-Resource-Version";
+constexpr const char *since_param = "wait_for_change_since";
+constexpr const char *timeout_param = "timeout_ms";
+constexpr uint64_t default_timeout_ms = 20000;
+constexpr uint64_t max_timeout_ms = 30000;
+
+// The ETag of the versioned GET being served on this task, or nullptr.
+// http::send_response adds it to 200s; handlers that send by other means
+// add it themselves.
+const char *current_entity_tag();
+
+// FNV-1a over the parts of some state a body is built from.
+class Fingerprint {
+public:
+  Fingerprint &add(const void *data, std::size_t len);
+  // Length-prefixed, so ("ab", "c") and ("a", "bc") differ.
+  Fingerprint &add(std::string_view text);
+
+  template <typename T>
+    requires std::is_arithmetic_v<T> || std::is_enum_v<T>
+  Fingerprint &add(T value) {
+    return add(&value, sizeof(value));
+  }
+
+  uint64_t value() const { return hash; }
+
+private:
+  uint64_t hash = 0xcbf29ce484222325ULL;
+};
+
+// Turns fingerprints of a resource's state into its version, for state that
+// has no counter of its own. Only fingerprints someone observes count, so a
+// change undone before the next observation leaves the version alone; the
+// body is the same by then anyway.
+class Tracker {
+public:
+  uint64_t observe(uint64_t fingerprint);
+
+private:
+  std::mutex mutex;
+  bool seen = false;
+  uint64_t last = 0;
+  uint64_t version = 1;
+};
+
+} // namespace watch
+
+} // namespace earbrain
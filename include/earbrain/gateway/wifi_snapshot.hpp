@@ -0,0 +1,44 @@
+#pragma once
+
+#include "earbrain/wifi_service.hpp"
+
+#include "esp_err.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace earbrain::wifi_snapshot {
+
+// The Wi-Fi status as handlers show it, kept up to date from the Wi-Fi and
+// IP events rather than asked of the Wi-Fi service, whose status() takes
+// its lock, on every request. Reading takes no lock and never holds up a
+// publish: a read copies whichever of two slots was published last, and
+// only starts over if a publish reuses that slot meanwhile, which takes two
+// in a row.
+//
+// The IP address and error message are formatted once per change, and the
+// version grows by one whenever any field does, so it can be a route's
+// ResourceVersion as is.
+
+struct Snapshot {
+  WifiStatus status;
+  // Dotted quad while the station is connected, otherwise empty.
+  char ip[16];
+  // sta_last_error as clients are told it, empty for ESP_OK.
+  char error[64];
+  // 0 until the first publish.
+  uint64_t version;
+};
+
+// Registers for the events. Call once the Wi-Fi service is initialized, so
+// that its own handlers have run by the time these read its status.
+esp_err_t start();
+
+// Publishes wifi().status() if it differs from the last snapshot. For
+// callers that changed it themselves and should not wait for the event.
+void refresh();
+
+Snapshot read();
+uint64_t version();
+
+} // namespace earbrain::wifi_snapshot
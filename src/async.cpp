@@ -0,0 +1,433 @@
+#include "earbrain/gateway/async.hpp"
+
+#include "carry_context.hpp"
+#include "compression_context.hpp"
+#include "earbrain/gateway/http_server.hpp"
+#include "earbrain/gateway/request_context.hpp"
+#include "earbrain/logging.hpp"
+#include "task_thread.hpp"
+
+#include "esp_timer.h"
+
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace earbrain::async {
+
+namespace detail {
+
+// A detached request and its handler's frame, owned by the executor from
+// run() until the handler finishes.
+struct Session {
+  Session(httpd_req_t *req, const UriHandler *route, bool gzip)
+    : req(req), route(route ? route->weak_from_this().lock() : nullptr),
+      context(req, route), gzip(gzip) {}
+
+  httpd_req_t *req;
+  // Keeps the route alive should it be removed meanwhile.
+  std::shared_ptr<const UriHandler> route;
+  RequestContext context;
+  // What the route's middlewares were measuring, closed once answered.
+  carry::detail::Carried measures;
+  bool gzip;
+  Task::Handle handle;
+  bool detached = true;
+
+  // For a request that could not be detached, whose task waits here.
+  std::mutex mutex;
+  std::condition_variable done;
+  bool finished = false;
+  esp_err_t result = ESP_OK;
+};
+
+} // namespace detail
+
+namespace {
+
+using detail::Session;
+
+// How often watches look at what they wait for.
+constexpr int64_t watch_poll_us = 100'000;
+
+// The executor resumes handlers that build, print and send JSON; the helper
+// runs perform_scan and blocking receives. Both need more than the 3 KB
+// pthread default.
+constexpr std::size_t executor_stack_size = 6144;
+constexpr std::size_t helper_stack_size = 4096;
+
+struct Timer {
+  int64_t due_us;
+  Session *session;
+};
+
+struct Watch {
+  int64_t due_us;
+  Session *session;
+  bool (*changed)(void *arg);
+  void *arg;
+};
+
+// The executor and helper tasks are detached and never joined, so their
+// state is never destroyed either; see singleflight's WorkQueue.
+struct Executor {
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<Session *> ready;
+  std::vector<Timer> timers;
+  std::vector<Watch> watches;
+  int64_t next_poll_us = 0;
+  bool started = false;
+};
+
+struct Job {
+  void (*run)(void *arg);
+  void *arg;
+  // Resumed once run returns; nullptr when run resumes its waiters itself.
+  Session *session;
+};
+
+struct Helper {
+  std::mutex mutex;
+  std::condition_variable wake;
+  std::deque<Job> jobs;
+  bool started = false;
+};
+
+Executor &executor() {
+  static Executor *instance = new Executor;
+  return *instance;
+}
+
+Helper &helper() {
+  static Helper *instance = new Helper;
+  return *instance;
+}
+
+// The session being resumed on the executor.
+thread_local Session *resuming = nullptr;
+
+struct ScanWaiter {
+  Session *session;
+  WifiScanResult *out;
+};
+
+std::mutex scan_mutex;
+std::vector<ScanWaiter> scan_waiters;
+bool scan_running = false;
+
+void schedule(Session *session) {
+  Executor &ex = executor();
+  {
+    std::lock_guard<std::mutex> lock(ex.mutex);
+    ex.ready.push_back(session);
+  }
+  ex.wake.notify_one();
+}
+
+void finish(Session *session) {
+  const esp_err_t result = session->handle.promise().result;
+  session->handle.destroy();
+  session->handle = nullptr;
+
+  if (!session->detached) {
+    session->measures.complete(session->req, result);
+    // The waiting task owns the session from here.
+    std::lock_guard<std::mutex> lock(session->mutex);
+    session->result = result;
+    session->finished = true;
+    session->done.notify_one();
+    return;
+  }
+
+  if (result != ESP_OK) {
+    logging::warnf("gateway", "Async handler for %s failed: %s",
+                   session->req->uri, esp_err_to_name(result));
+    httpd_resp_send_err(session->req, HTTPD_500_INTERNAL_SERVER_ERROR,
+                        nullptr);
+  }
+  session->measures.complete(session->req, result);
+  httpd_req_async_handler_complete(session->req);
+  delete session;
+}
+
+void resume(Session *session) {
+  {
+    const RequestContext::Scope scope(session->context);
+    const carry::detail::Carried::Scope measured(session->measures);
+    compression::detail::set_requested(session->gzip);
+    resuming = session;
+    session->handle.resume();
+    resuming = nullptr;
+    compression::detail::set_requested(false);
+  }
+  if (session->handle.done()) {
+    finish(session);
+  }
+}
+
+// Caller holds ex.mutex. Moves whatever is due to the ready queue and
+// returns when the loop should next look, or -1 for never.
+int64_t collect_due(Executor &ex, int64_t now_us) {
+  int64_t next_us = -1;
+  auto earlier = [&](int64_t at_us) {
+    next_us = next_us < 0 ? at_us : std::min(next_us, at_us);
+  };
+
+  for (auto it = ex.timers.begin(); it != ex.timers.end();) {
+    if (it->due_us <= now_us) {
+      ex.ready.push_back(it->session);
+      it = ex.timers.erase(it);
+    } else {
+      earlier(it->due_us);
+      ++it;
+    }
+  }
+
+  if (ex.watches.empty()) {
+    return next_us;
+  }
+  const bool poll = now_us >= ex.next_poll_us;
+  for (auto it = ex.watches.begin(); it != ex.watches.end();) {
+    // A watch at its timeout looks once more, so it resumes with the latest.
+    const bool due = it->due_us <= now_us;
+    if ((poll || due) && (it->changed(it->arg) || due)) {
+      ex.ready.push_back(it->session);
+      it = ex.watches.erase(it);
+    } else {
+      ++it;
+    }
+  }
+  if (poll) {
+    ex.next_poll_us = now_us + watch_poll_us;
+  }
+  for (const Watch &watch : ex.watches) {
+    earlier(std::min(watch.due_us, ex.next_poll_us));
+  }
+  return next_us;
+}
+
+void executor_loop() {
+  Executor &ex = executor();
+  for (;;) {
+    Session *session = nullptr;
+    {
+      std::unique_lock<std::mutex> lock(ex.mutex);
+      for (;;) {
+        const int64_t now_us = esp_timer_get_time();
+        const int64_t next_us = collect_due(ex, now_us);
+        if (!ex.ready.empty()) {
+          session = ex.ready.front();
+          ex.ready.pop_front();
+          break;
+        }
+        if (next_us < 0) {
+          ex.wake.wait(lock);
+        } else {
+          ex.wake.wait_for(lock, std::chrono::microseconds(next_us - now_us));
+        }
+      }
+    }
+    resume(session);
+  }
+}
+
+void helper_loop() {
+  Helper &h = helper();
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(h.mutex);
+      h.wake.wait(lock, [&] { return !h.jobs.empty(); });
+      job = h.jobs.front();
+      h.jobs.pop_front();
+    }
+    job.run(job.arg);
+    if (job.session) {
+      schedule(job.session);
+    }
+  }
+}
+
+void post(const Job &job) {
+  Helper &h = helper();
+  {
+    std::lock_guard<std::mutex> lock(h.mutex);
+    h.jobs.push_back(job);
+    if (!h.started) {
+      earbrain::detail::start_task("async_helper", helper_stack_size,
+                                   helper_loop)
+          .detach();
+      h.started = true;
+    }
+  }
+  h.wake.notify_one();
+}
+
+void run_scan(void *) {
+  // No trace is active on the helper; handlers time their own wait.
+  const WifiScanResult result = wifi().perform_scan();
+
+  std::vector<ScanWaiter> waiters;
+  {
+    std::lock_guard<std::mutex> lock(scan_mutex);
+    waiters.swap(scan_waiters);
+    scan_running = false;
+  }
+  for (const ScanWaiter &waiter : waiters) {
+    *waiter.out = result;
+    schedule(waiter.session);
+  }
+}
+
+struct ReceiveJob {
+  httpd_req_t *req;
+  char *buf;
+  std::size_t len;
+  int *out;
+};
+
+void run_receive(void *arg) {
+  auto *job = static_cast<ReceiveJob *>(arg);
+  int ret = HTTPD_SOCK_ERR_TIMEOUT;
+  while (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+    ret = httpd_req_recv(job->req, job->buf, job->len);
+  }
+  *job->out = ret;
+  delete job;
+}
+
+void start_executor() {
+  Executor &ex = executor();
+  std::lock_guard<std::mutex> lock(ex.mutex);
+  if (!ex.started) {
+    earbrain::detail::start_task("async_exec", executor_stack_size,
+                                 executor_loop)
+        .detach();
+    ex.started = true;
+  }
+}
+
+} // namespace
+
+namespace detail {
+
+bool sleep(uint32_t ms) {
+  Session *session = resuming;
+  if (!session) {
+    return false;
+  }
+  Executor &ex = executor();
+  std::lock_guard<std::mutex> lock(ex.mutex);
+  ex.timers.push_back(
+      Timer{esp_timer_get_time() + static_cast<int64_t>(ms) * 1000, session});
+  return true;
+}
+
+bool scan(WifiScanResult *out) {
+  Session *session = resuming;
+  if (!session) {
+    return false;
+  }
+  bool start = false;
+  {
+    std::lock_guard<std::mutex> lock(scan_mutex);
+    scan_waiters.push_back(ScanWaiter{session, out});
+    start = !scan_running;
+    scan_running = true;
+  }
+  if (start) {
+    post(Job{&run_scan, nullptr, nullptr});
+  }
+  return true;
+}
+
+bool watch(bool (*changed)(void *arg), void *arg, uint32_t timeout_ms) {
+  Session *session = resuming;
+  if (!session) {
+    return false;
+  }
+  Executor &ex = executor();
+  std::lock_guard<std::mutex> lock(ex.mutex);
+  ex.watches.push_back(Watch{
+      esp_timer_get_time() + static_cast<int64_t>(timeout_ms) * 1000, session,
+      changed, arg});
+  return true;
+}
+
+bool receive(httpd_req_t *req, char *buf, std::size_t len, int *out) {
+  Session *session = resuming;
+  if (!session) {
+    return false;
+  }
+  auto *job = new (std::nothrow) ReceiveJob{req, buf, len, out};
+  if (!job) {
+    return false;
+  }
+  post(Job{&run_receive, job, session});
+  return true;
+}
+
+bool wifi_changed(const WifiStatus &a, const WifiStatus &b) {
+  return a.mode != b.mode || a.sta_connected != b.sta_connected ||
+         a.sta_connecting != b.sta_connecting ||
+         a.sta_ip.addr != b.sta_ip.addr ||
+         a.sta_last_error != b.sta_last_error;
+}
+
+} // namespace detail
+
+esp_err_t run(httpd_req_t *req, Handler handler) {
+  if (!req || !handler) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  const RequestContext *context = RequestContext::current();
+  const UriHandler *route =
+      context && context->request() == req ? context->route() : nullptr;
+  const bool gzip = compression::detail::requested();
+
+  httpd_req_t *detached = nullptr;
+  const bool is_detached =
+      httpd_req_async_handler_begin(req, &detached) == ESP_OK;
+  httpd_req_t *target = is_detached ? detached : req;
+
+  auto *session = new (std::nothrow) Session(target, route, gzip);
+  Task::Handle handle = session ? handler(target).release() : nullptr;
+  if (!handle) {
+    delete session;
+    if (!is_detached) {
+      return ESP_ERR_NO_MEM;
+    }
+    httpd_resp_send_err(detached, HTTPD_500_INTERNAL_SERVER_ERROR, nullptr);
+    httpd_req_async_handler_complete(detached);
+    return ESP_OK;
+  }
+  session->handle = handle;
+  session->detached = is_detached;
+  // Taken even when the calling task waits: the handler runs on the
+  // executor, where the middlewares' measures would not see it.
+  session->measures = carry::detail::Carried::take();
+
+  start_executor();
+  schedule(session);
+  if (is_detached) {
+    return ESP_OK;
+  }
+
+  // Could not detach: wait for the executor to finish the handler.
+  esp_err_t result = ESP_OK;
+  {
+    std::unique_lock<std::mutex> lock(session->mutex);
+    session->done.wait(lock, [&] { return session->finished; });
+    result = session->result;
+  }
+  delete session;
+  return result;
+}
+
+} // namespace earbrain::async
@@ -0,0 +1,485 @@
+#include "earbrain/gateway/body_reader.hpp"
+
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+
+namespace earbrain::http {
+
+namespace {
+
+constexpr std::size_t buffer_size = 128;
+// Nesting allowed inside values that are skipped.
+constexpr int max_depth = 8;
+constexpr int end_of_body = -1;
+
+// The body as a byte stream, refilled from the socket as it is consumed.
+class Source {
+public:
+  explicit Source(httpd_req_t *req)
+    : req(req), remaining(static_cast<std::size_t>(req->content_len)) {}
+
+  int peek() {
+    if (pos == len && !fill()) {
+      return end_of_body;
+    }
+    return static_cast<unsigned char>(buffer[pos]);
+  }
+
+  int next() {
+    const int c = peek();
+    if (c != end_of_body) {
+      ++pos;
+    }
+    return c;
+  }
+
+  bool failed() const { return read_failed; }
+
+private:
+  bool fill() {
+    while (remaining > 0) {
+      const int ret =
+          httpd_req_recv(req, buffer, remaining < buffer_size ? remaining
+                                                              : buffer_size);
+      if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+        continue;
+      }
+      if (ret <= 0) {
+        read_failed = true;
+        return false;
+      }
+      remaining -= static_cast<std::size_t>(ret);
+      pos = 0;
+      len = static_cast<std::size_t>(ret);
+      return true;
+    }
+    return false;
+  }
+
+  httpd_req_t *req;
+  std::size_t remaining;
+  char buffer[buffer_size];
+  std::size_t pos = 0;
+  std::size_t len = 0;
+  bool read_failed = false;
+};
+
+int hex_value(int c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+class Parser {
+public:
+  Parser(Source &in, BodyField *fields, std::size_t count)
+    : in(in), fields(fields), count(count) {}
+
+  BodyResult run() {
+    skip_space();
+    if (in.next() != '{' || !members()) {
+      return finish(BodyError::malformed);
+    }
+    skip_space();
+    if (in.next() != end_of_body) {
+      return finish(BodyError::malformed);
+    }
+    for (std::size_t i = 0; i < count; ++i) {
+      if (fields[i].required && !fields[i].seen) {
+        fail(BodyError::missing_field, fields[i].name);
+        break;
+      }
+    }
+    return finish(BodyError::none);
+  }
+
+private:
+  // The first error wins; a socket failure outranks the parse error it
+  // caused.
+  BodyResult finish(BodyError fallback) {
+    if (in.failed()) {
+      return BodyResult{BodyError::read_failed, nullptr};
+    }
+    if (result.error == BodyError::none) {
+      result.error = fallback;
+    }
+    return result;
+  }
+
+  bool fail(BodyError error, const char *field = nullptr) {
+    if (result.error == BodyError::none) {
+      result = BodyResult{error, field};
+    }
+    return false;
+  }
+
+  void skip_space() {
+    for (int c = in.peek(); c == ' ' || c == '\t' || c == '\n' || c == '\r';
+         c = in.peek()) {
+      in.next();
+    }
+  }
+
+  bool literal(const char *text) {
+    for (; *text; ++text) {
+      if (in.next() != *text) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  // After the opening brace of the top-level object.
+  bool members() {
+    skip_space();
+    if (in.peek() == '}') {
+      in.next();
+      return true;
+    }
+    for (;;) {
+      skip_space();
+      char key[32];
+      std::size_t key_len = 0;
+      bool key_fits = true;
+      if (in.next() != '"' ||
+          !string([&](char c) {
+            if (key_len + 1 < sizeof(key)) {
+              key[key_len++] = c;
+            } else {
+              key_fits = false;
+            }
+            return true;
+          })) {
+        return false;
+      }
+      key[key_len] = '\0';
+
+      skip_space();
+      if (in.next() != ':') {
+        return false;
+      }
+      skip_space();
+
+      BodyField *field = key_fits ? find(key) : nullptr;
+      if (!(field ? value(*field) : skip_value(0))) {
+        return false;
+      }
+
+      skip_space();
+      const int c = in.next();
+      if (c == '}') {
+        return true;
+      }
+      if (c != ',') {
+        return false;
+      }
+    }
+  }
+
+  BodyField *find(const char *key) {
+    for (std::size_t i = 0; i < count; ++i) {
+      if (std::strcmp(fields[i].name, key) == 0) {
+        return &fields[i];
+      }
+    }
+    return nullptr;
+  }
+
+  bool value(BodyField &field) {
+    field.seen = true;
+    const int c = in.peek();
+    switch (field.type) {
+    case BodyField::Type::string: {
+      if (c != '"') {
+        return fail(BodyError::wrong_type, field.name);
+      }
+      in.next();
+      std::string &out = *field.string_out;
+      out.clear();
+      const bool read = string([&](char ch) {
+        if (out.size() >= field.max_length) {
+          return false;
+        }
+        out.push_back(ch);
+        return true;
+      });
+      return read || fail(BodyError::too_long, field.name);
+    }
+    case BodyField::Type::boolean:
+      if (c == 't' && literal("true")) {
+        *field.bool_out = true;
+        return true;
+      }
+      if (c == 'f' && literal("false")) {
+        *field.bool_out = false;
+        return true;
+      }
+      return fail(BodyError::wrong_type, field.name);
+    case BodyField::Type::integer: {
+      char text[24];
+      bool integral = false;
+      if (!number(text, sizeof(text), integral)) {
+        return fail(BodyError::wrong_type, field.name);
+      }
+      errno = 0;
+      const long long parsed = std::strtoll(text, nullptr, 10);
+      if (!integral || errno == ERANGE) {
+        return fail(BodyError::wrong_type, field.name);
+      }
+      *field.int_out = parsed;
+      return true;
+    }
+    }
+    return false;
+  }
+
+  bool skip_value(int depth) {
+    if (depth > max_depth) {
+      return false;
+    }
+    const int c = in.peek();
+    switch (c) {
+    case '"':
+      in.next();
+      return string([](char) { return true; });
+    case 't':
+      return literal("true");
+    case 'f':
+      return literal("false");
+    case 'n':
+      return literal("null");
+    case '{':
+    case '[': {
+      in.next();
+      const int close = c == '{' ? '}' : ']';
+      skip_space();
+      if (in.peek() == close) {
+        in.next();
+        return true;
+      }
+      for (;;) {
+        skip_space();
+        if (c == '{') {
+          if (in.next() != '"' || !string([](char) { return true; })) {
+            return false;
+          }
+          skip_space();
+          if (in.next() != ':') {
+            return false;
+          }
+          skip_space();
+        }
+        if (!skip_value(depth + 1)) {
+          return false;
+        }
+        skip_space();
+        const int separator = in.next();
+        if (separator == close) {
+          return true;
+        }
+        if (separator != ',') {
+          return false;
+        }
+      }
+    }
+    default: {
+      char text[32];
+      bool integral = false;
+      return number(text, sizeof(text), integral);
+    }
+    }
+  }
+
+  // Reads a JSON number into text and checks its grammar.
+  bool number(char *text, std::size_t size, bool &integral) {
+    std::size_t n = 0;
+    for (int c = in.peek();
+         (c >= '0' && c <= '9') || c == '-' || c == '+' || c == '.' ||
+         c == 'e' || c == 'E';
+         c = in.peek()) {
+      if (n + 1 == size) {
+        return false;
+      }
+      text[n++] = static_cast<char>(in.next());
+    }
+    text[n] = '\0';
+
+    std::size_t i = 0;
+    if (text[i] == '-') {
+      ++i;
+    }
+    if (text[i] == '0') {
+      ++i;
+    } else if (text[i] >= '1' && text[i] <= '9') {
+      while (text[i] >= '0' && text[i] <= '9') {
+        ++i;
+      }
+    } else {
+      return false;
+    }
+    integral = text[i] == '\0';
+    if (text[i] == '.') {
+      ++i;
+      if (!(text[i] >= '0' && text[i] <= '9')) {
+        return false;
+      }
+      while (text[i] >= '0' && text[i] <= '9') {
+        ++i;
+      }
+    }
+    if (text[i] == 'e' || text[i] == 'E') {
+      ++i;
+      if (text[i] == '+' || text[i] == '-') {
+        ++i;
+      }
+      if (!(text[i] >= '0' && text[i] <= '9')) {
+        return false;
+      }
+      while (text[i] >= '0' && text[i] <= '9') {
+        ++i;
+      }
+    }
+    return text[i] == '\0';
+  }
+
+  // After the opening quote. put receives the decoded bytes and returns
+  // false to stop; a false return from here means malformed input or a
+  // refused byte.
+  template <typename Put> bool string(Put &&put) {
+    for (;;) {
+      const int c = in.next();
+      if (c == '"') {
+        return true;
+      }
+      if (c == end_of_body || c < 0x20) {
+        return fail(BodyError::malformed);
+      }
+      if (c != '\\') {
+        if (!put(static_cast<char>(c))) {
+          return false;
+        }
+        continue;
+      }
+
+      const int escape = in.next();
+      char decoded = 0;
+      switch (escape) {
+      case '"':
+      case '\\':
+      case '/':
+        decoded = static_cast<char>(escape);
+        break;
+      case 'b':
+        decoded = '\b';
+        break;
+      case 'f':
+        decoded = '\f';
+        break;
+      case 'n':
+        decoded = '\n';
+        break;
+      case 'r':
+        decoded = '\r';
+        break;
+      case 't':
+        decoded = '\t';
+        break;
+      case 'u':
+        if (!unicode(put)) {
+          return false;
+        }
+        continue;
+      default:
+        return fail(BodyError::malformed);
+      }
+      if (!put(decoded)) {
+        return false;
+      }
+    }
+  }
+
+  bool hex4(uint32_t &out) {
+    out = 0;
+    for (int i = 0; i < 4; ++i) {
+      const int digit = hex_value(in.next());
+      if (digit < 0) {
+        return false;
+      }
+      out = (out << 4) | static_cast<uint32_t>(digit);
+    }
+    return true;
+  }
+
+  // \uXXXX, with surrogate pairs, as UTF-8.
+  template <typename Put> bool unicode(Put &put) {
+    uint32_t code = 0;
+    if (!hex4(code)) {
+      return fail(BodyError::malformed);
+    }
+    if (code >= 0xd800 && code <= 0xdbff) {
+      uint32_t low = 0;
+      if (in.next() != '\\' || in.next() != 'u' || !hex4(low) ||
+          low < 0xdc00 || low > 0xdfff) {
+        return fail(BodyError::malformed);
+      }
+      code = 0x10000 + ((code - 0xd800) << 10) + (low - 0xdc00);
+    } else if (code >= 0xdc00 && code <= 0xdfff) {
+      return fail(BodyError::malformed);
+    }
+
+    char bytes[4];
+    std::size_t n = 0;
+    if (code < 0x80) {
+      bytes[n++] = static_cast<char>(code);
+    } else if (code < 0x800) {
+      bytes[n++] = static_cast<char>(0xc0 | (code >> 6));
+      bytes[n++] = static_cast<char>(0x80 | (code & 0x3f));
+    } else if (code < 0x10000) {
+      bytes[n++] = static_cast<char>(0xe0 | (code >> 12));
+      bytes[n++] = static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      bytes[n++] = static_cast<char>(0x80 | (code & 0x3f));
+    } else {
+      bytes[n++] = static_cast<char>(0xf0 | (code >> 18));
+      bytes[n++] = static_cast<char>(0x80 | ((code >> 12) & 0x3f));
+      bytes[n++] = static_cast<char>(0x80 | ((code >> 6) & 0x3f));
+      bytes[n++] = static_cast<char>(0x80 | (code & 0x3f));
+    }
+    for (std::size_t i = 0; i < n; ++i) {
+      if (!put(bytes[i])) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  Source &in;
+  BodyField *fields;
+  std::size_t count;
+  BodyResult result;
+};
+
+} // namespace
+
+BodyResult read_json_body(httpd_req_t *req, BodyField *fields,
+                          std::size_t count, std::size_t max_body_size) {
+  if (!req || req->content_len == 0 ||
+      static_cast<std::size_t>(req->content_len) > max_body_size) {
+    return BodyResult{BodyError::too_large, nullptr};
+  }
+  for (std::size_t i = 0; i < count; ++i) {
+    fields[i].seen = false;
+  }
+
+  Source in(req);
+  return Parser(in, fields, count).run();
+}
+
+} // namespace earbrain::http
@@ -0,0 +1,501 @@
+#include "earbrain/gateway/captive_dns.hpp"
+
+#include "captive_dns_context.hpp"
+#include "earbrain/logging.hpp"
+
+#include "task_thread.hpp"
+
+#include "esp_netif.h"
+#include "esp_random.h"
+#include "esp_timer.h"
+#include "lwip/ip4_addr.h"
+#include "lwip/sockets.h"
+
+#include <atomic>
+#include <cctype>
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <thread>
+
+namespace earbrain::captive_dns {
+
+namespace {
+
+constexpr char dns_tag[] = "captive_dns";
+
+constexpr std::size_t header_size = 12;
+constexpr uint16_t type_a = 1;
+constexpr uint16_t class_in = 1;
+constexpr uint8_t rcode_refused = 5;
+// Longest name in dotted form (RFC 1035).
+constexpr std::size_t max_name_length = 253;
+
+// How long the task waits in select() before checking whether to stop.
+constexpr int poll_interval_ms = 200;
+constexpr std::size_t max_forwards = 8;
+constexpr int64_t forward_timeout_us = 2000 * 1000;
+constexpr std::size_t task_stack_size = 4096;
+
+uint16_t read_u16(const uint8_t *p) {
+  return static_cast<uint16_t>(p[0] << 8 | p[1]);
+}
+
+void write_u16(uint8_t *p, uint16_t value) {
+  p[0] = static_cast<uint8_t>(value >> 8);
+  p[1] = static_cast<uint8_t>(value & 0xff);
+}
+
+struct Counters {
+  std::atomic<uint32_t> queries{0};
+  std::atomic<uint32_t> answered{0};
+  std::atomic<uint32_t> no_data{0};
+  std::atomic<uint32_t> forwarded{0};
+  std::atomic<uint32_t> refused{0};
+  std::atomic<uint32_t> dropped{0};
+};
+
+Counters counters;
+
+void count(std::atomic<uint32_t> &counter) {
+  counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+// A passthrough query waiting for the upstream resolver.
+struct Forward {
+  bool used = false;
+  sockaddr_in client{};
+  uint16_t client_id = 0;
+  uint16_t upstream_id = 0;
+  // The query as sent: header and question.
+  uint16_t question_len = 0;
+  int64_t sent_us = 0;
+};
+
+struct Responder {
+  int sock = -1;
+  int upstream_sock = -1;
+  sockaddr_in upstream{};
+  std::unique_ptr<detail::Rules> rules;
+  std::atomic<bool> running{false};
+  std::thread task;
+  Forward forwards[max_forwards];
+  // Only the task uses these; kept here rather than on its stack. in has a
+  // byte to spare, so a datagram over max_packet_size shows as one.
+  uint8_t in[detail::max_packet_size + 1];
+  uint8_t out[detail::max_packet_size];
+};
+
+std::mutex control_mutex;
+Responder responder;
+
+int open_socket(uint16_t port) {
+  const int sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+  if (sock < 0 || port == 0) {
+    return sock;
+  }
+  const int reuse = 1;
+  setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &reuse, sizeof(reuse));
+  sockaddr_in addr{};
+  addr.sin_family = AF_INET;
+  addr.sin_addr.s_addr = htonl(INADDR_ANY);
+  addr.sin_port = htons(port);
+  if (bind(sock, reinterpret_cast<const sockaddr *>(&addr), sizeof(addr)) !=
+      0) {
+    close(sock);
+    return -1;
+  }
+  return sock;
+}
+
+void close_sockets(Responder &r) {
+  if (r.sock >= 0) {
+    close(r.sock);
+    r.sock = -1;
+  }
+  if (r.upstream_sock >= 0) {
+    close(r.upstream_sock);
+    r.upstream_sock = -1;
+  }
+}
+
+void expire_forwards(Responder &r, int64_t now_us) {
+  for (Forward &forward : r.forwards) {
+    if (forward.used && now_us - forward.sent_us > forward_timeout_us) {
+      forward.used = false;
+      count(counters.dropped);
+    }
+  }
+}
+
+// A random ID no pending forward uses, so answers for two clients that
+// picked the same one can be told apart and a spoofed answer has to guess it.
+uint16_t fresh_id(const Responder &r) {
+  for (;;) {
+    const uint16_t id = static_cast<uint16_t>(esp_random());
+    bool taken = false;
+    for (const Forward &forward : r.forwards) {
+      taken = taken || (forward.used && forward.upstream_id == id);
+    }
+    if (!taken) {
+      return id;
+    }
+  }
+}
+
+void forward_query(Responder &r, const sockaddr_in &client,
+                   std::size_t question_len) {
+  Forward *slot = nullptr;
+  for (Forward &forward : r.forwards) {
+    if (!forward.used) {
+      slot = &forward;
+      break;
+    }
+  }
+  if (!slot) {
+    count(counters.dropped);
+    return;
+  }
+
+  *slot = Forward{true, client, read_u16(r.in), fresh_id(r),
+                  static_cast<uint16_t>(question_len), esp_timer_get_time()};
+  // Header and question only: without the client's OPT record the resolver
+  // answers within max_packet_size.
+  write_u16(r.in, slot->upstream_id);
+  write_u16(r.in + 10, 0);
+  if (sendto(r.upstream_sock, r.in, question_len, 0,
+             reinterpret_cast<const sockaddr *>(&r.upstream),
+             sizeof(r.upstream)) < 0) {
+    slot->used = false;
+    count(counters.dropped);
+    return;
+  }
+  count(counters.forwarded);
+}
+
+void relay_reply(Responder &r, const sockaddr_in &from, std::size_t len) {
+  // Only responses from the resolver's address and port.
+  if (len < header_size ||
+      from.sin_addr.s_addr != r.upstream.sin_addr.s_addr ||
+      from.sin_port != r.upstream.sin_port || (r.in[2] & 0x80) == 0) {
+    return;
+  }
+  const uint16_t id = read_u16(r.in);
+  for (Forward &forward : r.forwards) {
+    if (!forward.used || forward.upstream_id != id) {
+      continue;
+    }
+    if (len < forward.question_len) {
+      return;
+    }
+    if (len > detail::max_packet_size) {
+      // Too long for a classic client: header and question with TC set,
+      // rather than a reply cut mid-record.
+      r.in[2] |= 0x02;
+      write_u16(r.in + 6, 0);
+      write_u16(r.in + 8, 0);
+      write_u16(r.in + 10, 0);
+      len = forward.question_len;
+    }
+    write_u16(r.in, forward.client_id);
+    sendto(r.sock, r.in, len, 0,
+           reinterpret_cast<const sockaddr *>(&forward.client),
+           sizeof(forward.client));
+    forward.used = false;
+    return;
+  }
+}
+
+void serve_query(Responder &r, const sockaddr_in &client, std::size_t len) {
+  count(counters.queries);
+  std::size_t out_len = 0;
+  switch (r.rules->handle(r.in, len, r.out, out_len)) {
+  case detail::Action::drop:
+    count(counters.dropped);
+    return;
+  case detail::Action::forward:
+    forward_query(r, client, out_len);
+    return;
+  case detail::Action::answer:
+    count(counters.answered);
+    break;
+  case detail::Action::no_data:
+    count(counters.no_data);
+    break;
+  case detail::Action::refuse:
+    count(counters.refused);
+    break;
+  }
+  sendto(r.sock, r.out, out_len, 0,
+         reinterpret_cast<const sockaddr *>(&client), sizeof(client));
+}
+
+// Returns the datagram's length, or 0 when there was none. Longer ones come
+// back as max_packet_size + 1.
+std::size_t receive(int sock, uint8_t *buf, sockaddr_in &from) {
+  socklen_t from_len = sizeof(from);
+  const ssize_t n =
+      recvfrom(sock, buf, detail::max_packet_size + 1, MSG_DONTWAIT,
+               reinterpret_cast<sockaddr *>(&from), &from_len);
+  return n > 0 ? static_cast<std::size_t>(n) : 0;
+}
+
+void run(Responder &r) {
+  while (r.running.load(std::memory_order_acquire)) {
+    fd_set readable;
+    FD_ZERO(&readable);
+    FD_SET(r.sock, &readable);
+    int max_fd = r.sock;
+    if (r.upstream_sock >= 0) {
+      FD_SET(r.upstream_sock, &readable);
+      max_fd = r.upstream_sock > max_fd ? r.upstream_sock : max_fd;
+    }
+    timeval timeout{0, poll_interval_ms * 1000};
+    const int ready = select(max_fd + 1, &readable, nullptr, nullptr, &timeout);
+    if (ready < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      logging::errorf(dns_tag, "select failed: errno %d", errno);
+      r.running.store(false, std::memory_order_release);
+      return;
+    }
+
+    expire_forwards(r, esp_timer_get_time());
+    if (ready == 0) {
+      continue;
+    }
+
+    sockaddr_in from{};
+    if (FD_ISSET(r.sock, &readable)) {
+      if (const std::size_t len = receive(r.sock, r.in, from)) {
+        serve_query(r, from, len);
+      }
+    }
+    if (r.upstream_sock >= 0 && FD_ISSET(r.upstream_sock, &readable)) {
+      if (const std::size_t len = receive(r.upstream_sock, r.in, from)) {
+        relay_reply(r, from, len);
+      }
+    }
+  }
+}
+
+} // namespace
+
+namespace detail {
+
+Rules::Rules(const CaptiveDnsConfig &config, uint32_t answer_ip)
+  : has_upstream(config.upstream != 0) {
+  passthrough.reserve(config.passthrough.size());
+  for (std::string name : config.passthrough) {
+    while (!name.empty() && name.back() == '.') {
+      name.pop_back();
+    }
+    for (char &c : name) {
+      c = static_cast<char>(std::tolower(static_cast<unsigned char>(c)));
+    }
+    if (!name.empty()) {
+      passthrough.push_back(std::move(name));
+    }
+  }
+
+  const uint8_t record[] = {
+      0xc0, header_size, // the question's name
+      0, type_a, 0, class_in,
+      static_cast<uint8_t>(answer_ttl_s >> 24),
+      static_cast<uint8_t>(answer_ttl_s >> 16),
+      static_cast<uint8_t>(answer_ttl_s >> 8),
+      static_cast<uint8_t>(answer_ttl_s),
+      0, 4,
+  };
+  static_assert(sizeof(record) + sizeof(answer_ip) == sizeof(answer));
+  std::memcpy(answer, record, sizeof(record));
+  std::memcpy(answer + sizeof(record), &answer_ip, sizeof(answer_ip));
+}
+
+bool Rules::passes_through(const char *name, std::size_t len) const {
+  for (const std::string &entry : passthrough) {
+    if (len == entry.size() && std::memcmp(name, entry.data(), len) == 0) {
+      return true;
+    }
+    if (len > entry.size() && name[len - entry.size() - 1] == '.' &&
+        std::memcmp(name + len - entry.size(), entry.data(), entry.size()) ==
+            0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+Action Rules::handle(const uint8_t *query, std::size_t len, uint8_t *out,
+                     std::size_t &out_len) const {
+  if (len < header_size || len > max_packet_size) {
+    return Action::drop;
+  }
+  // Standard queries (QR and OPCODE clear) with the one question every
+  // resolver sends.
+  const uint8_t flags = query[2];
+  if ((flags & 0xf8) != 0 || read_u16(query + 4) != 1) {
+    return Action::drop;
+  }
+
+  char name[max_name_length + 1];
+  std::size_t name_len = 0;
+  std::size_t at = header_size;
+  for (;;) {
+    if (at >= len) {
+      return Action::drop;
+    }
+    const std::size_t label = query[at++];
+    if (label == 0) {
+      break;
+    }
+    // Also rules out compression pointers, which a question has no use for.
+    const std::size_t dot = name_len > 0 ? 1 : 0;
+    if (label > 63 || at + label > len ||
+        name_len + dot + label > max_name_length) {
+      return Action::drop;
+    }
+    if (dot) {
+      name[name_len++] = '.';
+    }
+    for (std::size_t i = 0; i < label; ++i) {
+      name[name_len++] =
+          static_cast<char>(std::tolower(static_cast<unsigned char>(query[at + i])));
+    }
+    at += label;
+  }
+  if (at + 4 > len) {
+    return Action::drop;
+  }
+  const uint16_t qtype = read_u16(query + at);
+  const uint16_t qclass = read_u16(query + at + 2);
+  const std::size_t question_end = at + 4;
+  if (question_end + sizeof(answer) > max_packet_size) {
+    return Action::drop;
+  }
+
+  Action action = Action::no_data;
+  if (passes_through(name, name_len)) {
+    if (has_upstream) {
+      out_len = question_end;
+      return Action::forward;
+    }
+    action = Action::refuse;
+  } else if (qtype == type_a && qclass == class_in) {
+    action = Action::answer;
+  }
+
+  // The header and question as asked; anything after them (EDNS) is left
+  // out. QR and AA set, RD echoed.
+  std::memcpy(out, query, question_end);
+  out[2] = static_cast<uint8_t>(0x80 | 0x04 | (flags & 0x01));
+  out[3] = action == Action::refuse ? rcode_refused : 0;
+  write_u16(out + 6, action == Action::answer ? 1 : 0);
+  write_u16(out + 8, 0);
+  write_u16(out + 10, 0);
+  out_len = question_end;
+  if (action == Action::answer) {
+    std::memcpy(out + question_end, answer, sizeof(answer));
+    out_len += sizeof(answer);
+  }
+  return action;
+}
+
+} // namespace detail
+
+uint32_t portal_address() {
+  esp_netif_t *ap = esp_netif_get_handle_from_ifkey("WIFI_AP_DEF");
+  esp_netif_ip_info_t info{};
+  if (ap && esp_netif_get_ip_info(ap, &info) == ESP_OK && info.ip.addr != 0) {
+    return info.ip.addr;
+  }
+  // ESP-IDF's default for the soft-AP.
+  return ESP_IP4TOADDR(192, 168, 4, 1);
+}
+
+esp_err_t start(const CaptiveDnsConfig &config) {
+  std::lock_guard<std::mutex> lock(control_mutex);
+  if (responder.task.joinable()) {
+    return ESP_ERR_INVALID_STATE;
+  }
+
+  const uint32_t address = portal_address();
+  std::unique_ptr<detail::Rules> rules(new (std::nothrow)
+                                           detail::Rules(config, address));
+  if (!rules) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  responder.sock = open_socket(config.port);
+  if (responder.sock < 0) {
+    logging::errorf(dns_tag, "Failed to bind UDP port %u: errno %d",
+                    static_cast<unsigned>(config.port), errno);
+    return ESP_FAIL;
+  }
+  if (config.upstream != 0) {
+    responder.upstream_sock = open_socket(0);
+    if (responder.upstream_sock < 0) {
+      logging::errorf(dns_tag, "Failed to open upstream socket: errno %d",
+                      errno);
+      close_sockets(responder);
+      return ESP_FAIL;
+    }
+    responder.upstream = sockaddr_in{};
+    responder.upstream.sin_family = AF_INET;
+    responder.upstream.sin_addr.s_addr = config.upstream;
+    responder.upstream.sin_port = htons(config.upstream_port);
+  }
+
+  responder.rules = std::move(rules);
+  for (Forward &forward : responder.forwards) {
+    forward.used = false;
+  }
+  responder.running.store(true, std::memory_order_release);
+  responder.task = earbrain::detail::start_task(
+      "captive_dns", task_stack_size, [] { run(responder); });
+
+  char text[16] = "";
+  const ip4_addr_t ip{address};
+  ip4addr_ntoa_r(&ip, text, sizeof(text));
+  logging::infof(dns_tag, "Answering DNS on port %u with %s",
+                 static_cast<unsigned>(config.port), text);
+  return ESP_OK;
+}
+
+void stop() {
+  std::lock_guard<std::mutex> lock(control_mutex);
+  if (!responder.task.joinable()) {
+    return;
+  }
+  responder.running.store(false, std::memory_order_release);
+  responder.task.join();
+  close_sockets(responder);
+  responder.rules.reset();
+}
+
+bool running() { return responder.running.load(std::memory_order_acquire); }
+
+Stats stats() {
+  Stats out;
+  out.queries = counters.queries.load(std::memory_order_relaxed);
+  out.answered = counters.answered.load(std::memory_order_relaxed);
+  out.no_data = counters.no_data.load(std::memory_order_relaxed);
+  out.forwarded = counters.forwarded.load(std::memory_order_relaxed);
+  out.refused = counters.refused.load(std::memory_order_relaxed);
+  out.dropped = counters.dropped.load(std::memory_order_relaxed);
+  return out;
+}
+
+void reset_stats() {
+  counters.queries.store(0, std::memory_order_relaxed);
+  counters.answered.store(0, std::memory_order_relaxed);
+  counters.no_data.store(0, std::memory_order_relaxed);
+  counters.forwarded.store(0, std::memory_order_relaxed);
+  counters.refused.store(0, std::memory_order_relaxed);
+  counters.dropped.store(0, std::memory_order_relaxed);
+}
+
+} // namespace earbrain::captive_dns
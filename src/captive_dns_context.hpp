@@ -0,0 +1,48 @@
+#pragma once
+
+#include "earbrain/gateway/captive_dns.hpp"
+
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace earbrain::captive_dns::detail {
+
+// Classic DNS over UDP; longer queries are dropped. EDNS is not offered:
+// forwarded queries go out without their OPT record, so the resolver keeps
+// its replies to this size too, and one that does not is cut (TC set).
+constexpr std::size_t max_packet_size = 512;
+
+// What to do with a query. answer, no_data and refuse come with a reply.
+enum class Action {
+  drop,
+  answer,
+  no_data,
+  refuse,
+  forward,
+};
+
+// The responder's decisions, kept apart from its sockets.
+class Rules {
+public:
+  // answer_ip in network order.
+  Rules(const CaptiveDnsConfig &config, uint32_t answer_ip);
+
+  // Reads one query and, when there is a reply, writes it to out
+  // (max_packet_size bytes) and its length to out_len. For forward, out_len
+  // is where the question ends, which is all that is sent upstream.
+  Action handle(const uint8_t *query, std::size_t len, uint8_t *out,
+                std::size_t &out_len) const;
+
+private:
+  bool passes_through(const char *name, std::size_t len) const;
+
+  std::vector<std::string> passthrough;
+  bool has_upstream;
+  // TYPE A, CLASS IN, TTL, RDLENGTH and the address, after a pointer to
+  // the question's name.
+  uint8_t answer[16];
+};
+
+} // namespace earbrain::captive_dns::detail
@@ -0,0 +1,127 @@
+#include "earbrain/gateway/captive_probe.hpp"
+
+#include "earbrain/gateway/captive_dns.hpp"
+
+#include "lwip/ip4_addr.h"
+
+#include <atomic>
+#include <cctype>
+#include <cstdio>
+
+namespace earbrain::captive_probe {
+
+namespace {
+
+std::span<const std::string_view> probe_paths;
+
+std::atomic<uint32_t> probe_count{0};
+std::atomic<uint32_t> redirect_count{0};
+std::atomic<uint32_t> not_found_count{0};
+
+void count(std::atomic<uint32_t> &counter) {
+  counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+// "http://<portal address>/", formatted on first use.
+struct PortalLocation {
+  char text[sizeof("http://255.255.255.255/")] = "";
+
+  PortalLocation() {
+    const ip4_addr_t ip{captive_dns::portal_address()};
+    char address[16] = "";
+    ip4addr_ntoa_r(&ip, address, sizeof(address));
+    std::snprintf(text, sizeof(text), "http://%s/", address);
+  }
+};
+
+const char *portal_location() {
+  static const PortalLocation location;
+  return location.text;
+}
+
+bool ends_with_ignoring_case(std::string_view text, std::string_view suffix) {
+  if (text.size() < suffix.size()) {
+    return false;
+  }
+  text.remove_prefix(text.size() - suffix.size());
+  for (std::size_t i = 0; i < suffix.size(); ++i) {
+    if (std::tolower(static_cast<unsigned char>(text[i])) != suffix[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Whether a Host header names the gateway rather than some site whose
+// lookup the captive DNS answered.
+bool names_gateway(std::string_view host) {
+  if (host.empty() || host.front() == '[') {
+    return true; // none given, or an IPv6 literal
+  }
+  host = host.substr(0, host.rfind(':'));
+  if (host.find_first_not_of("0123456789.") == std::string_view::npos) {
+    return true;
+  }
+  return ends_with_ignoring_case(host, "localhost") ||
+         ends_with_ignoring_case(host, ".local");
+}
+
+bool from_gateway_host(httpd_req_t *req) {
+  char host[64];
+  const std::size_t len = httpd_req_get_hdr_value_len(req, "Host");
+  if (len == 0) {
+    return true;
+  }
+  if (len >= sizeof(host) ||
+      httpd_req_get_hdr_value_str(req, "Host", host, sizeof(host)) != ESP_OK) {
+    return false;
+  }
+  return names_gateway(std::string_view{host, len});
+}
+
+bool is_probe(std::string_view path) {
+  for (const std::string_view probe : probe_paths) {
+    if (path == probe) {
+      return true;
+    }
+  }
+  return false;
+}
+
+esp_err_t redirect_to_portal(httpd_req_t *req) {
+  httpd_resp_set_status(req, "302 Found");
+  httpd_resp_set_hdr(req, "Location", portal_location());
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+  return httpd_resp_send(req, nullptr, 0);
+}
+
+} // namespace
+
+void configure(std::span<const std::string_view> paths) { probe_paths = paths; }
+
+esp_err_t handle_not_found(httpd_req_t *req, httpd_err_code_t error) {
+  if (error == HTTPD_404_NOT_FOUND &&
+      (req->method == HTTP_GET || req->method == HTTP_HEAD)) {
+    const std::string_view uri{req->uri};
+    if (is_probe(uri.substr(0, uri.find('?')))) {
+      count(probe_count);
+      return redirect_to_portal(req);
+    }
+    if (!from_gateway_host(req)) {
+      count(redirect_count);
+      return redirect_to_portal(req);
+    }
+  }
+  count(not_found_count);
+  return httpd_resp_send_err(req, error, nullptr);
+}
+
+Stats stats() {
+  Stats out;
+  out.probes = probe_count.load(std::memory_order_relaxed);
+  out.redirects = redirect_count.load(std::memory_order_relaxed);
+  out.not_found = not_found_count.load(std::memory_order_relaxed);
+  return out;
+}
+
+} // namespace earbrain::captive_probe
@@ -0,0 +1,213 @@
+#include "earbrain/gateway/capture.hpp"
+
+#include "capture_context.hpp"
+
+#include "esp_timer.h"
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <new>
+
+namespace earbrain::capture {
+
+namespace {
+
+// Largest possible record: fixed part, URI and every captured header.
+constexpr std::size_t fixed_record_size = 2 + 1 + 1 + 4 + 4 + 2 + 4 + 1 + 1;
+constexpr std::size_t max_record_size =
+    fixed_record_size + max_uri_length +
+    captured_header_count * (2 + max_header_length);
+static_assert(max_record_size <= ring_bytes / 4,
+              "capture ring must hold several worst-case records");
+
+thread_local detail::RequestCapture *active_capture = nullptr;
+
+std::mutex ring_mutex;
+std::unique_ptr<uint8_t[]> ring;
+std::size_t ring_tail = 0; // oldest record
+std::size_t ring_used = 0;
+uint32_t dropped_records = 0;
+
+class Writer {
+public:
+  Writer(uint8_t *out, std::size_t capacity) : out(out), capacity(capacity) {}
+
+  void u8(uint8_t value) {
+    if (size < capacity) {
+      out[size++] = value;
+    }
+  }
+  void u16(uint16_t value) {
+    u8(static_cast<uint8_t>(value));
+    u8(static_cast<uint8_t>(value >> 8));
+  }
+  void u32(uint32_t value) {
+    u16(static_cast<uint16_t>(value));
+    u16(static_cast<uint16_t>(value >> 16));
+  }
+  void bytes(const void *data, std::size_t len) {
+    len = std::min(len, capacity - size);
+    std::memcpy(out + size, data, len);
+    size += len;
+  }
+  void patch_u16(std::size_t at, uint16_t value) {
+    out[at] = static_cast<uint8_t>(value);
+    out[at + 1] = static_cast<uint8_t>(value >> 8);
+  }
+
+  uint8_t *out;
+  std::size_t capacity;
+  std::size_t size = 0;
+};
+
+uint16_t read_size(std::size_t at) {
+  return static_cast<uint16_t>(ring[at % ring_bytes] |
+                               (ring[(at + 1) % ring_bytes] << 8));
+}
+
+// Caller holds ring_mutex.
+bool append(const uint8_t *record, std::size_t size) {
+  if (!ring) {
+    ring.reset(new (std::nothrow) uint8_t[ring_bytes]);
+    if (!ring) {
+      return false;
+    }
+  }
+
+  while (ring_bytes - ring_used < size) {
+    const uint16_t oldest = read_size(ring_tail);
+    ring_tail = (ring_tail + oldest) % ring_bytes;
+    ring_used -= oldest;
+    ++dropped_records;
+  }
+
+  const std::size_t head = (ring_tail + ring_used) % ring_bytes;
+  const std::size_t first = std::min(size, ring_bytes - head);
+  std::memcpy(ring.get() + head, record, first);
+  std::memcpy(ring.get(), record + first, size - first);
+  ring_used += size;
+  return true;
+}
+
+std::size_t encode(uint8_t *out, const detail::RequestCapture &capture,
+                   httpd_req_t *req, esp_err_t result) {
+  Writer writer(out, max_record_size);
+  const int64_t now_us = esp_timer_get_time();
+
+  const std::size_t uri_len = std::strlen(req->uri);
+  uint8_t flags = 0;
+  if (result != ESP_OK) {
+    flags |= record_flag_handler_failed;
+  }
+  if (uri_len > max_uri_length) {
+    flags |= record_flag_uri_truncated;
+  }
+
+  uint16_t status = capture.status;
+  if (status == 0 && result == ESP_OK) {
+    status = 200;
+  }
+
+  writer.u16(0); // size, patched below
+  writer.u8(static_cast<uint8_t>(req->method));
+  writer.u8(flags);
+  writer.u32(static_cast<uint32_t>(capture.start_us / 1000));
+  writer.u32(static_cast<uint32_t>(std::max<int64_t>(now_us - capture.start_us, 0)));
+  writer.u16(status);
+  writer.u32(static_cast<uint32_t>(req->content_len));
+  writer.u8(static_cast<uint8_t>(std::min(uri_len, max_uri_length)));
+  writer.bytes(req->uri, std::min(uri_len, max_uri_length));
+
+  const std::size_t count_at = writer.size;
+  writer.u8(0);
+  uint8_t header_count = 0;
+  char value[max_header_length + 1];
+  for (std::size_t id = 0; id < captured_header_count; ++id) {
+    const std::size_t len = httpd_req_get_hdr_value_len(req, captured_headers[id]);
+    if (len == 0) {
+      continue;
+    }
+    // Truncated values are kept: they are only replayed, never parsed.
+    const esp_err_t err = httpd_req_get_hdr_value_str(
+        req, captured_headers[id], value, sizeof(value));
+    if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+      continue;
+    }
+    const std::size_t stored = std::min(len, max_header_length);
+    writer.u8(static_cast<uint8_t>(id));
+    writer.u8(static_cast<uint8_t>(stored));
+    writer.bytes(value, stored);
+    ++header_count;
+  }
+  out[count_at] = header_count;
+
+  writer.patch_u16(0, static_cast<uint16_t>(writer.size));
+  return writer.size;
+}
+
+} // namespace
+
+namespace detail {
+
+void begin(RequestCapture &capture) {
+  capture.start_us = esp_timer_get_time();
+  capture.status = 0;
+  enter(capture);
+}
+
+void enter(RequestCapture &capture) {
+  capture.outer = active_capture;
+  active_capture = &capture;
+}
+
+void leave(RequestCapture &capture) { active_capture = capture.outer; }
+
+void end(RequestCapture &capture, httpd_req_t *req, esp_err_t result) {
+  uint8_t record[max_record_size];
+  const std::size_t size = encode(record, capture, req, result);
+
+  std::lock_guard<std::mutex> lock(ring_mutex);
+  append(record, size);
+}
+
+} // namespace detail
+
+void note_status(const char *http_status) noexcept {
+  if (!active_capture || !http_status) {
+    return;
+  }
+  active_capture->status =
+      static_cast<uint16_t>(std::strtoul(http_status, nullptr, 10));
+}
+
+std::vector<uint8_t> export_ring() {
+  std::lock_guard<std::mutex> lock(ring_mutex);
+
+  std::vector<uint8_t> out(header_size + ring_used);
+  Writer writer(out.data(), out.size());
+  writer.bytes("EBCP", 4);
+  writer.u8(format_version);
+  writer.u8(0);
+  writer.u16(static_cast<uint16_t>(header_size));
+  writer.u32(dropped_records);
+  writer.u32(static_cast<uint32_t>(esp_timer_get_time() / 1000));
+
+  if (ring_used > 0) {
+    const std::size_t first = std::min(ring_used, ring_bytes - ring_tail);
+    writer.bytes(ring.get() + ring_tail, first);
+    writer.bytes(ring.get(), ring_used - first);
+  }
+  return out;
+}
+
+void reset() {
+  std::lock_guard<std::mutex> lock(ring_mutex);
+  ring_tail = 0;
+  ring_used = 0;
+  dropped_records = 0;
+}
+
+} // namespace earbrain::capture
@@ -0,0 +1,29 @@
+#pragma once
+
+#include "earbrain/gateway/capture.hpp"
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#include <cstdint>
+
+namespace earbrain::capture::detail {
+
+// Per-request capture state. Lives on the stack of
+// middleware::capture_request and is published to the task through a
+// thread-local pointer so note_status() can fill in the status.
+struct RequestCapture {
+  int64_t start_us = 0;
+  uint16_t status = 0;
+  RequestCapture *outer = nullptr;
+};
+
+// Starts a capture and publishes it to the calling task.
+void begin(RequestCapture &capture);
+// Publishes a started capture to the calling task, and withdraws it.
+void enter(RequestCapture &capture);
+void leave(RequestCapture &capture);
+// Records a withdrawn capture.
+void end(RequestCapture &capture, httpd_req_t *req, esp_err_t result);
+
+} // namespace earbrain::capture::detail
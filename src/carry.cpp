@@ -0,0 +1,113 @@
+#include "carry_context.hpp"
+
+#include "heap_scope.hpp"
+
+#include <utility>
+
+namespace earbrain::carry::detail {
+
+namespace {
+
+// Innermost measure open on this task.
+thread_local Measure *open_measures = nullptr;
+
+} // namespace
+
+void Carried::enter_outermost_first(Measure *measure) {
+  if (!measure) {
+    return;
+  }
+  // The chain is a handful of middlewares deep.
+  enter_outermost_first(measure->outer);
+  measure->enter();
+}
+
+Open::Open(Measure &measure) : measure(measure) {
+  measure.outer = open_measures;
+  open_measures = &measure;
+}
+
+Open::~Open() { open_measures = measure.outer; }
+
+Carried::Carried(Carried &&other) noexcept
+  : innermost(std::exchange(other.innermost, nullptr)) {}
+
+Carried &Carried::operator=(Carried &&other) noexcept {
+  if (this != &other) {
+    Carried dropped(std::move(*this));
+    innermost = std::exchange(other.innermost, nullptr);
+  }
+  return *this;
+}
+
+Carried::~Carried() {
+  while (innermost) {
+    delete std::exchange(innermost, innermost->outer);
+  }
+}
+
+Carried Carried::take() {
+  // The copies belong to the detached request, not to what it measured.
+  const heap::detail::Untracked untracked;
+
+  Carried carried;
+  Measure *last = nullptr;
+  for (Measure *open = open_measures; open; open = open->outer) {
+    if (open->carried) {
+      continue;
+    }
+    Measure *copy = open->clone();
+    if (!copy) {
+      continue;
+    }
+    copy->carried = false;
+    copy->outer = nullptr;
+    open->carried = true;
+    (last ? last->outer : carried.innermost) = copy;
+    last = copy;
+  }
+  return carried;
+}
+
+Carried::Scope::Scope(Carried &carried)
+  : carried(carried), outer(open_measures) {
+  if (!carried.innermost) {
+    return;
+  }
+  enter_outermost_first(carried.innermost);
+  Measure *outermost = carried.innermost;
+  while (outermost->outer) {
+    outermost = outermost->outer;
+  }
+  outermost->outer = outer;
+  open_measures = carried.innermost;
+}
+
+Carried::Scope::~Scope() {
+  if (!carried.innermost) {
+    return;
+  }
+  open_measures = outer;
+  Measure *measure = carried.innermost;
+  for (;;) {
+    measure->leave();
+    if (measure->outer == outer) {
+      measure->outer = nullptr;
+      return;
+    }
+    measure = measure->outer;
+  }
+}
+
+void Carried::complete(httpd_req_t *req, esp_err_t result) {
+  while (innermost) {
+    Measure *measure = std::exchange(innermost, innermost->outer);
+    // Carried on once more by a request detached again; that one finishes.
+    if (!measure->carried) {
+      measure->finish(req, result);
+    }
+    delete measure;
+  }
+}
+
+} // namespace earbrain::carry::detail
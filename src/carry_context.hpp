@@ -0,0 +1,100 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+namespace earbrain::carry::detail {
+
+// Something a measuring middleware (memory_governor, heap_accounting,
+// trace_request, capture_request) keeps open around next(): a heap scope, a
+// reservation, a trace, a capture. Those middlewares expect the handler to
+// be done once next() returns, which is not so for a request that async::run
+// or singleflight detaches. Before detaching, they call Carried::take(): every
+// measure open on the task is copied to the heap and the original marked
+// carried, so its middleware leaves the work after next() to the copy. The
+// detached request publishes the copies while its handler runs and completes
+// them once it has been answered.
+class Measure {
+public:
+  virtual ~Measure() = default;
+
+  // A heap copy, or nullptr when out of memory. The copy may take over
+  // state the original, whose work is left to it, no longer needs.
+  virtual Measure *clone() = 0;
+  // Publishes the measure to the calling task, and withdraws it.
+  virtual void enter() = 0;
+  virtual void leave() = 0;
+  // What the middleware does after next(). Runs withdrawn.
+  virtual void finish(httpd_req_t *req, esp_err_t result) = 0;
+
+  // Set once take() copied the measure.
+  bool carried = false;
+
+protected:
+  Measure() = default;
+  Measure(const Measure &) = default;
+  Measure &operator=(const Measure &) = delete;
+
+private:
+  friend class Open;
+  friend class Carried;
+
+  Measure *outer = nullptr;
+};
+
+// Lists measure as open on the calling task while alive. The middleware
+// publishes the measure itself.
+class Open {
+public:
+  explicit Open(Measure &measure);
+  ~Open();
+
+  Open(const Open &) = delete;
+  Open &operator=(const Open &) = delete;
+
+private:
+  Measure &measure;
+};
+
+// The copies take() made, innermost first. Must be completed: a dropped
+// copy never finishes, and a governor reservation it holds stays taken.
+class Carried {
+public:
+  Carried() = default;
+  Carried(Carried &&other) noexcept;
+  Carried &operator=(Carried &&other) noexcept;
+  ~Carried();
+
+  Carried(const Carried &) = delete;
+  Carried &operator=(const Carried &) = delete;
+
+  // Copies every measure open on the calling task. Empty when none is, or
+  // for whichever could not be copied; those finish with their middleware.
+  static Carried take();
+
+  // Publishes the copies to the calling task, and lists them as open, while
+  // alive.
+  class Scope {
+  public:
+    explicit Scope(Carried &carried);
+    ~Scope();
+
+    Scope(const Scope &) = delete;
+    Scope &operator=(const Scope &) = delete;
+
+  private:
+    Carried &carried;
+    Measure *outer;
+  };
+
+  // Finishes the copies, innermost first, and frees them. req is the
+  // request as answered (the detached copy).
+  void complete(httpd_req_t *req, esp_err_t result);
+
+private:
+  static void enter_outermost_first(Measure *measure);
+
+  Measure *innermost = nullptr;
+};
+
+} // namespace earbrain::carry::detail
@@ -0,0 +1,345 @@
+#include "cbor.hpp"
+
+#include <cfloat>
+#include <cmath>
+#include <cstring>
+#include <new>
+#include <string>
+
+namespace earbrain::cbor {
+
+namespace {
+
+// 2^64: integral doubles below this (and above its negation) are CBOR
+// integers.
+constexpr double integer_limit = 18446744073709551616.0;
+
+class Reader {
+public:
+  Reader(const uint8_t *data, std::size_t len) : data(data), len(len) {}
+
+  std::size_t remaining() const { return len - at; }
+
+  bool byte(uint8_t &out) {
+    if (at >= len) {
+      return false;
+    }
+    out = data[at++];
+    return true;
+  }
+
+  bool uint(std::size_t width, uint64_t &out) {
+    if (remaining() < width) {
+      return false;
+    }
+    out = 0;
+    for (std::size_t i = 0; i < width; ++i) {
+      out = (out << 8) | data[at++];
+    }
+    return true;
+  }
+
+  // Reads the argument following an initial byte. Indefinite lengths and
+  // the reserved values are refused.
+  bool argument(uint8_t info, uint64_t &out) {
+    if (info < 24) {
+      out = info;
+      return true;
+    }
+    if (info > 27) {
+      return false;
+    }
+    return uint(std::size_t{1} << (info - 24), out);
+  }
+
+  bool text(uint64_t size, std::string &out) {
+    if (size > remaining()) {
+      return false;
+    }
+    const char *begin = reinterpret_cast<const char *>(data + at);
+    // cJSON strings end at the first NUL.
+    if (std::memchr(begin, '\0', size)) {
+      return false;
+    }
+    out.assign(begin, size);
+    at += size;
+    return true;
+  }
+
+  cJSON *item(int depth);
+
+private:
+  const uint8_t *data;
+  std::size_t len;
+  std::size_t at = 0;
+};
+
+double half_to_double(uint16_t half) {
+  const int exponent = (half >> 10) & 0x1f;
+  const int mantissa = half & 0x3ff;
+  double value = 0;
+  if (exponent == 0) {
+    value = std::ldexp(mantissa, -24);
+  } else if (exponent != 31) {
+    value = std::ldexp(mantissa + 1024, exponent - 25);
+  } else {
+    value = mantissa == 0 ? INFINITY : NAN;
+  }
+  return half & 0x8000 ? -value : value;
+}
+
+cJSON *Reader::item(int depth) {
+  uint8_t initial = 0;
+  if (depth > max_decode_depth || !byte(initial)) {
+    return nullptr;
+  }
+  const uint8_t major = initial >> 5;
+  const uint8_t info = initial & 0x1f;
+
+  if (major == 7) {
+    switch (info) {
+    case 20:
+      return cJSON_CreateFalse();
+    case 21:
+      return cJSON_CreateTrue();
+    case 22:
+    case 23: // undefined
+      return cJSON_CreateNull();
+    case 25: {
+      uint64_t bits = 0;
+      return uint(2, bits) ? cJSON_CreateNumber(half_to_double(
+                                 static_cast<uint16_t>(bits)))
+                           : nullptr;
+    }
+    case 26: {
+      uint64_t bits = 0;
+      if (!uint(4, bits)) {
+        return nullptr;
+      }
+      const uint32_t narrow = static_cast<uint32_t>(bits);
+      float value = 0;
+      std::memcpy(&value, &narrow, sizeof(value));
+      return cJSON_CreateNumber(value);
+    }
+    case 27: {
+      uint64_t bits = 0;
+      if (!uint(8, bits)) {
+        return nullptr;
+      }
+      double value = 0;
+      std::memcpy(&value, &bits, sizeof(value));
+      return cJSON_CreateNumber(value);
+    }
+    default:
+      return nullptr;
+    }
+  }
+
+  uint64_t value = 0;
+  if (!argument(info, value)) {
+    return nullptr;
+  }
+
+  switch (major) {
+  case major_unsigned:
+    return cJSON_CreateNumber(static_cast<double>(value));
+  case major_negative:
+    return cJSON_CreateNumber(-1.0 - static_cast<double>(value));
+  case major_text: {
+    std::string content;
+    return text(value, content) ? cJSON_CreateString(content.c_str())
+                                : nullptr;
+  }
+  case major_array: {
+    // Every element takes at least a byte.
+    if (value > remaining()) {
+      return nullptr;
+    }
+    json::Ptr array{cJSON_CreateArray()};
+    for (uint64_t i = 0; array && i < value; ++i) {
+      cJSON *element = item(depth + 1);
+      if (!element) {
+        return nullptr;
+      }
+      cJSON_AddItemToArray(array.get(), element);
+    }
+    return array.release();
+  }
+  case major_map: {
+    if (value > remaining() / 2) {
+      return nullptr;
+    }
+    json::Ptr object = json::object();
+    std::string key;
+    for (uint64_t i = 0; object && i < value; ++i) {
+      uint8_t key_initial = 0;
+      uint64_t key_size = 0;
+      if (!byte(key_initial) || (key_initial >> 5) != major_text ||
+          !argument(key_initial & 0x1f, key_size) || !text(key_size, key)) {
+        return nullptr;
+      }
+      cJSON *member = item(depth + 1);
+      if (!member) {
+        return nullptr;
+      }
+      cJSON_AddItemToObject(object.get(), key.c_str(), member);
+    }
+    return object.release();
+  }
+  default:
+    // Byte strings and tags have no JSON counterpart.
+    return nullptr;
+  }
+}
+
+} // namespace
+
+void Writer::byte(uint8_t value) {
+  if (out && written < capacity) {
+    out[written] = value;
+  }
+  ++written;
+}
+
+void Writer::bytes(const void *data, std::size_t len) {
+  if (out && written + len <= capacity) {
+    std::memcpy(out + written, data, len);
+  }
+  written += len;
+}
+
+void Writer::head(uint8_t major, uint64_t value) {
+  const uint8_t type = static_cast<uint8_t>(major << 5);
+  if (value < 24) {
+    byte(type | static_cast<uint8_t>(value));
+    return;
+  }
+  int width = 8;
+  uint8_t info = 27;
+  if (value <= 0xff) {
+    width = 1;
+    info = 24;
+  } else if (value <= 0xffff) {
+    width = 2;
+    info = 25;
+  } else if (value <= 0xffffffff) {
+    width = 4;
+    info = 26;
+  }
+  byte(type | info);
+  for (int shift = (width - 1) * 8; shift >= 0; shift -= 8) {
+    byte(static_cast<uint8_t>(value >> shift));
+  }
+}
+
+void Writer::text(std::string_view value) {
+  head(major_text, value.size());
+  bytes(value.data(), value.size());
+}
+
+void Writer::number(double value) {
+  if (std::trunc(value) == value && value >= -integer_limit &&
+      value < integer_limit) {
+    if (value >= 0) {
+      head(major_unsigned, static_cast<uint64_t>(value));
+    } else {
+      head(major_negative, static_cast<uint64_t>(-(value + 1)));
+    }
+    return;
+  }
+
+  if (std::isinf(value) ||
+      (std::fabs(value) <= FLT_MAX &&
+       static_cast<double>(static_cast<float>(value)) == value)) {
+    const float narrow = static_cast<float>(value);
+    uint32_t bits = 0;
+    std::memcpy(&bits, &narrow, sizeof(bits));
+    byte(0xfa);
+    for (int shift = 24; shift >= 0; shift -= 8) {
+      byte(static_cast<uint8_t>(bits >> shift));
+    }
+    return;
+  }
+
+  uint64_t bits = 0;
+  std::memcpy(&bits, &value, sizeof(bits));
+  byte(0xfb);
+  for (int shift = 56; shift >= 0; shift -= 8) {
+    byte(static_cast<uint8_t>(bits >> shift));
+  }
+}
+
+bool Writer::item(const cJSON *node, int depth) {
+  if (!node || depth > max_depth) {
+    return false;
+  }
+
+  switch (node->type & 0xff) {
+  case cJSON_False:
+    byte(value_false);
+    return true;
+  case cJSON_True:
+    byte(value_true);
+    return true;
+  case cJSON_NULL:
+    byte(value_null);
+    return true;
+  case cJSON_Number:
+    number(node->valuedouble);
+    return true;
+  case cJSON_String:
+    text(node->valuestring ? node->valuestring : "");
+    return true;
+  case cJSON_Array:
+  case cJSON_Object: {
+    const bool object = (node->type & 0xff) == cJSON_Object;
+    uint64_t count = 0;
+    for (const cJSON *child = node->child; child; child = child->next) {
+      ++count;
+    }
+    head(object ? major_map : major_array, count);
+    for (const cJSON *child = node->child; child; child = child->next) {
+      if (object) {
+        text(child->string ? child->string : "");
+      }
+      if (!item(child, depth + 1)) {
+        return false;
+      }
+    }
+    return true;
+  }
+  default:
+    // cJSON_Raw holds JSON text, which has no CBOR form here.
+    return false;
+  }
+}
+
+esp_err_t encode(const cJSON *node, Buffer &out) {
+  Writer sizing(nullptr, 0);
+  if (!sizing.item(node)) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+
+  out.data.reset(new (std::nothrow) uint8_t[sizing.size() > 0 ? sizing.size() : 1]);
+  if (!out.data) {
+    return ESP_ERR_NO_MEM;
+  }
+  Writer writer(out.data.get(), sizing.size());
+  writer.item(node);
+  out.size = writer.size();
+  return ESP_OK;
+}
+
+json::Ptr decode(const uint8_t *data, std::size_t len) {
+  if (!data || len == 0) {
+    return nullptr;
+  }
+  Reader reader(data, len);
+  json::Ptr root{reader.item(0)};
+  if (root && reader.remaining() != 0) {
+    return nullptr;
+  }
+  return root;
+}
+
+} // namespace earbrain::cbor
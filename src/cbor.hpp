@@ -0,0 +1,73 @@
+#pragma once
+
+#include "json/json_helpers.hpp"
+
+#include "esp_err.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string_view>
+
+// CBOR (RFC 8949) for the json_model layer: the serialisers still build
+// cJSON trees, and these are written out as CBOR instead of JSON text.
+// Integral numbers become CBOR integers and other numbers floats, so no
+// number is ever formatted as text.
+namespace earbrain::cbor {
+
+inline constexpr uint8_t major_unsigned = 0;
+inline constexpr uint8_t major_negative = 1;
+inline constexpr uint8_t major_text = 3;
+inline constexpr uint8_t major_array = 4;
+inline constexpr uint8_t major_map = 5;
+
+inline constexpr uint8_t value_false = 0xf4;
+inline constexpr uint8_t value_true = 0xf5;
+inline constexpr uint8_t value_null = 0xf6;
+inline constexpr uint8_t indefinite_map = 0xbf;
+inline constexpr uint8_t break_code = 0xff;
+
+// Appends CBOR to a caller-owned buffer. With a null buffer it only counts,
+// which is how encode() sizes its allocation.
+class Writer {
+public:
+  Writer(uint8_t *out, std::size_t capacity) : out(out), capacity(capacity) {}
+
+  void byte(uint8_t value);
+  void bytes(const void *data, std::size_t len);
+  // Major type and argument, in the shortest form.
+  void head(uint8_t major, uint64_t value);
+  void text(std::string_view value);
+  void number(double value);
+  // false when a cJSON_Raw node (or nesting deeper than max_depth) was met.
+  bool item(const cJSON *node, int depth = 0);
+
+  std::size_t size() const { return written; }
+  bool overflowed() const { return written > capacity; }
+
+  static constexpr int max_depth = 16;
+
+private:
+  uint8_t *out;
+  std::size_t capacity;
+  std::size_t written = 0;
+};
+
+struct Buffer {
+  std::unique_ptr<uint8_t[]> data;
+  std::size_t size = 0;
+};
+
+// ESP_ERR_NO_MEM when the buffer cannot be allocated, ESP_ERR_NOT_SUPPORTED
+// for trees CBOR cannot express.
+esp_err_t encode(const cJSON *node, Buffer &out);
+
+// Nesting accepted by decode(); request bodies are flat objects.
+inline constexpr int max_decode_depth = 8;
+
+// Builds a cJSON tree from CBOR. Returns null for malformed or trailing
+// input, nesting deeper than max_decode_depth, and what JSON cannot hold:
+// byte strings, tags, non-text map keys and indefinite lengths.
+json::Ptr decode(const uint8_t *data, std::size_t len);
+
+} // namespace earbrain::cbor
@@ -0,0 +1,22 @@
+#pragma once
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#include <cstddef>
+
+namespace earbrain::compression::detail {
+
+// Whether the request on this task accepts a gzip body. Set by
+// middleware::compress_response; singleflight carries it across a detach.
+bool requested();
+void set_requested(bool gzip);
+
+// Sends body gzip-encoded, as chunks, if gzip is set and its type and size
+// qualify. ESP_ERR_NOT_SUPPORTED when nothing was sent and it should go out
+// as is. Either way, once middleware::compress_response is in use, a body
+// of a compressible type gets Vary: Accept-Encoding.
+esp_err_t send(httpd_req_t *req, const char *content_type, const char *body,
+               std::size_t len, bool gzip);
+
+} // namespace earbrain::compression::detail
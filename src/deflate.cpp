@@ -0,0 +1,266 @@
+#include "deflate.hpp"
+
+#include <algorithm>
+#include <memory>
+#include <new>
+
+namespace earbrain::deflate {
+
+namespace {
+
+constexpr int hash_bits = 9;
+constexpr std::size_t hash_size = std::size_t{1} << hash_bits;
+constexpr std::size_t min_match = 3;
+constexpr std::size_t max_match = 258;
+
+constexpr uint16_t length_base[] = {3,  4,  5,  6,   7,   8,   9,   10,
+                                    11, 13, 15, 17,  19,  23,  27,  31,
+                                    35, 43, 51, 59,  67,  83,  99,  115,
+                                    131, 163, 195, 227, 258};
+constexpr uint8_t length_extra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1,
+                                    1, 1, 2, 2, 2, 2, 3, 3, 3, 3,
+                                    4, 4, 4, 4, 5, 5, 5, 5, 0};
+constexpr uint16_t distance_base[] = {
+    1,    2,    3,    4,    5,    7,     9,     13,    17,    25,
+    33,   49,   65,   97,   129,  193,   257,   385,   513,   769,
+    1025, 1537, 2049, 3073, 4097, 6145,  8193,  12289, 16385, 24577};
+constexpr uint8_t distance_extra[] = {0, 0, 0, 0, 1, 1, 2,  2,  3,  3,
+                                      4, 4, 5, 5, 6, 6, 7,  7,  8,  8,
+                                      9, 9, 10, 10, 11, 11, 12, 12, 13, 13};
+
+static_assert(window_size <= 32768, "DEFLATE distances stop at 32 KiB");
+
+// CRC-32 (IEEE) a nibble at a time: a 16-entry table instead of 1 KiB.
+constexpr uint32_t crc_table[16] = {
+    0x00000000, 0x1db71064, 0x3b6e20c8, 0x26d930ac, 0x76dc4190, 0x6b6b51f4,
+    0x4db26158, 0x5005713c, 0xedb88320, 0xf00f9344, 0xd6d6a3e8, 0xcb61b38c,
+    0x9b64c2b0, 0x86d3d2d4, 0xa00ae278, 0xbdbdf21c};
+
+uint32_t crc32(const uint8_t *data, std::size_t len) {
+  uint32_t crc = 0xffffffff;
+  for (std::size_t i = 0; i < len; ++i) {
+    crc ^= data[i];
+    crc = (crc >> 4) ^ crc_table[crc & 0x0f];
+    crc = (crc >> 4) ^ crc_table[crc & 0x0f];
+  }
+  return ~crc;
+}
+
+template <std::size_t N>
+std::size_t code_for(const uint16_t (&base)[N], std::size_t value) {
+  return static_cast<std::size_t>(
+      std::upper_bound(base, base + N, value) - base - 1);
+}
+
+class Encoder {
+public:
+  Encoder(const uint8_t *data, std::size_t len, Sink sink, void *ctx)
+    : data(data), len(len), sink(sink), ctx(ctx) {}
+
+  void header() {
+    static constexpr uint8_t gzip_header[] = {0x1f, 0x8b, 8, 0, 0, 0,
+                                              0,    0,    0, 0xff};
+    for (const uint8_t byte : gzip_header) {
+      put_byte(byte);
+    }
+    put_bits(1, 1); // BFINAL
+    put_bits(1, 2); // BTYPE 01: fixed Huffman codes
+  }
+
+  void compress(uint32_t max_chain) {
+    std::size_t at = 0;
+    while (at < len && err == ESP_OK) {
+      std::size_t best_len = 0;
+      std::size_t best_distance = 0;
+      if (len - at >= min_match) {
+        find_match(at, max_chain, best_len, best_distance);
+      }
+      if (best_len >= min_match) {
+        emit_match(best_len, best_distance);
+        // Later matches can start inside this one.
+        const std::size_t end = at + best_len;
+        for (++at; at < end && len - at >= min_match; ++at) {
+          insert(at);
+        }
+        at = end;
+      } else {
+        emit_symbol(data[at]);
+        ++at;
+      }
+    }
+  }
+
+  void trailer() {
+    emit_symbol(256); // end of block
+    if (bit_count > 0) {
+      put_byte(static_cast<uint8_t>(bits));
+      bits = 0;
+      bit_count = 0;
+    }
+    const uint32_t crc = crc32(data, len);
+    const uint32_t size = static_cast<uint32_t>(len);
+    for (int shift = 0; shift < 32; shift += 8) {
+      put_byte(static_cast<uint8_t>(crc >> shift));
+    }
+    for (int shift = 0; shift < 32; shift += 8) {
+      put_byte(static_cast<uint8_t>(size >> shift));
+    }
+    flush();
+  }
+
+  esp_err_t error() const { return err; }
+  std::size_t written() const { return total; }
+
+private:
+  uint32_t hash(std::size_t at) const {
+    const uint32_t key = static_cast<uint32_t>(data[at]) << 16 |
+                         static_cast<uint32_t>(data[at + 1]) << 8 |
+                         data[at + 2];
+    return (key * 2654435761u) >> (32 - hash_bits);
+  }
+
+  // Records at in its hash chain; returns the previous head (position + 1,
+  // 0 for none).
+  uint32_t insert(std::size_t at) {
+    const uint32_t h = hash(at);
+    const uint32_t last = head[h];
+    const std::size_t distance = last ? at - (last - 1) : 0;
+    prev[at % window_size] =
+        distance < window_size ? static_cast<uint16_t>(distance) : 0;
+    head[h] = static_cast<uint32_t>(at + 1);
+    return last;
+  }
+
+  void find_match(std::size_t at, uint32_t max_chain, std::size_t &best_len,
+                  std::size_t &best_distance) {
+    const uint32_t last = insert(at);
+    if (!last) {
+      return;
+    }
+    const std::size_t limit = std::min(max_match, len - at);
+    std::size_t candidate = last - 1;
+    for (uint32_t tries = 0; tries < max_chain; ++tries) {
+      const std::size_t distance = at - candidate;
+      if (distance >= window_size) {
+        break;
+      }
+      std::size_t length = 0;
+      while (length < limit && data[candidate + length] == data[at + length]) {
+        ++length;
+      }
+      if (length > best_len) {
+        best_len = length;
+        best_distance = distance;
+        if (length == limit) {
+          break;
+        }
+      }
+      // A slot is only reused window_size positions later, so within the
+      // window the link is still the candidate's own.
+      const uint16_t step = prev[candidate % window_size];
+      if (step == 0 || step > candidate) {
+        break;
+      }
+      candidate -= step;
+    }
+  }
+
+  void emit_symbol(uint32_t symbol) {
+    if (symbol < 144) {
+      put_code(0x30 + symbol, 8);
+    } else if (symbol < 256) {
+      put_code(0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+      put_code(symbol - 256, 7);
+    } else {
+      put_code(0xc0 + symbol - 280, 8);
+    }
+  }
+
+  void emit_match(std::size_t length, std::size_t distance) {
+    const std::size_t length_code = code_for(length_base, length);
+    emit_symbol(static_cast<uint32_t>(257 + length_code));
+    put_bits(static_cast<uint32_t>(length - length_base[length_code]),
+             length_extra[length_code]);
+
+    const std::size_t distance_code = code_for(distance_base, distance);
+    put_code(static_cast<uint32_t>(distance_code), 5);
+    put_bits(static_cast<uint32_t>(distance - distance_base[distance_code]),
+             distance_extra[distance_code]);
+  }
+
+  // Huffman codes are sent most significant bit first.
+  void put_code(uint32_t code, int count) {
+    uint32_t reversed = 0;
+    for (int i = 0; i < count; ++i) {
+      reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    put_bits(reversed, count);
+  }
+
+  void put_bits(uint32_t value, int count) {
+    bits |= value << bit_count;
+    bit_count += count;
+    while (bit_count >= 8) {
+      put_byte(static_cast<uint8_t>(bits));
+      bits >>= 8;
+      bit_count -= 8;
+    }
+  }
+
+  void put_byte(uint8_t byte) {
+    out[out_len++] = byte;
+    if (out_len == chunk_size) {
+      flush();
+    }
+  }
+
+  void flush() {
+    if (err == ESP_OK && out_len > 0) {
+      err = sink(ctx, out, out_len);
+      total += out_len;
+    }
+    out_len = 0;
+  }
+
+  const uint8_t *data;
+  std::size_t len;
+  Sink sink;
+  void *ctx;
+  esp_err_t err = ESP_OK;
+  std::size_t total = 0;
+
+  uint32_t bits = 0;
+  int bit_count = 0;
+  std::size_t out_len = 0;
+  uint8_t out[chunk_size];
+
+  uint32_t head[hash_size] = {};
+  uint16_t prev[window_size] = {};
+};
+
+} // namespace
+
+esp_err_t gzip(const uint8_t *data, std::size_t len, uint32_t max_chain,
+               Sink sink, void *ctx, Result *result) {
+  if ((!data && len > 0) || !sink) {
+    return ESP_ERR_INVALID_ARG;
+  }
+  // About 7 KiB; too much for a handler task's stack.
+  std::unique_ptr<Encoder> encoder{new (std::nothrow)
+                                       Encoder(data, len, sink, ctx)};
+  if (!encoder) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  encoder->header();
+  encoder->compress(std::max<uint32_t>(max_chain, 1));
+  encoder->trailer();
+
+  if (result) {
+    result->bytes_out = encoder->written();
+  }
+  return encoder->error();
+}
+
+} // namespace earbrain::deflate
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "esp_err.h"
+
+#include <cstddef>
+#include <cstdint>
+
+// gzip (RFC 1952) around a DEFLATE (RFC 1951) encoder sized for response
+// bodies: the input is already in memory, so matches point back into it
+// and the only state is a hash table over a small window. One block with
+// the fixed Huffman codes keeps the encoder free of code-length tables.
+namespace earbrain::deflate {
+
+// Matches reach back at most this far.
+inline constexpr std::size_t window_size = 2048;
+// Output is handed to the sink in pieces of this size.
+inline constexpr std::size_t chunk_size = 512;
+
+// Receives the gzip stream in order. Stops compression on any error.
+using Sink = esp_err_t (*)(void *ctx, const uint8_t *data, std::size_t len);
+
+struct Result {
+  std::size_t bytes_out = 0;
+};
+
+// max_chain bounds the candidates tried per position: higher compresses
+// better and costs more CPU. ESP_ERR_NO_MEM before anything reached the
+// sink when the encoder state cannot be allocated.
+esp_err_t gzip(const uint8_t *data, std::size_t len, uint32_t max_chain,
+               Sink sink, void *ctx, Result *result = nullptr);
+
+} // namespace earbrain::deflate
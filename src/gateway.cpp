@@ -3,15 +3,23 @@
 #include <cstring>
 #include <string_view>
 
+#include "earbrain/gateway/captive_probe.hpp"
+#include "earbrain/gateway/handlers/batch_handler.hpp"
+#include "earbrain/gateway/handlers/capture_handler.hpp"
 #include "earbrain/gateway/handlers/device_handler.hpp"
 #include "earbrain/gateway/handlers/health_handler.hpp"
+#include "earbrain/gateway/handlers/heap_stats_handler.hpp"
 #include "earbrain/gateway/handlers/log_handler.hpp"
 #include "earbrain/gateway/handlers/metrics_handler.hpp"
 #include "earbrain/gateway/handlers/mdns_handler.hpp"
 #include "earbrain/gateway/handlers/portal_handler.hpp"
 #include "earbrain/gateway/handlers/portal_detail_handler.hpp"
+#include "earbrain/gateway/handlers/trace_handler.hpp"
 #include "earbrain/gateway/handlers/wifi_handler.hpp"
+#include "earbrain/gateway/response_cache.hpp"
+#include "earbrain/gateway/wifi_snapshot.hpp"
 #include "earbrain/logging.hpp"
+#include "sdkconfig.h"
 
 namespace earbrain {
 
@@ -31,17 +39,19 @@ Gateway::Gateway()
 
 esp_err_t Gateway::initialize(const GatewayOptions &opts) {
   options = opts;
+  response_cache::invalidate();
   return ESP_OK;
 }
 
 Gateway::~Gateway() {
+  captive_dns::stop();
   http_server.stop();
   earbrain::mdns().stop();
 }
 
 esp_err_t Gateway::add_route(std::string_view uri, httpd_method_t method,
-                             RequestHandler handler, void *user_ctx) {
-  return http_server.add_route(uri, method, handler, user_ctx);
+                             RequestHandler handler, RouteData user_data) {
+  return http_server.add_route(uri, method, handler, user_data);
 }
 
 esp_err_t Gateway::add_route(std::string_view uri, httpd_method_t method,
@@ -57,6 +67,11 @@ esp_err_t Gateway::start_portal() {
     return err;
   }
 
+  err = wifi_snapshot::start();
+  if (err != ESP_OK) {
+    return err;
+  }
+
   // Initialize mDNS service
   err = earbrain::mdns().initialize();
   if (err != ESP_OK) {
@@ -75,6 +90,7 @@ esp_err_t Gateway::start_portal() {
 
   // Start WiFi in APSTA mode (AP + STA)
   err = earbrain::wifi().mode(WifiMode::APSTA);
+  wifi_snapshot::refresh();
   if (err != ESP_OK) {
     logging::errorf(gateway_tag, "Failed to start WiFi in APSTA mode: %s", esp_err_to_name(err));
     return err;
@@ -86,20 +102,33 @@ esp_err_t Gateway::start_portal() {
   if (err != ESP_OK) {
     logging::errorf(gateway_tag, "Failed to start HTTP server: %s", esp_err_to_name(err));
     earbrain::wifi().mode(WifiMode::Off);
+    wifi_snapshot::refresh();
     return err;
   }
 
   err = earbrain::mdns().start(options.mdns_config);
+  response_cache::invalidate();
   if (err != ESP_OK) {
     logging::warnf(gateway_tag, "Failed to start mDNS service: %s", esp_err_to_name(err));
   }
 
+  // Without it the portal still works, only clients take longer to find it.
+  if (options.captive_dns.enabled) {
+    err = captive_dns::start(options.captive_dns);
+    if (err != ESP_OK) {
+      logging::warnf(gateway_tag, "Failed to start captive DNS: %s", esp_err_to_name(err));
+    }
+  }
+
   logging::info("Portal started successfully", gateway_tag);
   return ESP_OK;
 }
 
 esp_err_t Gateway::stop_portal() {
+  captive_dns::stop();
+
   esp_err_t mdns_err = earbrain::mdns().stop();
+  response_cache::invalidate();
   if (mdns_err != ESP_OK) {
     logging::warnf(gateway_tag, "Failed to stop mDNS service: %s", esp_err_to_name(mdns_err));
   }
@@ -110,6 +139,7 @@ esp_err_t Gateway::stop_portal() {
   }
 
   esp_err_t wifi_err = earbrain::wifi().mode(WifiMode::Off);
+  wifi_snapshot::refresh();
   if (wifi_err != ESP_OK) {
     logging::errorf(gateway_tag, "Failed to stop WiFi: %s", esp_err_to_name(wifi_err));
   }
@@ -133,8 +163,15 @@ void Gateway::ensure_builtin_routes() {
     std::string_view uri;
     httpd_method_t method;
     RequestHandler handler;
+    bool coalesce = false;
+    DataProducer batch = nullptr;
+    ResourceVersion version = nullptr;
+    uint32_t cache_ttl_ms = 0;
   };
 
+  // Backstop for the cached routes; their versions catch changes sooner.
+  static constexpr uint32_t cache_ttl_ms = 60000;
+
   static constexpr BuiltinRoute routes_to_register[] = {
       // Portal UI routes
       {"/", HTTP_GET, &handlers::portal::handle_root_get},
@@ -150,20 +187,70 @@ void Gateway::ensure_builtin_routes() {
       // Health check
       {"/health", HTTP_GET, &handlers::health::handle_health},
       // REST API
-      {"/api/v1/portal", HTTP_GET, &handlers::portal_detail::handle_get},
-      {"/api/v1/device", HTTP_GET, &handlers::device::handle_get},
-      {"/api/v1/metrics", HTTP_GET, &handlers::metrics::handle_get},
+      {"/api/v1/portal", HTTP_GET, &handlers::portal_detail::handle_get, false,
+       &handlers::portal_detail::produce_get,
+       &handlers::portal_detail::version_get, cache_ttl_ms},
+      {"/api/v1/device", HTTP_GET, &handlers::device::handle_get, false,
+       &handlers::device::produce_get, &handlers::device::version_get,
+       cache_ttl_ms},
+      // Versioned on everything but timestamp_ms.
+      {"/api/v1/metrics", HTTP_GET, &handlers::metrics::handle_get, false,
+       &handlers::metrics::produce_get, &handlers::metrics::version_get},
       {"/api/v1/wifi/credentials", HTTP_POST, &handlers::wifi::handle_credentials_post},
       {"/api/v1/wifi/connect", HTTP_POST, &handlers::wifi::handle_connect_post},
-      {"/api/v1/wifi/status", HTTP_GET, &handlers::wifi::handle_status_get},
+      {"/api/v1/wifi/status", HTTP_GET, &handlers::wifi::handle_status_get, false,
+       &handlers::wifi::produce_status_get,
+       &handlers::wifi::version_status_get},
+      // Async; requests arriving during a scan share it (see async::scan).
       {"/api/v1/wifi/scan", HTTP_GET, &handlers::wifi::handle_scan_get},
-      {"/api/v1/mdns", HTTP_GET, &handlers::mdns::handle_get},
-      {"/api/v1/logs", HTTP_GET, &handlers::logs::handle_get},
+      {"/api/v1/mdns", HTTP_GET, &handlers::mdns::handle_get, false,
+       &handlers::mdns::produce_get, &handlers::mdns::version_get,
+       cache_ttl_ms},
+      {"/api/v1/logs", HTTP_GET, &handlers::logs::handle_get, true, nullptr,
+       &handlers::logs::version_get},
+#if CONFIG_EARBRAIN_GATEWAY_TRACE_ROUTE
+      // Debug: spans from middleware::trace_request
+      {"/api/v1/trace", HTTP_GET, &handlers::trace::handle_get},
+#endif
+#if CONFIG_EARBRAIN_GATEWAY_CAPTURE_ROUTE
+      // Debug: request ring from middleware::capture_request
+      {"/api/v1/capture", HTTP_GET, &handlers::capture::handle_get},
+#endif
+      {"/api/v1/batch", HTTP_GET, &handlers::batch::handle_get},
+#if CONFIG_HEAP_USE_HOOKS
+      // Debug: per-route heap figures from middleware::heap_accounting
+      {"/api/v1/debug/heap", HTTP_GET, &handlers::heap_stats::handle_get},
+#endif
   };
 
+  // OS connectivity checks, answered from the not-found handler (see
+  // captive_probe.hpp) rather than as routes.
+  static constexpr std::string_view probe_paths[] = {
+      "/generate_204",              // Android, ChromeOS
+      "/gen_204",                   // Android
+      "/hotspot-detect.html",       // Apple
+      "/library/test/success.html", // Apple, older
+      "/connecttest.txt",           // Windows 10+
+      "/ncsi.txt",                  // Windows 7/8
+      "/redirect",                  // Windows, after connecttest
+      "/canonical.html",            // Firefox
+      "/success.txt",               // Firefox
+  };
+  captive_probe::configure(probe_paths);
+  http_server.set_not_found_handler(&captive_probe::handle_not_found);
+
   for (const auto &route : routes_to_register) {
     esp_err_t err = ESP_OK;
-    err = add_route(route.uri, route.method, route.handler);
+    if (route.coalesce || route.batch || route.version) {
+      RouteOptions route_options;
+      route_options.coalesce = route.coalesce;
+      route_options.batch = route.batch;
+      route_options.version = route.version;
+      route_options.cache_ttl_ms = route.cache_ttl_ms;
+      err = add_route(route.uri, route.method, route.handler, route_options);
+    } else {
+      err = add_route(route.uri, route.method, route.handler);
+    }
 
     if (err != ESP_OK && err != ESP_ERR_INVALID_STATE) {
       logging::warnf("gateway", "Failed to register builtin route %.*s: %s",
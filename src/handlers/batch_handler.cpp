@@ -0,0 +1,230 @@
+#include "earbrain/gateway/handlers/batch_handler.hpp"
+
+#include <cstdio>
+#include <memory>
+#include <string_view>
+
+#include "earbrain/gateway/gateway.hpp"
+#include "earbrain/gateway/request_context.hpp"
+#include "earbrain/gateway/tracing.hpp"
+#include "cbor.hpp"
+#include "json/http_response.hpp"
+#include "json/json_helpers.hpp"
+
+namespace earbrain::handlers::batch {
+
+namespace {
+
+constexpr std::size_t max_resources = 8;
+constexpr std::string_view api_prefix = "/api/v1/";
+
+bool valid_name(std::string_view name) {
+  if (name.empty() || name.size() > 48) {
+    return false;
+  }
+  for (const char c : name) {
+    const bool ok = (c >= 'a' && c <= 'z') || (c >= '0' && c <= '9') ||
+                    c == '/' || c == '_' || c == '-';
+    if (!ok) {
+      return false;
+    }
+  }
+  return true;
+}
+
+// Builds the per-resource envelope: the producer's data on success, a fail
+// or error entry otherwise. Only this entry is held in memory at a time.
+json::Ptr make_entry(std::string_view name) {
+  char uri[64];
+  std::snprintf(uri, sizeof(uri), "%.*s%.*s",
+                static_cast<int>(api_prefix.size()), api_prefix.data(),
+                static_cast<int>(name.size()), name.data());
+
+  const std::shared_ptr<const UriHandler> route =
+      gateway().server().find_route(uri, HTTP_GET);
+  if (!route) {
+    return http::make_envelope("fail", json::Ptr{}, "Unknown resource.");
+  }
+  // The producer is called directly, outside the route's own middlewares,
+  // so a route guarded by them (auth, rate limits) is only served alone.
+  if (!route->batch || !route->middlewares.empty()) {
+    return http::make_envelope("fail", json::Ptr{},
+                               "Resource is not batchable.");
+  }
+
+  cJSON *data = nullptr;
+  esp_err_t err = ESP_OK;
+  {
+    tracing::Span span("batch.resource");
+    err = route->batch(&data);
+  }
+  if (err != ESP_OK) {
+    return http::make_envelope("error", json::Ptr{}, esp_err_to_name(err));
+  }
+  return http::make_envelope("success", json::Ptr{data}, nullptr);
+}
+
+// Once streaming has started the response cannot become an error any more,
+// so running out of memory is reported in the resource's own entry.
+esp_err_t send_entry(httpd_req_t *req, std::string_view name, bool first) {
+  static constexpr char no_mem_entry[] =
+      R"({"status":"error","data":{},"error":"ESP_ERR_NO_MEM"})";
+
+  char key[56];
+  const int key_len =
+      std::snprintf(key, sizeof(key), "%s\"%.*s\":", first ? "" : ",",
+                    static_cast<int>(name.size()), name.data());
+
+  char *buffer = nullptr;
+  if (json::Ptr entry = make_entry(name)) {
+    tracing::Span span("json.print");
+    buffer = cJSON_PrintUnformatted(entry.get());
+  }
+
+  esp_err_t err = httpd_resp_send_chunk(req, key, key_len);
+  if (err == ESP_OK) {
+    err = buffer ? httpd_resp_send_chunk(req, buffer, HTTPD_RESP_USE_STRLEN)
+                 : httpd_resp_send_chunk(req, no_mem_entry,
+                                         sizeof(no_mem_entry) - 1);
+  }
+  cJSON_free(buffer);
+  return err;
+}
+
+esp_err_t send_cbor_entry(httpd_req_t *req, std::string_view name) {
+  uint8_t key[56];
+  cbor::Writer key_writer(key, sizeof(key));
+  key_writer.text(name);
+
+  cbor::Buffer buffer;
+  esp_err_t encoded = ESP_ERR_NO_MEM;
+  if (json::Ptr entry = make_entry(name)) {
+    tracing::Span span("cbor.encode");
+    encoded = cbor::encode(entry.get(), buffer);
+  }
+
+  esp_err_t err = httpd_resp_send_chunk(
+      req, reinterpret_cast<const char *>(key), key_writer.size());
+  if (err == ESP_OK && encoded == ESP_OK) {
+    err = httpd_resp_send_chunk(
+        req, reinterpret_cast<const char *>(buffer.data.get()), buffer.size);
+  } else if (err == ESP_OK) {
+    uint8_t no_mem_entry[48];
+    cbor::Writer writer(no_mem_entry, sizeof(no_mem_entry));
+    writer.head(cbor::major_map, 3);
+    writer.text("status");
+    writer.text("error");
+    writer.text("data");
+    writer.head(cbor::major_map, 0);
+    writer.text("error");
+    writer.text("ESP_ERR_NO_MEM");
+    err = httpd_resp_send_chunk(
+        req, reinterpret_cast<const char *>(no_mem_entry), writer.size());
+  }
+  return err;
+}
+
+// Same envelope in CBOR: a three-member map whose "data" is an
+// indefinite-length map, closed once every entry is out.
+esp_err_t send_cbor_batch(httpd_req_t *req, const std::string_view *names,
+                          std::size_t count) {
+  httpd_resp_set_type(req, http::cbor_media_type);
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+  uint8_t head[24];
+  cbor::Writer head_writer(head, sizeof(head));
+  head_writer.head(cbor::major_map, 3);
+  head_writer.text("status");
+  head_writer.text("success");
+  head_writer.text("data");
+  head_writer.byte(cbor::indefinite_map);
+
+  uint8_t tail[8];
+  cbor::Writer tail_writer(tail, sizeof(tail));
+  tail_writer.byte(cbor::break_code);
+  tail_writer.text("error");
+  tail_writer.byte(cbor::value_null);
+
+  esp_err_t err = httpd_resp_send_chunk(
+      req, reinterpret_cast<const char *>(head), head_writer.size());
+  for (std::size_t i = 0; i < count && err == ESP_OK; ++i) {
+    err = send_cbor_entry(req, names[i]);
+  }
+  if (err == ESP_OK) {
+    err = httpd_resp_send_chunk(req, reinterpret_cast<const char *>(tail),
+                                tail_writer.size());
+  }
+  if (err == ESP_OK) {
+    err = httpd_resp_send_chunk(req, nullptr, 0);
+  }
+  return err;
+}
+
+} // namespace
+
+esp_err_t handle_get(httpd_req_t *req) {
+  // ?fields= applies to every entry. Entries keep their envelopes even in
+  // compact mode, as some of them may have failed.
+  http::ResponseShape shape(req);
+
+  RequestContext *context = RequestContext::current();
+  if (!context || !context->has_query("r")) {
+    return http::send_fail_field(req, "r", "List the resources to fetch.");
+  }
+
+  std::string_view names[max_resources];
+  std::size_t count = 0;
+  std::string_view rest = context->query("r");
+  while (!rest.empty()) {
+    const std::size_t comma = rest.find(',');
+    const std::string_view name = rest.substr(0, comma);
+    rest = comma == std::string_view::npos ? std::string_view{}
+                                           : rest.substr(comma + 1);
+    if (name.empty()) {
+      continue;
+    }
+    if (!valid_name(name)) {
+      return http::send_fail_field(req, "r", "Invalid resource name.");
+    }
+    bool duplicate = false;
+    for (std::size_t i = 0; i < count; ++i) {
+      duplicate = duplicate || names[i] == name;
+    }
+    if (duplicate) {
+      continue;
+    }
+    if (count == max_resources) {
+      return http::send_fail_field(req, "r", "Too many resources.");
+    }
+    names[count++] = name;
+  }
+  if (count == 0) {
+    return http::send_fail_field(req, "r", "List the resources to fetch.");
+  }
+
+  if (http::ResponseShape::cbor()) {
+    return send_cbor_batch(req, names, count);
+  }
+
+  // The outer envelope is streamed around the entries so a large batch never
+  // has more than one resource serialised at once. Being chunked, it is not
+  // gzipped by middleware::compress_response.
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+
+  static constexpr char head[] = R"({"status":"success","data":{)";
+  static constexpr char tail[] = R"(},"error":null})";
+  esp_err_t err = httpd_resp_send_chunk(req, head, sizeof(head) - 1);
+  for (std::size_t i = 0; i < count && err == ESP_OK; ++i) {
+    err = send_entry(req, names[i], i == 0);
+  }
+  if (err == ESP_OK) {
+    err = httpd_resp_send_chunk(req, tail, sizeof(tail) - 1);
+  }
+  if (err == ESP_OK) {
+    err = httpd_resp_send_chunk(req, nullptr, 0);
+  }
+  return err;
+}
+
+} // namespace earbrain::handlers::batch
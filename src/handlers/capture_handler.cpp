@@ -0,0 +1,18 @@
+#include "earbrain/gateway/handlers/capture_handler.hpp"
+
+#include "earbrain/gateway/capture.hpp"
+
+namespace earbrain::handlers::capture {
+
+esp_err_t handle_get(httpd_req_t *req) {
+  const std::vector<uint8_t> data = earbrain::capture::export_ring();
+
+  httpd_resp_set_type(req, "application/octet-stream");
+  httpd_resp_set_hdr(req, "Content-Disposition",
+                     "attachment; filename=\"capture.bin\"");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+  return httpd_resp_send(req, reinterpret_cast<const char *>(data.data()),
+                         static_cast<ssize_t>(data.size()));
+}
+
+} // namespace earbrain::handlers::capture
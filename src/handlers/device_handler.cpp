@@ -42,8 +42,7 @@ constexpr const char build_timestamp[] = __DATE__ " " __TIME__;
 
 } // namespace
 
-esp_err_t handle_get(httpd_req_t *req) {
-
+esp_err_t produce_get(cJSON **out) {
   esp_chip_info_t chip_info{};
   esp_chip_info(&chip_info);
 
@@ -58,7 +57,15 @@ esp_err_t handle_get(httpd_req_t *req) {
     return ESP_ERR_NO_MEM;
   }
 
-  return http::send_success(req, std::move(data));
+  *out = data.release();
+  return ESP_OK;
+}
+
+// Nothing in the device detail changes while the firmware runs.
+uint64_t version_get() { return 1; }
+
+esp_err_t handle_get(httpd_req_t *req) {
+  return http::send_produced(req, &produce_get);
 }
 
 } // namespace earbrain::handlers::device
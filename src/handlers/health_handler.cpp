@@ -8,6 +8,7 @@
 namespace earbrain::handlers::health {
 
 esp_err_t handle_health(httpd_req_t *req) {
+  http::ResponseShape shape(req);
 
   auto data = json::object();
   if (!data) {
@@ -15,18 +16,20 @@ esp_err_t handle_health(httpd_req_t *req) {
   }
 
   // Basic status
-  if (json::add(data.get(), "status", "ok") != ESP_OK) {
+  if (json::wanted("status") && json::add(data.get(), "status", "ok") != ESP_OK) {
     return ESP_ERR_NO_MEM;
   }
 
   // Uptime in seconds
   int64_t uptime_us = esp_timer_get_time();
-  if (json::add(data.get(), "uptime", static_cast<int>(uptime_us / 1000000)) != ESP_OK) {
+  if (json::wanted("uptime") &&
+      json::add(data.get(), "uptime", static_cast<int>(uptime_us / 1000000)) != ESP_OK) {
     return ESP_ERR_NO_MEM;
   }
 
   // Version
-  if (json::add(data.get(), "version", gateway().version()) != ESP_OK) {
+  if (json::wanted("version") &&
+      json::add(data.get(), "version", gateway().version()) != ESP_OK) {
     return ESP_ERR_NO_MEM;
   }
 
@@ -0,0 +1,23 @@
+#include "earbrain/gateway/handlers/heap_stats_handler.hpp"
+
+#include <utility>
+
+#include "earbrain/gateway/middlewares/heap_accounting.hpp"
+#include "json/heap_stats.hpp"
+#include "json/http_response.hpp"
+
+namespace earbrain::handlers::heap_stats {
+
+esp_err_t handle_get(httpd_req_t *req) {
+  http::ResponseShape shape(req);
+  const auto routes = middleware::heap_stats();
+
+  auto data = json_model::to_json(routes, middleware::heap_accounting_available());
+  if (!data) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  return http::send_success(req, std::move(data));
+}
+
+} // namespace earbrain::handlers::heap_stats
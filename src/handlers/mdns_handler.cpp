@@ -4,13 +4,20 @@
 
 #include "earbrain/gateway/gateway.hpp"
 #include "earbrain/gateway/handlers/handler_helpers.hpp"
+#include "earbrain/gateway/watch.hpp"
 #include "earbrain/mdns_service.hpp"
 #include "json/http_response.hpp"
 #include "json/json_helpers.hpp"
 
 namespace earbrain::handlers::mdns {
 
-esp_err_t handle_get(httpd_req_t *req) {
+namespace {
+
+watch::Tracker versions;
+
+} // namespace
+
+esp_err_t produce_get(cJSON **out) {
   auto data = json::object();
   if (!data) {
     return ESP_ERR_NO_MEM;
@@ -18,27 +25,51 @@ esp_err_t handle_get(httpd_req_t *req) {
 
   const MdnsConfig &config = earbrain::mdns().config();
 
-  if (json::add(data.get(), "hostname", config.hostname) != ESP_OK) {
+  if (json::wanted("hostname") &&
+      json::add(data.get(), "hostname", config.hostname) != ESP_OK) {
     return ESP_ERR_NO_MEM;
   }
-  if (json::add(data.get(), "instance_name", config.instance_name) != ESP_OK) {
+  if (json::wanted("instance_name") &&
+      json::add(data.get(), "instance_name", config.instance_name) != ESP_OK) {
     return ESP_ERR_NO_MEM;
   }
-  if (json::add(data.get(), "service_type", config.service_type) != ESP_OK) {
+  if (json::wanted("service_type") &&
+      json::add(data.get(), "service_type", config.service_type) != ESP_OK) {
     return ESP_ERR_NO_MEM;
   }
-  if (json::add(data.get(), "protocol", config.protocol) != ESP_OK) {
+  if (json::wanted("protocol") &&
+      json::add(data.get(), "protocol", config.protocol) != ESP_OK) {
     return ESP_ERR_NO_MEM;
   }
-  if (!cJSON_AddNumberToObject(data.get(), "port",
+  if (json::wanted("port") &&
+      !cJSON_AddNumberToObject(data.get(), "port",
                                static_cast<int>(config.port))) {
     return ESP_ERR_NO_MEM;
   }
-  if (json::add(data.get(), "running", earbrain::mdns().is_running()) != ESP_OK) {
+  if (json::wanted("running") &&
+      json::add(data.get(), "running", earbrain::mdns().is_running()) !=
+          ESP_OK) {
     return ESP_ERR_NO_MEM;
   }
 
-  return http::send_success(req, std::move(data));
+  *out = data.release();
+  return ESP_OK;
+}
+
+uint64_t version_get() {
+  const MdnsConfig &config = earbrain::mdns().config();
+  return versions.observe(watch::Fingerprint{}
+                              .add(config.hostname)
+                              .add(config.instance_name)
+                              .add(config.service_type)
+                              .add(config.protocol)
+                              .add(config.port)
+                              .add(earbrain::mdns().is_running())
+                              .value());
+}
+
+esp_err_t handle_get(httpd_req_t *req) {
+  return http::send_produced(req, &produce_get);
 }
 
 } // namespace earbrain::handlers::mdns
@@ -2,13 +2,30 @@
 
 #include <utility>
 
+#include "earbrain/gateway/captive_dns.hpp"
+#include "earbrain/gateway/captive_probe.hpp"
+#include "earbrain/gateway/middlewares/compression.hpp"
+#include "earbrain/gateway/middlewares/memory_governor.hpp"
+#include "earbrain/gateway/middlewares/rate_limit.hpp"
+#include "earbrain/gateway/watch.hpp"
 #include "earbrain/metrics.hpp"
+#include "json/captive_dns.hpp"
+#include "json/captive_probe.hpp"
+#include "json/compression.hpp"
 #include "json/http_response.hpp"
+#include "json/memory_governor.hpp"
 #include "json/metrics.hpp"
+#include "json/rate_limit.hpp"
 
 namespace earbrain::handlers::metrics {
 
-esp_err_t handle_get(httpd_req_t *req) {
+namespace {
+
+watch::Tracker versions;
+
+} // namespace
+
+esp_err_t produce_get(cJSON **out) {
   const Metrics metrics = collect_metrics();
 
   auto data = json_model::to_json(metrics);
@@ -16,7 +33,133 @@ esp_err_t handle_get(httpd_req_t *req) {
     return ESP_ERR_NO_MEM;
   }
 
-  return http::send_success(req, std::move(data));
+  // Admission control is only reported once its middleware has seen traffic.
+  const middleware::RateLimitStats rate_limit =
+      json::wanted("rate_limit") ? middleware::rate_limit_stats()
+                                 : middleware::RateLimitStats{};
+  if (rate_limit.allowed > 0 || rate_limit.rejected > 0) {
+    auto limits = json_model::to_json(rate_limit);
+    if (!limits) {
+      return ESP_ERR_NO_MEM;
+    }
+    cJSON_AddItemToObject(data.get(), "rate_limit", limits.release());
+  }
+
+  const middleware::MemoryGovernorStats governor =
+      json::wanted("memory_governor") ? middleware::memory_governor_stats()
+                                      : middleware::MemoryGovernorStats{};
+  if (governor.admitted > 0 || governor.rejected > 0) {
+    auto memory = json_model::to_json(governor);
+    if (!memory) {
+      return ESP_ERR_NO_MEM;
+    }
+    cJSON_AddItemToObject(data.get(), "memory_governor", memory.release());
+  }
+
+  const middleware::CompressionStats compression =
+      json::wanted("compression") ? middleware::compression_stats()
+                                  : middleware::CompressionStats{};
+  if (compression.compressed > 0 || compression.skipped > 0) {
+    auto gzip = json_model::to_json(compression);
+    if (!gzip) {
+      return ESP_ERR_NO_MEM;
+    }
+    cJSON_AddItemToObject(data.get(), "compression", gzip.release());
+  }
+
+  const captive_dns::Stats dns = json::wanted("captive_dns")
+                                     ? captive_dns::stats()
+                                     : captive_dns::Stats{};
+  if (dns.queries > 0) {
+    auto queries = json_model::to_json(dns);
+    if (!queries) {
+      return ESP_ERR_NO_MEM;
+    }
+    cJSON_AddItemToObject(data.get(), "captive_dns", queries.release());
+  }
+
+  const captive_probe::Stats probes = json::wanted("captive_probe")
+                                          ? captive_probe::stats()
+                                          : captive_probe::Stats{};
+  if (probes.probes > 0 || probes.redirects > 0 || probes.not_found > 0) {
+    auto misses = json_model::to_json(probes);
+    if (!misses) {
+      return ESP_ERR_NO_MEM;
+    }
+    cJSON_AddItemToObject(data.get(), "captive_probe", misses.release());
+  }
+
+  *out = data.release();
+  return ESP_OK;
+}
+
+// Everything the body can report except timestamp_ms, which moves on every
+// call. A 304 or a long-poll answer thus means that only the clock moved.
+uint64_t version_get() {
+  const Metrics metrics = collect_metrics();
+  watch::Fingerprint fingerprint;
+  fingerprint.add(metrics.heap_total)
+      .add(metrics.heap_free)
+      .add(metrics.heap_used)
+      .add(metrics.heap_min_free)
+      .add(metrics.heap_largest_free_block);
+
+  const middleware::RateLimitStats rate_limit = middleware::rate_limit_stats();
+  fingerprint.add(rate_limit.allowed)
+      .add(rate_limit.rejected)
+      .add(rate_limit.evictions);
+  for (const uint32_t rejected : rate_limit.rejected_by_class) {
+    fingerprint.add(rejected);
+  }
+  for (const auto &bucket : rate_limit.buckets) {
+    fingerprint.add(bucket.client)
+        .add(bucket.client_ipv6)
+        .add(bucket.route_class)
+        .add(bucket.allowed)
+        .add(bucket.rejected)
+        .add(bucket.tokens);
+  }
+
+  const middleware::MemoryGovernorStats governor =
+      middleware::memory_governor_stats();
+  fingerprint.add(governor.learning)
+      .add(governor.reserved_bytes)
+      .add(governor.in_flight)
+      .add(governor.admitted)
+      .add(governor.rejected);
+  for (const auto &route : governor.routes) {
+    fingerprint.add(route.uri)
+        .add(route.method)
+        .add(route.estimate)
+        .add(route.learned)
+        .add(route.admitted)
+        .add(route.rejected);
+  }
+
+  const middleware::CompressionStats compression =
+      middleware::compression_stats();
+  fingerprint.add(compression.compressed)
+      .add(compression.skipped)
+      .add(compression.bytes_in)
+      .add(compression.bytes_out)
+      .add(compression.compress_us);
+
+  const captive_dns::Stats dns = captive_dns::stats();
+  fingerprint.add(dns.queries)
+      .add(dns.answered)
+      .add(dns.no_data)
+      .add(dns.forwarded)
+      .add(dns.refused)
+      .add(dns.dropped);
+
+  const captive_probe::Stats probes = captive_probe::stats();
+  fingerprint.add(probes.probes).add(probes.redirects).add(probes.not_found);
+
+  return versions.observe(fingerprint.value());
+}
+
+esp_err_t handle_get(httpd_req_t *req) {
+  return http::send_produced(req, &produce_get);
 }
 
 } // namespace earbrain::handlers::metrics
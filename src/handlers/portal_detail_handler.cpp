@@ -4,13 +4,20 @@
 
 #include "earbrain/gateway/gateway.hpp"
 #include "earbrain/gateway/handlers/handler_helpers.hpp"
+#include "earbrain/gateway/watch.hpp"
 #include "json/http_response.hpp"
 #include "json/json_helpers.hpp"
 #include "json/portal_detail.hpp"
 
 namespace earbrain::handlers::portal_detail {
 
-esp_err_t handle_get(httpd_req_t *req) {
+namespace {
+
+watch::Tracker versions;
+
+} // namespace
+
+esp_err_t produce_get(cJSON **out) {
   json_model::PortalDetail detail;
   detail.title = gateway().options.portal_config.title;
 
@@ -19,7 +26,17 @@ esp_err_t handle_get(httpd_req_t *req) {
     return ESP_ERR_NO_MEM;
   }
 
-  return http::send_success(req, std::move(data));
+  *out = data.release();
+  return ESP_OK;
+}
+
+uint64_t version_get() {
+  return versions.observe(
+      watch::Fingerprint{}.add(gateway().options.portal_config.title).value());
+}
+
+esp_err_t handle_get(httpd_req_t *req) {
+  return http::send_produced(req, &produce_get);
 }
 
 } // namespace earbrain::handlers::portal_detail
@@ -0,0 +1,30 @@
+#include "earbrain/gateway/handlers/trace_handler.hpp"
+
+#include <memory>
+#include <new>
+
+#include "earbrain/gateway/tracing.hpp"
+#include "json/http_response.hpp"
+#include "json/trace_events.hpp"
+
+namespace earbrain::handlers::trace {
+
+esp_err_t handle_get(httpd_req_t *req) {
+  std::unique_ptr<tracing::SpanRecord[]> spans{
+      new (std::nothrow) tracing::SpanRecord[tracing::ring_capacity]};
+  if (!spans) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  const std::size_t count =
+      tracing::snapshot(spans.get(), tracing::ring_capacity);
+  auto data = json_model::to_json(spans.get(), count);
+  if (!data) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  // Trace viewers expect the bare trace-event object, not the API envelope.
+  return http::send_json_response(req, data.get());
+}
+
+} // namespace earbrain::handlers::trace
@@ -1,5 +1,6 @@
 #include "earbrain/gateway/handlers/wifi_handler.hpp"
 
+#include "esp_timer.h"
 #include "esp_wifi.h"
 
 #include <cstddef>
@@ -7,17 +8,23 @@
 #include <string_view>
 #include <utility>
 
+#include "earbrain/gateway/async.hpp"
+#include "earbrain/gateway/body_reader.hpp"
 #include "earbrain/gateway/gateway.hpp"
 #include "earbrain/gateway/handlers/handler_helpers.hpp"
+#include "earbrain/gateway/request_context.hpp"
+#include "earbrain/gateway/tracing.hpp"
+#include "earbrain/gateway/watch.hpp"
+#include "earbrain/gateway/wifi_snapshot.hpp"
 #include "earbrain/logging.hpp"
 #include "earbrain/validation.hpp"
 #include "earbrain/wifi_service.hpp"
+#include "cbor.hpp"
 #include "json/http_response.hpp"
 #include "json/json_helpers.hpp"
 #include "json/wifi_credentials.hpp"
 #include "json/wifi_status.hpp"
 #include "json/wifi_scan.hpp"
-#include "lwip/ip4_addr.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 
@@ -26,13 +33,36 @@ namespace earbrain::handlers::wifi {
 namespace {
 
 constexpr std::size_t max_request_body_size = 1024;
+// Longer values fail validation anyway, so reading stops there.
+constexpr std::size_t max_ssid_length = 32;
+constexpr std::size_t max_passphrase_length = 64;
+
+constexpr char invalid_ssid_message[] = "ssid must be 1-32 characters.";
+constexpr char invalid_passphrase_message[] =
+    "Passphrase must be 8-63 chars or 64 hex.";
+
+// application/cbor bodies carry the same object as JSON ones.
+bool has_cbor_body() {
+  RequestContext *context = RequestContext::current();
+  return context &&
+         context->header("Content-Type").rfind(http::cbor_media_type, 0) == 0;
+}
 
-} // namespace
+http::BodyResult read_json_credentials(httpd_req_t *req,
+                                       WifiCredentials &out) {
+  http::BodyField fields[] = {
+      http::string_field("ssid", out.ssid, max_ssid_length),
+      http::string_field("passphrase", out.passphrase, max_passphrase_length),
+  };
+  return http::read_json_body(req, fields, max_request_body_size);
+}
 
-esp_err_t handle_credentials_post(httpd_req_t *req) {
+// CBOR bodies are read whole and decoded with cbor::decode.
+http::BodyResult read_cbor_credentials(httpd_req_t *req,
+                                       WifiCredentials &out) {
   if (req->content_len <= 0 ||
       static_cast<std::size_t>(req->content_len) > max_request_body_size) {
-    return http::send_fail(req, "Invalid request size.");
+    return http::BodyResult{http::BodyError::too_large, nullptr};
   }
 
   std::string body;
@@ -46,34 +76,72 @@ esp_err_t handle_credentials_post(httpd_req_t *req) {
       if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
         continue;
       }
-      return http::send_fail(req, "Failed to read request body.");
+      return http::BodyResult{http::BodyError::read_failed, nullptr};
     }
     received += static_cast<std::size_t>(ret);
   }
 
-  auto root = json::parse(body);
+  auto root = cbor::decode(reinterpret_cast<const uint8_t *>(body.data()),
+                           body.size());
   if (!root || !cJSON_IsObject(root.get())) {
-    return http::send_fail(req, "Invalid JSON body.");
+    return http::BodyResult{http::BodyError::malformed, nullptr};
   }
 
-  WifiCredentials wifi_creds{};
   const char *bad_field = nullptr;
-  if (!json_model::parse_wifi_credentials(root.get(), wifi_creds, &bad_field)) {
-    std::string message = bad_field
-                            ? std::string(bad_field) + " must be a string."
-                            : "Invalid credentials payload.";
-    return http::send_fail_field(req, bad_field ? bad_field : "body",
+  if (!json_model::parse_wifi_credentials(root.get(), out, &bad_field)) {
+    return http::BodyResult{http::BodyError::wrong_type, bad_field};
+  }
+  return http::BodyResult{};
+}
+
+esp_err_t send_body_error(httpd_req_t *req, const http::BodyResult &body,
+                          bool cbor_body) {
+  switch (body.error) {
+  case http::BodyError::too_large:
+    return http::send_fail(req, "Invalid request size.");
+  case http::BodyError::read_failed:
+    return http::send_fail(req, "Failed to read request body.");
+  case http::BodyError::too_long:
+    return std::string_view{body.field} == "ssid"
+               ? http::send_fail_field(req, "ssid", invalid_ssid_message)
+               : http::send_fail_field(req, "passphrase",
+                                       invalid_passphrase_message);
+  case http::BodyError::missing_field:
+  case http::BodyError::wrong_type: {
+    const std::string message =
+        body.field ? std::string(body.field) + " must be a string."
+                   : "Invalid credentials payload.";
+    return http::send_fail_field(req, body.field ? body.field : "body",
                                  message.c_str());
   }
+  case http::BodyError::malformed:
+  case http::BodyError::none:
+    break;
+  }
+  return http::send_fail(req, cbor_body ? "Invalid CBOR body."
+                                        : "Invalid JSON body.");
+}
+
+} // namespace
+
+esp_err_t handle_credentials_post(httpd_req_t *req) {
+  http::ResponseShape shape(req);
+
+  WifiCredentials wifi_creds{};
+  const bool cbor_body = has_cbor_body();
+  const http::BodyResult body = cbor_body
+                                    ? read_cbor_credentials(req, wifi_creds)
+                                    : read_json_credentials(req, wifi_creds);
+  if (!body.ok()) {
+    return send_body_error(req, body, cbor_body);
+  }
 
   if (!validation::is_valid_ssid(wifi_creds.ssid)) {
-    return http::send_fail_field(req, "ssid",
-                                 "ssid must be 1-32 characters.");
+    return http::send_fail_field(req, "ssid", invalid_ssid_message);
   }
 
   if (!validation::is_valid_passphrase(wifi_creds.passphrase)) {
-    return http::send_fail_field(req, "passphrase",
-                                 "Passphrase must be 8-63 chars or 64 hex.");
+    return http::send_fail_field(req, "passphrase", invalid_passphrase_message);
   }
 
   logging::infof("gateway",
@@ -93,35 +161,116 @@ esp_err_t handle_credentials_post(httpd_req_t *req) {
   return http::send_success(req);
 }
 
-esp_err_t handle_connect_post(httpd_req_t *req) {
+namespace {
+
+// How long POST /api/v1/wifi/connect?wait=<ms> may hold the response.
+constexpr uint64_t default_connect_wait_ms = 15000;
+constexpr uint64_t max_connect_wait_ms = 30000;
+
+// Starts connecting with the saved credentials. On failure returns the
+// message to answer with and sets result.
+const char *begin_connect(esp_err_t &result) {
   logging::info("Attempting to connect using saved credentials", "gateway");
 
   // Get saved credentials to check if they exist
   auto saved_creds = earbrain::wifi().load_credentials();
   if (!saved_creds.has_value()) {
-    return http::send_error(req, "No saved credentials found", "ESP_ERR_NOT_FOUND");
+    result = ESP_ERR_NOT_FOUND;
+    return "No saved credentials found";
   }
 
-  const esp_err_t result = earbrain::wifi().connect();
+  result = earbrain::wifi().connect();
+  // Show the attempt as under way without waiting for an event.
+  wifi_snapshot::refresh();
   if (result != ESP_OK) {
     logging::errorf("gateway", "Failed to initiate connection: %s", esp_err_to_name(result));
 
-    const char* error_msg = "Failed to initiate connection";
     if (result == ESP_ERR_INVALID_STATE) {
-      error_msg = "WiFi not in correct mode (APSTA required)";
+      return "WiFi not in correct mode (APSTA required)";
+    }
+    return "Failed to initiate connection";
+  }
+  return nullptr;
+}
+
+// Answers once the attempt has succeeded or failed, with the Wi-Fi status,
+// so the client does not have to poll /api/v1/wifi/status.
+async::Task connect_and_wait(httpd_req_t *req) {
+  uint64_t wait_ms = default_connect_wait_ms;
+  if (RequestContext *context = RequestContext::current()) {
+    wait_ms = context->query_uint("wait", default_connect_wait_ms, 1,
+                                  max_connect_wait_ms);
+  }
+
+  esp_err_t result = ESP_OK;
+  if (const char *error = begin_connect(result)) {
+    http::ResponseShape shape(req);
+    co_return http::send_error(req, error, esp_err_to_name(result));
+  }
+
+  const int64_t deadline_us =
+      esp_timer_get_time() + static_cast<int64_t>(wait_ms) * 1000;
+  WifiStatus status = earbrain::wifi().status();
+  while (status.sta_connecting) {
+    const int64_t left_us = deadline_us - esp_timer_get_time();
+    if (left_us <= 0) {
+      break;
     }
+    status = co_await async::wifi_change(
+        status, static_cast<uint32_t>((left_us + 999) / 1000));
+  }
 
-    return http::send_error(req, error_msg, esp_err_to_name(result));
+  co_return http::send_produced(req, &produce_status_get);
+}
+
+// The scan runs on the async helper task, shared with any other request
+// waiting for one, so no httpd or worker task is held for its duration.
+async::Task scan_and_send(httpd_req_t *req) {
+  WifiScanResult result;
+  {
+    tracing::Span span("wifi.scan");
+    result = co_await async::scan();
+  }
+
+  http::ResponseShape shape(req);
+  if (result.error != ESP_OK) {
+    co_return http::send_error(req, "Wi-Fi scan failed",
+                               esp_err_to_name(result.error));
+  }
+
+  auto payload = json_model::to_json(result);
+  if (!payload) {
+    co_return ESP_ERR_NO_MEM;
+  }
+
+  co_return http::send_success(req, std::move(payload));
+}
+
+} // namespace
+
+esp_err_t handle_connect_post(httpd_req_t *req) {
+  RequestContext *context = RequestContext::current();
+  if (context && context->has_query("wait")) {
+    return async::run(req, &connect_and_wait);
+  }
+
+  http::ResponseShape shape(req);
+  esp_err_t result = ESP_OK;
+  if (const char *error = begin_connect(result)) {
+    return http::send_error(req, error, esp_err_to_name(result));
   }
 
   logging::info("Connection initiated, check /api/v1/wifi/status for progress", "gateway");
 
-  // Return success immediately - client should poll /api/v1/wifi/status to check connection status
+  // Return success immediately - client should watch /api/v1/wifi/status
+  // (?wait_for_change_since) for progress, or ask with ?wait to be answered
+  // once it is done
   return http::send_success(req);
 }
 
-esp_err_t handle_status_get(httpd_req_t *req) {
-  earbrain::WifiStatus wifi_status = earbrain::wifi().status();
+esp_err_t produce_status_get(cJSON **out) {
+  const wifi_snapshot::Snapshot snapshot = wifi_snapshot::read();
+  const earbrain::WifiStatus &wifi_status = snapshot.status;
 
   json_model::WifiStatus status;
   // Map WifiMode to ap_active and sta_active for backward compatibility
@@ -129,36 +278,27 @@ esp_err_t handle_status_get(httpd_req_t *req) {
   status.sta_active = (wifi_status.mode == WifiMode::STA || wifi_status.mode == WifiMode::APSTA);
   status.sta_connected = wifi_status.sta_connected;
   status.sta_connecting = wifi_status.sta_connecting;
-  status.last_error = wifi_status.sta_last_error;
+  status.error = snapshot.error;
   status.disconnect_reason = wifi_status.sta_last_disconnect_reason;
-
-  const ip4_addr_t *ip4 = reinterpret_cast<const ip4_addr_t *>(&wifi_status.sta_ip);
-  char ip_buffer[16] = {0};
-  if (wifi_status.sta_connected && ip4addr_ntoa_r(ip4, ip_buffer, sizeof(ip_buffer))) {
-    status.ip = ip_buffer;
-  }
+  status.ip = snapshot.ip;
 
   auto data = json_model::to_json(status);
   if (!data) {
     return ESP_ERR_NO_MEM;
   }
 
-  return http::send_success(req, std::move(data));
+  *out = data.release();
+  return ESP_OK;
 }
 
-esp_err_t handle_scan_get(httpd_req_t *req) {
-  WifiScanResult result = earbrain::wifi().perform_scan();
-
-  if (result.error != ESP_OK) {
-    return http::send_error(req, "Wi-Fi scan failed", esp_err_to_name(result.error));
-  }
+uint64_t version_status_get() { return wifi_snapshot::version(); }
 
-  auto payload = json_model::to_json(result);
-  if (!payload) {
-    return ESP_ERR_NO_MEM;
-  }
+esp_err_t handle_status_get(httpd_req_t *req) {
+  return http::send_produced(req, &produce_status_get);
+}
 
-  return http::send_success(req, std::move(payload));
+esp_err_t handle_scan_get(httpd_req_t *req) {
+  return async::run(req, &scan_and_send);
 }
 
 } // namespace earbrain::handlers::wifi
@@ -0,0 +1,159 @@
+#include "heap_scope.hpp"
+
+#include "esp_attr.h"
+#include "esp_heap_caps.h"
+#include "sdkconfig.h"
+
+#include <algorithm>
+#include <atomic>
+#include <utility>
+
+namespace earbrain::heap::detail {
+
+namespace {
+
+// Innermost scope of the request running on this task, if any. The heap hooks
+// fire for every allocation in the system, so this filters to the handler's
+// task.
+thread_local HeapScope *active_scope = nullptr;
+
+#if CONFIG_HEAP_USE_HOOKS
+
+static_assert(HeapScope::pool_chunks <= 32, "one bit per chunk in chunks_taken");
+
+HeapScope::Block pool[HeapScope::pool_chunks][HeapScope::chunk_blocks];
+std::atomic<uint32_t> chunks_taken{0};
+constexpr uint32_t all_chunks =
+    HeapScope::pool_chunks == 32 ? UINT32_MAX
+                                 : (uint32_t{1} << HeapScope::pool_chunks) - 1;
+
+IRAM_ATTR bool take_chunk(HeapScope &scope) {
+  uint32_t taken = chunks_taken.load(std::memory_order_relaxed);
+  for (;;) {
+    const uint32_t free_chunks = ~taken & all_chunks;
+    if (free_chunks == 0) {
+      return false;
+    }
+    const uint32_t chunk = static_cast<uint32_t>(__builtin_ctz(free_chunks));
+    if (chunks_taken.compare_exchange_weak(taken, taken | uint32_t{1} << chunk,
+                                           std::memory_order_acquire,
+                                           std::memory_order_relaxed)) {
+      scope.chunks[scope.chunk_count++] = static_cast<uint8_t>(chunk);
+      return true;
+    }
+  }
+}
+
+IRAM_ATTR HeapScope::Block &block(HeapScope &scope, std::size_t i) {
+  return pool[scope.chunks[i / HeapScope::chunk_blocks]]
+             [i % HeapScope::chunk_blocks];
+}
+
+IRAM_ATTR bool track(HeapScope &scope, const HeapScope::Block &tracked) {
+  if (scope.tracked == scope.chunk_count * HeapScope::chunk_blocks &&
+      !take_chunk(scope)) {
+    return false;
+  }
+  block(scope, scope.tracked++) = tracked;
+  return true;
+}
+
+#endif
+
+} // namespace
+
+#if CONFIG_HEAP_USE_HOOKS
+
+extern "C" IRAM_ATTR void esp_heap_trace_alloc_hook(void *ptr, size_t size,
+                                                    uint32_t caps) {
+  (void)caps;
+  HeapScope *innermost = active_scope;
+  if (!ptr || !innermost) {
+    return;
+  }
+  const bool tracked = track(*innermost, HeapScope::Block{ptr, size});
+  for (HeapScope *scope = innermost; scope; scope = scope->outer) {
+    ++scope->allocations;
+    scope->allocated_bytes += size;
+    if (!tracked) {
+      scope->saturated = true;
+      continue;
+    }
+    scope->live_bytes += size;
+    if (scope->live_bytes > scope->peak_bytes) {
+      scope->peak_bytes = scope->live_bytes;
+    }
+  }
+}
+
+extern "C" IRAM_ATTR void esp_heap_trace_free_hook(void *ptr) {
+  if (!ptr) {
+    return;
+  }
+  for (HeapScope *scope = active_scope; scope; scope = scope->outer) {
+    // Newest first: a request mostly frees what it allocated last.
+    for (std::size_t i = scope->tracked; i-- > 0;) {
+      HeapScope::Block &freed = block(*scope, i);
+      if (freed.ptr != ptr) {
+        continue;
+      }
+      for (HeapScope *charged = scope; charged; charged = charged->outer) {
+        charged->live_bytes -= freed.size;
+      }
+      freed = block(*scope, --scope->tracked);
+      return;
+    }
+  }
+}
+
+#endif
+
+HeapScope::HeapScope(HeapScope &&other) noexcept
+  : allocations(other.allocations), allocated_bytes(other.allocated_bytes),
+    live_bytes(other.live_bytes), peak_bytes(other.peak_bytes),
+    saturated(other.saturated), tracked(std::exchange(other.tracked, 0)),
+    chunk_count(std::exchange(other.chunk_count, 0)) {
+  std::copy(other.chunks, other.chunks + chunk_count, chunks);
+  other.live_bytes = 0;
+}
+
+HeapScope::~HeapScope() {
+#if CONFIG_HEAP_USE_HOOKS
+  for (std::size_t i = 0; i < tracked && outer; ++i) {
+    const Block &live = block(*this, i);
+    if (!track(*outer, live)) {
+      // Its free can no longer be matched, so it no longer counts as live.
+      for (HeapScope *charged = outer; charged; charged = charged->outer) {
+        charged->live_bytes -= live.size;
+        charged->saturated = true;
+      }
+    }
+  }
+  uint32_t mask = 0;
+  for (std::size_t i = 0; i < chunk_count; ++i) {
+    mask |= uint32_t{1} << chunks[i];
+  }
+  chunks_taken.fetch_and(~mask, std::memory_order_release);
+#endif
+}
+
+bool hooks_available() {
+#if CONFIG_HEAP_USE_HOOKS
+  return true;
+#else
+  return false;
+#endif
+}
+
+void begin(HeapScope &scope) {
+  scope.outer = active_scope;
+  active_scope = &scope;
+}
+
+void end(HeapScope &scope) { active_scope = scope.outer; }
+
+Untracked::Untracked() : outer(std::exchange(active_scope, nullptr)) {}
+
+Untracked::~Untracked() { active_scope = outer; }
+
+} // namespace earbrain::heap::detail
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+namespace earbrain::heap::detail {
+
+// Live-byte accounting for one request, fed by the ESP-IDF heap hooks. Lives
+// on the handler task's stack and is published through a thread-local
+// pointer. Scopes nest: an allocation is charged to every open scope, and
+// its block tracked by the innermost one only.
+struct HeapScope {
+  struct Block {
+    void *ptr;
+    std::size_t size;
+  };
+
+  // Blocks whose size we still need on free go in chunks taken from a fixed
+  // pool, shared by every scope, as the scope grows, so the hooks never
+  // allocate themselves and an idle scope holds none. The pool holds the
+  // cJSON tree of a scan with about 40 networks.
+  static constexpr std::size_t chunk_blocks = 32;
+  static constexpr std::size_t pool_chunks = 32;
+
+  HeapScope() = default;
+  // Takes over other's figures and blocks, leaving it empty; for a measure
+  // carried to a detached request. outer is set when it is next begun.
+  HeapScope(HeapScope &&other) noexcept;
+  // Hands the blocks still live to outer, which they were charged to too,
+  // and returns the chunks to the pool.
+  ~HeapScope();
+
+  HeapScope(const HeapScope &) = delete;
+  HeapScope &operator=(const HeapScope &) = delete;
+
+  uint32_t allocations = 0;
+  uint64_t allocated_bytes = 0;
+  // Of the tracked blocks only: a block that found the pool empty is
+  // counted in allocations and allocated_bytes but not here, since its free
+  // could not be matched. peak_bytes is then a lower bound, and saturated
+  // says so.
+  std::size_t live_bytes = 0;
+  std::size_t peak_bytes = 0;
+  bool saturated = false;
+  std::size_t tracked = 0;
+  std::size_t chunk_count = 0;
+  uint8_t chunks[pool_chunks] = {};
+  HeapScope *outer = nullptr;
+};
+
+// False when built without CONFIG_HEAP_USE_HOOKS; scopes then stay empty.
+bool hooks_available();
+
+void begin(HeapScope &scope);
+void end(HeapScope &scope);
+
+// Charges nothing to the task's open scopes while alive.
+class Untracked {
+public:
+  Untracked();
+  ~Untracked();
+
+  Untracked(const Untracked &) = delete;
+  Untracked &operator=(const Untracked &) = delete;
+
+private:
+  HeapScope *outer;
+};
+
+} // namespace earbrain::heap::detail
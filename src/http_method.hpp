@@ -0,0 +1,28 @@
+#pragma once
+
+#include "esp_http_server.h"
+
+namespace earbrain::http {
+
+inline const char *method_str(int method) {
+  switch (static_cast<httpd_method_t>(method)) {
+  case HTTP_GET:
+    return "GET";
+  case HTTP_POST:
+    return "POST";
+  case HTTP_PUT:
+    return "PUT";
+  case HTTP_DELETE:
+    return "DELETE";
+  case HTTP_HEAD:
+    return "HEAD";
+  case HTTP_PATCH:
+    return "PATCH";
+  case HTTP_OPTIONS:
+    return "OPTIONS";
+  default:
+    return "UNKNOWN";
+  }
+}
+
+} // namespace earbrain::http
@@ -1,83 +1,147 @@
 #include "earbrain/gateway/http_server.hpp"
 
+#include "earbrain/gateway/response_cache.hpp"
+#include "earbrain/gateway/tracing.hpp"
+#include "singleflight_context.hpp"
+#include "watch_context.hpp"
+
+#include <algorithm>
+#include <iterator>
+
 namespace earbrain {
 
+struct HttpServer::RouteTable {
+  std::vector<std::shared_ptr<UriHandler>> routes;
+  std::vector<Middleware> global_middlewares;
+  httpd_err_handler_func_t not_found_handler = nullptr;
+};
+
 namespace {
 
-// Middleware wrapper
-esp_err_t middleware_wrapper(httpd_req_t *req) {
-  auto *route = static_cast<UriHandler *>(req->user_ctx);
-  if (!route) {
-    return ESP_FAIL;
+// Each gets one wildcard handler; routing happens in HttpServer::dispatch.
+constexpr httpd_method_t dispatched_methods[] = {
+    HTTP_GET, HTTP_POST, HTTP_PUT, HTTP_DELETE,
+    HTTP_PATCH, HTTP_HEAD, HTTP_OPTIONS,
+};
+
+// The httpd task runs dispatch: the RequestContext (about 600 B), the
+// middlewares' own state (a trace, heap scopes) and then most handlers
+// inline, which alone want the 6 KB singleflight gives its workers.
+// HTTPD_DEFAULT_CONFIG's 4 KB is not enough.
+constexpr std::size_t server_stack_size = 8192;
+
+esp_err_t run_handler(httpd_req_t *req, const UriHandler &route) {
+  tracing::Span span("handler");
+  if (route.version) {
+    return watch::detail::run(req, route);
   }
-
-  // Build the handler chain
-  NextHandler next = [route](httpd_req_t *r) {
-    return route->handler(r);
-  };
-
-  for (auto it = route->middlewares.rbegin(); it != route->middlewares.rend(); ++it) {
-    const Middleware &middleware = *it;
-    NextHandler current_next = next;
-    next = [middleware, current_next](httpd_req_t *r) {
-      return middleware(r, current_next);
-    };
+  if (route.coalesce) {
+    return singleflight::detail::run(req, route);
   }
+  return route.handler(req);
+}
 
-  if (route->server) {
-    const auto &global_middlewares = route->server->get_global_middlewares();
-    for (auto it = global_middlewares.rbegin(); it != global_middlewares.rend(); ++it) {
-      const Middleware &middleware = *it;
-      NextHandler current_next = next;
-      next = [middleware, current_next](httpd_req_t *r) {
-        return middleware(r, current_next);
-      };
+// A request's middlewares, globals first, then the route's handler. Each
+// middleware is handed the rest as a NextHandler holding only this chain and
+// a position, small enough for std::function to keep without allocating, so
+// a request a middleware answers itself (a 503, a 429) costs no heap.
+struct Chain {
+  const std::vector<Middleware> &global_middlewares;
+  const UriHandler &route;
+
+  esp_err_t run(httpd_req_t *req, std::size_t index) const {
+    const NextHandler next = [this, index](httpd_req_t *r) {
+      return run(r, index + 1);
+    };
+    if (index < global_middlewares.size()) {
+      return global_middlewares[index](req, next);
+    }
+    index -= global_middlewares.size();
+    if (index < route.middlewares.size()) {
+      return route.middlewares[index](req, next);
     }
+    return run_handler(req, route);
   }
+};
 
-  // Execute the chain
-  const esp_err_t result = next(req);
-  return result;
+template <typename Routes>
+auto find_in(Routes &routes, std::string_view uri, int method) {
+  return std::find_if(routes.begin(), routes.end(), [&](const auto &route) {
+    return route->method == method && route->uri == uri;
+  });
 }
 
 } // namespace
 
-UriHandler::UriHandler(std::string_view path, httpd_method_t m,
-                       RequestHandler h, void *ctx, HttpServer *srv)
-  : uri(path), method(m), handler(h), user_ctx(ctx), descriptor{},
-    middlewares{}, server(srv) {
-  refresh_descriptor();
-}
-
-UriHandler::UriHandler(std::string_view path, httpd_method_t m,
-                       RequestHandler h, const RouteOptions &opts, HttpServer *srv)
-  : uri(path), method(m), handler(h), user_ctx(opts.user_ctx),
-    descriptor{}, middlewares(opts.middlewares), server(srv) {
-  refresh_descriptor();
-}
+// Every request comes through here, so a route's requests always have a
+// RequestContext.
+esp_err_t HttpServer::dispatch(httpd_req_t *req) {
+  auto *server = static_cast<HttpServer *>(req->user_ctx);
+  if (!server) {
+    return ESP_FAIL;
+  }
+  // Held until the request is done, along with every route it lists.
+  const TablePtr table = server->table.load(std::memory_order_acquire);
+
+  const std::string_view uri{req->uri};
+  const std::string_view path = uri.substr(0, uri.find('?'));
+  const auto found = find_in(table->routes, path, req->method);
+  if (found == table->routes.end()) {
+    const bool other_method = std::any_of(
+        table->routes.begin(), table->routes.end(),
+        [&](const auto &route) { return route->uri == path; });
+    if (other_method) {
+      return httpd_resp_send_err(req, HTTPD_405_METHOD_NOT_ALLOWED, nullptr);
+    }
+    if (table->not_found_handler) {
+      return table->not_found_handler(req, HTTPD_404_NOT_FOUND);
+    }
+    return httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, nullptr);
+  }
+  const UriHandler *route = found->get();
 
-void UriHandler::refresh_descriptor() {
-  descriptor.uri = uri.c_str();
-  descriptor.method = method;
+  RequestContext context(req, route);
+  const RequestContext::Scope scope(context);
 
-  bool has_middlewares = !middlewares.empty();
-  if (!has_middlewares && server) {
-    has_middlewares = !server->get_global_middlewares().empty();
+  const auto &global_middlewares = table->global_middlewares;
+  if (route->middlewares.empty() && global_middlewares.empty()) {
+    return run_handler(req, *route);
   }
 
-  if (has_middlewares) {
-    descriptor.handler = &middleware_wrapper;
-    descriptor.user_ctx = this;  // Pass UriHandler* to wrapper
-  } else {
-    descriptor.handler = handler;
-    descriptor.user_ctx = user_ctx;  // Available for future use
-  }
+  const Chain chain{global_middlewares, *route};
+  return chain.run(req, 0);
 }
 
+UriHandler::UriHandler(std::string_view path, httpd_method_t m,
+                       RequestHandler h, RouteData data, HttpServer *srv)
+  : uri(path), method(m), handler(h), user_data(data), middlewares{},
+    coalesce(false), batch(nullptr), version(nullptr), cache_ttl_ms(0),
+    server(srv) {}
+
+UriHandler::UriHandler(std::string_view path, httpd_method_t m,
+                       RequestHandler h, const RouteOptions &opts, HttpServer *srv)
+  : uri(path), method(m), handler(h), user_data(opts.user_data),
+    middlewares(opts.middlewares), coalesce(opts.coalesce),
+    batch(opts.batch), version(opts.version),
+    cache_ttl_ms(opts.version ? opts.cache_ttl_ms : 0), server(srv) {}
+
+HttpServer::HttpServer() : table(std::make_shared<const RouteTable>()) {}
+
 HttpServer::~HttpServer() {
   stop();
 }
 
+template <typename Edit> esp_err_t HttpServer::update(Edit &&edit) {
+  std::lock_guard<std::mutex> lock(update_mutex);
+  RouteTable next = *table.load(std::memory_order_relaxed);
+  const esp_err_t err = edit(next);
+  if (err == ESP_OK) {
+    table.store(std::make_shared<const RouteTable>(std::move(next)),
+                std::memory_order_release);
+  }
+  return err;
+}
+
 esp_err_t HttpServer::start() {
   if (running) {
     return ESP_OK;
@@ -89,8 +153,10 @@ esp_err_t HttpServer::start() {
   }
 
   httpd_config_t config = HTTPD_DEFAULT_CONFIG();
-  config.max_uri_handlers = 32;
+  config.max_uri_handlers = std::size(dispatched_methods);
+  config.uri_match_fn = httpd_uri_match_wildcard;
   config.lru_purge_enable = true;
+  config.stack_size = server_stack_size;
   // Allow slower clients more time before the server aborts the socket on send/recv.
   config.recv_wait_timeout = 20;
   config.send_wait_timeout = 30;
@@ -101,8 +167,9 @@ esp_err_t HttpServer::start() {
     return err;
   }
 
-  for (auto &route : routes) {
-    const esp_err_t reg_err = register_route_with_server(*route);
+  for (const httpd_method_t method : dispatched_methods) {
+    const httpd_uri_t descriptor{"/*", method, &HttpServer::dispatch, this};
+    const esp_err_t reg_err = httpd_register_uri_handler(handle, &descriptor);
     if (reg_err != ESP_OK) {
       httpd_stop(handle);
       handle = nullptr;
@@ -132,27 +199,19 @@ esp_err_t HttpServer::stop() {
 }
 
 esp_err_t HttpServer::add_route(std::string_view uri, httpd_method_t method,
-                                RequestHandler handler, void *user_ctx) {
+                                RequestHandler handler, RouteData user_data) {
   if (uri.empty() || !handler) {
     return ESP_ERR_INVALID_ARG;
   }
 
-  if (has_route(uri, method)) {
-    return ESP_ERR_INVALID_STATE;
-  }
-
-  auto entry = std::make_unique<UriHandler>(uri, method, handler, user_ctx, this);
-  UriHandler &route = *entry;
-
-  if (handle) {
-    const esp_err_t err = register_route_with_server(route);
-    if (err != ESP_OK) {
-      return err;
+  auto route = std::make_shared<UriHandler>(uri, method, handler, user_data, this);
+  return update([&](RouteTable &next) {
+    if (find_in(next.routes, uri, method) != next.routes.end()) {
+      return ESP_ERR_INVALID_STATE;
     }
-  }
-
-  routes.push_back(std::move(entry));
-  return ESP_OK;
+    next.routes.push_back(std::move(route));
+    return ESP_OK;
+  });
 }
 
 esp_err_t HttpServer::add_route(std::string_view uri, httpd_method_t method,
@@ -161,52 +220,60 @@ esp_err_t HttpServer::add_route(std::string_view uri, httpd_method_t method,
     return ESP_ERR_INVALID_ARG;
   }
 
-  if (has_route(uri, method)) {
-    return ESP_ERR_INVALID_STATE;
-  }
-
-  auto entry = std::make_unique<UriHandler>(uri, method, handler, options, this);
-  UriHandler &route = *entry;
+  auto route = std::make_shared<UriHandler>(uri, method, handler, options, this);
+  return update([&](RouteTable &next) {
+    if (find_in(next.routes, uri, method) != next.routes.end()) {
+      return ESP_ERR_INVALID_STATE;
+    }
+    next.routes.push_back(std::move(route));
+    return ESP_OK;
+  });
+}
 
-  if (handle) {
-    const esp_err_t err = register_route_with_server(route);
-    if (err != ESP_OK) {
-      return err;
+esp_err_t HttpServer::remove_route(std::string_view uri, httpd_method_t method) {
+  const esp_err_t err = update([&](RouteTable &next) {
+    const auto found = find_in(next.routes, uri, method);
+    if (found == next.routes.end()) {
+      return ESP_ERR_NOT_FOUND;
     }
+    next.routes.erase(found);
+    return ESP_OK;
+  });
+  if (err == ESP_OK) {
+    // Kept responses name their route by address, which a later route may
+    // reuse.
+    response_cache::invalidate();
   }
-
-  routes.push_back(std::move(entry));
-  return ESP_OK;
+  return err;
 }
 
 bool HttpServer::has_route(std::string_view uri, httpd_method_t method) const {
-  for (const auto &route : routes) {
-    if (route->method == method && route->uri == uri) {
-      return true;
-    }
-  }
-  return false;
+  return find_route(uri, method) != nullptr;
 }
 
-esp_err_t HttpServer::register_route_with_server(UriHandler &route) const {
-  if (!handle) {
-    return ESP_ERR_INVALID_STATE;
-  }
+std::shared_ptr<const UriHandler>
+HttpServer::find_route(std::string_view uri, httpd_method_t method) const {
+  const TablePtr current = table.load(std::memory_order_acquire);
+  const auto found = find_in(current->routes, uri, method);
+  return found != current->routes.end() ? *found : nullptr;
+}
 
-  route.refresh_descriptor();
-  return httpd_register_uri_handler(handle, &route.descriptor);
+void HttpServer::set_not_found_handler(httpd_err_handler_func_t handler) {
+  update([&](RouteTable &next) {
+    next.not_found_handler = handler;
+    return ESP_OK;
+  });
 }
 
 void HttpServer::use(Middleware middleware) {
-  global_middlewares.push_back(middleware);
-  for (auto &route : routes) {
-    if (handle) {
-      httpd_unregister_uri_handler(handle, route->uri.c_str(), route->method);
-      register_route_with_server(*route);
-    } else {
-      route->refresh_descriptor();
-    }
-  }
+  update([&](RouteTable &next) {
+    next.global_middlewares.push_back(std::move(middleware));
+    return ESP_OK;
+  });
+}
+
+std::vector<Middleware> HttpServer::get_global_middlewares() const {
+  return table.load(std::memory_order_acquire)->global_middlewares;
 }
 
 } // namespace earbrain
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "earbrain/gateway/captive_dns.hpp"
+#include "json/json_helpers.hpp"
+
+#include <cJSON.h>
+
+#include <utility>
+
+namespace earbrain::json_model {
+
+inline json::Ptr to_json(const captive_dns::Stats &stats) {
+  auto obj = json::object();
+  if (!obj) {
+    return nullptr;
+  }
+
+  const std::pair<const char *, uint32_t> counters[] = {
+      {"queries", stats.queries},     {"answered", stats.answered},
+      {"no_data", stats.no_data},     {"forwarded", stats.forwarded},
+      {"refused", stats.refused},     {"dropped", stats.dropped},
+  };
+  for (const auto &[key, value] : counters) {
+    if (!cJSON_AddNumberToObject(obj.get(), key, static_cast<double>(value))) {
+      return nullptr;
+    }
+  }
+
+  return obj;
+}
+
+} // namespace earbrain::json_model
@@ -0,0 +1,32 @@
+#pragma once
+
+#include "earbrain/gateway/captive_probe.hpp"
+#include "json/json_helpers.hpp"
+
+#include <cJSON.h>
+
+#include <utility>
+
+namespace earbrain::json_model {
+
+inline json::Ptr to_json(const captive_probe::Stats &stats) {
+  auto obj = json::object();
+  if (!obj) {
+    return nullptr;
+  }
+
+  const std::pair<const char *, uint32_t> counters[] = {
+      {"probes", stats.probes},
+      {"redirects", stats.redirects},
+      {"not_found", stats.not_found},
+  };
+  for (const auto &[key, value] : counters) {
+    if (!cJSON_AddNumberToObject(obj.get(), key, static_cast<double>(value))) {
+      return nullptr;
+    }
+  }
+
+  return obj;
+}
+
+} // namespace earbrain::json_model
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "earbrain/gateway/middlewares/compression.hpp"
+#include "json/json_helpers.hpp"
+
+#include <cJSON.h>
+
+namespace earbrain::json_model {
+
+inline json::Ptr to_json(const middleware::CompressionStats &stats) {
+  auto obj = json::object();
+  if (!obj) {
+    return nullptr;
+  }
+
+  if (!cJSON_AddNumberToObject(obj.get(), "compressed",
+                               static_cast<double>(stats.compressed))) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "skipped",
+                               static_cast<double>(stats.skipped))) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "bytes_in",
+                               static_cast<double>(stats.bytes_in))) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "bytes_out",
+                               static_cast<double>(stats.bytes_out))) {
+    return nullptr;
+  }
+  // Compressed size over original size; lower is better.
+  const double ratio = stats.bytes_in > 0
+                           ? static_cast<double>(stats.bytes_out) /
+                                 static_cast<double>(stats.bytes_in)
+                           : 0.0;
+  if (!cJSON_AddNumberToObject(obj.get(), "ratio", ratio)) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "compress_us",
+                               static_cast<double>(stats.compress_us))) {
+    return nullptr;
+  }
+
+  return obj;
+}
+
+} // namespace earbrain::json_model
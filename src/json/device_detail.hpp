@@ -11,17 +11,21 @@ inline json::Ptr to_json(const DeviceDetail &detail) {
     return obj;
   }
 
-  if (json::add(obj.get(), "model", detail.model) != ESP_OK) {
+  if (json::wanted("model") &&
+      json::add(obj.get(), "model", detail.model) != ESP_OK) {
     return json::Ptr{};
   }
-  if (json::add(obj.get(), "gateway_version", detail.gateway_version) !=
-      ESP_OK) {
+  if (json::wanted("gateway_version") &&
+      json::add(obj.get(), "gateway_version", detail.gateway_version) !=
+          ESP_OK) {
     return json::Ptr{};
   }
-  if (json::add(obj.get(), "build_time", detail.build_time) != ESP_OK) {
+  if (json::wanted("build_time") &&
+      json::add(obj.get(), "build_time", detail.build_time) != ESP_OK) {
     return json::Ptr{};
   }
-  if (json::add(obj.get(), "idf_version", detail.idf_version) != ESP_OK) {
+  if (json::wanted("idf_version") &&
+      json::add(obj.get(), "idf_version", detail.idf_version) != ESP_OK) {
     return json::Ptr{};
   }
 
@@ -0,0 +1,81 @@
+#pragma once
+
+#include "earbrain/gateway/middlewares/heap_accounting.hpp"
+#include "http_method.hpp"
+#include "json/json_helpers.hpp"
+
+#include <vector>
+
+namespace earbrain::json_model {
+
+inline json::Ptr to_json(const middleware::RouteHeapStats &stats) {
+  auto obj = json::object();
+  if (!obj) {
+    return nullptr;
+  }
+
+  if (json::add(obj.get(), "uri", stats.uri) != ESP_OK) {
+    return nullptr;
+  }
+  if (json::add(obj.get(), "method", http::method_str(stats.method)) != ESP_OK) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "requests",
+                               static_cast<double>(stats.requests))) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "allocations",
+                               static_cast<double>(stats.allocations))) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "allocated_bytes",
+                               static_cast<double>(stats.allocated_bytes))) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "peak_bytes",
+                               static_cast<double>(stats.peak_bytes))) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "last_peak_bytes",
+                               static_cast<double>(stats.last_peak_bytes))) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "saturated",
+                               static_cast<double>(stats.saturated))) {
+    return nullptr;
+  }
+
+  return obj;
+}
+
+inline json::Ptr to_json(const std::vector<middleware::RouteHeapStats> &routes,
+                         bool hooks_enabled) {
+  auto obj = json::object();
+  if (!obj) {
+    return nullptr;
+  }
+
+  if (json::wanted("hooks_enabled") &&
+      json::add(obj.get(), "hooks_enabled", hooks_enabled) != ESP_OK) {
+    return nullptr;
+  }
+
+  if (json::wanted("routes")) {
+    cJSON *items = cJSON_AddArrayToObject(obj.get(), "routes");
+    if (!items) {
+      return nullptr;
+    }
+
+    for (const auto &stats : routes) {
+      json::Ptr item = to_json(stats);
+      if (!item) {
+        return nullptr;
+      }
+      cJSON_AddItemToArray(items, item.release());
+    }
+  }
+
+  return obj;
+}
+
+} // namespace earbrain::json_model
@@ -1,18 +1,177 @@
 #pragma once
 
+#include "earbrain/gateway/capture.hpp"
+#include "earbrain/gateway/http_server.hpp"
+#include "earbrain/gateway/response_cache.hpp"
+#include "earbrain/gateway/singleflight.hpp"
+#include "earbrain/gateway/tracing.hpp"
+#include "cbor.hpp"
+#include "compression_context.hpp"
 #include "json/json_helpers.hpp"
 
 #include "esp_http_server.h"
 #include "esp_log.h"
 
+#include <cstring>
+#include <string_view>
+
 namespace earbrain::http {
 
-inline esp_err_t send_json_response(httpd_req_t *req, cJSON *json) {
+// Media types a client can ask for in Accept; see ResponseShape.
+inline constexpr char cbor_media_type[] = "application/cbor";
+inline constexpr char compact_json_media_type[] =
+    "application/vnd.earbrain.compact+json";
+inline constexpr char compact_cbor_media_type[] =
+    "application/vnd.earbrain.compact+cbor";
+
+class ResponseShape;
+
+namespace detail {
+inline thread_local const ResponseShape *active_shape = nullptr;
+// The ETag of the versioned resource being served on this task; set by
+// watch::detail::serve around the handler.
+inline thread_local const char *entity_tag = nullptr;
+} // namespace detail
+
+// How an API response is built, from the request:
+//   ?fields=a,b  only these top-level data fields are serialised
+//   Accept: application/cbor
+//               the same response encoded as CBOR rather than JSON text
+//   Accept: application/vnd.earbrain.compact+json (or +cbor)
+//               a success response is the bare data, without the envelope
+// Lives on the handler's stack and is published to the task until it goes
+// out of scope. fail and error responses always keep the envelope.
+class ResponseShape {
+public:
+  explicit ResponseShape(httpd_req_t *req)
+    : outer(detail::active_shape), outer_fields(json::detail::selected_fields) {
+    RequestContext *context = RequestContext::current();
+    if (context && context->request() != req) {
+      context = nullptr;
+    }
+    parse_fields(context);
+    parse_accept(context);
+    detail::active_shape = this;
+    if (fields.count > 0) {
+      json::detail::selected_fields = &fields;
+    }
+  }
+
+  ~ResponseShape() {
+    detail::active_shape = outer;
+    json::detail::selected_fields = outer_fields;
+  }
+
+  ResponseShape(const ResponseShape &) = delete;
+  ResponseShape &operator=(const ResponseShape &) = delete;
+
+  // Whether the request being served on this task asked for compact mode.
+  static bool compact() {
+    return detail::active_shape && detail::active_shape->compact_mode;
+  }
+
+  // Whether it asked for CBOR.
+  static bool cbor() {
+    return detail::active_shape && detail::active_shape->cbor_mode;
+  }
+
+private:
+  void parse_fields(RequestContext *context) {
+    // Percent-decoded by the context; URLSearchParams sends "a%2Cb" for
+    // "a,b".
+    std::string_view rest = context ? context->query("fields")
+                                    : std::string_view{};
+    while (!rest.empty()) {
+      const std::size_t comma = rest.find(',');
+      const std::string_view name = rest.substr(0, comma);
+      rest = comma == std::string_view::npos ? std::string_view{}
+                                             : rest.substr(comma + 1);
+      if (name.empty()) {
+        continue;
+      }
+      if (fields.count == json::FieldSelection::max_fields) {
+        // Too many to honour: the full response is a superset of any of them.
+        fields.count = 0;
+        return;
+      }
+      fields.names[fields.count++] = name;
+    }
+  }
+
+  void parse_accept(RequestContext *context) {
+    const std::string_view value =
+        context ? context->header("Accept") : std::string_view{};
+    const bool compact_cbor =
+        value.find(compact_cbor_media_type) != std::string_view::npos;
+    compact_mode = compact_cbor || value.find(compact_json_media_type) !=
+                                       std::string_view::npos;
+    cbor_mode = compact_cbor ||
+                value.find(cbor_media_type) != std::string_view::npos;
+  }
+
+  const ResponseShape *outer;
+  const json::FieldSelection *outer_fields;
+  json::FieldSelection fields;
+  bool compact_mode = false;
+  bool cbor_mode = false;
+};
+
+// Common tail of the JSON and CBOR senders.
+inline esp_err_t send_body(httpd_req_t *req, const char *content_type,
+                           const char *body, std::size_t len) {
+  httpd_resp_set_type(req, content_type);
+  httpd_resp_set_hdr(req, "Cache-Control",
+                     detail::entity_tag ? "no-cache" : "no-store");
+  if (const char *timing = tracing::server_timing()) {
+    httpd_resp_set_hdr(req, "Server-Timing", timing);
+  }
+
+  singleflight::note_body(content_type, body, len);
+  response_cache::note_body(content_type, body, len);
+
+  const esp_err_t err = compression::detail::send(
+      req, content_type, body, len, compression::detail::requested());
+  if (err != ESP_ERR_NOT_SUPPORTED) {
+    return err;
+  }
+
+  tracing::Span span("socket.send");
+  return httpd_resp_send(req, body, static_cast<ssize_t>(len));
+}
+
+inline esp_err_t send_cbor_response(httpd_req_t *req, cJSON *json,
+                                    const char *content_type =
+                                        cbor_media_type) {
+  if (!req || !json) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
+  cbor::Buffer buffer;
+  esp_err_t err = ESP_OK;
+  {
+    tracing::Span span("cbor.encode");
+    err = cbor::encode(json, buffer);
+  }
+  if (err != ESP_OK) {
+    return err;
+  }
+  return send_body(req, content_type,
+                   reinterpret_cast<const char *>(buffer.data.get()),
+                   buffer.size);
+}
+
+inline esp_err_t send_json_response(httpd_req_t *req, cJSON *json,
+                                    const char *content_type =
+                                        "application/json") {
   if (!req || !json) {
     return ESP_ERR_INVALID_ARG;
   }
 
-  char *buffer = cJSON_PrintUnformatted(json);
+  char *buffer = nullptr;
+  {
+    tracing::Span span("json.print");
+    buffer = cJSON_PrintUnformatted(json);
+  }
   if (!buffer) {
     return ESP_ERR_NO_MEM;
   }
@@ -21,28 +180,22 @@ inline esp_err_t send_json_response(httpd_req_t *req, cJSON *json) {
   ESP_LOGD("gateway", "response: %s", buffer);
 #endif
 
-  httpd_resp_set_type(req, "application/json");
-  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
-  const esp_err_t err = httpd_resp_send(req, buffer, HTTPD_RESP_USE_STRLEN);
+  const esp_err_t err = send_body(req, content_type, buffer,
+                                  std::strlen(buffer));
   cJSON_free(buffer);
   return err;
 }
 
-inline esp_err_t send_response(httpd_req_t *req, const char *status,
-                               json::Ptr data = json::Ptr{},
-                               const char *error_message = nullptr,
-                               const char *http_status = nullptr) {
-  if (!req || !status) {
-    return ESP_ERR_INVALID_ARG;
-  }
-
+inline json::Ptr make_envelope(const char *status, json::Ptr data,
+                               const char *error_message) {
+  tracing::Span span("json.envelope");
   auto root = json::object();
   if (!root) {
-    return ESP_ERR_NO_MEM;
+    return nullptr;
   }
 
   if (json::add(root.get(), "status", status) != ESP_OK) {
-    return ESP_ERR_NO_MEM;
+    return nullptr;
   }
 
   cJSON *data_obj = nullptr;
@@ -51,7 +204,7 @@ inline esp_err_t send_response(httpd_req_t *req, const char *status,
   } else {
     auto empty = json::object();
     if (!empty) {
-      return ESP_ERR_NO_MEM;
+      return nullptr;
     }
     data_obj = empty.release();
   }
@@ -61,16 +214,49 @@ inline esp_err_t send_response(httpd_req_t *req, const char *status,
                          ? cJSON_CreateString(error_message)
                          : cJSON_CreateNull()};
   if (!error_node) {
-    return ESP_ERR_NO_MEM;
+    return nullptr;
   }
   cJSON_AddItemToObject(root.get(), "error", error_node.release());
 
+  return root;
+}
+
+inline esp_err_t send_response(httpd_req_t *req, const char *status,
+                               json::Ptr data = json::Ptr{},
+                               const char *error_message = nullptr,
+                               const char *http_status = nullptr) {
+  if (!req || !status) {
+    return ESP_ERR_INVALID_ARG;
+  }
+
   if (http_status) {
     httpd_resp_set_status(req, http_status);
+    capture::note_status(http_status);
+    singleflight::note_status(http_status);
+    response_cache::note_status(http_status);
+  } else if (detail::entity_tag) {
+    // Only the 200 is the resource itself.
+    httpd_resp_set_hdr(req, "ETag", detail::entity_tag);
   }
 
-  const esp_err_t err = send_json_response(req, root.get());
-  return err;
+  const bool bare =
+      ResponseShape::compact() && std::strcmp(status, "success") == 0;
+  json::Ptr root;
+  if (bare) {
+    root = data ? std::move(data) : json::object();
+  } else {
+    root = make_envelope(status, std::move(data), error_message);
+  }
+  if (!root) {
+    return ESP_ERR_NO_MEM;
+  }
+
+  if (ResponseShape::cbor()) {
+    return send_cbor_response(req, root.get(),
+                              bare ? compact_cbor_media_type : cbor_media_type);
+  }
+  return send_json_response(req, root.get(),
+                            bare ? compact_json_media_type : "application/json");
 }
 
 inline esp_err_t send_success(httpd_req_t *req, json::Ptr data = json::Ptr{},
@@ -79,6 +265,18 @@ inline esp_err_t send_success(httpd_req_t *req, json::Ptr data = json::Ptr{},
                        http_status);
 }
 
+// Sends what a route's DataProducer builds as a success response, shaped by
+// the request's ?fields= and Accept.
+inline esp_err_t send_produced(httpd_req_t *req, DataProducer produce) {
+  ResponseShape shape(req);
+  cJSON *data = nullptr;
+  const esp_err_t err = produce(&data);
+  if (err != ESP_OK) {
+    return err;
+  }
+  return send_success(req, json::Ptr{data});
+}
+
 inline esp_err_t send_fail_field(httpd_req_t *req, const char *field,
                                  const char *message,
                                  const char *http_status =
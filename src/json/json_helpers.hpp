@@ -3,6 +3,7 @@
 #include "esp_err.h"
 #include <cJSON.h>
 
+#include <cstddef>
 #include <memory>
 #include <string>
 #include <string_view>
@@ -19,6 +20,34 @@ struct Deleter {
 
 using Ptr = std::unique_ptr<cJSON, Deleter>;
 
+// Top-level data fields a client asked for with ?fields= (see
+// http::ResponseShape). Serialisers check wanted() before building a field,
+// so unselected fields cost nothing.
+struct FieldSelection {
+  static constexpr std::size_t max_fields = 12;
+  std::string_view names[max_fields];
+  std::size_t count = 0;
+};
+
+namespace detail {
+inline thread_local const FieldSelection *selected_fields = nullptr;
+} // namespace detail
+
+// True unless a selection is active for this request and lacks the field.
+// Only top-level fields of a response's data are selectable.
+inline bool wanted(std::string_view field) {
+  const FieldSelection *selection = detail::selected_fields;
+  if (!selection) {
+    return true;
+  }
+  for (std::size_t i = 0; i < selection->count; ++i) {
+    if (selection->names[i] == field) {
+      return true;
+    }
+  }
+  return false;
+}
+
 inline Ptr object() { return Ptr{cJSON_CreateObject()}; }
 
 inline Ptr parse(std::string_view text) {
@@ -32,47 +32,51 @@ inline json::Ptr to_json(const LogBatch &batch) {
     return nullptr;
   }
 
-  json::Ptr entries{cJSON_CreateArray()};
-  if (!entries) {
-    return nullptr;
-  }
-
-  for (const auto &entry : batch.entries) {
-    json::Ptr item = json::object();
-    if (!item) {
+  if (json::wanted("entries")) {
+    json::Ptr entries{cJSON_CreateArray()};
+    if (!entries) {
       return nullptr;
     }
 
-    if (!cJSON_AddNumberToObject(item.get(), "id",
-                                 static_cast<double>(entry.id))) {
-      return nullptr;
-    }
-    if (!cJSON_AddNumberToObject(item.get(), "timestamp_ms",
-                                 static_cast<double>(entry.timestamp_ms))) {
-      return nullptr;
-    }
-    if (json::add(item.get(), "level", log_level_to_string(entry.level)) !=
-        ESP_OK) {
-      return nullptr;
-    }
-    if (json::add(item.get(), "tag", entry.tag) != ESP_OK) {
-      return nullptr;
-    }
-    if (json::add(item.get(), "message", entry.message) != ESP_OK) {
-      return nullptr;
+    for (const auto &entry : batch.entries) {
+      json::Ptr item = json::object();
+      if (!item) {
+        return nullptr;
+      }
+
+      if (!cJSON_AddNumberToObject(item.get(), "id",
+                                   static_cast<double>(entry.id))) {
+        return nullptr;
+      }
+      if (!cJSON_AddNumberToObject(item.get(), "timestamp_ms",
+                                   static_cast<double>(entry.timestamp_ms))) {
+        return nullptr;
+      }
+      if (json::add(item.get(), "level", log_level_to_string(entry.level)) !=
+          ESP_OK) {
+        return nullptr;
+      }
+      if (json::add(item.get(), "tag", entry.tag) != ESP_OK) {
+        return nullptr;
+      }
+      if (json::add(item.get(), "message", entry.message) != ESP_OK) {
+        return nullptr;
+      }
+
+      cJSON_AddItemToArray(entries.get(), item.release());
     }
 
-    cJSON_AddItemToArray(entries.get(), item.release());
+    cJSON_AddItemToObject(obj.get(), "entries", entries.release());
   }
 
-  cJSON_AddItemToObject(obj.get(), "entries", entries.release());
-
-  if (!cJSON_AddNumberToObject(obj.get(), "next_cursor",
+  if (json::wanted("next_cursor") &&
+      !cJSON_AddNumberToObject(obj.get(), "next_cursor",
                                static_cast<double>(batch.next_cursor))) {
     return nullptr;
   }
 
-  if (json::add(obj.get(), "has_more", batch.has_more) != ESP_OK) {
+  if (json::wanted("has_more") &&
+      json::add(obj.get(), "has_more", batch.has_more) != ESP_OK) {
     return nullptr;
   }
 
@@ -0,0 +1,83 @@
+#pragma once
+
+#include "earbrain/gateway/middlewares/memory_governor.hpp"
+#include "http_method.hpp"
+#include "json/json_helpers.hpp"
+
+#include <cJSON.h>
+
+namespace earbrain::json_model {
+
+inline json::Ptr to_json(const middleware::RouteMemoryStats &stats) {
+  auto obj = json::object();
+  if (!obj) {
+    return nullptr;
+  }
+
+  if (json::add(obj.get(), "uri", stats.uri) != ESP_OK) {
+    return nullptr;
+  }
+  if (json::add(obj.get(), "method", http::method_str(stats.method)) != ESP_OK) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "estimate_bytes",
+                               static_cast<double>(stats.estimate))) {
+    return nullptr;
+  }
+  if (json::add(obj.get(), "learned", stats.learned) != ESP_OK) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "admitted",
+                               static_cast<double>(stats.admitted))) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "rejected",
+                               static_cast<double>(stats.rejected))) {
+    return nullptr;
+  }
+
+  return obj;
+}
+
+inline json::Ptr to_json(const middleware::MemoryGovernorStats &stats) {
+  auto obj = json::object();
+  if (!obj) {
+    return nullptr;
+  }
+
+  if (json::add(obj.get(), "learning", stats.learning) != ESP_OK) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "reserved_bytes",
+                               static_cast<double>(stats.reserved_bytes))) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "in_flight",
+                               static_cast<double>(stats.in_flight))) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "admitted",
+                               static_cast<double>(stats.admitted))) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "rejected",
+                               static_cast<double>(stats.rejected))) {
+    return nullptr;
+  }
+
+  cJSON *items = cJSON_AddArrayToObject(obj.get(), "routes");
+  if (!items) {
+    return nullptr;
+  }
+  for (const auto &route : stats.routes) {
+    json::Ptr item = to_json(route);
+    if (!item) {
+      return nullptr;
+    }
+    cJSON_AddItemToArray(items, item.release());
+  }
+
+  return obj;
+}
+
+} // namespace earbrain::json_model
@@ -13,28 +13,34 @@ inline json::Ptr to_json(const Metrics &metrics) {
     return nullptr;
   }
 
-  if (!cJSON_AddNumberToObject(obj.get(), "heap_total",
+  if (json::wanted("heap_total") &&
+      !cJSON_AddNumberToObject(obj.get(), "heap_total",
                                static_cast<double>(metrics.heap_total))) {
     return nullptr;
   }
-  if (!cJSON_AddNumberToObject(obj.get(), "heap_free",
+  if (json::wanted("heap_free") &&
+      !cJSON_AddNumberToObject(obj.get(), "heap_free",
                                static_cast<double>(metrics.heap_free))) {
     return nullptr;
   }
-  if (!cJSON_AddNumberToObject(obj.get(), "heap_used",
+  if (json::wanted("heap_used") &&
+      !cJSON_AddNumberToObject(obj.get(), "heap_used",
                                static_cast<double>(metrics.heap_used))) {
     return nullptr;
   }
-  if (!cJSON_AddNumberToObject(obj.get(), "heap_min_free",
+  if (json::wanted("heap_min_free") &&
+      !cJSON_AddNumberToObject(obj.get(), "heap_min_free",
                                static_cast<double>(metrics.heap_min_free))) {
     return nullptr;
   }
-  if (!cJSON_AddNumberToObject(obj.get(), "heap_largest_free_block",
+  if (json::wanted("heap_largest_free_block") &&
+      !cJSON_AddNumberToObject(obj.get(), "heap_largest_free_block",
                                static_cast<double>(
                                  metrics.heap_largest_free_block))) {
     return nullptr;
   }
-  if (!cJSON_AddNumberToObject(obj.get(), "timestamp_ms",
+  if (json::wanted("timestamp_ms") &&
+      !cJSON_AddNumberToObject(obj.get(), "timestamp_ms",
                                static_cast<double>(metrics.timestamp_ms))) {
     return nullptr;
   }
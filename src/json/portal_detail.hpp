@@ -15,7 +15,8 @@ inline json::Ptr to_json(const PortalDetail &detail) {
     return obj;
   }
 
-  if (json::add(obj.get(), "title", detail.title) != ESP_OK) {
+  if (json::wanted("title") &&
+      json::add(obj.get(), "title", detail.title) != ESP_OK) {
     return json::Ptr{};
   }
 
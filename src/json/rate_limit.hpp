@@ -0,0 +1,98 @@
+#pragma once
+
+#include "earbrain/gateway/middlewares/rate_limit.hpp"
+#include "json/json_helpers.hpp"
+
+#include <cJSON.h>
+#include <cstdio>
+
+namespace earbrain::json_model {
+
+inline json::Ptr to_json(const middleware::RateLimitBucketStats &bucket) {
+  auto obj = json::object();
+  if (!obj) {
+    return nullptr;
+  }
+
+  char client[16];
+  if (bucket.client_ipv6) {
+    std::snprintf(client, sizeof(client), "v6:%08lx",
+                  static_cast<unsigned long>(bucket.client));
+  } else {
+    // Network byte order: the first octet is the lowest address byte.
+    const auto *octets = reinterpret_cast<const uint8_t *>(&bucket.client);
+    std::snprintf(client, sizeof(client), "%u.%u.%u.%u", octets[0], octets[1],
+                  octets[2], octets[3]);
+  }
+
+  if (json::add(obj.get(), "client", client) != ESP_OK) {
+    return nullptr;
+  }
+  if (json::add(obj.get(), "class",
+                middleware::route_class_name(bucket.route_class)) != ESP_OK) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "allowed",
+                               static_cast<double>(bucket.allowed))) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "rejected",
+                               static_cast<double>(bucket.rejected))) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "tokens",
+                               static_cast<double>(bucket.tokens))) {
+    return nullptr;
+  }
+
+  return obj;
+}
+
+inline json::Ptr to_json(const middleware::RateLimitStats &stats) {
+  auto obj = json::object();
+  if (!obj) {
+    return nullptr;
+  }
+
+  if (!cJSON_AddNumberToObject(obj.get(), "allowed",
+                               static_cast<double>(stats.allowed))) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "rejected",
+                               static_cast<double>(stats.rejected))) {
+    return nullptr;
+  }
+  if (!cJSON_AddNumberToObject(obj.get(), "evictions",
+                               static_cast<double>(stats.evictions))) {
+    return nullptr;
+  }
+
+  cJSON *by_class = cJSON_AddObjectToObject(obj.get(), "rejected_by_class");
+  if (!by_class) {
+    return nullptr;
+  }
+  for (std::size_t i = 0; i < middleware::route_class_count; ++i) {
+    const auto route_class = static_cast<middleware::RouteClass>(i);
+    if (!cJSON_AddNumberToObject(by_class,
+                                 middleware::route_class_name(route_class),
+                                 static_cast<double>(stats.rejected_by_class[i]))) {
+      return nullptr;
+    }
+  }
+
+  cJSON *items = cJSON_AddArrayToObject(obj.get(), "buckets");
+  if (!items) {
+    return nullptr;
+  }
+  for (const auto &bucket : stats.buckets) {
+    json::Ptr item = to_json(bucket);
+    if (!item) {
+      return nullptr;
+    }
+    cJSON_AddItemToArray(items, item.release());
+  }
+
+  return obj;
+}
+
+} // namespace earbrain::json_model
@@ -0,0 +1,71 @@
+#pragma once
+
+#include "earbrain/gateway/tracing.hpp"
+#include "json/json_helpers.hpp"
+
+#include <cstddef>
+
+namespace earbrain::json_model {
+
+// Chrome trace-event format: one complete ("X") event per span, one row
+// (tid) per trace.
+inline json::Ptr to_json(const tracing::SpanRecord *spans, std::size_t count) {
+  auto obj = json::object();
+  if (!obj) {
+    return nullptr;
+  }
+
+  cJSON *events = cJSON_AddArrayToObject(obj.get(), "traceEvents");
+  if (!events) {
+    return nullptr;
+  }
+
+  for (std::size_t i = 0; i < count; ++i) {
+    const tracing::SpanRecord &span = spans[i];
+    json::Ptr event = json::object();
+    if (!event) {
+      return nullptr;
+    }
+
+    if (json::add(event.get(), "name", span.name) != ESP_OK) {
+      return nullptr;
+    }
+    if (json::add(event.get(), "cat", "http") != ESP_OK) {
+      return nullptr;
+    }
+    if (json::add(event.get(), "ph", "X") != ESP_OK) {
+      return nullptr;
+    }
+    if (!cJSON_AddNumberToObject(event.get(), "ts",
+                                 static_cast<double>(span.start_us))) {
+      return nullptr;
+    }
+    if (!cJSON_AddNumberToObject(event.get(), "dur",
+                                 static_cast<double>(span.duration_us))) {
+      return nullptr;
+    }
+    if (!cJSON_AddNumberToObject(event.get(), "pid", 1)) {
+      return nullptr;
+    }
+    if (!cJSON_AddNumberToObject(event.get(), "tid",
+                                 static_cast<double>(span.trace_id))) {
+      return nullptr;
+    }
+    if (span.detail[0] != '\0') {
+      cJSON *args = cJSON_AddObjectToObject(event.get(), "args");
+      if (!args || json::add(args, "uri", span.detail) != ESP_OK) {
+        return nullptr;
+      }
+    }
+
+    cJSON_AddItemToArray(events, event.release());
+  }
+
+  if (json::add(obj.get(), "displayTimeUnit", "ms") != ESP_OK) {
+    return nullptr;
+  }
+
+  return obj;
+}
+
+} // namespace earbrain::json_model
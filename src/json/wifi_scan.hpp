@@ -40,55 +40,58 @@ inline json::Ptr to_json(const WifiScanResult &result) {
     return nullptr;
   }
 
-  cJSON *items = cJSON_AddArrayToObject(root.get(), "networks");
-  if (!items) {
-    return nullptr;
-  }
-
-  for (const auto &network : result.networks) {
-    cJSON *entry = cJSON_CreateObject();
-    if (!entry) {
-      return nullptr;
-    }
-    if (json::add(entry, "ssid", network.ssid) != ESP_OK) {
-      cJSON_Delete(entry);
+  if (json::wanted("networks")) {
+    cJSON *items = cJSON_AddArrayToObject(root.get(), "networks");
+    if (!items) {
       return nullptr;
     }
-    if (json::add(entry, "bssid", network.bssid) != ESP_OK) {
-      cJSON_Delete(entry);
-      return nullptr;
-    }
-    if (!cJSON_AddNumberToObject(entry, "rssi", network.rssi)) {
-      cJSON_Delete(entry);
-      return nullptr;
-    }
-    if (!cJSON_AddNumberToObject(entry, "signal", network.signal)) {
-      cJSON_Delete(entry);
-      return nullptr;
-    }
-    if (!cJSON_AddNumberToObject(entry, "channel", network.channel)) {
-      cJSON_Delete(entry);
-      return nullptr;
-    }
-    if (json::add(entry, "security", auth_mode_to_string(network.auth_mode)) != ESP_OK) {
-      cJSON_Delete(entry);
-      return nullptr;
-    }
-    if (json::add(entry, "connected", network.connected) != ESP_OK) {
-      cJSON_Delete(entry);
-      return nullptr;
-    }
-    if (json::add(entry, "hidden", network.hidden) != ESP_OK) {
-      cJSON_Delete(entry);
-      return nullptr;
+
+    for (const auto &network : result.networks) {
+      cJSON *entry = cJSON_CreateObject();
+      if (!entry) {
+        return nullptr;
+      }
+      if (json::add(entry, "ssid", network.ssid) != ESP_OK) {
+        cJSON_Delete(entry);
+        return nullptr;
+      }
+      if (json::add(entry, "bssid", network.bssid) != ESP_OK) {
+        cJSON_Delete(entry);
+        return nullptr;
+      }
+      if (!cJSON_AddNumberToObject(entry, "rssi", network.rssi)) {
+        cJSON_Delete(entry);
+        return nullptr;
+      }
+      if (!cJSON_AddNumberToObject(entry, "signal", network.signal)) {
+        cJSON_Delete(entry);
+        return nullptr;
+      }
+      if (!cJSON_AddNumberToObject(entry, "channel", network.channel)) {
+        cJSON_Delete(entry);
+        return nullptr;
+      }
+      if (json::add(entry, "security", auth_mode_to_string(network.auth_mode)) != ESP_OK) {
+        cJSON_Delete(entry);
+        return nullptr;
+      }
+      if (json::add(entry, "connected", network.connected) != ESP_OK) {
+        cJSON_Delete(entry);
+        return nullptr;
+      }
+      if (json::add(entry, "hidden", network.hidden) != ESP_OK) {
+        cJSON_Delete(entry);
+        return nullptr;
+      }
+      cJSON_AddItemToArray(items, entry);
     }
-    cJSON_AddItemToArray(items, entry);
   }
 
   const char *error_name = result.error == ESP_OK
                              ? ""
                              : esp_err_to_name(result.error);
-  if (json::add(root.get(), "error", error_name) != ESP_OK) {
+  if (json::wanted("error") &&
+      json::add(root.get(), "error", error_name) != ESP_OK) {
     return nullptr;
   }
 
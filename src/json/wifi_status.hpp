@@ -14,9 +14,10 @@ struct WifiStatus {
   bool sta_active = false;
   bool sta_connected = false;
   bool sta_connecting = false;
-  std::string ip;
+  // Already formatted, see map_wifi_error_to_message for error.
+  const char *ip = "";
   wifi_err_reason_t disconnect_reason = WIFI_REASON_UNSPECIFIED;
-  esp_err_t last_error = ESP_OK;
+  const char *error = "";
 };
 
 inline std::string map_wifi_error_to_message(esp_err_t err) {
@@ -43,7 +44,7 @@ inline json::Ptr to_json(const WifiStatus &status) {
   }
 
   auto add_bool = [&](const char *key, bool value) -> esp_err_t {
-    return json::add(obj.get(), key, value);
+    return json::wanted(key) ? json::add(obj.get(), key, value) : ESP_OK;
   };
 
   if (add_bool("ap_active", status.ap_active) != ESP_OK) {
@@ -59,16 +60,17 @@ inline json::Ptr to_json(const WifiStatus &status) {
     return nullptr;
   }
 
-  const std::string error_message = map_wifi_error_to_message(status.last_error);
-  if (json::add(obj.get(), "sta_error", error_message.c_str()) != ESP_OK) {
+  if (json::wanted("sta_error") &&
+      json::add(obj.get(), "sta_error", status.error) != ESP_OK) {
     return nullptr;
   }
 
-  if (json::add(obj.get(), "ip", status.ip) != ESP_OK) {
+  if (json::wanted("ip") && json::add(obj.get(), "ip", status.ip) != ESP_OK) {
     return nullptr;
   }
 
-  if (!cJSON_AddNumberToObject(obj.get(), "disconnect_reason",
+  if (json::wanted("disconnect_reason") &&
+      !cJSON_AddNumberToObject(obj.get(), "disconnect_reason",
                                static_cast<int>(status.disconnect_reason))) {
     return nullptr;
   }
@@ -0,0 +1,44 @@
+#include "earbrain/gateway/middlewares/capture.hpp"
+
+#include "capture_context.hpp"
+#include "carry_context.hpp"
+
+#include <new>
+
+namespace earbrain::middleware {
+
+namespace {
+
+// Goes with the request should its handler be detached.
+class Capture final : public carry::detail::Measure {
+public:
+  Measure *clone() override { return new (std::nothrow) Capture(*this); }
+  void enter() override { capture::detail::enter(capture); }
+  void leave() override { capture::detail::leave(capture); }
+  void finish(httpd_req_t *req, esp_err_t result) override {
+    capture::detail::end(capture, req, result);
+  }
+
+  capture::detail::RequestCapture capture;
+};
+
+} // namespace
+
+esp_err_t capture_request(httpd_req_t *req, NextHandler next) {
+  Capture capture;
+  capture::detail::begin(capture.capture);
+
+  esp_err_t result = ESP_OK;
+  {
+    const carry::detail::Open open(capture);
+    result = next(req);
+  }
+
+  capture::detail::leave(capture.capture);
+  if (!capture.carried) {
+    capture.finish(req, result);
+  }
+  return result;
+}
+
+} // namespace earbrain::middleware
@@ -0,0 +1,200 @@
+#include "earbrain/gateway/middlewares/compression.hpp"
+
+#include "compression_context.hpp"
+#include "deflate.hpp"
+#include "earbrain/gateway/request_context.hpp"
+#include "earbrain/gateway/tracing.hpp"
+
+#include "esp_timer.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <mutex>
+#include <string_view>
+
+namespace earbrain {
+
+namespace {
+
+std::mutex compression_mutex;
+middleware::CompressionConfig config;
+middleware::CompressionStats counters;
+
+thread_local bool gzip_requested = false;
+// Set by the first request through compress_response. From then on the
+// server's compressible responses depend on Accept-Encoding, so they say so
+// even when they go out uncompressed.
+std::atomic<bool> negotiating{false};
+
+bool equals_ignore_case(std::string_view a, std::string_view b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    const char x = a[i] >= 'A' && a[i] <= 'Z' ? a[i] - 'A' + 'a' : a[i];
+    if (x != b[i]) {
+      return false;
+    }
+  }
+  return true;
+}
+
+std::string_view trim(std::string_view value) {
+  while (!value.empty() && value.front() == ' ') {
+    value.remove_prefix(1);
+  }
+  while (!value.empty() && value.back() == ' ') {
+    value.remove_suffix(1);
+  }
+  return value;
+}
+
+// gzip (or x-gzip) listed without q=0.
+bool accepts_gzip() {
+  RequestContext *context = RequestContext::current();
+  if (!context) {
+    return false;
+  }
+
+  std::string_view rest = context->header("Accept-Encoding");
+  while (!rest.empty()) {
+    const std::size_t comma = rest.find(',');
+    const std::string_view item = rest.substr(0, comma);
+    rest = comma == std::string_view::npos ? std::string_view{}
+                                           : rest.substr(comma + 1);
+
+    const std::size_t semicolon = item.find(';');
+    const std::string_view coding = trim(item.substr(0, semicolon));
+    if (!equals_ignore_case(coding, "gzip") &&
+        !equals_ignore_case(coding, "x-gzip")) {
+      continue;
+    }
+    const std::size_t q = item.find("q=", semicolon);
+    if (semicolon == std::string_view::npos || q == std::string_view::npos) {
+      return true;
+    }
+    // q values are at most "1.000", and the view is not terminated.
+    char weight[8] = {};
+    item.substr(q + 2).copy(weight, sizeof(weight) - 1);
+    return std::strtod(weight, nullptr) > 0;
+  }
+  return false;
+}
+
+bool compressible(std::string_view content_type) {
+  return content_type.rfind("text/", 0) == 0 ||
+         content_type.find("json") != std::string_view::npos ||
+         content_type.find("javascript") != std::string_view::npos;
+}
+
+struct ChunkSink {
+  httpd_req_t *req;
+  bool started = false;
+  // Time spent in the socket, kept out of the compression figure.
+  int64_t send_us = 0;
+};
+
+// Headers go out with the first chunk, so an encoder that fails to
+// allocate leaves the response untouched.
+esp_err_t send_chunk(void *ctx, const uint8_t *data, std::size_t len) {
+  auto *sink = static_cast<ChunkSink *>(ctx);
+  if (!sink->started) {
+    httpd_resp_set_hdr(sink->req, "Content-Encoding", "gzip");
+    sink->started = true;
+  }
+  const int64_t start_us = esp_timer_get_time();
+  const esp_err_t err = httpd_resp_send_chunk(
+      sink->req, reinterpret_cast<const char *>(data), static_cast<ssize_t>(len));
+  sink->send_us += esp_timer_get_time() - start_us;
+  return err;
+}
+
+} // namespace
+
+namespace compression::detail {
+
+bool requested() { return gzip_requested; }
+
+void set_requested(bool gzip) { gzip_requested = gzip; }
+
+esp_err_t send(httpd_req_t *req, const char *content_type, const char *body,
+               std::size_t len, bool gzip) {
+  if (!content_type || !compressible(content_type)) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+  if (negotiating.load(std::memory_order_relaxed)) {
+    httpd_resp_set_hdr(req, "Vary", "Accept-Encoding");
+  }
+  if (!gzip) {
+    return ESP_ERR_NOT_SUPPORTED;
+  }
+
+  middleware::CompressionConfig current;
+  {
+    std::lock_guard<std::mutex> lock(compression_mutex);
+    current = config;
+    if (len < current.min_size) {
+      ++counters.skipped;
+      return ESP_ERR_NOT_SUPPORTED;
+    }
+  }
+
+  ChunkSink sink{req};
+  deflate::Result result;
+  const int64_t start_us = esp_timer_get_time();
+  esp_err_t err = ESP_OK;
+  {
+    tracing::Span span("gzip");
+    err = deflate::gzip(reinterpret_cast<const uint8_t *>(body), len,
+                        current.max_chain, &send_chunk, &sink, &result);
+  }
+  const int64_t elapsed_us = esp_timer_get_time() - start_us - sink.send_us;
+
+  if (!sink.started) {
+    std::lock_guard<std::mutex> lock(compression_mutex);
+    ++counters.skipped;
+    return err == ESP_ERR_NO_MEM ? ESP_ERR_NOT_SUPPORTED : err;
+  }
+  if (err == ESP_OK) {
+    err = httpd_resp_send_chunk(req, nullptr, 0);
+  }
+
+  std::lock_guard<std::mutex> lock(compression_mutex);
+  ++counters.compressed;
+  counters.bytes_in += len;
+  counters.bytes_out += result.bytes_out;
+  counters.compress_us += static_cast<uint64_t>(elapsed_us > 0 ? elapsed_us : 0);
+  return err;
+}
+
+} // namespace compression::detail
+
+namespace middleware {
+
+esp_err_t compress_response(httpd_req_t *req, NextHandler next) {
+  negotiating.store(true, std::memory_order_relaxed);
+  const bool outer = gzip_requested;
+  gzip_requested = accepts_gzip();
+  const esp_err_t result = next(req);
+  gzip_requested = outer;
+  return result;
+}
+
+void configure_compression(const CompressionConfig &new_config) {
+  std::lock_guard<std::mutex> lock(compression_mutex);
+  config = new_config;
+}
+
+CompressionStats compression_stats() {
+  std::lock_guard<std::mutex> lock(compression_mutex);
+  return counters;
+}
+
+void reset_compression() {
+  std::lock_guard<std::mutex> lock(compression_mutex);
+  counters = CompressionStats{};
+}
+
+} // namespace middleware
+
+} // namespace earbrain
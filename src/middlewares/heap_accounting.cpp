@@ -0,0 +1,106 @@
+#include "earbrain/gateway/middlewares/heap_accounting.hpp"
+
+#include "carry_context.hpp"
+#include "heap_scope.hpp"
+
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <utility>
+
+namespace earbrain::middleware {
+
+namespace {
+
+// Set while an instance of this middleware measures the request on this task.
+thread_local bool measuring = false;
+
+std::mutex stats_mutex;
+std::vector<RouteHeapStats> route_stats;
+
+RouteHeapStats &stats_for(const UriHandler *route, httpd_req_t *req) {
+  const std::string_view uri = route ? std::string_view{route->uri}
+                                     : std::string_view{req->uri};
+  const auto method = static_cast<httpd_method_t>(req->method);
+  for (auto &entry : route_stats) {
+    if (entry.method == method && entry.uri == uri) {
+      return entry;
+    }
+  }
+  RouteHeapStats &entry = route_stats.emplace_back();
+  entry.uri = std::string(uri);
+  entry.method = method;
+  return entry;
+}
+
+// Goes with the request should its handler be detached.
+class Accounting final : public carry::detail::Measure {
+public:
+  explicit Accounting(const UriHandler *route) : route(route) {}
+
+  // The copy carries on with the scope's blocks.
+  Measure *clone() override {
+    return new (std::nothrow) Accounting(std::move(*this));
+  }
+  void enter() override { heap::detail::begin(scope); }
+  void leave() override { heap::detail::end(scope); }
+  void finish(httpd_req_t *req, esp_err_t) override {
+    std::lock_guard<std::mutex> lock(stats_mutex);
+    RouteHeapStats &stats = stats_for(route, req);
+    ++stats.requests;
+    stats.allocations += scope.allocations;
+    stats.allocated_bytes += scope.allocated_bytes;
+    stats.last_peak_bytes = scope.peak_bytes;
+    if (scope.saturated) {
+      ++stats.saturated;
+    }
+    if (scope.peak_bytes > stats.peak_bytes) {
+      stats.peak_bytes = scope.peak_bytes;
+    }
+  }
+
+  heap::detail::HeapScope scope;
+
+private:
+  const UriHandler *route;
+};
+
+} // namespace
+
+esp_err_t heap_accounting(httpd_req_t *req, NextHandler next) {
+  if (measuring) {
+    // Already measured by an outer instance of this middleware.
+    return next(req);
+  }
+
+  const RequestContext *context = RequestContext::current();
+  Accounting accounting(context ? context->route() : nullptr);
+  esp_err_t result = ESP_OK;
+  measuring = true;
+  heap::detail::begin(accounting.scope);
+  {
+    const carry::detail::Open open(accounting);
+    result = next(req);
+  }
+  heap::detail::end(accounting.scope);
+  measuring = false;
+
+  if (!accounting.carried) {
+    accounting.finish(req, result);
+  }
+  return result;
+}
+
+bool heap_accounting_available() { return heap::detail::hooks_available(); }
+
+std::vector<RouteHeapStats> heap_stats() {
+  std::lock_guard<std::mutex> lock(stats_mutex);
+  return route_stats;
+}
+
+void reset_heap_stats() {
+  std::lock_guard<std::mutex> lock(stats_mutex);
+  route_stats.clear();
+}
+
+} // namespace earbrain::middleware
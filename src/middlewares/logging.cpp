@@ -1,38 +1,14 @@
 #include "earbrain/gateway/middlewares/logging.hpp"
 
 #include "earbrain/logging.hpp"
+#include "http_method.hpp"
 #include "esp_timer.h"
 #include <cstring>
 
 namespace earbrain::middleware {
 
-namespace {
-
-const char *http_method_str(int method) {
-  switch (static_cast<httpd_method_t>(method)) {
-  case HTTP_GET:
-    return "GET";
-  case HTTP_POST:
-    return "POST";
-  case HTTP_PUT:
-    return "PUT";
-  case HTTP_DELETE:
-    return "DELETE";
-  case HTTP_HEAD:
-    return "HEAD";
-  case HTTP_PATCH:
-    return "PATCH";
-  case HTTP_OPTIONS:
-    return "OPTIONS";
-  default:
-    return "UNKNOWN";
-  }
-}
-
-} // namespace
-
 esp_err_t log_request(httpd_req_t *req, NextHandler next) {
-  const char *method = http_method_str(req->method);
+  const char *method = http::method_str(req->method);
   const char *uri = req->uri;
 
   // Record start time
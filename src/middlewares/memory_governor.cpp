@@ -0,0 +1,202 @@
+#include "earbrain/gateway/middlewares/memory_governor.hpp"
+
+#include "earbrain/gateway/capture.hpp"
+#include "carry_context.hpp"
+#include "heap_scope.hpp"
+
+#include "esp_heap_caps.h"
+
+#include <algorithm>
+#include <mutex>
+#include <new>
+#include <string_view>
+#include <utility>
+
+namespace earbrain::middleware {
+
+namespace {
+
+constexpr char service_unavailable_body[] =
+    R"({"status":"fail","data":{},"error":"Server is low on memory."})";
+
+std::mutex governor_mutex;
+MemoryGovernorConfig config;
+std::vector<RouteMemoryStats> budgets;
+std::size_t reserved_bytes = 0;
+uint32_t in_flight = 0;
+uint32_t total_admitted = 0;
+uint32_t total_rejected = 0;
+
+std::string_view uri_of(const UriHandler *route, httpd_req_t *req) {
+  return route ? std::string_view{route->uri} : std::string_view{req->uri};
+}
+
+// Caller holds governor_mutex. nullptr for a route not seen yet.
+RouteMemoryStats *find_budget(const UriHandler *route, httpd_req_t *req) {
+  const std::string_view uri = uri_of(route, req);
+  const auto method = static_cast<httpd_method_t>(req->method);
+  for (auto &budget : budgets) {
+    if (budget.method == method && budget.uri == uri) {
+      return &budget;
+    }
+  }
+  return nullptr;
+}
+
+// Caller holds governor_mutex. Allocates for a route not seen yet, so only
+// for admitted requests.
+RouteMemoryStats &budget_for(const UriHandler *route, httpd_req_t *req) {
+  if (RouteMemoryStats *budget = find_budget(route, req)) {
+    return *budget;
+  }
+  const std::string_view uri = uri_of(route, req);
+  const auto method = static_cast<httpd_method_t>(req->method);
+  RouteMemoryStats &budget = budgets.emplace_back();
+  budget.uri = std::string(uri);
+  budget.method = method;
+  budget.estimate = config.default_estimate;
+  return budget;
+}
+
+// The first observation replaces the default. Later ones raise the estimate
+// at once but only let it decay by 1/16 per request, so one light request
+// does not undo a heavy one. The 1/8 margin covers allocator overhead.
+// A peak that is only a lower bound (the scope ran out of tracked blocks)
+// may raise the estimate but never lowers it or counts as learned.
+void learn(RouteMemoryStats &stats, std::size_t peak_bytes, bool exact) {
+  const std::size_t observed = peak_bytes + peak_bytes / 8;
+  if (!exact) {
+    stats.estimate = std::max(stats.estimate, observed);
+    return;
+  }
+  if (!stats.learned) {
+    stats.estimate = observed;
+    stats.learned = true;
+    return;
+  }
+  stats.estimate = std::max(observed, stats.estimate - stats.estimate / 16);
+}
+
+esp_err_t send_service_unavailable(httpd_req_t *req) {
+  httpd_resp_set_status(req, "503 Service Unavailable");
+  capture::note_status("503 Service Unavailable");
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Retry-After", "1");
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+  return httpd_resp_send(req, service_unavailable_body,
+                         sizeof(service_unavailable_body) - 1);
+}
+
+// An admitted request's reservation and the scope its peak is learned from.
+// Goes with the request should its handler be detached, so the reservation
+// is held until it is answered.
+class Admission final : public carry::detail::Measure {
+public:
+  Admission(const UriHandler *route, std::size_t reservation)
+    : route(route), reservation(reservation) {}
+
+  // The copy carries on with the scope's blocks.
+  Measure *clone() override {
+    return new (std::nothrow) Admission(std::move(*this));
+  }
+  void enter() override { heap::detail::begin(scope); }
+  void leave() override { heap::detail::end(scope); }
+  void finish(httpd_req_t *req, esp_err_t) override {
+    std::lock_guard<std::mutex> lock(governor_mutex);
+    reserved_bytes -= reservation;
+    --in_flight;
+    if (heap::detail::hooks_available()) {
+      learn(budget_for(route, req), scope.peak_bytes, !scope.saturated);
+    }
+  }
+
+  heap::detail::HeapScope scope;
+
+private:
+  const UriHandler *route;
+  std::size_t reservation;
+};
+
+} // namespace
+
+esp_err_t memory_governor(httpd_req_t *req, NextHandler next) {
+  const RequestContext *context = RequestContext::current();
+  const UriHandler *route = context ? context->route() : nullptr;
+  const std::size_t free_bytes = heap_caps_get_free_size(MALLOC_CAP_8BIT);
+  const std::size_t largest_block =
+      heap_caps_get_largest_free_block(MALLOC_CAP_8BIT);
+
+  std::size_t reservation = 0;
+  bool admitted = false;
+  {
+    std::lock_guard<std::mutex> lock(governor_mutex);
+    // Looked up without adding the route, so that a rejection, made when
+    // memory is short, allocates nothing; an unseen route is only listed
+    // once a request of it is admitted.
+    RouteMemoryStats *budget = find_budget(route, req);
+    reservation = budget ? budget->estimate : config.default_estimate;
+    // Reservations stay whole while their requests run, so memory those
+    // requests already hold is counted twice. That errs on the safe side.
+    const std::size_t needed =
+        reserved_bytes + reservation + config.min_free_bytes;
+    admitted = free_bytes >= needed &&
+               largest_block >= config.min_largest_free_block;
+    if (admitted) {
+      ++budget_for(route, req).admitted;
+      ++total_admitted;
+      reserved_bytes += reservation;
+      ++in_flight;
+    } else {
+      if (budget) {
+        ++budget->rejected;
+      }
+      ++total_rejected;
+    }
+  }
+
+  if (!admitted) {
+    return send_service_unavailable(req);
+  }
+
+  Admission admission(route, reservation);
+  esp_err_t result = ESP_OK;
+  heap::detail::begin(admission.scope);
+  {
+    const carry::detail::Open open(admission);
+    result = next(req);
+  }
+  heap::detail::end(admission.scope);
+
+  if (!admission.carried) {
+    admission.finish(req, result);
+  }
+  return result;
+}
+
+void configure_memory_governor(const MemoryGovernorConfig &new_config) {
+  std::lock_guard<std::mutex> lock(governor_mutex);
+  config = new_config;
+}
+
+MemoryGovernorStats memory_governor_stats() {
+  MemoryGovernorStats stats;
+  stats.learning = heap::detail::hooks_available();
+
+  std::lock_guard<std::mutex> lock(governor_mutex);
+  stats.reserved_bytes = reserved_bytes;
+  stats.in_flight = in_flight;
+  stats.admitted = total_admitted;
+  stats.rejected = total_rejected;
+  stats.routes = budgets;
+  return stats;
+}
+
+void reset_memory_governor() {
+  std::lock_guard<std::mutex> lock(governor_mutex);
+  // In-flight reservations are released by their requests.
+  budgets.clear();
+  total_admitted = 0;
+  total_rejected = 0;
+}
+
+} // namespace earbrain::middleware
@@ -0,0 +1,267 @@
+#include "earbrain/gateway/middlewares/rate_limit.hpp"
+
+#include "earbrain/gateway/capture.hpp"
+
+#include "esp_timer.h"
+#include "lwip/sockets.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+namespace earbrain::middleware {
+
+namespace {
+
+// Tokens are kept in thousandths so slow refill rates accumulate exactly.
+constexpr uint32_t token_scale = 1000;
+
+constexpr char too_many_requests_body[] =
+    R"({"status":"fail","data":{},"error":"Too many requests."})";
+
+struct Bucket {
+  bool used = false;
+  uint32_t client = 0;
+  bool client_ipv6 = false;
+  RouteClass route_class = RouteClass::page;
+  uint32_t tokens = 0; // scaled by token_scale
+  int64_t refilled_us = 0;
+  int64_t last_seen_us = 0;
+  uint32_t allowed = 0;
+  uint32_t rejected = 0;
+};
+
+std::mutex table_mutex;
+RateLimitConfig config;
+Bucket table[rate_limit_table_size];
+uint32_t total_allowed = 0;
+uint32_t total_rejected = 0;
+uint32_t total_evictions = 0;
+uint32_t class_rejected[route_class_count] = {};
+
+struct ClientKey {
+  uint32_t address = 0;
+  bool ipv6 = false;
+};
+
+ClientKey client_of(httpd_req_t *req) {
+  ClientKey key;
+  const int fd = httpd_req_to_sockfd(req);
+  if (fd < 0) {
+    return key;
+  }
+
+  sockaddr_storage addr{};
+  socklen_t len = sizeof(addr);
+  if (getpeername(fd, reinterpret_cast<sockaddr *>(&addr), &len) != 0) {
+    return key;
+  }
+
+  if (addr.ss_family == AF_INET) {
+    key.address = reinterpret_cast<const sockaddr_in *>(&addr)->sin_addr.s_addr;
+    return key;
+  }
+  if (addr.ss_family == AF_INET6) {
+    const uint8_t *bytes =
+        reinterpret_cast<const sockaddr_in6 *>(&addr)->sin6_addr.s6_addr;
+    static constexpr uint8_t v4_mapped_prefix[12] = {0, 0, 0, 0, 0, 0,
+                                                     0, 0, 0, 0, 0xff, 0xff};
+    if (std::memcmp(bytes, v4_mapped_prefix, sizeof(v4_mapped_prefix)) == 0) {
+      std::memcpy(&key.address, bytes + 12, sizeof(key.address));
+      return key;
+    }
+    // FNV-1a fold; collisions only make two clients share a budget.
+    uint32_t hash = 2166136261u;
+    for (int i = 0; i < 16; ++i) {
+      hash = (hash ^ bytes[i]) * 16777619u;
+    }
+    key.address = hash;
+    key.ipv6 = true;
+  }
+  return key;
+}
+
+void refill(Bucket &bucket, const TokenBucketPolicy &policy, int64_t now_us) {
+  constexpr int64_t us_per_minute = 60'000'000;
+  // A day is enough to refill any burst and keeps the product below 2^63.
+  constexpr int64_t max_elapsed_us = 24 * 60 * us_per_minute;
+
+  const int64_t capacity = static_cast<int64_t>(policy.burst) * token_scale;
+  const int64_t rate = static_cast<int64_t>(policy.refill_per_minute) * token_scale;
+  const int64_t elapsed_us =
+      std::min(now_us - bucket.refilled_us, max_elapsed_us);
+  const int64_t earned = elapsed_us > 0 ? elapsed_us * rate / us_per_minute : 0;
+  if (earned <= 0) {
+    return;
+  }
+
+  if (bucket.tokens + earned >= capacity) {
+    bucket.tokens = static_cast<uint32_t>(capacity);
+    bucket.refilled_us = now_us;
+  } else {
+    bucket.tokens += static_cast<uint32_t>(earned);
+    // Only advance by the time actually converted into tokens so partial
+    // progress carries over to the next request.
+    bucket.refilled_us += earned * us_per_minute / rate;
+  }
+}
+
+// Caller holds table_mutex.
+Bucket &bucket_for(const ClientKey &key, RouteClass route_class,
+                   int64_t now_us) {
+  Bucket *victim = &table[0];
+  for (Bucket &bucket : table) {
+    if (bucket.used && bucket.client == key.address &&
+        bucket.client_ipv6 == key.ipv6 && bucket.route_class == route_class) {
+      return bucket;
+    }
+    if (!bucket.used) {
+      if (victim->used) {
+        victim = &bucket;
+      }
+    } else if (victim->used && bucket.last_seen_us < victim->last_seen_us) {
+      victim = &bucket;
+    }
+  }
+
+  if (victim->used) {
+    ++total_evictions;
+  }
+  const TokenBucketPolicy &policy =
+      config.policies[static_cast<std::size_t>(route_class)];
+  *victim = Bucket{};
+  victim->used = true;
+  victim->client = key.address;
+  victim->client_ipv6 = key.ipv6;
+  victim->route_class = route_class;
+  victim->tokens = static_cast<uint32_t>(policy.burst) * token_scale;
+  victim->refilled_us = now_us;
+  return *victim;
+}
+
+esp_err_t send_too_many_requests(httpd_req_t *req, uint32_t retry_after_s) {
+  char retry_after[12];
+  std::snprintf(retry_after, sizeof(retry_after), "%lu",
+                static_cast<unsigned long>(retry_after_s));
+
+  httpd_resp_set_status(req, "429 Too Many Requests");
+  capture::note_status("429 Too Many Requests");
+  httpd_resp_set_type(req, "application/json");
+  httpd_resp_set_hdr(req, "Retry-After", retry_after);
+  httpd_resp_set_hdr(req, "Cache-Control", "no-store");
+  return httpd_resp_send(req, too_many_requests_body,
+                         sizeof(too_many_requests_body) - 1);
+}
+
+} // namespace
+
+RouteClass classify_route(httpd_method_t method, std::string_view uri) {
+  if (method != HTTP_GET && method != HTTP_HEAD) {
+    return RouteClass::write;
+  }
+  uri = uri.substr(0, uri.find('?'));
+  if (uri == "/api/v1/wifi/scan") {
+    return RouteClass::scan;
+  }
+  if (uri.substr(0, 5) == "/api/") {
+    return RouteClass::api;
+  }
+  return RouteClass::page;
+}
+
+const char *route_class_name(RouteClass route_class) {
+  switch (route_class) {
+  case RouteClass::page:
+    return "page";
+  case RouteClass::api:
+    return "api";
+  case RouteClass::write:
+    return "write";
+  case RouteClass::scan:
+    return "scan";
+  }
+  return "unknown";
+}
+
+esp_err_t rate_limit(httpd_req_t *req, NextHandler next) {
+  const ClientKey key = client_of(req);
+  const RouteClass route_class =
+      classify_route(static_cast<httpd_method_t>(req->method), req->uri);
+  const int64_t now_us = esp_timer_get_time();
+
+  uint32_t retry_after_s = 0;
+  {
+    std::lock_guard<std::mutex> lock(table_mutex);
+    const TokenBucketPolicy &policy =
+        config.policies[static_cast<std::size_t>(route_class)];
+    Bucket &bucket = bucket_for(key, route_class, now_us);
+    bucket.last_seen_us = now_us;
+    refill(bucket, policy, now_us);
+
+    if (bucket.tokens >= token_scale) {
+      bucket.tokens -= token_scale;
+      ++bucket.allowed;
+      ++total_allowed;
+    } else {
+      ++bucket.rejected;
+      ++total_rejected;
+      ++class_rejected[static_cast<std::size_t>(route_class)];
+      const uint32_t missing = token_scale - bucket.tokens;
+      const uint32_t per_minute = std::max<uint32_t>(policy.refill_per_minute, 1);
+      // Seconds until one token is back, rounded up.
+      retry_after_s = static_cast<uint32_t>(
+          (static_cast<uint64_t>(missing) * 60 + per_minute * token_scale - 1) /
+          (static_cast<uint64_t>(per_minute) * token_scale));
+      retry_after_s = std::max<uint32_t>(retry_after_s, 1);
+    }
+  }
+
+  if (retry_after_s > 0) {
+    return send_too_many_requests(req, retry_after_s);
+  }
+  return next(req);
+}
+
+void configure_rate_limit(const RateLimitConfig &new_config) {
+  std::lock_guard<std::mutex> lock(table_mutex);
+  config = new_config;
+}
+
+RateLimitStats rate_limit_stats() {
+  RateLimitStats stats;
+  stats.buckets.reserve(rate_limit_table_size);
+
+  std::lock_guard<std::mutex> lock(table_mutex);
+  stats.allowed = total_allowed;
+  stats.rejected = total_rejected;
+  stats.evictions = total_evictions;
+  std::copy(std::begin(class_rejected), std::end(class_rejected),
+            stats.rejected_by_class);
+  for (const Bucket &bucket : table) {
+    if (!bucket.used) {
+      continue;
+    }
+    RateLimitBucketStats &entry = stats.buckets.emplace_back();
+    entry.client = bucket.client;
+    entry.client_ipv6 = bucket.client_ipv6;
+    entry.route_class = bucket.route_class;
+    entry.allowed = bucket.allowed;
+    entry.rejected = bucket.rejected;
+    entry.tokens = static_cast<uint16_t>(bucket.tokens / token_scale);
+  }
+  return stats;
+}
+
+void reset_rate_limit() {
+  std::lock_guard<std::mutex> lock(table_mutex);
+  for (Bucket &bucket : table) {
+    bucket = Bucket{};
+  }
+  total_allowed = 0;
+  total_rejected = 0;
+  total_evictions = 0;
+  std::fill(std::begin(class_rejected), std::end(class_rejected), 0);
+}
+
+} // namespace earbrain::middleware
@@ -0,0 +1,51 @@
+#include "earbrain/gateway/middlewares/tracing.hpp"
+
+#include "carry_context.hpp"
+#include "tracing_context.hpp"
+
+#include <new>
+
+namespace earbrain::middleware {
+
+namespace {
+
+// Goes with the request should its handler be detached.
+class Trace final : public carry::detail::Measure {
+public:
+  Measure *clone() override { return new (std::nothrow) Trace(*this); }
+  void enter() override { tracing::detail::enter(ctx); }
+  void leave() override { tracing::detail::leave(ctx); }
+  void finish(httpd_req_t *req, esp_err_t) override {
+    tracing::detail::end(ctx, req->uri);
+  }
+
+  tracing::detail::TraceContext ctx;
+};
+
+} // namespace
+
+esp_err_t trace_request(httpd_req_t *req, NextHandler next) {
+  if (tracing::current_trace_id() != 0) {
+    return next(req);
+  }
+
+  Trace trace;
+  tracing::detail::begin(trace.ctx);
+  if (trace.ctx.id_header) {
+    httpd_resp_set_hdr(req, "X-Trace-Id", trace.ctx.id_header);
+  }
+
+  esp_err_t result = ESP_OK;
+  {
+    const carry::detail::Open open(trace);
+    result = next(req);
+  }
+
+  tracing::detail::leave(trace.ctx);
+  if (!trace.carried) {
+    trace.finish(req, result);
+  }
+  return result;
+}
+
+} // namespace earbrain::middleware
@@ -0,0 +1,209 @@
+#include "earbrain/gateway/request_context.hpp"
+
+#include "earbrain/gateway/http_server.hpp"
+
+#include <algorithm>
+#include <charconv>
+#include <cstdint>
+#include <cstring>
+
+namespace earbrain {
+
+namespace {
+
+thread_local RequestContext *active_context = nullptr;
+
+int hex_value(char c) {
+  if (c >= '0' && c <= '9') {
+    return c - '0';
+  }
+  if (c >= 'a' && c <= 'f') {
+    return c - 'a' + 10;
+  }
+  if (c >= 'A' && c <= 'F') {
+    return c - 'A' + 10;
+  }
+  return -1;
+}
+
+// In place; returns the decoded length. Malformed escapes are kept as they
+// are.
+std::size_t percent_decode(char *text, std::size_t len) {
+  std::size_t out = 0;
+  for (std::size_t in = 0; in < len; ++in) {
+    if (text[in] == '%' && in + 2 < len &&
+        hex_value(text[in + 1]) >= 0 &&
+        hex_value(text[in + 2]) >= 0) {
+      text[out++] = static_cast<char>(hex_value(text[in + 1]) * 16 +
+                                      hex_value(text[in + 2]));
+      in += 2;
+    } else {
+      text[out++] = text[in];
+    }
+  }
+  return out;
+}
+
+bool equals_ignore_case(std::string_view a, std::string_view b) {
+  if (a.size() != b.size()) {
+    return false;
+  }
+  for (std::size_t i = 0; i < a.size(); ++i) {
+    const char x = a[i] >= 'A' && a[i] <= 'Z' ? a[i] - 'A' + 'a' : a[i];
+    const char y = b[i] >= 'A' && b[i] <= 'Z' ? b[i] - 'A' + 'a' : b[i];
+    if (x != y) {
+      return false;
+    }
+  }
+  return true;
+}
+
+} // namespace
+
+RequestContext::Scope::Scope(RequestContext &context) : outer(active_context) {
+  active_context = &context;
+}
+
+RequestContext::Scope::~Scope() { active_context = outer; }
+
+RequestContext::RequestContext(httpd_req_t *req, const UriHandler *route)
+  : req(req), handler(route), data(route ? route->user_data : RouteData{}) {}
+
+RequestContext *RequestContext::current() { return active_context; }
+
+void RequestContext::parse_query() {
+  query_parsed = true;
+  const std::size_t len = httpd_req_get_url_query_len(req);
+  if (len == 0 || len >= sizeof(query_text) ||
+      httpd_req_get_url_query_str(req, query_text, sizeof(query_text)) !=
+          ESP_OK) {
+    return;
+  }
+
+  std::size_t at = 0;
+  while (at < len && param_count < max_params) {
+    std::size_t end = at;
+    while (end < len && query_text[end] != '&') {
+      ++end;
+    }
+    std::size_t eq = at;
+    while (eq < end && query_text[eq] != '=') {
+      ++eq;
+    }
+
+    if (end > at) {
+      Param &param = params[param_count++];
+      param.key_at = static_cast<uint8_t>(at);
+      param.key_len =
+          static_cast<uint8_t>(percent_decode(query_text + at, eq - at));
+      const std::size_t value_at = eq < end ? eq + 1 : end;
+      param.value_at = static_cast<uint8_t>(value_at);
+      param.value_len = static_cast<uint8_t>(
+          percent_decode(query_text + value_at, end - value_at));
+    }
+    at = end + 1;
+  }
+}
+
+const RequestContext::Param *RequestContext::find_param(std::string_view key) {
+  if (!query_parsed) {
+    parse_query();
+  }
+  for (std::size_t i = 0; i < param_count; ++i) {
+    const Param &param = params[i];
+    if (std::string_view{query_text + param.key_at, param.key_len} == key) {
+      return &param;
+    }
+  }
+  return nullptr;
+}
+
+std::string_view RequestContext::query(std::string_view key) {
+  const Param *param = find_param(key);
+  if (!param) {
+    return {};
+  }
+  return std::string_view{query_text + param->value_at, param->value_len};
+}
+
+bool RequestContext::has_query(std::string_view key) {
+  return find_param(key) != nullptr;
+}
+
+int64_t RequestContext::query_int(std::string_view key, int64_t fallback,
+                                  int64_t min, int64_t max) {
+  const std::string_view text = query(key);
+  int64_t value = 0;
+  const auto [end, err] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (text.empty() || err != std::errc{} || end != text.data() + text.size()) {
+    return fallback;
+  }
+  return std::clamp(value, min, max);
+}
+
+uint64_t RequestContext::query_uint(std::string_view key, uint64_t fallback,
+                                    uint64_t min, uint64_t max) {
+  const std::string_view text = query(key);
+  uint64_t value = 0;
+  const auto [end, err] =
+      std::from_chars(text.data(), text.data() + text.size(), value);
+  if (text.empty() || err != std::errc{} || end != text.data() + text.size()) {
+    return fallback;
+  }
+  return std::clamp(value, min, max);
+}
+
+bool RequestContext::query_bool(std::string_view key, bool fallback) {
+  const std::string_view text = query(key);
+  if (text == "1" || text == "true" || text == "yes") {
+    return true;
+  }
+  if (text == "0" || text == "false" || text == "no") {
+    return false;
+  }
+  return fallback;
+}
+
+std::string_view RequestContext::header(const char *name) {
+  const std::string_view wanted{name};
+  for (std::size_t i = 0; i < header_count; ++i) {
+    const CachedHeader &cached = headers[i];
+    if (equals_ignore_case({header_text + cached.at, cached.name_len},
+                           wanted)) {
+      return cached.present
+                 ? std::string_view{header_text + cached.at + cached.name_len,
+                                    cached.len}
+                 : std::string_view{};
+    }
+  }
+  // The name is copied in ahead of its value, so the caller's string need
+  // not outlive the call.
+  if (header_count == max_cached_headers || wanted.size() > UINT8_MAX ||
+      wanted.size() >= sizeof(header_text) - header_used) {
+    return {};
+  }
+
+  CachedHeader &cached = headers[header_count++];
+  cached.at = static_cast<uint16_t>(header_used);
+  cached.name_len = static_cast<uint8_t>(wanted.size());
+  cached.len = 0;
+  cached.present = false;
+  std::memcpy(header_text + header_used, wanted.data(), wanted.size());
+  header_used += wanted.size();
+
+  char *value = header_text + header_used;
+  const std::size_t room = sizeof(header_text) - header_used;
+  const esp_err_t err = httpd_req_get_hdr_value_str(req, name, value, room);
+  if (err != ESP_OK && err != ESP_ERR_HTTPD_RESULT_TRUNC) {
+    return {};
+  }
+  const std::size_t len = std::char_traits<char>::length(value);
+  cached.len = static_cast<uint16_t>(len);
+  cached.present = true;
+  // The terminator is not needed once the length is known.
+  header_used += len;
+  return std::string_view{value, len};
+}
+
+} // namespace earbrain
@@ -0,0 +1,182 @@
+#include "earbrain/gateway/response_cache.hpp"
+
+#include "compression_context.hpp"
+#include "response_cache_context.hpp"
+#include "watch_context.hpp"
+
+#include "esp_timer.h"
+
+#include <algorithm>
+#include <cstring>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace earbrain::response_cache {
+
+namespace {
+
+struct Entry {
+  const UriHandler *route;
+  uint64_t version;
+  char tag[watch::detail::entity_tag_size];
+  const char *content_type;
+  // Shared so a hit can send it after letting go of the lock.
+  std::shared_ptr<char> body;
+  std::size_t body_len;
+  int64_t expires_us;
+  int64_t used_us;
+};
+
+std::mutex entries_mutex;
+std::vector<Entry> entries;
+std::size_t total_bytes = 0;
+
+thread_local detail::Recording *recording = nullptr;
+
+// Caller holds entries_mutex.
+void erase(std::vector<Entry>::iterator it) {
+  total_bytes -= it->body_len;
+  entries.erase(it);
+}
+
+// Caller holds entries_mutex. Drops what the new entry replaces or outlives,
+// then the least recently used until len fits.
+void make_room(const UriHandler &route, uint64_t version, const char *tag,
+               std::size_t len, int64_t now_us) {
+  for (auto it = entries.begin(); it != entries.end();) {
+    const bool replaced =
+        it->route == &route &&
+        (it->version != version || std::strcmp(it->tag, tag) == 0);
+    if (replaced || it->expires_us <= now_us) {
+      erase(it);
+    } else {
+      ++it;
+    }
+  }
+  while (!entries.empty() && total_bytes + len > max_total_bytes) {
+    erase(std::min_element(entries.begin(), entries.end(),
+                           [](const Entry &a, const Entry &b) {
+                             return a.used_us < b.used_us;
+                           }));
+  }
+}
+
+} // namespace
+
+namespace detail {
+
+bool send_hit(httpd_req_t *req, const UriHandler &route, const char *tag,
+              bool gzip, esp_err_t &result) {
+  const char *content_type = nullptr;
+  std::shared_ptr<char> body;
+  std::size_t body_len = 0;
+  {
+    std::lock_guard<std::mutex> lock(entries_mutex);
+    const int64_t now_us = esp_timer_get_time();
+    for (auto it = entries.begin(); it != entries.end(); ++it) {
+      if (it->route != &route || std::strcmp(it->tag, tag) != 0) {
+        continue;
+      }
+      if (it->expires_us <= now_us) {
+        erase(it);
+        return false;
+      }
+      it->used_us = now_us;
+      content_type = it->content_type;
+      body = it->body;
+      body_len = it->body_len;
+      break;
+    }
+  }
+  if (!body) {
+    return false;
+  }
+
+  httpd_resp_set_type(req, content_type);
+  httpd_resp_set_hdr(req, "ETag", tag);
+  httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+  result =
+      compression::detail::send(req, content_type, body.get(), body_len, gzip);
+  if (result != ESP_ERR_NOT_SUPPORTED) {
+    return true;
+  }
+  result = httpd_resp_send(req, body.get(), static_cast<ssize_t>(body_len));
+  return true;
+}
+
+Recording::Recording(const UriHandler &route, uint64_t version,
+                     const char *tag)
+  : route(route), version(version), tag(tag), outer(recording),
+    active(route.cache_ttl_ms > 0) {
+  if (active) {
+    recording = this;
+  }
+}
+
+Recording::~Recording() {
+  if (active) {
+    recording = outer;
+  }
+}
+
+void Recording::note_status() { invalid = true; }
+
+void Recording::note_body(const char *type, const char *data,
+                          std::size_t len) {
+  if (body || len > max_body_size) {
+    // More than one body, or too big to be worth the room.
+    invalid = true;
+    return;
+  }
+  body.reset(new (std::nothrow) char[len > 0 ? len : 1],
+             std::default_delete<char[]>());
+  if (!body) {
+    invalid = true;
+    return;
+  }
+  std::memcpy(body.get(), data, len);
+  body_len = len;
+  content_type = type;
+}
+
+void Recording::keep(esp_err_t result) {
+  if (!active || invalid || !body || result != ESP_OK) {
+    return;
+  }
+  Entry entry{&route, version, {}, content_type, std::move(body), body_len,
+              0, 0};
+  std::strncpy(entry.tag, tag, sizeof(entry.tag) - 1);
+
+  std::lock_guard<std::mutex> lock(entries_mutex);
+  const int64_t now_us = esp_timer_get_time();
+  make_room(route, version, tag, entry.body_len, now_us);
+  entry.expires_us =
+      now_us + static_cast<int64_t>(route.cache_ttl_ms) * 1000;
+  entry.used_us = now_us;
+  total_bytes += entry.body_len;
+  entries.push_back(std::move(entry));
+}
+
+} // namespace detail
+
+void invalidate() {
+  std::lock_guard<std::mutex> lock(entries_mutex);
+  entries.clear();
+  total_bytes = 0;
+}
+
+void note_status(const char *http_status) noexcept {
+  if (recording && http_status) {
+    recording->note_status();
+  }
+}
+
+void note_body(const char *content_type, const char *body,
+               std::size_t len) noexcept {
+  if (recording) {
+    recording->note_body(content_type, body, len);
+  }
+}
+
+} // namespace earbrain::response_cache
@@ -0,0 +1,48 @@
+#pragma once
+
+#include "earbrain/gateway/http_server.hpp"
+#include "earbrain/gateway/response_cache.hpp"
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#include <cstdint>
+#include <memory>
+
+namespace earbrain::response_cache::detail {
+
+// Sends the kept response for tag when there is a fresh one, setting
+// result. False when the handler has to run.
+bool send_hit(httpd_req_t *req, const UriHandler &route, const char *tag,
+              bool gzip, esp_err_t &result);
+
+// Records what the handler sends on this task while it lives, and keeps it
+// under tag if keep() is told the handler succeeded and the response was a
+// plain 200. Does nothing for routes without a TTL.
+class Recording {
+public:
+  Recording(const UriHandler &route, uint64_t version, const char *tag);
+  ~Recording();
+
+  Recording(const Recording &) = delete;
+  Recording &operator=(const Recording &) = delete;
+
+  void keep(esp_err_t result);
+
+  // For note_status and note_body.
+  void note_status();
+  void note_body(const char *content_type, const char *body, std::size_t len);
+
+private:
+  const UriHandler &route;
+  uint64_t version;
+  const char *tag;
+  Recording *outer;
+  bool active;
+  bool invalid = false;
+  const char *content_type = nullptr;
+  std::shared_ptr<char> body;
+  std::size_t body_len = 0;
+};
+
+} // namespace earbrain::response_cache::detail
@@ -0,0 +1,375 @@
+#include "earbrain/gateway/singleflight.hpp"
+
+#include "earbrain/gateway/capture.hpp"
+#include "carry_context.hpp"
+#include "compression_context.hpp"
+#include "singleflight_context.hpp"
+#include "task_thread.hpp"
+#include "watch_context.hpp"
+
+#include <algorithm>
+#include <condition_variable>
+#include <cstring>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <new>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <vector>
+
+namespace earbrain::singleflight {
+
+namespace {
+
+// A detached request and what it asked of the response, since the task
+// state that held it is gone once the request is detached, along with what
+// its middlewares were measuring.
+struct Waiter {
+  httpd_req_t *req = nullptr;
+  bool gzip = false;
+  carry::detail::Carried measures;
+};
+
+struct Flight {
+  std::string key;
+  const UriHandler *route = nullptr;
+  // Keeps route alive for the parked requests should it be removed.
+  std::shared_ptr<const UriHandler> pin;
+  // Detached requests waiting for this flight's response.
+  std::vector<Waiter> parked;
+  bool recorded = false;
+  bool invalid = false;
+  char status[40] = {};
+  const char *content_type = nullptr;
+  std::unique_ptr<char[]> body;
+  std::size_t body_len = 0;
+  // The route's version when the leader ran, for routes that have one.
+  uint64_t version = 0;
+};
+
+struct Job {
+  std::shared_ptr<Flight> flight;
+  Waiter leader;
+};
+
+std::mutex flights_mutex;
+std::vector<std::shared_ptr<Flight>> flights;
+Stats counters;
+
+// A second worker is only started when a job arrives while the first is
+// busy, so a scan does not hold up an unrelated key.
+constexpr std::size_t max_workers = 2;
+
+// Workers run whole handlers (a scan, cJSON building and printing, gzip,
+// httpd_resp_send), so they get more than the 3 KB pthread default. The
+// httpd task gets more still (see http_server.cpp).
+constexpr std::size_t worker_stack_size = 6144;
+
+// Workers are detached and never joined, so their queue is never destroyed
+// either; static destruction at exit would pull it from under them.
+struct WorkQueue {
+  std::mutex mutex;
+  std::condition_variable ready;
+  std::deque<Job> jobs;
+  std::size_t workers = 0;
+  std::size_t idle = 0;
+};
+
+WorkQueue &work_queue() {
+  static WorkQueue *queue = new WorkQueue;
+  return *queue;
+}
+
+thread_local Flight *leading = nullptr;
+
+// Accept, then the path plus the query parameters sorted, so "?a=1&b=2"
+// and "?b=2&a=1" share a flight. Accept is part of the key because it can
+// select a different body (compact mode).
+std::string key_for(httpd_req_t *req) {
+  std::string key;
+  if (RequestContext *context = RequestContext::current()) {
+    const std::string_view accept = context->header("Accept");
+    if (!accept.empty()) {
+      key.append(accept);
+      key += ' ';
+    }
+  }
+
+  const std::string_view uri{req->uri};
+  const std::size_t query_at = uri.find('?');
+  key.append(uri.substr(0, query_at));
+  if (query_at == std::string_view::npos) {
+    return key;
+  }
+
+  std::vector<std::string_view> params;
+  std::string_view query = uri.substr(query_at + 1);
+  while (!query.empty()) {
+    const std::size_t amp = query.find('&');
+    const std::string_view param = query.substr(0, amp);
+    if (!param.empty()) {
+      params.push_back(param);
+    }
+    if (amp == std::string_view::npos) {
+      break;
+    }
+    query.remove_prefix(amp + 1);
+  }
+  std::sort(params.begin(), params.end());
+
+  char separator = '?';
+  for (const auto param : params) {
+    key += separator;
+    key.append(param.data(), param.size());
+    separator = '&';
+  }
+  return key;
+}
+
+// Caller holds flights_mutex.
+void retire(const Flight &flight) {
+  flights.erase(std::remove_if(flights.begin(), flights.end(),
+                               [&](const std::shared_ptr<Flight> &entry) {
+                                 return entry.get() == &flight;
+                               }),
+                flights.end());
+}
+
+// Detached requests run on a worker, away from the context
+// HttpServer::dispatch kept for them, so they get one of their own.
+esp_err_t call(const Flight &flight, httpd_req_t *req, uint64_t version) {
+  const RequestContext *context = RequestContext::current();
+  if (context && context->request() == req) {
+    return watch::detail::serve(req, *flight.route, version);
+  }
+  RequestContext own(req, flight.route);
+  const RequestContext::Scope scope(own);
+  return watch::detail::serve(req, *flight.route, version);
+}
+
+uint64_t version_of(const UriHandler &route) {
+  return route.version ? route.version() : 0;
+}
+
+esp_err_t replay(const Waiter &waiter, const Flight &flight) {
+  httpd_req_t *req = waiter.req;
+  if (flight.status[0] != '\0') {
+    httpd_resp_set_status(req, flight.status);
+    capture::note_status(flight.status);
+  }
+  char version[watch::detail::version_text_size];
+  char tag[watch::detail::entity_tag_size];
+  if (flight.route->version) {
+    watch::detail::set_header(req, flight.version, version);
+    if (flight.status[0] == '\0') {
+      watch::detail::entity_tag(req, flight.version, waiter.gzip, tag);
+      if (watch::detail::client_has(req, tag)) {
+        return watch::detail::send_not_modified(req, tag);
+      }
+      httpd_resp_set_hdr(req, "ETag", tag);
+    }
+  }
+  if (flight.content_type) {
+    httpd_resp_set_type(req, flight.content_type);
+  }
+  httpd_resp_set_hdr(req, "Cache-Control",
+                     flight.route->version ? "no-cache" : "no-store");
+  const esp_err_t err =
+      compression::detail::send(req, flight.content_type, flight.body.get(),
+                                flight.body_len, waiter.gzip);
+  if (err != ESP_ERR_NOT_SUPPORTED) {
+    return err;
+  }
+  return httpd_resp_send(req, flight.body.get(),
+                         static_cast<ssize_t>(flight.body_len));
+}
+
+// Runs the handler once and then answers everyone parked on the flight.
+// req is a detached copy on the worker, or the original request when it
+// could not be detached.
+esp_err_t lead(const std::shared_ptr<Flight> &flight, Waiter &leader) {
+  compression::detail::set_requested(leader.gzip);
+  leading = flight.get();
+  flight->version = version_of(*flight->route);
+  esp_err_t result = ESP_OK;
+  {
+    const carry::detail::Carried::Scope measured(leader.measures);
+    result = call(*flight, leader.req, flight->version);
+  }
+  leading = nullptr;
+
+  std::vector<Waiter> parked;
+  bool shared = false;
+  {
+    std::lock_guard<std::mutex> lock(flights_mutex);
+    retire(*flight);
+    parked.swap(flight->parked);
+    shared = result == ESP_OK && flight->recorded && !flight->invalid;
+    if (shared) {
+      counters.followers += parked.size();
+    } else {
+      counters.fallbacks += parked.size();
+    }
+  }
+
+  // Retired, so nothing writes the recorded response any more.
+  for (Waiter &waiter : parked) {
+    esp_err_t answered = ESP_OK;
+    {
+      const carry::detail::Carried::Scope measured(waiter.measures);
+      if (shared) {
+        answered = replay(waiter, *flight);
+      } else {
+        compression::detail::set_requested(waiter.gzip);
+        answered = call(*flight, waiter.req, version_of(*flight->route));
+      }
+    }
+    waiter.measures.complete(waiter.req, answered);
+    httpd_req_async_handler_complete(waiter.req);
+  }
+  compression::detail::set_requested(leader.gzip);
+  return result;
+}
+
+void worker_loop() {
+  WorkQueue &queue = work_queue();
+  for (;;) {
+    Job job;
+    {
+      std::unique_lock<std::mutex> lock(queue.mutex);
+      ++queue.idle;
+      queue.ready.wait(lock, [&] { return !queue.jobs.empty(); });
+      --queue.idle;
+      job = std::move(queue.jobs.front());
+      queue.jobs.pop_front();
+    }
+    const esp_err_t result = lead(job.flight, job.leader);
+    compression::detail::set_requested(false);
+    job.leader.measures.complete(job.leader.req, result);
+    httpd_req_async_handler_complete(job.leader.req);
+  }
+}
+
+} // namespace
+
+namespace detail {
+
+esp_err_t run(httpd_req_t *req, const UriHandler &route) {
+  if (req->method != HTTP_GET || leading) {
+    return watch::detail::serve(req, route, version_of(route));
+  }
+
+  std::string key = key_for(req);
+  const bool gzip = compression::detail::requested();
+  std::shared_ptr<Flight> flight;
+  httpd_req_t *detached = nullptr;
+  {
+    std::lock_guard<std::mutex> lock(flights_mutex);
+    for (const auto &entry : flights) {
+      if (entry->key == key) {
+        flight = entry;
+        break;
+      }
+    }
+
+    if (flight) {
+      if (httpd_req_async_handler_begin(req, &detached) == ESP_OK) {
+        flight->parked.push_back(
+            Waiter{detached, gzip, carry::detail::Carried::take()});
+        return ESP_OK;
+      }
+      // Could not detach: answer this one on its own below.
+      ++counters.fallbacks;
+      flight = nullptr;
+    } else {
+      flight = std::make_shared<Flight>();
+      flight->key = std::move(key);
+      flight->route = &route;
+      flight->pin = route.weak_from_this().lock();
+      flights.push_back(flight);
+      ++counters.leaders;
+
+      if (httpd_req_async_handler_begin(req, &detached) != ESP_OK) {
+        detached = nullptr;
+      }
+    }
+  }
+
+  if (!flight) {
+    return watch::detail::serve(req, route, version_of(route));
+  }
+  if (detached) {
+    Waiter leader{detached, gzip, carry::detail::Carried::take()};
+    WorkQueue &queue = work_queue();
+    {
+      std::lock_guard<std::mutex> lock(queue.mutex);
+      queue.jobs.push_back(Job{flight, std::move(leader)});
+      if (queue.idle < queue.jobs.size() && queue.workers < max_workers) {
+        earbrain::detail::start_task("sf_worker", worker_stack_size,
+                                     worker_loop)
+            .detach();
+        ++queue.workers;
+      }
+    }
+    queue.ready.notify_one();
+    return ESP_OK;
+  }
+  // Detaching failed: lead on this task instead, inside its middlewares.
+  Waiter leader{req, gzip, {}};
+  return lead(flight, leader);
+}
+
+} // namespace detail
+
+void note_status(const char *http_status) noexcept {
+  Flight *flight = leading;
+  if (!flight || !http_status) {
+    return;
+  }
+  // Kept even with nobody parked yet: someone may join before the body.
+  std::lock_guard<std::mutex> lock(flights_mutex);
+  if (std::strlen(http_status) >= sizeof(flight->status)) {
+    flight->invalid = true;
+    return;
+  }
+  std::strcpy(flight->status, http_status);
+}
+
+void note_body(const char *content_type, const char *body,
+               std::size_t len) noexcept {
+  Flight *flight = leading;
+  if (!flight) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(flights_mutex);
+  if (flight->recorded) {
+    // More than one response body: nothing sensible to replay.
+    flight->invalid = true;
+    return;
+  }
+  if (flight->parked.empty()) {
+    // Nobody to share with. Close the flight so requests arriving from now
+    // on run the handler again rather than get a response already sent.
+    flight->invalid = true;
+    retire(*flight);
+    return;
+  }
+  flight->body.reset(new (std::nothrow) char[len > 0 ? len : 1]);
+  if (!flight->body) {
+    flight->invalid = true;
+    return;
+  }
+  std::memcpy(flight->body.get(), body, len);
+  flight->body_len = len;
+  flight->content_type = content_type;
+  flight->recorded = true;
+}
+
+Stats stats() {
+  std::lock_guard<std::mutex> lock(flights_mutex);
+  return counters;
+}
+
+} // namespace earbrain::singleflight
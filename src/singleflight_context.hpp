@@ -0,0 +1,15 @@
+#pragma once
+
+#include "earbrain/gateway/http_server.hpp"
+#include "earbrain/gateway/singleflight.hpp"
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+namespace earbrain::singleflight::detail {
+
+// Runs the route's handler for req, or waits for an identical in-flight GET
+// and replays its response. Non-GET requests go straight to the handler.
+esp_err_t run(httpd_req_t *req, const UriHandler &route);
+
+} // namespace earbrain::singleflight::detail
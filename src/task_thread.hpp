@@ -0,0 +1,33 @@
+#pragma once
+
+#include "esp_pthread.h"
+
+#include <cstddef>
+#include <thread>
+#include <utility>
+
+namespace earbrain::detail {
+
+// Starts fn on a std::thread backed by a task with its own name and stack.
+// The pthread default (CONFIG_PTHREAD_TASK_STACK_SIZE_DEFAULT, 3 KB) is too
+// small for anything that runs handlers. The caller's pthread config is put
+// back afterwards. name must be a string with static storage.
+template <typename Fn>
+std::thread start_task(const char *name, std::size_t stack_size, Fn &&fn) {
+  esp_pthread_cfg_t previous;
+  const bool had_config = esp_pthread_get_cfg(&previous) == ESP_OK;
+
+  esp_pthread_cfg_t config = esp_pthread_get_default_config();
+  config.stack_size = stack_size;
+  config.thread_name = name;
+  esp_pthread_set_cfg(&config);
+  std::thread thread(std::forward<Fn>(fn));
+
+  if (!had_config) {
+    previous = esp_pthread_get_default_config();
+  }
+  esp_pthread_set_cfg(&previous);
+  return thread;
+}
+
+} // namespace earbrain::detail
@@ -0,0 +1,172 @@
+#include "earbrain/gateway/tracing.hpp"
+
+#include "tracing_context.hpp"
+
+#include "esp_timer.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <mutex>
+
+namespace earbrain::tracing {
+
+namespace {
+
+thread_local detail::TraceContext *active_trace = nullptr;
+
+std::atomic<uint32_t> next_trace_id{1};
+
+// Room for the X-Trace-Id of this many unfinished traces; a slot is held
+// from begin() to end(). Long-polls hold theirs while they wait.
+constexpr std::size_t max_open_traces = 16;
+constexpr std::size_t id_header_size = 12;
+char id_headers[max_open_traces][id_header_size];
+std::atomic<bool> id_header_taken[max_open_traces];
+
+char *take_id_header() {
+  for (std::size_t i = 0; i < max_open_traces; ++i) {
+    if (!id_header_taken[i].exchange(true, std::memory_order_acquire)) {
+      return id_headers[i];
+    }
+  }
+  return nullptr;
+}
+
+void release_id_header(const char *text) {
+  if (text) {
+    const std::size_t i = (text - id_headers[0]) / id_header_size;
+    id_header_taken[i].store(false, std::memory_order_release);
+  }
+}
+
+std::mutex ring_mutex;
+SpanRecord ring[ring_capacity];
+std::size_t ring_head = 0;
+std::size_t ring_size = 0;
+
+void record(const SpanRecord &span) {
+  std::lock_guard<std::mutex> lock(ring_mutex);
+  ring[ring_head] = span;
+  ring_head = (ring_head + 1) % ring_capacity;
+  if (ring_size < ring_capacity) {
+    ++ring_size;
+  }
+}
+
+void record(uint32_t trace_id, const char *name, int64_t start_us,
+            int64_t end_us, const char *detail) {
+  SpanRecord span;
+  span.trace_id = trace_id;
+  span.name = name;
+  span.start_us = start_us;
+  span.duration_us = static_cast<uint32_t>(std::max<int64_t>(end_us - start_us, 0));
+  if (detail) {
+    std::strncpy(span.detail, detail, sizeof(span.detail) - 1);
+  }
+  record(span);
+}
+
+} // namespace
+
+namespace detail {
+
+void begin(TraceContext &ctx) {
+  ctx.id = next_trace_id.fetch_add(1, std::memory_order_relaxed);
+  ctx.start_us = esp_timer_get_time();
+  if (char *text = take_id_header()) {
+    std::snprintf(text, id_header_size, "%08lx",
+                  static_cast<unsigned long>(ctx.id));
+    ctx.id_header = text;
+  }
+  enter(ctx);
+}
+
+void enter(TraceContext &ctx) {
+  ctx.outer = active_trace;
+  active_trace = &ctx;
+}
+
+void leave(TraceContext &ctx) { active_trace = ctx.outer; }
+
+void end(TraceContext &ctx, const char *uri) {
+  record(ctx.id, "request", ctx.start_us, esp_timer_get_time(), uri);
+  release_id_header(ctx.id_header);
+  ctx.id_header = nullptr;
+}
+
+} // namespace detail
+
+Span::Span(const char *name) noexcept
+  : name(name), trace_id(0), start_us(0) {
+  if (active_trace) {
+    trace_id = active_trace->id;
+    start_us = esp_timer_get_time();
+  }
+}
+
+Span::~Span() {
+  if (trace_id == 0) {
+    return;
+  }
+
+  const int64_t end_us = esp_timer_get_time();
+  detail::TraceContext *ctx = active_trace;
+  if (ctx && ctx->id == trace_id &&
+      ctx->timing_count < detail::TraceContext::max_timings) {
+    ctx->timings[ctx->timing_count++] = {
+        name, static_cast<uint32_t>(std::max<int64_t>(end_us - start_us, 0))};
+  }
+  record(trace_id, name, start_us, end_us, nullptr);
+}
+
+uint32_t current_trace_id() noexcept {
+  return active_trace ? active_trace->id : 0;
+}
+
+const char *server_timing() noexcept {
+  detail::TraceContext *ctx = active_trace;
+  if (!ctx) {
+    return nullptr;
+  }
+
+  char *out = ctx->server_timing;
+  const std::size_t size = sizeof(ctx->server_timing);
+  std::size_t used = 0;
+  for (std::size_t i = 0; i < ctx->timing_count && used < size; ++i) {
+    const auto &timing = ctx->timings[i];
+    const int n = std::snprintf(out + used, size - used, "%s%s;dur=%.2f",
+                                used ? ", " : "", timing.name,
+                                timing.duration_us / 1000.0);
+    if (n < 0) {
+      break;
+    }
+    used += static_cast<std::size_t>(n);
+  }
+  if (used < size) {
+    const double total_ms = (esp_timer_get_time() - ctx->start_us) / 1000.0;
+    std::snprintf(out + used, size - used, "%stotal;dur=%.2f", used ? ", " : "",
+                  total_ms);
+  }
+  return out;
+}
+
+std::size_t snapshot(SpanRecord *out, std::size_t capacity) {
+  if (!out) {
+    return 0;
+  }
+
+  std::lock_guard<std::mutex> lock(ring_mutex);
+  const std::size_t count = std::min(capacity, ring_size);
+  // Oldest retained span sits ring_size slots behind the head.
+  std::size_t index = (ring_head + ring_capacity - ring_size) % ring_capacity;
+  index = (index + (ring_size - count)) % ring_capacity;
+  for (std::size_t i = 0; i < count; ++i) {
+    out[i] = ring[index];
+    index = (index + 1) % ring_capacity;
+  }
+  return count;
+}
+
+} // namespace earbrain::tracing
@@ -0,0 +1,41 @@
+#pragma once
+
+#include "earbrain/gateway/tracing.hpp"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace earbrain::tracing::detail {
+
+// Per-request trace state. Lives on the stack of middleware::trace_request
+// and is published to the task through a thread-local pointer.
+struct TraceContext {
+  struct Timing {
+    const char *name;
+    uint32_t duration_us;
+  };
+
+  static constexpr std::size_t max_timings = 6;
+
+  uint32_t id = 0;
+  int64_t start_us = 0;
+  Timing timings[max_timings] = {};
+  std::size_t timing_count = 0;
+  // X-Trace-Id value, from a slot held until end(); nullptr when every
+  // slot is taken. httpd keeps the pointer until the response is sent,
+  // which for a detached request is after trace_request has returned, so
+  // it cannot point into this context on the middleware's stack.
+  const char *id_header = nullptr;
+  char server_timing[160] = {};
+  TraceContext *outer = nullptr;
+};
+
+// Starts a trace and publishes it to the calling task.
+void begin(TraceContext &ctx);
+// Publishes a started trace to the calling task, and withdraws it.
+void enter(TraceContext &ctx);
+void leave(TraceContext &ctx);
+// Records the request span of a withdrawn trace and frees its id_header.
+void end(TraceContext &ctx, const char *uri);
+
+} // namespace earbrain::tracing::detail
@@ -0,0 +1,227 @@
+#include "earbrain/gateway/watch.hpp"
+
+#include "earbrain/gateway/async.hpp"
+#include "earbrain/gateway/capture.hpp"
+#include "earbrain/gateway/request_context.hpp"
+#include "compression_context.hpp"
+#include "json/http_response.hpp"
+#include "response_cache_context.hpp"
+#include "singleflight_context.hpp"
+#include "watch_context.hpp"
+
+#include "esp_random.h"
+
+#include <cinttypes>
+#include <cstdio>
+
+namespace earbrain::watch {
+
+namespace {
+
+// Keeps ETags from one boot from matching another's, as versions restart.
+uint32_t boot_id() {
+  static const uint32_t id = esp_random();
+  return id;
+}
+
+std::string_view request_header(httpd_req_t *req, const char *name,
+                                char *buf, std::size_t size) {
+  RequestContext *context = RequestContext::current();
+  if (context && context->request() == req) {
+    return context->header(name);
+  }
+  if (httpd_req_get_hdr_value_str(req, name, buf, size) != ESP_OK &&
+      httpd_req_get_hdr_value_len(req, name) == 0) {
+    return {};
+  }
+  return std::string_view{buf};
+}
+
+bool is_watch_param(std::string_view param) {
+  const std::string_view key = param.substr(0, param.find('='));
+  return key == since_param || key == timeout_param;
+}
+
+// Whether an If-None-Match value names tag. Weak comparison, as RFC 9110
+// asks for If-None-Match.
+bool names(std::string_view list, std::string_view tag) {
+  while (!list.empty()) {
+    const std::size_t comma = list.find(',');
+    std::string_view item = list.substr(0, comma);
+    list = comma == std::string_view::npos ? std::string_view{}
+                                           : list.substr(comma + 1);
+    while (!item.empty() && (item.front() == ' ' || item.front() == '\t')) {
+      item.remove_prefix(1);
+    }
+    while (!item.empty() && (item.back() == ' ' || item.back() == '\t')) {
+      item.remove_suffix(1);
+    }
+    if (item == "*") {
+      return true;
+    }
+    if (item.substr(0, 2) == "W/") {
+      item.remove_prefix(2);
+    }
+    if (item == tag) {
+      return true;
+    }
+  }
+  return false;
+}
+
+// Publishes a route's ETag to the response helpers while its handler runs.
+class PublishedTag {
+public:
+  explicit PublishedTag(const char *tag) : outer(http::detail::entity_tag) {
+    http::detail::entity_tag = tag;
+  }
+  ~PublishedTag() { http::detail::entity_tag = outer; }
+
+  PublishedTag(const PublishedTag &) = delete;
+  PublishedTag &operator=(const PublishedTag &) = delete;
+
+private:
+  const char *outer;
+};
+
+// Answers a request parked by detail::run once its route's version moves
+// or its timeout passes.
+async::Task wait_for_change(httpd_req_t *req) {
+  RequestContext *context = RequestContext::current();
+  const UriHandler *route = context ? context->route() : nullptr;
+  if (!route || !route->version) {
+    co_return ESP_FAIL;
+  }
+
+  const uint64_t since = context->query_uint(since_param, 0);
+  const uint64_t timeout_ms = context->query_uint(
+      timeout_param, default_timeout_ms, 0, max_timeout_ms);
+  const uint64_t version = co_await async::version_change(
+      route->version, since, static_cast<uint32_t>(timeout_ms));
+  // Straight to the handler: a parked request has nobody to share a
+  // singleflight run with.
+  co_return detail::serve(req, *route, version);
+}
+
+} // namespace
+
+const char *current_entity_tag() { return http::detail::entity_tag; }
+
+Fingerprint &Fingerprint::add(const void *data, std::size_t len) {
+  const auto *bytes = static_cast<const unsigned char *>(data);
+  for (std::size_t i = 0; i < len; ++i) {
+    hash ^= bytes[i];
+    hash *= 0x100000001b3ULL;
+  }
+  return *this;
+}
+
+Fingerprint &Fingerprint::add(std::string_view text) {
+  add(text.size());
+  return add(text.data(), text.size());
+}
+
+uint64_t Tracker::observe(uint64_t fingerprint) {
+  std::lock_guard<std::mutex> lock(mutex);
+  if (seen && fingerprint != last) {
+    ++version;
+  }
+  seen = true;
+  last = fingerprint;
+  return version;
+}
+
+namespace detail {
+
+void set_header(httpd_req_t *req, uint64_t version,
+                char (&text)[version_text_size]) {
+  std::snprintf(text, sizeof(text), "%" PRIu64, version);
+  httpd_resp_set_hdr(req, version_header, text);
+}
+
+void entity_tag(httpd_req_t *req, uint64_t version, bool gzip,
+                char (&out)[entity_tag_size]) {
+  // The watch parameters only say when to answer, not what with.
+  Fingerprint variant;
+  const std::string_view uri{req->uri};
+  const std::size_t query_at = uri.find('?');
+  variant.add(uri.substr(0, query_at));
+  std::string_view query = query_at == std::string_view::npos
+                               ? std::string_view{}
+                               : uri.substr(query_at + 1);
+  while (!query.empty()) {
+    const std::size_t amp = query.find('&');
+    const std::string_view param = query.substr(0, amp);
+    if (!is_watch_param(param)) {
+      variant.add(param);
+    }
+    query = amp == std::string_view::npos ? std::string_view{}
+                                          : query.substr(amp + 1);
+  }
+  char accept[128];
+  variant.add(request_header(req, "Accept", accept, sizeof(accept)));
+  variant.add(gzip);
+
+  std::snprintf(out, sizeof(out), "\"%08" PRIx32 "-%" PRIu64 "-%08" PRIx32 "\"",
+                boot_id(), version, static_cast<uint32_t>(variant.value()));
+}
+
+bool client_has(httpd_req_t *req, const char *tag) {
+  char if_none_match[96];
+  const std::string_view condition = request_header(
+      req, "If-None-Match", if_none_match, sizeof(if_none_match));
+  return !condition.empty() && names(condition, tag);
+}
+
+esp_err_t send_not_modified(httpd_req_t *req, const char *tag) {
+  httpd_resp_set_status(req, "304 Not Modified");
+  capture::note_status("304 Not Modified");
+  httpd_resp_set_hdr(req, "ETag", tag);
+  httpd_resp_set_hdr(req, "Cache-Control", "no-cache");
+  return httpd_resp_send(req, nullptr, 0);
+}
+
+esp_err_t serve(httpd_req_t *req, const UriHandler &route, uint64_t version) {
+  if (!route.version) {
+    return route.handler(req);
+  }
+  char text[version_text_size];
+  set_header(req, version, text);
+  if (req->method != HTTP_GET) {
+    return route.handler(req);
+  }
+
+  const bool gzip = compression::detail::requested();
+  char tag[entity_tag_size];
+  entity_tag(req, version, gzip, tag);
+  if (client_has(req, tag)) {
+    return send_not_modified(req, tag);
+  }
+  esp_err_t result = ESP_OK;
+  if (route.cache_ttl_ms > 0 &&
+      response_cache::detail::send_hit(req, route, tag, gzip, result)) {
+    return result;
+  }
+
+  const PublishedTag published(tag);
+  response_cache::detail::Recording recording(route, version, tag);
+  result = route.handler(req);
+  recording.keep(result);
+  return result;
+}
+
+esp_err_t run(httpd_req_t *req, const UriHandler &route) {
+  RequestContext *context = RequestContext::current();
+  if (req->method == HTTP_GET && context && context->has_query(since_param) &&
+      context->query_uint(since_param, 0) == route.version()) {
+    return async::run(req, &wait_for_change);
+  }
+  if (route.coalesce) {
+    return singleflight::detail::run(req, route);
+  }
+  return serve(req, route, route.version());
+}
+
+} // namespace detail
+
+} // namespace earbrain::watch
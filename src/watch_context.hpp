@@ -0,0 +1,41 @@
+#pragma once
+
+#include "earbrain/gateway/http_server.hpp"
+#include "earbrain/gateway/watch.hpp"
+
+#include "esp_err.h"
+#include "esp_http_server.h"
+
+#include <cstddef>
+#include <cstdint>
+
+namespace earbrain::watch::detail {
+
+// A version as decimal text.
+constexpr std::size_t version_text_size = 21;
+
+// Sets the version header from text, which must stay alive until the
+// response is sent.
+void set_header(httpd_req_t *req, uint64_t version,
+                char (&text)[version_text_size]);
+
+// Room for an ETag, quotes included.
+constexpr std::size_t entity_tag_size = 48;
+
+// The ETag of req's representation of a resource at version.
+void entity_tag(httpd_req_t *req, uint64_t version, bool gzip,
+                char (&out)[entity_tag_size]);
+
+// Whether req's If-None-Match names tag.
+bool client_has(httpd_req_t *req, const char *tag);
+esp_err_t send_not_modified(httpd_req_t *req, const char *tag);
+
+// Runs the route's handler with version in the header, or answers 304 when
+// the client's If-None-Match already names the ETag.
+esp_err_t serve(httpd_req_t *req, const UriHandler &route, uint64_t version);
+
+// For routes with RouteOptions::version: parks a request asking to wait
+// for a change, otherwise hands it to singleflight or serve.
+esp_err_t run(httpd_req_t *req, const UriHandler &route);
+
+} // namespace earbrain::watch::detail
@@ -0,0 +1,149 @@
+#include "earbrain/gateway/wifi_snapshot.hpp"
+
+#include "earbrain/logging.hpp"
+#include "json/wifi_status.hpp"
+
+#include "esp_event.h"
+#include "esp_netif.h"
+#include "esp_wifi_types.h"
+#include "lwip/ip4_addr.h"
+
+#include <atomic>
+#include <cstring>
+#include <mutex>
+#include <type_traits>
+
+namespace earbrain::wifi_snapshot {
+
+namespace {
+
+static_assert(std::is_trivially_copyable_v<Snapshot>);
+static_assert(sizeof(Snapshot) % sizeof(uint32_t) == 0);
+
+constexpr std::size_t words = sizeof(Snapshot) / sizeof(uint32_t);
+
+// A seqlock over two slots. Publish n fills slot n & 1, so the one before
+// stays whole for readers meanwhile; begun and done count the publishes
+// started and finished. The slots are copied word by word through
+// atomic_ref, so a read that overlaps a publish is a retry rather than a
+// data race.
+alignas(std::atomic_ref<uint32_t>::required_alignment) uint32_t
+    slots[2][words];
+std::atomic<uint32_t> begun{0};
+std::atomic<uint32_t> done{0};
+
+// Serializes publishers and holds the latest snapshot for comparing.
+std::mutex publish_mutex;
+Snapshot latest{};
+bool started = false;
+
+void store(uint32_t (&slot)[words], const Snapshot &snapshot) {
+  uint32_t buf[words];
+  std::memcpy(buf, &snapshot, sizeof(buf));
+  for (std::size_t i = 0; i < words; ++i) {
+    std::atomic_ref<uint32_t>(slot[i]).store(buf[i],
+                                             std::memory_order_relaxed);
+  }
+}
+
+Snapshot load(uint32_t (&slot)[words]) {
+  uint32_t buf[words];
+  for (std::size_t i = 0; i < words; ++i) {
+    buf[i] = std::atomic_ref<uint32_t>(slot[i]).load(
+        std::memory_order_relaxed);
+  }
+  Snapshot snapshot;
+  std::memcpy(&snapshot, buf, sizeof(buf));
+  return snapshot;
+}
+
+bool same(const WifiStatus &a, const WifiStatus &b) {
+  return a.mode == b.mode && a.sta_connected == b.sta_connected &&
+         a.sta_connecting == b.sta_connecting &&
+         a.sta_ip.addr == b.sta_ip.addr &&
+         a.sta_last_error == b.sta_last_error &&
+         a.sta_last_disconnect_reason == b.sta_last_disconnect_reason;
+}
+
+// Caller holds publish_mutex.
+void publish(const Snapshot &snapshot) {
+  const uint32_t next = done.load(std::memory_order_relaxed) + 1;
+  // A reader that copies any word of this publish must then see begun
+  // move, hence the fence between the two.
+  begun.store(next, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  store(slots[next & 1], snapshot);
+  done.store(next, std::memory_order_release);
+}
+
+void on_event(void *, esp_event_base_t, int32_t, void *) { refresh(); }
+
+} // namespace
+
+esp_err_t start() {
+  std::lock_guard<std::mutex> lock(publish_mutex);
+  if (started) {
+    return ESP_OK;
+  }
+  esp_err_t err = esp_event_handler_register(WIFI_EVENT, ESP_EVENT_ANY_ID,
+                                             &on_event, nullptr);
+  if (err == ESP_OK) {
+    err = esp_event_handler_register(IP_EVENT, ESP_EVENT_ANY_ID, &on_event,
+                                     nullptr);
+    if (err != ESP_OK) {
+      esp_event_handler_unregister(WIFI_EVENT, ESP_EVENT_ANY_ID, &on_event);
+    }
+  }
+  if (err != ESP_OK) {
+    logging::errorf("gateway", "Failed to watch Wi-Fi events: %s",
+                    esp_err_to_name(err));
+    return err;
+  }
+  started = true;
+  return ESP_OK;
+}
+
+void refresh() {
+  const WifiStatus status = earbrain::wifi().status();
+
+  std::lock_guard<std::mutex> lock(publish_mutex);
+  if (latest.version != 0 && same(latest.status, status)) {
+    return;
+  }
+
+  Snapshot snapshot{};
+  snapshot.status = status;
+  const ip4_addr_t *ip4 = reinterpret_cast<const ip4_addr_t *>(&status.sta_ip);
+  if (!status.sta_connected ||
+      !ip4addr_ntoa_r(ip4, snapshot.ip, sizeof(snapshot.ip))) {
+    snapshot.ip[0] = '\0';
+  }
+  const std::string error =
+      json_model::map_wifi_error_to_message(status.sta_last_error);
+  std::strncpy(snapshot.error, error.c_str(), sizeof(snapshot.error) - 1);
+  snapshot.version = latest.version + 1;
+
+  latest = snapshot;
+  publish(snapshot);
+}
+
+Snapshot read() {
+  for (;;) {
+    const uint32_t last = done.load(std::memory_order_acquire);
+    if (last == 0) {
+      // Nothing published yet.
+      refresh();
+      continue;
+    }
+    const Snapshot snapshot = load(slots[last & 1]);
+    std::atomic_thread_fence(std::memory_order_acquire);
+    // Whole unless publish last + 2, the next to use that slot, has begun.
+    if (begun.load(std::memory_order_relaxed) - last < 2) {
+      return snapshot;
+    }
+  }
+}
+
+uint64_t version() { return read().version; }
+
+} // namespace earbrain::wifi_snapshot